@@ -0,0 +1,250 @@
+#ifndef BENCHMARK_HEADER
+#define BENCHMARK_HEADER
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include <FML/Global/Global.h>
+
+//===========================================================================
+//
+// Compile time defines:
+// FML_GIT_VERSION : The version of the library we benchmark. Stored in the
+//                   output so results from different versions can be compared
+//
+//===========================================================================
+
+#ifndef FML_GIT_VERSION
+#define FML_GIT_VERSION "unknown"
+#endif
+
+namespace FML {
+    namespace UTILS {
+
+        //=======================================================
+        /// A small harness for timing kernels reproducibly over
+        /// all tasks and writing the results as JSON so they can be
+        /// tracked across versions.
+        ///
+        /// Every benchmark is run nwarmup + nrepeat times. Each run
+        /// starts after a barrier and the time of a run is the time
+        /// of the slowest task (i.e. the wall-time of the kernel).
+        /// We record min/median/mean/max over the runs and the load
+        /// imbalance (max/mean over tasks - 1, averaged over runs).
+        /// An optional setup function is called (untimed) before every
+        /// run e.g. to reset the input.
+        ///
+        /// Only benchmarks whose name contains the filter are run
+        /// (the filter can be a comma separated list).
+        //=======================================================
+        class BenchmarkSuite {
+          public:
+            struct Result {
+                std::string name;
+                std::map<std::string, double> params;
+                int nrepeat;
+                double time_min;
+                double time_median;
+                double time_mean;
+                double time_max;
+                double imbalance;
+                double work;
+                std::string work_unit;
+            };
+
+          private:
+            int nrepeat{5};
+            int nwarmup{1};
+            std::vector<std::string> filters{};
+            std::map<std::string, std::string> metadata{};
+            std::vector<Result> results{};
+
+            static double time_since(const std::chrono::time_point<std::chrono::steady_clock> & start) {
+                return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() -
+                                                                                 start)
+                    .count();
+            }
+
+            static void barrier() {
+#ifdef USE_MPI
+                MPI_Barrier(MPI_COMM_WORLD);
+#endif
+            }
+
+            static std::string json_number(double x) {
+                std::ostringstream out;
+                out << std::setprecision(10) << x;
+                return out.str();
+            }
+
+          public:
+            BenchmarkSuite() = default;
+            BenchmarkSuite(int _nrepeat, int _nwarmup, std::string filter = "") : nrepeat(_nrepeat), nwarmup(_nwarmup) {
+                set_filter(filter);
+            }
+
+            /// Only run benchmarks whose name contains (one of the comma separated) filter(s)
+            void set_filter(std::string filter) {
+                filters.clear();
+                size_t start = 0;
+                while (start <= filter.size()) {
+                    auto end = filter.find(',', start);
+                    if (end == std::string::npos)
+                        end = filter.size();
+                    if (end > start)
+                        filters.push_back(filter.substr(start, end - start));
+                    start = end + 1;
+                }
+            }
+
+            /// Add info about the run (parameters, machine, ...) to the output
+            void add_metadata(std::string key, std::string value) { metadata[key] = value; }
+
+            /// Should we run the benchmark with this name?
+            bool selected(const std::string & name) const {
+                if (filters.empty())
+                    return true;
+                for (auto & f : filters)
+                    if (name.find(f) != std::string::npos)
+                        return true;
+                return false;
+            }
+
+            /// Run a benchmark. The work (e.g. number of particles or cells) is used to compute a throughput
+            void run(std::string name,
+                     std::map<std::string, double> params,
+                     std::function<void()> kernel,
+                     std::function<void()> setup = nullptr,
+                     double work = 0.0,
+                     std::string work_unit = "") {
+                if (not selected(name))
+                    return;
+
+                std::vector<double> times;
+                std::vector<double> imbalances;
+                for (int i = 0; i < nwarmup + nrepeat; i++) {
+                    if (setup)
+                        setup();
+                    barrier();
+                    auto start = std::chrono::steady_clock::now();
+                    kernel();
+                    double time_task = time_since(start);
+                    double time_max = time_task;
+                    double time_mean = time_task;
+                    FML::MaxOverTasks(&time_max);
+                    FML::SumOverTasks(&time_mean);
+                    time_mean /= FML::NTasks;
+                    if (i < nwarmup)
+                        continue;
+                    times.push_back(time_max);
+                    imbalances.push_back(time_mean > 0.0 ? time_max / time_mean - 1.0 : 0.0);
+                }
+
+                Result result;
+                result.name = name;
+                result.params = params;
+                result.nrepeat = nrepeat;
+                result.work = work;
+                result.work_unit = work_unit;
+                std::sort(times.begin(), times.end());
+                const size_t n = times.size();
+                result.time_min = n > 0 ? times.front() : 0.0;
+                result.time_max = n > 0 ? times.back() : 0.0;
+                result.time_median =
+                    n == 0 ? 0.0 : (n % 2 == 1 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]));
+                result.time_mean = n > 0 ? std::accumulate(times.begin(), times.end(), 0.0) / double(n) : 0.0;
+                result.imbalance =
+                    n > 0 ? std::accumulate(imbalances.begin(), imbalances.end(), 0.0) / double(n) : 0.0;
+                results.push_back(result);
+
+                if (FML::ThisTask == 0) {
+                    std::cout << "[Benchmark] " << std::left << std::setw(40) << name << std::right
+                              << " median: " << std::setw(12) << result.time_median << " sec  min: " << std::setw(12)
+                              << result.time_min << " sec";
+                    if (work > 0.0 and result.time_median > 0.0)
+                        std::cout << "  " << std::setw(12) << work / result.time_median << " " << work_unit << "/s";
+                    std::cout << std::endl;
+                }
+            }
+
+            const std::vector<Result> & get_results() const { return results; }
+
+            /// Write all the results as JSON (only task 0 writes)
+            void write_json(std::string filename) const {
+                if (FML::ThisTask > 0)
+                    return;
+                std::ofstream fp(filename.c_str());
+                if (not fp.is_open()) {
+                    std::cout << "Warning: [BenchmarkSuite::write_json] Failed to open " << filename << "\n";
+                    return;
+                }
+
+                int nthreads = 1;
+#ifdef USE_OMP
+                nthreads = omp_get_max_threads();
+#endif
+                std::time_t now = std::time(nullptr);
+                char date[64];
+                std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+                fp << "{\n";
+                fp << "  \"version\": \"" << FML_GIT_VERSION << "\",\n";
+                fp << "  \"date\": \"" << date << "\",\n";
+                fp << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+                fp << "  \"ntasks\": " << FML::NTasks << ",\n";
+                fp << "  \"nthreads\": " << nthreads << ",\n";
+                fp << "  \"nrepeat\": " << nrepeat << ",\n";
+                fp << "  \"nwarmup\": " << nwarmup << ",\n";
+                fp << "  \"metadata\": {";
+                for (auto it = metadata.begin(); it != metadata.end(); ++it)
+                    fp << (it == metadata.begin() ? "" : ",") << "\n    \"" << it->first << "\": \"" << it->second
+                       << "\"";
+                fp << "\n  },\n";
+                fp << "  \"benchmarks\": [";
+                for (size_t i = 0; i < results.size(); i++) {
+                    const auto & r = results[i];
+                    fp << (i == 0 ? "" : ",") << "\n    {\n";
+                    fp << "      \"name\": \"" << r.name << "\",\n";
+                    fp << "      \"params\": {";
+                    for (auto it = r.params.begin(); it != r.params.end(); ++it)
+                        fp << (it == r.params.begin() ? "" : ", ") << "\"" << it->first
+                           << "\": " << json_number(it->second);
+                    fp << "},\n";
+                    fp << "      \"nrepeat\": " << r.nrepeat << ",\n";
+                    fp << "      \"time_min\": " << json_number(r.time_min) << ",\n";
+                    fp << "      \"time_median\": " << json_number(r.time_median) << ",\n";
+                    fp << "      \"time_mean\": " << json_number(r.time_mean) << ",\n";
+                    fp << "      \"time_max\": " << json_number(r.time_max) << ",\n";
+                    fp << "      \"imbalance\": " << json_number(r.imbalance) << ",\n";
+                    fp << "      \"work\": " << json_number(r.work) << ",\n";
+                    fp << "      \"work_unit\": \"" << r.work_unit << "\",\n";
+                    fp << "      \"throughput\": "
+                       << json_number(r.time_median > 0.0 ? r.work / r.time_median : 0.0) << "\n";
+                    fp << "    }";
+                }
+                fp << "\n  ]\n";
+                fp << "}\n";
+            }
+        };
+    } // namespace UTILS
+} // namespace FML
+
+#endif
@@ -0,0 +1,589 @@
+#include <FML/Benchmarks/Benchmark.h>
+#include <FML/ComputePowerSpectra/ComputePowerSpectrum.h>
+#include <FML/FFTWGrid/FFTWGrid.h>
+#include <FML/FriendsOfFriends/FoF.h>
+#include <FML/Global/Global.h>
+#include <FML/Interpolation/ParticleGridInterpolation.h>
+#include <FML/MPIParticles/MPIParticles.h>
+#include <FML/MultigridSolver/MultiGridSolver.h>
+#include <FML/NBody/NBody.h>
+#include <FML/PairCounting/PairCount.h>
+#include <FML/RandomGenerator/RandomGenerator.h>
+#include <FML/Smoothing/SmoothingFourier.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+//=====================================================
+//
+// Benchmark suite for the main kernels in the library:
+// * FFTs (r2c and c2r)
+// * Random numbers (per call versus in blocks)
+// * Out-of-core grid (FFTs, streaming P(k) binning and smoothing) versus the in-core grid
+// * Density assignment NGP, CIC, TSC, PCS and PQS with and without interlacing
+// * Interpolation of the force to the particle positions
+// * Particle exchange between tasks
+// * Power spectrum and bispectrum binning
+// * Friends of Friends
+// * Pair counting
+// * Multigrid V-cycles
+// * A short COLA run (1LPT COLA in EdS on top of the PM kernels)
+//
+// Run as: ./benchmark [--nmesh 128] [--npart1d 128] [--npart_paircount 20000] [--nrepeat 5] [--nwarmup 1]
+//                     [--nvcycles 5] [--nsteps_cola 5] [--filter fft,fof] [--output bench.json]
+//                     [--scratch .] [--ooc_memory_mb 64]
+// The out-of-core benchmarks put one scratch file per task in the scratch folder (use a node-local disk)
+// The number of threads is set with OMP_NUM_THREADS and the number of tasks with mpirun
+// (see the bench target in the Makefile). The results are written as JSON.
+//
+//=====================================================
+
+const int NDIM = 3;
+
+struct BenchParticle {
+    double Pos[NDIM];
+    double Vel[NDIM];
+    double D_1LPT[NDIM];
+    constexpr int get_ndim() { return NDIM; }
+    double * get_pos() { return Pos; }
+    double * get_vel() { return Vel; }
+    double * get_D_1LPT() { return D_1LPT; }
+};
+
+// Only positions (the pair counter works with std::vector)
+struct PairCountParticle {
+    double Pos[NDIM];
+    constexpr int get_ndim() { return NDIM; }
+    double * get_pos() { return Pos; }
+};
+
+template <int N>
+using FFTWGrid = FML::GRID::FFTWGrid<N>;
+template <int N>
+using OutOfCoreGrid = FML::GRID::OutOfCoreGrid<N>;
+using BenchmarkSuite = FML::UTILS::BenchmarkSuite;
+
+struct Parameters {
+    int nmesh = 128;
+    int npart1d = 128;
+    int npart_paircount = 20000;
+    int nrepeat = 5;
+    int nwarmup = 1;
+    int nvcycles = 5;
+    int nsteps_cola = 5;
+    double buffer_factor = 1.5;
+    std::string filter = "";
+    std::string output = "bench.json";
+    std::string scratch = ".";
+    int ooc_memory_mb = 64;
+};
+
+Parameters parse_arguments(int argc, char ** argv) {
+    Parameters param;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (i + 1 >= argc)
+            throw std::runtime_error("Missing value for argument " + arg);
+        std::string value(argv[++i]);
+        if (arg == "--nmesh")
+            param.nmesh = std::stoi(value);
+        else if (arg == "--npart1d")
+            param.npart1d = std::stoi(value);
+        else if (arg == "--npart_paircount")
+            param.npart_paircount = std::stoi(value);
+        else if (arg == "--nrepeat")
+            param.nrepeat = std::stoi(value);
+        else if (arg == "--nwarmup")
+            param.nwarmup = std::stoi(value);
+        else if (arg == "--nvcycles")
+            param.nvcycles = std::stoi(value);
+        else if (arg == "--nsteps_cola")
+            param.nsteps_cola = std::stoi(value);
+        else if (arg == "--filter")
+            param.filter = value;
+        else if (arg == "--output")
+            param.output = value;
+        else if (arg == "--scratch")
+            param.scratch = value;
+        else if (arg == "--ooc_memory_mb")
+            param.ooc_memory_mb = std::stoi(value);
+        else
+            throw std::runtime_error("Unknown argument " + arg);
+    }
+    return param;
+}
+
+// Uniform random particles in the local domain. Each task uses its own seed so results are reproducible
+// for a given number of tasks
+void make_random_particles(FML::PARTICLE::MPIParticles<BenchParticle> & part, int npart1d, double buffer_factor) {
+    FML::RANDOM::RandomGenerator rng;
+    rng.set_seed(1234 + FML::ThisTask);
+    const double npart_total = std::pow(double(npart1d), NDIM);
+    const size_t npart_local = size_t(npart_total * (FML::xmax_domain - FML::xmin_domain));
+    std::vector<BenchParticle> p(npart_local);
+    std::vector<double> u(NDIM * npart_local);
+    rng.fill_uniform(u);
+    size_t i = 0;
+    for (auto & curpart : p) {
+        curpart.Pos[0] = FML::xmin_domain + (FML::xmax_domain - FML::xmin_domain) * u[i++];
+        for (int idim = 1; idim < NDIM; idim++)
+            curpart.Pos[idim] = u[i++];
+        for (int idim = 0; idim < NDIM; idim++)
+            curpart.Vel[idim] = curpart.D_1LPT[idim] = 0.0;
+    }
+    part.create(p, size_t(npart_local * buffer_factor), [](BenchParticle &) { return true; });
+}
+
+int main(int argc, char ** argv) {
+
+    const Parameters param = parse_arguments(argc, argv);
+    const int Nmesh = param.nmesh;
+    const std::vector<std::string> methods{"NGP", "CIC", "TSC", "PCS", "PQS"};
+
+    BenchmarkSuite bench(param.nrepeat, param.nwarmup, param.filter);
+    bench.add_metadata("nmesh", std::to_string(param.nmesh));
+    bench.add_metadata("npart1d", std::to_string(param.npart1d));
+    bench.add_metadata("npart_paircount", std::to_string(param.npart_paircount));
+    bench.add_metadata("filter", param.filter);
+
+    const double ncells = std::pow(double(Nmesh), NDIM);
+    const double npart_total = std::pow(double(param.npart1d), NDIM);
+    const std::map<std::string, double> grid_params{{"nmesh", Nmesh}};
+    const std::map<std::string, double> part_params{{"nmesh", Nmesh}, {"npart1d", param.npart1d}};
+
+    FML::PARTICLE::MPIParticles<BenchParticle> part;
+    make_random_particles(part, param.npart1d, param.buffer_factor);
+
+    //=====================================================
+    // FFTs
+    //=====================================================
+    {
+        FFTWGrid<NDIM> grid(Nmesh);
+        auto fill = [&]() {
+            for (auto && real_index : grid.get_real_range())
+                grid.set_real_from_index(real_index, FML::GRID::FloatType(real_index % 7));
+        };
+        bench.run("fft_r2c", grid_params, [&]() { grid.fftw_r2c(); }, fill, ncells, "cells");
+        bench.run(
+            "fft_c2r",
+            grid_params,
+            [&]() { grid.fftw_c2r(); },
+            [&]() {
+                fill();
+                grid.fftw_r2c();
+            },
+            ncells,
+            "cells");
+    }
+
+    //=====================================================
+    // Random numbers: one virtual call per number versus
+    // one call per block (as used for the white noise field)
+    //=====================================================
+    {
+        const std::vector<std::pair<std::string, std::shared_ptr<FML::RANDOM::RandomGenerator>>> rngs{
+            {"_mt19937", std::make_shared<FML::RANDOM::RandomGenerator>(1234)},
+            {"_philox", std::make_shared<FML::RANDOM::PhiloxRandomGenerator>(1234)}};
+        std::vector<double> numbers(static_cast<size_t>(ncells));
+        for (auto & entry : rngs) {
+            const std::string & suffix = entry.first;
+            auto & rng = entry.second;
+            bench.run(
+                "rng_uniform_per_call" + suffix,
+                grid_params,
+                [&]() {
+                    for (auto & x : numbers)
+                        x = rng->generate_uniform();
+                },
+                nullptr,
+                ncells,
+                "numbers");
+            bench.run(
+                "rng_uniform_block" + suffix,
+                grid_params,
+                [&]() { rng->fill_uniform(numbers); },
+                nullptr,
+                ncells,
+                "numbers");
+            bench.run(
+                "rng_normal_per_call" + suffix,
+                grid_params,
+                [&]() {
+                    for (auto & x : numbers)
+                        x = rng->generate_normal();
+                },
+                nullptr,
+                ncells,
+                "numbers");
+            bench.run(
+                "rng_normal_block" + suffix,
+                grid_params,
+                [&]() { rng->fill_normal(numbers); },
+                nullptr,
+                ncells,
+                "numbers");
+        }
+    }
+
+    //=====================================================
+    // Out-of-core grid compared to the in-core grid. The grid
+    // is local to each task so every task does the full grid
+    //=====================================================
+    const std::vector<std::string> ooc_benchmarks{"incore_power_spectrum_binning",
+                                                  "incore_smoothing",
+                                                  "ooc_fft_r2c",
+                                                  "ooc_fft_c2r",
+                                                  "ooc_power_spectrum_binning",
+                                                  "ooc_smoothing"};
+    if (std::any_of(ooc_benchmarks.begin(), ooc_benchmarks.end(), [&](auto & name) { return bench.selected(name); })) {
+        FFTWGrid<NDIM> grid(Nmesh);
+        auto fill = [&]() {
+            for (auto && real_index : grid.get_real_range())
+                grid.set_real_from_index(real_index, FML::GRID::FloatType(real_index % 7));
+        };
+        fill();
+        grid.fftw_r2c();
+        FML::CORRELATIONFUNCTIONS::PowerSpectrumBinning<NDIM> pofk(Nmesh / 2);
+        bench.run(
+            "incore_power_spectrum_binning",
+            grid_params,
+            [&]() { FML::CORRELATIONFUNCTIONS::bin_up_power_spectrum<NDIM>(grid, pofk); },
+            nullptr,
+            ncells,
+            "cells");
+        bench.run(
+            "incore_smoothing",
+            grid_params,
+            [&]() { FML::GRID::smoothing_filter_fourier_space<NDIM>(grid, 0.01, "gaussian"); },
+            nullptr,
+            ncells,
+            "cells");
+
+        const std::map<std::string, double> ooc_params{{"nmesh", Nmesh}, {"memory_mb", param.ooc_memory_mb}};
+        const std::string filename = param.scratch + "/ooc_grid_task" + std::to_string(FML::ThisTask) + ".bin";
+        OutOfCoreGrid<NDIM> ooc_grid(Nmesh, filename, size_t(param.ooc_memory_mb) << 20);
+        fill();
+        bench.run(
+            "ooc_fft_r2c",
+            ooc_params,
+            [&]() { ooc_grid.fftw_r2c(); },
+            [&]() { ooc_grid.copy_from(grid); },
+            ncells,
+            "cells");
+        bench.run(
+            "ooc_fft_c2r",
+            ooc_params,
+            [&]() { ooc_grid.fftw_c2r(); },
+            [&]() {
+                ooc_grid.copy_from(grid);
+                ooc_grid.fftw_r2c();
+            },
+            ncells,
+            "cells");
+        grid.fftw_r2c();
+        ooc_grid.copy_from(grid);
+        bench.run(
+            "ooc_power_spectrum_binning",
+            ooc_params,
+            [&]() { FML::CORRELATIONFUNCTIONS::bin_up_power_spectrum<NDIM>(ooc_grid, pofk); },
+            nullptr,
+            ncells,
+            "cells");
+        bench.run(
+            "ooc_smoothing",
+            ooc_params,
+            [&]() { FML::GRID::smoothing_filter_fourier_space<NDIM>(ooc_grid, 0.01, "gaussian"); },
+            nullptr,
+            ncells,
+            "cells");
+    }
+
+    //=====================================================
+    // Density assignment (real space and fourier space with interlacing)
+    //=====================================================
+    for (auto & method : methods) {
+        auto nleftright = FML::INTERPOLATION::get_extra_slices_needed_for_density_assignment(method);
+        FFTWGrid<NDIM> density(Nmesh, nleftright.first, nleftright.second);
+        bench.run(
+            "density_assignment_" + method,
+            part_params,
+            [&]() {
+                FML::INTERPOLATION::particles_to_grid<NDIM, BenchParticle>(
+                    part.get_particles_ptr(), part.get_npart(), part.get_npart_total(), density, method);
+            },
+            nullptr,
+            npart_total,
+            "particles");
+        for (int interlacing = 0; interlacing <= 1; interlacing++)
+            bench.run(
+                "density_assignment_fourier_" + method + (interlacing ? "_interlaced" : ""),
+                part_params,
+                [&]() {
+                    FML::INTERPOLATION::particles_to_fourier_grid<NDIM, BenchParticle>(part.get_particles_ptr(),
+                                                                                        part.get_npart(),
+                                                                                        part.get_npart_total(),
+                                                                                        density,
+                                                                                        method,
+                                                                                        bool(interlacing));
+                },
+                nullptr,
+                npart_total,
+                "particles");
+    }
+
+    //=====================================================
+    // Force interpolation to the particle positions
+    //=====================================================
+    for (auto & method : {"CIC", "TSC"}) {
+        if (not bench.selected(std::string("force_interpolation_") + method))
+            continue;
+        auto nleftright = FML::INTERPOLATION::get_extra_slices_needed_for_density_assignment(method);
+        FFTWGrid<NDIM> density(Nmesh, nleftright.first, nleftright.second);
+        FML::INTERPOLATION::particles_to_grid<NDIM, BenchParticle>(
+            part.get_particles_ptr(), part.get_npart(), part.get_npart_total(), density, method);
+        std::array<FFTWGrid<NDIM>, NDIM> force;
+        FML::NBODY::compute_force_from_density_real<NDIM>(density, force, method, 1.0);
+        std::array<std::vector<FML::GRID::FloatType>, NDIM> force_at_particles;
+        bench.run(
+            std::string("force_interpolation_") + method,
+            part_params,
+            [&]() {
+                FML::INTERPOLATION::interpolate_grid_vector_to_particle_positions<NDIM, BenchParticle>(
+                    force, part.get_particles_ptr(), part.get_npart(), force_at_particles, method);
+            },
+            nullptr,
+            npart_total,
+            "particles");
+    }
+
+    //=====================================================
+    // Particle exchange. Before each run we move the particles a
+    // random distance up to a quarter of a slab so a fixed fraction
+    // of them has to be sent to the neighboring tasks
+    //=====================================================
+    {
+        FML::RANDOM::RandomGenerator rng;
+        rng.set_seed(4321 + FML::ThisTask);
+        const double max_shift = 0.25 / double(FML::NTasks);
+        bench.run(
+            "particle_exchange",
+            part_params,
+            [&]() { part.communicate_particles(); },
+            [&]() {
+                for (auto & p : part) {
+                    auto * pos = FML::PARTICLE::GetPos(p);
+                    pos[0] += max_shift * (2.0 * rng.generate_uniform() - 1.0);
+                    pos[0] += pos[0] < 0.0 ? 1.0 : (pos[0] >= 1.0 ? -1.0 : 0.0);
+                }
+            },
+            npart_total,
+            "particles");
+    }
+
+    //=====================================================
+    // Power spectrum and bispectrum
+    //=====================================================
+    {
+        FML::CORRELATIONFUNCTIONS::PowerSpectrumBinning<NDIM> pofk(Nmesh / 2);
+        bench.run(
+            "power_spectrum",
+            part_params,
+            [&]() {
+                FML::CORRELATIONFUNCTIONS::compute_power_spectrum<NDIM>(
+                    Nmesh, part.get_particles_ptr(), part.get_npart(), part.get_npart_total(), pofk, "CIC", true);
+            },
+            nullptr,
+            npart_total,
+            "particles");
+
+        const int nbins_bispectrum = 8;
+        const double kmax = 2.0 * M_PI * Nmesh / 4.0;
+        FML::CORRELATIONFUNCTIONS::BispectrumBinning<NDIM> bofk(0.0, kmax, nbins_bispectrum);
+        bench.run(
+            "bispectrum",
+            {{"nmesh", Nmesh}, {"npart1d", param.npart1d}, {"nbins", nbins_bispectrum}},
+            [&]() {
+                FML::CORRELATIONFUNCTIONS::compute_bispectrum<NDIM>(
+                    Nmesh, part.get_particles_ptr(), part.get_npart(), part.get_npart_total(), bofk, "CIC", true);
+            },
+            nullptr,
+            npart_total,
+            "particles");
+    }
+
+    //=====================================================
+    // Friends of Friends
+    //=====================================================
+    {
+        const double fof_distance = 0.2 / double(param.npart1d);
+        const int nmin_fof_group = 20;
+        std::vector<FML::FOF::FoFHalo<BenchParticle, NDIM>> halos;
+        bench.run(
+            "friends_of_friends",
+            {{"npart1d", param.npart1d}, {"linking_length", 0.2}},
+            [&]() {
+                halos.clear();
+                FML::FOF::FriendsOfFriends<BenchParticle, NDIM>(
+                    part.get_particles_ptr(), part.get_npart(), fof_distance, nmin_fof_group, true, halos);
+            },
+            nullptr,
+            npart_total,
+            "particles");
+    }
+
+    //=====================================================
+    // Pair counting. The pair counter assumes all tasks have all
+    // the particles so all tasks generate the same set
+    //=====================================================
+    {
+        FML::RANDOM::RandomGenerator rng;
+        rng.set_seed(5678);
+        std::vector<PairCountParticle> particles(param.npart_paircount);
+        for (auto & p : particles)
+            for (int idim = 0; idim < NDIM; idim++)
+                p.Pos[idim] = rng.generate_uniform();
+        const int nbins = 20;
+        const double rmax = 0.1;
+        bench.run(
+            "pair_counting",
+            {{"npart", param.npart_paircount}, {"nbins", nbins}, {"rmax", rmax}},
+            [&]() { FML::CORRELATIONFUNCTIONS::AutoPairCount(particles, nbins, rmax, true, false); },
+            nullptr,
+            param.npart_paircount,
+            "particles");
+    }
+
+    //=====================================================
+    // Multigrid: a fixed number of V-cycles for the Poisson equation
+    //=====================================================
+    if (bench.selected("multigrid_vcycles")) {
+        using namespace FML::SOLVERS::MULTIGRIDSOLVER;
+        using SolverType = double;
+        auto source = [](std::array<double, NDIM> & x) -> SolverType {
+            return std::sin(2.0 * M_PI * x[0]) * std::cos(4.0 * M_PI * x[1]) * std::sin(6.0 * M_PI * x[2]);
+        };
+        MultiGridFunction<NDIM, SolverType> Equation =
+            [&](MultiGridSolver<NDIM, SolverType> * sol, int level, IndexInt index) {
+                auto index_list = sol->get_neighbor_gridindex(level, index);
+                auto coordinate = sol->get_Coordinate(level, index);
+                auto L = sol->get_Laplacian(level, index_list) - source(coordinate);
+                auto dL = sol->get_derivLaplacian(level, index_list);
+                return std::pair<SolverType, SolverType>{L, dL};
+            };
+        MultiGridConvCrit ConvergenceCriterion = [&](double, double, int step_number) {
+            return step_number >= param.nvcycles;
+        };
+        std::unique_ptr<MultiGridSolver<NDIM, SolverType>> solver;
+        bench.run(
+            "multigrid_vcycles",
+            {{"nmesh", Nmesh}, {"nvcycles", param.nvcycles}},
+            [&]() { solver->solve(Equation, ConvergenceCriterion); },
+            [&]() {
+                solver = std::make_unique<MultiGridSolver<NDIM, SolverType>>(Nmesh, -1, false, true, 1, 1);
+                solver->set_ngs_sweeps(2, 2, 2);
+                solver->set_maxsteps(param.nvcycles + 1);
+                solver->set_initial_guess(SolverType(0.0));
+            },
+            ncells * param.nvcycles,
+            "cells");
+    }
+
+    //=====================================================
+    // A short COLA run (1LPT) in an Einstein-de Sitter universe
+    // where D1 = a and the time integrals are analytic. The initial
+    // conditions are made once and restored before each run
+    //=====================================================
+    if (bench.selected("cola_run")) {
+        const double aini = 0.1;
+        const double aend = 1.0;
+        const int nsteps = param.nsteps_cola;
+        const std::string method = "CIC";
+        auto Pofk_of_kBox_over_volume_primordial = [](double kBox) {
+            return kBox > 0.0 ? 1.0 / (kBox * kBox * kBox) : 0.0;
+        };
+        auto Pofk_of_kBox_over_Pofk_primordial = [](double kBox) { return 1e-5 * kBox * kBox; };
+
+        FML::RANDOM::RandomGenerator rng;
+        rng.set_seed(1234);
+        FML::PARTICLE::MPIParticles<BenchParticle> cola_part;
+        FML::NBODY::NBodyInitialConditions<NDIM, BenchParticle>(cola_part,
+                                                                param.npart1d,
+                                                                param.buffer_factor,
+                                                                Nmesh,
+                                                                true,
+                                                                &rng,
+                                                                Pofk_of_kBox_over_Pofk_primordial,
+                                                                Pofk_of_kBox_over_volume_primordial,
+                                                                1,
+                                                                "gaussian",
+                                                                0.0,
+                                                                1000.0,
+                                                                1.0 / aini - 1.0,
+                                                                {std::sqrt(aini), 0.0, 0.0, 0.0});
+        std::vector<BenchParticle> initial_conditions;
+        for (auto & p : cola_part) {
+            initial_conditions.push_back(p);
+            for (int idim = 0; idim < NDIM; idim++)
+                initial_conditions.back().Vel[idim] = 0.0;
+        }
+
+        auto nleftright = FML::INTERPOLATION::get_extra_slices_needed_for_density_assignment(method);
+        auto cola_run = [&]() {
+            const double delta_a = (aend - aini) / double(nsteps);
+            for (int i = 0; i <= nsteps; i++) {
+                const double apos_old = aini + delta_a * i;
+                const double apos_new = (i == nsteps) ? aend : apos_old + delta_a;
+                const double avel_old = (i == 0) ? aini : apos_old - 0.5 * delta_a;
+                const double avel_new =
+                    (i == 0) ? aini + 0.5 * delta_a : (i == nsteps ? aend : apos_old + 0.5 * delta_a);
+                const double amid = 0.5 * (avel_old + avel_new);
+                const double delta_time_pos = 2.0 * (1.0 / std::sqrt(apos_old) - 1.0 / std::sqrt(apos_new));
+                const double delta_time_vel = 2.0 * (std::sqrt(avel_new) - std::sqrt(avel_old)) / amid;
+                const double norm_poisson_equation = 1.5 * apos_old;
+
+                FFTWGrid<NDIM> density(Nmesh, nleftright.first, nleftright.second);
+                FML::INTERPOLATION::particles_to_grid<NDIM, BenchParticle>(cola_part.get_particles_ptr(),
+                                                                           cola_part.get_npart(),
+                                                                           cola_part.get_npart_total(),
+                                                                           density,
+                                                                           method);
+                density.fftw_r2c();
+                std::array<FFTWGrid<NDIM>, NDIM> force;
+                FML::NBODY::compute_force_from_density_fourier<NDIM>(density, force, method, norm_poisson_equation);
+                FML::NBODY::KickParticles<NDIM>(force, cola_part, delta_time_vel, method);
+
+                // The COLA 1LPT displacement and velocity (D1 = a in EdS)
+                const double fac_pos = (apos_new - apos_old) / aini;
+                const double fac_vel = -norm_poisson_equation * apos_old / aini * delta_time_vel;
+                for (auto & p : cola_part) {
+                    auto * pos = FML::PARTICLE::GetPos(p);
+                    auto * vel = FML::PARTICLE::GetVel(p);
+                    auto * D1 = FML::PARTICLE::GetD_1LPT(p);
+                    for (int idim = 0; idim < NDIM; idim++) {
+                        pos[idim] += D1[idim] * fac_pos;
+                        vel[idim] += D1[idim] * fac_vel;
+                    }
+                }
+                FML::NBODY::DriftParticles<NDIM, BenchParticle>(cola_part, delta_time_pos);
+            }
+        };
+        bench.run(
+            "cola_run",
+            {{"nmesh", Nmesh}, {"npart1d", param.npart1d}, {"nsteps", nsteps}},
+            cola_run,
+            [&]() {
+                const size_t nallocate = size_t(initial_conditions.size() * param.buffer_factor);
+                cola_part.create(initial_conditions, nallocate, [](BenchParticle &) { return true; });
+            },
+            npart_total * (nsteps + 1),
+            "particle-steps");
+    }
+
+    bench.write_json(param.output);
+    if (FML::ThisTask == 0)
+        std::cout << "Results written to " << param.output << "\n";
+}
@@ -164,7 +164,8 @@ end
 ------------------------------------------------------------
 -- The random seed
 ic_random_seed = 1234
--- The random generator (GSL or MT19937). Fiducial GSL is gsl_rng_ranlxd1 (as used in the 2LPTIC code for comparison)
+-- The random generator (GSL, MT19937 or PHILOX). Fiducial GSL is gsl_rng_ranlxd1 (as used in the 2LPTIC code for comparison)
+-- PHILOX is counter-based and gives the same IC for any number of tasks and threads
 ic_random_generator = "GSL"
 -- Fix amplitude when generating the gaussian random field
 ic_fix_amplitude = true
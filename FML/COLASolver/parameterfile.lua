@@ -219,7 +219,8 @@ end
 ------------------------------------------------------------
 -- The random seed
 ic_random_seed = 1234
--- The random generator (GSL or MT19937). Fiducial GSL is gsl_rng_ranlxd1 (as used in the 2LPTIC code for comparison)
+-- The random generator (GSL, MT19937 or PHILOX). Fiducial GSL is gsl_rng_ranlxd1 (as used in the 2LPTIC code for comparison)
+-- PHILOX is counter-based and gives the same IC for any number of tasks and threads
 ic_random_generator = "GSL"
 -- Fix amplitude when generating the gaussian random field
 ic_fix_amplitude = true
@@ -293,6 +294,23 @@ force_kernel = "continuous_greens_function"
 -- Requires: transferinfofile above (we need all T(k,z))
 force_linear_massive_neutrinos = true
 
+------------------------------------------------------------
+-- Massive neutrinos as particles
+------------------------------------------------------------
+-- Switch from linear massive neutrinos to particles at low redshift
+-- Until the switch the neutrinos are included using linear theory (as above)
+-- Requires: transferinfofile above (we need all T(k,z))
+neutrino_particles = false
+if neutrino_particles then
+  -- The redshift where we create the neutrino particles
+  neutrino_particles_switch_redshift = 10.0
+  -- Number of sites per dimension. Every site gets two particles with
+  -- opposite thermal velocities (so 2 * Npart_1D^NDIM particles in total)
+  neutrino_particles_Npart_1D = 64
+  -- The grid we bin the neutrinos to (can be smaller than force_nmesh)
+  neutrino_particles_nmesh = 64
+end
+
 ------------------------------------------------------------
 -- On the fly analysis
 ------------------------------------------------------------
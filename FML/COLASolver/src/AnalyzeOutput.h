@@ -31,6 +31,7 @@ void output_pofk_for_every_step(NBodySimulation<NDIM, T> & sim) {
     const auto ic_initial_redshift = sim.ic_initial_redshift;
     const auto & pofk_cb_every_step = sim.pofk_cb_every_step;
     const auto & pofk_total_every_step = sim.pofk_total_every_step;
+    const auto & pofk_nu_every_step = sim.pofk_nu_every_step;
     const auto & grav = sim.grav;
     const auto & transferdata = sim.transferdata;
     const auto & power_initial_spline = sim.power_initial_spline;
@@ -93,6 +94,35 @@ void output_pofk_for_every_step(NBodySimulation<NDIM, T> & sim) {
             fp << "\n";
         }
     }
+
+    //=============================================================
+    // Output all massive neutrino Pofk (only if we have neutrino particles)
+    //=============================================================
+    for (auto & p : pofk_nu_every_step) {
+        auto redshift = p.first;
+        auto binning = p.second;
+        auto pofk_nu = [&](double k) {
+            if (transferdata)
+                return transferdata->get_massive_neutrino_power_spectrum(k, 1.0 / (1.0 + redshift));
+            return 0.0;
+        };
+
+        std::stringstream stream;
+        stream << std::fixed << std::setprecision(3) << redshift;
+        std::string redshiftstring = stream.str();
+        std::string filename = output_folder;
+        filename =
+            filename + (filename == "" ? "" : "/") + "pofk_" + simulation_name + "_nu_z" + redshiftstring + ".txt";
+
+        std::ofstream fp(filename.c_str());
+        fp << "# k  (h/Mpc)    Pnu(k)  (Mpc/h)^3    Pnu_linear(k)  (Mpc/h)^3\n";
+        for (int i = 0; i < binning.n; i++) {
+            fp << std::setw(15) << binning.kbin[i] << " ";
+            fp << std::setw(15) << binning.pofk[i] << " ";
+            fp << std::setw(15) << pofk_nu(binning.kbin[i]) << " ";
+            fp << "\n";
+        }
+    }
 }
 
 template <int NDIM, class T>
@@ -594,8 +594,8 @@ void cola_kick_drift_scaledependent(FML::PARTICLE::MPIParticles<T> & part,
     }
 
     timer.EndTiming("Scaledependent COLA");
-    if (FML::ThisTask == 0 and print_timings)
-        timer.PrintAllTimings();
+    if (print_timings)
+        timer.PrintAllTimingsAllTasks();
 }
 
 template <int NDIM, class T>
@@ -150,6 +150,12 @@ class Cosmology {
     // Neutrino temperature in eV
     double get_neutrino_temperature_eV(double a) const { return (Tnu_kelvin * units.K * units.k_b / units.eV) / a; }
 
+    // Peculiar velocity in km/s of a neutrino with momentum p = q T_nu(a) (assuming degenerate masses)
+    double get_neutrino_velocity_kms(double q, double a) const {
+        const double p_over_m = q * get_neutrino_temperature_eV(a) / (Mnu_eV / N_nu);
+        return p_over_m / std::sqrt(1.0 + p_over_m * p_over_m) * units.c / (units.km / units.s);
+    }
+
     //========================================================================
     // Read the parameters we need
     // In derived class remember to also call the base class (this)
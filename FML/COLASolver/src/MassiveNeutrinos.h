@@ -0,0 +1,347 @@
+#ifndef MASSIVENEUTRINOS_HEADER
+#define MASSIVENEUTRINOS_HEADER
+
+#include <FML/FFTWGrid/FFTWGrid.h>
+#include <FML/Global/Global.h>
+#include <FML/Interpolation/ParticleGridInterpolation.h>
+#include <FML/LPT/DisplacementFields.h>
+#include <FML/MPIParticles/MPIParticles.h>
+#include <FML/Spline/Spline.h>
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//========================================================================
+// This header contains the methods for massive neutrinos as particles:
+// the neutrino particle, creating them from the linear neutrino field with
+// thermal velocities and adding their density to the density field we
+// compute forces from. Before we switch to particles the neutrinos are
+// included using linear theory (see compute_density_field_fourier).
+//
+// To reduce the shot-noise from the thermal velocities every Lagrangian
+// site gets a pair of particles with the same bulk velocity and opposite
+// thermal velocities (so the pair has no net thermal momentum) and the
+// thermal momenta are sampled with a low-discrepancy (Kronecker) sequence
+// over the sites instead of random numbers. The density of the neutrinos
+// is assigned to a separate (lower resolution) grid and interpolated onto
+// the force grid.
+//========================================================================
+
+/// A neutrino particle. Only position and velocity to keep the memory footprint small
+template <int NDIM>
+class NeutrinoParticle {
+  private:
+    double pos[NDIM];
+    double vel[NDIM];
+
+  public:
+    double * get_pos() { return pos; }
+    double * get_vel() { return vel; }
+    constexpr int get_ndim() const { return NDIM; }
+};
+
+/// Draw comoving momenta q = p/T_nu from the (relativistic) Fermi-Dirac distribution f(q) ~ q^2/(e^q+1)
+class FermiDiracSampler {
+  public:
+    using DVector = FML::INTERPOLATION::SPLINE::DVector;
+    using Spline = FML::INTERPOLATION::SPLINE::Spline;
+
+    FermiDiracSampler() {
+        // Integrate the CDF with the trapezoidal rule. Above qmax the CDF is 1 to double precision
+        const int npts = 4000;
+        const double qmax = 30.0;
+        const double dq = qmax / double(npts - 1);
+        auto f = [](double q) { return q * q / (std::exp(q) + 1.0); };
+
+        DVector q_arr(npts), cdf_arr(npts);
+        q_arr[0] = 0.0;
+        cdf_arr[0] = 0.0;
+        for (int i = 1; i < npts; i++) {
+            q_arr[i] = i * dq;
+            cdf_arr[i] = cdf_arr[i - 1] + 0.5 * dq * (f(q_arr[i - 1]) + f(q_arr[i]));
+        }
+
+        // Normalize and only keep points where the CDF is strictly increasing
+        DVector x, y;
+        for (int i = 0; i < npts; i++) {
+            const double value = std::cbrt(cdf_arr[i] / cdf_arr[npts - 1]);
+            if (x.size() == 0 or value > x.back()) {
+                x.push_back(value);
+                y.push_back(q_arr[i]);
+            }
+        }
+        cbrt_cdf_min = x.front();
+        cbrt_cdf_max = x.back();
+        q_of_cbrt_cdf_spline.create(x, y, "q(CDF^(1/3)) Fermi-Dirac");
+    }
+
+    /// The momentum q corresponding to the quantile u in [0,1)
+    double q_of_quantile(double u) const {
+        const double x = std::min(std::max(std::cbrt(u), cbrt_cdf_min), cbrt_cdf_max);
+        return q_of_cbrt_cdf_spline(x);
+    }
+
+  private:
+    // We spline q as function of CDF^(1/3) as this is close to linear for small q where CDF ~ q^3
+    Spline q_of_cbrt_cdf_spline;
+    double cbrt_cdf_min;
+    double cbrt_cdf_max;
+};
+
+template <int NDIM>
+void neutrino_low_discrepancy_point(uint64_t index,
+                                    const std::array<double, NDIM> & shift,
+                                    std::array<double, NDIM> & point);
+
+template <int NDIM>
+void neutrino_unit_vector_from_uniforms(const double * u, std::array<double, NDIM> & dir);
+
+template <int NDIM>
+void create_neutrino_particles(FML::PARTICLE::MPIParticles<NeutrinoParticle<NDIM>> & part_nu,
+                               int Npart_1D,
+                               double buffer_factor,
+                               const FML::GRID::FFTWGrid<NDIM> & phi_cb_ini_fourier,
+                               std::function<double(double)> displacement_factor_of_kBox,
+                               std::function<double(double)> velocity_factor_of_kBox,
+                               std::function<double(double)> thermal_velocity_of_q,
+                               const std::array<double, NDIM> & shift,
+                               std::string interpolation_method);
+
+template <int NDIM>
+void add_neutrino_density_to_grid(FML::GRID::FFTWGrid<NDIM> & delta_nu_real,
+                                  FML::GRID::FFTWGrid<NDIM> & density_real,
+                                  double fMNu);
+
+//========================================================================
+/// Point number index of the NDIM dimensional Kronecker sequence
+/// frac(shift + index * alpha) with alpha_j = phi_d^-(j+1) where phi_d is the
+/// generalized golden ratio (x^(d+1) = x + 1). Any consecutive set of indices
+/// samples [0,1)^NDIM evenly. The shift is a random offset (Cranley-Patterson rotation)
+//========================================================================
+template <int NDIM>
+void neutrino_low_discrepancy_point(uint64_t index,
+                                    const std::array<double, NDIM> & shift,
+                                    std::array<double, NDIM> & point) {
+    static const std::array<double, NDIM> alpha = []() {
+        double phi = 2.0;
+        for (int i = 0; i < 50; i++)
+            phi = std::pow(1.0 + phi, 1.0 / (NDIM + 1.0));
+        std::array<double, NDIM> res;
+        for (int idim = 0; idim < NDIM; idim++)
+            res[idim] = std::pow(1.0 / phi, idim + 1);
+        return res;
+    }();
+    for (int idim = 0; idim < NDIM; idim++) {
+        const double x = shift[idim] + double(index) * alpha[idim];
+        point[idim] = x - std::floor(x);
+    }
+}
+
+//========================================================================
+/// Unit vector from NDIM-1 uniform numbers in [0,1) (uniform on the sphere)
+//========================================================================
+template <int NDIM>
+void neutrino_unit_vector_from_uniforms([[maybe_unused]] const double * u, std::array<double, NDIM> & dir) {
+    if constexpr (NDIM == 1) {
+        dir[0] = 1.0;
+    } else if constexpr (NDIM == 2) {
+        const double phi = 2.0 * M_PI * u[0];
+        dir[0] = std::cos(phi);
+        dir[1] = std::sin(phi);
+    } else if constexpr (NDIM == 3) {
+        const double cost = 1.0 - 2.0 * u[0];
+        const double sint = std::sqrt(std::max(0.0, 1.0 - cost * cost));
+        const double phi = 2.0 * M_PI * u[1];
+        dir[0] = sint * std::cos(phi);
+        dir[1] = sint * std::sin(phi);
+        dir[2] = cost;
+    } else {
+        throw std::runtime_error("Neutrino particles are only implemented for NDIM <= 3");
+    }
+}
+
+//========================================================================
+/// Create neutrino particles from the linear neutrino field. We put Npart_1D^NDIM sites on a regular
+/// grid and displace them using 1LPT. The bulk velocity is the linear one and on top of this every
+/// site gets two particles with opposite thermal velocities. The thermal momenta are sampled using a
+/// low-discrepancy sequence over the sites.
+///
+/// @param[out] part_nu The neutrino particles (2 Npart_1D^NDIM of them)
+/// @param[in] Npart_1D The number of sites per dimension
+/// @param[in] buffer_factor How many extra particles to allocate for
+/// @param[in] phi_cb_ini_fourier The 1LPT potential of delta_cb at the initial time
+/// @param[in] displacement_factor_of_kBox The neutrino displacement over the one of phi_cb_ini as function of kBox
+/// (i.e. T_nu(k,a) / T_cb(k,aini))
+/// @param[in] velocity_factor_of_kBox Same as above for the bulk velocity (in code units)
+/// @param[in] thermal_velocity_of_q The thermal velocity in code units for a neutrino with momentum q T_nu
+/// @param[in] shift Random shift of the low-discrepancy sequence
+/// @param[in] interpolation_method The method used to interpolate the displacement field to the sites
+///
+//========================================================================
+template <int NDIM>
+void create_neutrino_particles(FML::PARTICLE::MPIParticles<NeutrinoParticle<NDIM>> & part_nu,
+                               int Npart_1D,
+                               double buffer_factor,
+                               const FML::GRID::FFTWGrid<NDIM> & phi_cb_ini_fourier,
+                               std::function<double(double)> displacement_factor_of_kBox,
+                               std::function<double(double)> velocity_factor_of_kBox,
+                               std::function<double(double)> thermal_velocity_of_q,
+                               const std::array<double, NDIM> & shift,
+                               std::string interpolation_method) {
+
+    //=============================================================
+    // The sites on the local task: x-slices i with xmin <= i / Npart_1D < xmax
+    //=============================================================
+    int imin = 0;
+    while (imin / double(Npart_1D) < FML::xmin_domain)
+        imin++;
+    int imax = imin;
+    while (imax / double(Npart_1D) < FML::xmax_domain)
+        imax++;
+    const size_t nsites_per_slice = size_t(FML::power(Npart_1D, NDIM - 1));
+    const size_t nsites = (imax - imin) * nsites_per_slice;
+    const uint64_t first_site = uint64_t(imin) * nsites_per_slice;
+
+    std::vector<NeutrinoParticle<NDIM>> sites(nsites);
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+    for (size_t i = 0; i < nsites; i++) {
+        auto * pos = FML::PARTICLE::GetPos(sites[i]);
+        size_t rest = first_site + i;
+        for (int idim = NDIM - 1; idim >= 0; idim--) {
+            pos[idim] = (rest % Npart_1D) / double(Npart_1D);
+            rest /= Npart_1D;
+        }
+    }
+
+    //=============================================================
+    // Displacement and bulk velocity at the sites. We use the same grids for both
+    //=============================================================
+    std::array<FML::GRID::FFTWGrid<NDIM>, NDIM> psi;
+    std::array<std::vector<FML::GRID::FloatType>, NDIM> displacement;
+    std::array<std::vector<FML::GRID::FloatType>, NDIM> velocity;
+    FML::COSMOLOGY::LPT::from_LPT_potential_to_displacement_vector_scaledependent<NDIM>(
+        phi_cb_ini_fourier, psi, displacement_factor_of_kBox);
+    for (int idim = 0; idim < NDIM; idim++)
+        psi[idim].communicate_boundaries();
+    FML::INTERPOLATION::interpolate_grid_vector_to_particle_positions<NDIM, NeutrinoParticle<NDIM>>(
+        psi, sites.data(), nsites, displacement, interpolation_method);
+    FML::COSMOLOGY::LPT::from_LPT_potential_to_displacement_vector_scaledependent<NDIM>(
+        phi_cb_ini_fourier, psi, velocity_factor_of_kBox);
+    for (int idim = 0; idim < NDIM; idim++)
+        psi[idim].communicate_boundaries();
+    FML::INTERPOLATION::interpolate_grid_vector_to_particle_positions<NDIM, NeutrinoParticle<NDIM>>(
+        psi, sites.data(), nsites, velocity, interpolation_method);
+    for (int idim = 0; idim < NDIM; idim++)
+        psi[idim].free();
+
+    //=============================================================
+    // Two particles per site with opposite thermal velocities
+    //=============================================================
+    FermiDiracSampler sampler;
+    std::vector<NeutrinoParticle<NDIM>> particles(2 * nsites);
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+    for (size_t i = 0; i < nsites; i++) {
+        std::array<double, NDIM> u, dir;
+        neutrino_low_discrepancy_point<NDIM>(first_site + i, shift, u);
+        neutrino_unit_vector_from_uniforms<NDIM>(u.data() + 1, dir);
+        const double vthermal = thermal_velocity_of_q(sampler.q_of_quantile(u[0]));
+
+        auto * q = FML::PARTICLE::GetPos(sites[i]);
+        for (int j = 0; j < 2; j++) {
+            auto * pos = FML::PARTICLE::GetPos(particles[2 * i + j]);
+            auto * vel = FML::PARTICLE::GetVel(particles[2 * i + j]);
+            const double sign = j == 0 ? 1.0 : -1.0;
+            for (int idim = 0; idim < NDIM; idim++) {
+                pos[idim] = q[idim] + displacement[idim][i];
+                if (pos[idim] >= 1.0)
+                    pos[idim] -= 1.0;
+                if (pos[idim] < 0.0)
+                    pos[idim] += 1.0;
+                vel[idim] = velocity[idim][i] + sign * vthermal * dir[idim];
+            }
+        }
+    }
+    sites.clear();
+    sites.shrink_to_fit();
+
+    //=============================================================
+    // Move them into MPIParticles and send them to the right task
+    //=============================================================
+    const size_t nallocate = size_t(2 * nsites * buffer_factor);
+    part_nu.create(particles, nallocate, [](NeutrinoParticle<NDIM> &) { return true; });
+    part_nu.communicate_particles();
+}
+
+//========================================================================
+/// Combine the neutrino density contrast on the (coarse) grid delta_nu_real with the
+/// baryon+CDM density contrast in density_real: delta = (1 - fMNu) delta_cb + fMNu delta_nu.
+/// We use linear interpolation from the coarse grid. All grids have the same x-domain on each
+/// task so this is local apart from one boundary slice (delta_nu_real needs one extra slice on the right).
+//========================================================================
+template <int NDIM>
+void add_neutrino_density_to_grid(FML::GRID::FFTWGrid<NDIM> & delta_nu_real,
+                                  FML::GRID::FFTWGrid<NDIM> & density_real,
+                                  double fMNu) {
+
+    FML::assert_mpi(delta_nu_real.get_n_extra_slices_right() >= 1,
+                    "[add_neutrino_density_to_grid] Neutrino grid needs one extra slice on the right");
+    delta_nu_real.communicate_boundaries();
+
+    const int Nmesh = density_real.get_nmesh();
+    const int Nmesh_nu = delta_nu_real.get_nmesh();
+    const auto Local_nx = density_real.get_local_nx();
+    const auto Local_x_start = density_real.get_local_x_start();
+    const auto Local_x_start_nu = delta_nu_real.get_local_x_start();
+
+    // The coarse cell to the left and the weight of the right one for every fine cell
+    std::vector<int> ileft(Nmesh);
+    std::vector<double> wright(Nmesh);
+    for (int i = 0; i < Nmesh; i++) {
+        const double x = i * double(Nmesh_nu) / double(Nmesh);
+        ileft[i] = int(x);
+        wright[i] = x - ileft[i];
+    }
+
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+    for (int islice = 0; islice < Local_nx; islice++) {
+        for (auto && real_index : density_real.get_real_range(islice, islice + 1)) {
+            auto coord = density_real.get_coord_from_index(real_index);
+            coord[0] += int(Local_x_start);
+
+            double delta_nu = 0.0;
+            for (int corner = 0; corner < FML::power(2, NDIM); corner++) {
+                std::array<int, NDIM> coord_nu;
+                double weight = 1.0;
+                for (int idim = 0; idim < NDIM; idim++) {
+                    const int right = (corner >> idim) & 1;
+                    coord_nu[idim] = ileft[coord[idim]] + right;
+                    weight *= right ? wright[coord[idim]] : 1.0 - wright[coord[idim]];
+                }
+                if (weight == 0.0)
+                    continue;
+                // The x-coordinate is local (the right neighbor might be in the extra slice) the others are periodic
+                coord_nu[0] -= int(Local_x_start_nu);
+                for (int idim = 1; idim < NDIM; idim++)
+                    coord_nu[idim] = coord_nu[idim] % Nmesh_nu;
+                delta_nu += weight * delta_nu_real.get_real(coord_nu);
+            }
+
+            const double delta_cb = density_real.get_real_from_index(real_index);
+            density_real.set_real_from_index(real_index,
+                                             FML::GRID::FloatType((1.0 - fMNu) * delta_cb + fMNu * delta_nu));
+        }
+    }
+}
+
+#endif
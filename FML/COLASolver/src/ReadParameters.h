@@ -240,6 +240,17 @@ void read_parameterfile(ParameterMap & param, std::string filename) {
     param["force_kernel"] = lfp.read_string("force_kernel", "continuous_greens_function", OPTIONAL);
     param["force_linear_massive_neutrinos"] = lfp.read_bool("force_linear_massive_neutrinos", false, OPTIONAL);
 
+    //=============================================================
+    // Massive neutrinos as particles
+    //=============================================================
+    param["neutrino_particles"] = lfp.read_bool("neutrino_particles", false, OPTIONAL);
+    if (param.get<bool>("neutrino_particles")) {
+        param["neutrino_particles_switch_redshift"] =
+            lfp.read_double("neutrino_particles_switch_redshift", 10.0, OPTIONAL);
+        param["neutrino_particles_Npart_1D"] = lfp.read_int("neutrino_particles_Npart_1D", 0, REQUIRED);
+        param["neutrino_particles_nmesh"] = lfp.read_int("neutrino_particles_nmesh", 0, REQUIRED);
+    }
+
     //=============================================================
     // Output
     //=============================================================
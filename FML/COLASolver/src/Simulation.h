@@ -21,7 +21,9 @@
 #include "COLA.h"
 #include "Cosmology.h"
 #include "GravityModel.h"
+#include "MassiveNeutrinos.h"
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <iostream>
@@ -36,6 +38,7 @@
 //=============================================================================
 using RandomGenerator = FML::RANDOM::RandomGenerator;
 using GSLRandomGenerator = FML::RANDOM::GSLRandomGenerator;
+using PhiloxRandomGenerator = FML::RANDOM::PhiloxRandomGenerator;
 using DVector = FML::INTERPOLATION::SPLINE::DVector;
 using Spline = FML::INTERPOLATION::SPLINE::Spline;
 using ODESolver = FML::SOLVERS::ODESOLVER::ODESolver;
@@ -80,9 +83,16 @@ class NBodySimulation {
     //=============================================================================
     MPIParticles<T> part;
 
+    //=============================================================================
+    /// Massive neutrino particles (only created if neutrino_particles = true and
+    /// we have passed the redshift where we switch from linear theory to particles)
+    //=============================================================================
+    MPIParticles<NeutrinoParticle<NDIM>> part_nu;
+
     //=============================================================================
     /// The initial density field delta_cb(zini,k) computed with the same Nmesh
-    /// as the forces (used for linear massive neutrinos - not allocated otherwise)
+    /// as the forces (used for linear massive neutrinos and to create neutrino particles
+    /// - not allocated otherwise)
     /// NB: we cannot use phi_1LPT_ini_fourier below as it might have a different gridsize
     //=============================================================================
     FFTWGrid<NDIM> initial_density_field_fourier;
@@ -118,12 +128,18 @@ class NBodySimulation {
     std::string force_kernel;                    // The force kernel (see relevant files)
     bool force_linear_massive_neutrinos;         // Include the effects of massive neutrinos using linear theory
 
+    // Massive neutrinos as particles
+    bool neutrino_particles;                   // Switch from linear massive neutrinos to particles at low redshift
+    double neutrino_particles_switch_redshift; // The redshift where we create the neutrino particles
+    int neutrino_particles_Npart_1D;           // Number of sites per dimension (we put two particles per site)
+    int neutrino_particles_nmesh;              // The gridsize we bin the neutrinos to
+
     // Initial conditions
     std::string ic_random_field_type; // gaussian, nongaussian, reconstruct_from_particles, read_particles
     double ic_initial_redshift;       // The initial redshift of the sim
     int ic_nmesh;                     // The Nmesh used to generate the IC (use particle_Npart_1D)
     int ic_random_seed;               // The random seed
-    std::string ic_random_generator;  // The generator: GSL or MT19937 (fiducial)
+    std::string ic_random_generator;  // The generator: GSL, MT19937 (fiducial) or PHILOX
     int ic_LPT_order;                 // The LPT order to use to make IC (1,2,3)
 
     // Initial conditions: input file (power-spectrum / transfer functions)
@@ -207,6 +223,7 @@ class NBodySimulation {
     // A list of (z, P(k)) for the particles at every step (naive binning - not using the same pofk_* setting!)
     std::vector<std::pair<double, PowerSpectrumBinning<NDIM>>> pofk_cb_every_step;
     std::vector<std::pair<double, PowerSpectrumBinning<NDIM>>> pofk_total_every_step;
+    std::vector<std::pair<double, PowerSpectrumBinning<NDIM>>> pofk_nu_every_step;
     // A list of (z, P(k)) for the particles that we compute if pofk = true
     std::vector<std::pair<double, PowerSpectrumBinning<NDIM>>> pofk_every_output;
     // A list of (z, P_ell(k)) for the particles that we compute every output if pofk_multipoles = true
@@ -247,6 +264,9 @@ class NBodySimulation {
     /// From particles to density field
     void compute_density_field_fourier(FFTWGrid<NDIM> & density_grid_fourier, double a);
 
+    /// Create the neutrino particles from linear theory (positions at apos and velocities at avel)
+    void create_neutrino_particles_from_linear(double apos, double avel);
+
     /// Compute stuff on the fly and output
     void analyze_and_output(int ioutput, double redshift);
 
@@ -504,6 +524,23 @@ void NBodySimulation<NDIM, T>::read_parameters(ParameterMap & param) {
         std::cout << "force_linear_massive_neutrinos           : " << force_linear_massive_neutrinos << "\n";
     }
 
+    // Massive neutrinos as particles
+    neutrino_particles = param.get<bool>("neutrino_particles");
+    if (neutrino_particles) {
+        neutrino_particles_switch_redshift = param.get<double>("neutrino_particles_switch_redshift");
+        neutrino_particles_Npart_1D = param.get<int>("neutrino_particles_Npart_1D");
+        neutrino_particles_nmesh = param.get<int>("neutrino_particles_nmesh");
+        if (FML::ThisTask == 0) {
+            std::cout << "neutrino_particles                       : " << neutrino_particles << "\n";
+            std::cout << "neutrino_particles_switch_redshift       : " << neutrino_particles_switch_redshift << "\n";
+            std::cout << "neutrino_particles_Npart_1D              : " << neutrino_particles_Npart_1D << "\n";
+            std::cout << "neutrino_particles_nmesh                 : " << neutrino_particles_nmesh << "\n";
+        }
+        FML::assert_mpi(neutrino_particles_nmesh > 0 and neutrino_particles_nmesh % FML::NTasks == 0,
+                        "neutrino_particles_nmesh must be a positive multiple of the number of tasks");
+        FML::assert_mpi(neutrino_particles_Npart_1D > 0, "neutrino_particles_Npart_1D must be positive");
+    }
+
     // Initial conditions
     ic_type_of_input = param.get<std::string>("ic_type_of_input");
     ic_input_filename = param.get<std::string>("ic_input_filename");
@@ -1006,6 +1043,8 @@ void NBodySimulation<NDIM, T>::init() {
         rng = std::make_shared<GSLRandomGenerator>();
     else if (ic_random_generator == "MT19937")
         rng = std::make_shared<RandomGenerator>();
+    else if (ic_random_generator == "PHILOX")
+        rng = std::make_shared<PhiloxRandomGenerator>();
     else
         throw std::runtime_error("Unknown random generator " + ic_random_generator);
     rng->set_seed(ic_random_seed);
@@ -1172,11 +1211,23 @@ void NBodySimulation<NDIM, T>::init() {
 template <int NDIM, class T>
 void NBodySimulation<NDIM, T>::run() {
     timer.StartTiming("Timestepping");
+#ifdef PROFILING
+    FML::UTILS::Profiler::get().enter("NBodySimulation::run");
+#endif
 
     // Number of extra slices we need for density assignement
     const auto nleftright =
         FML::INTERPOLATION::get_extra_slices_needed_for_density_assignment(force_density_assignment_method);
 
+    //================================================================
+    // Neutrino particles are created from the linear neutrino field so we need the transfer functions
+    //================================================================
+    if (neutrino_particles) {
+        FML::assert_mpi(cosmo->get_OmegaMNu() > 0.0 and transferdata,
+                        "Neutrino particles requires OmegaMNu > 0 and transfer functions (ic_type_of_input)");
+    }
+    const double a_neutrino_switch = neutrino_particles ? 1.0 / (1.0 + neutrino_particles_switch_redshift) : 1.0;
+
     //================================================================
     // Check that the first output redshift is not larger than the initial redshift
     //================================================================
@@ -1262,6 +1313,10 @@ void NBodySimulation<NDIM, T>::run() {
         //=============================================================
         if (timestep_nsteps[ioutput] > 0)
             for (int istep = 0; istep <= timestep_nsteps[ioutput]; istep++) {
+                FML_PROFILE_SCOPE("Timestep");
+#ifdef MEMORY_LOGGING
+                FML::MemoryLog::get()->set_region("Step " + std::to_string(istep_total));
+#endif
 
                 const double apos = asteps.first[istep];
                 const double avel = asteps.second[istep];
@@ -1289,6 +1344,7 @@ void NBodySimulation<NDIM, T>::run() {
                 // Compute total density field
                 FFTWGrid<NDIM> density_grid_fourier(force_nmesh, nleftright.first, nleftright.second);
                 if (delta_time_kick != 0.0) {
+                    FML_PROFILE_SCOPE("ComputeDensityField");
                     timer.StartTiming("ComputeDensityField");
                     compute_density_field_fourier(density_grid_fourier, apos);
                     timer.EndTiming("ComputeDensityField");
@@ -1297,6 +1353,7 @@ void NBodySimulation<NDIM, T>::run() {
                 // Compute forces
                 std::array<FFTWGrid<NDIM>, NDIM> force_real;
                 if (delta_time_kick != 0.0) {
+                    FML_PROFILE_SCOPE("ComputeForce");
                     timer.StartTiming("ComputeForce");
                     grav->compute_force(apos,
                                         grav->H0_hmpc * simulation_boxsize,
@@ -1306,15 +1363,29 @@ void NBodySimulation<NDIM, T>::run() {
                     timer.EndTiming("ComputeForce");
                 }
 
+                // Switch from linear massive neutrinos to particles. The force above used the linear neutrinos
+                const bool create_neutrinos = neutrino_particles and part_nu.get_npart_total() == 0;
+                if (create_neutrinos and delta_time_kick != 0.0 and apos >= a_neutrino_switch) {
+                    FML_PROFILE_SCOPE("CreateNeutrinoParticles");
+                    timer.StartTiming("CreateNeutrinoParticles");
+                    create_neutrino_particles_from_linear(apos, avel);
+                    timer.EndTiming("CreateNeutrinoParticles");
+                }
+
                 // Kick particles (updates velocity)
                 if (delta_time_kick != 0.0) {
+                    FML_PROFILE_SCOPE("Kick");
                     timer.StartTiming("Kick");
                     FML::NBODY::KickParticles<NDIM>(force_real, part, delta_time_kick, force_density_assignment_method);
+                    if (part_nu.get_npart_total() > 0)
+                        FML::NBODY::KickParticles<NDIM>(
+                            force_real, part_nu, delta_time_kick, force_density_assignment_method);
                     timer.EndTiming("Kick");
                 }
 
                 // For COLA we can do the kick and drift at the same time
                 if (simulation_use_cola) {
+                    FML_PROFILE_SCOPE("COLA");
                     timer.StartTiming("COLA");
                     // If the growth factors are scaledependent then we use the scaledependent version
                     // unless simulation_use_scaledependent_cola is set to false
@@ -1340,13 +1411,18 @@ void NBodySimulation<NDIM, T>::run() {
 
                 // Drift particles (updates positions)
                 if (delta_time_drift != 0.0) {
+                    FML_PROFILE_SCOPE("Drift");
                     timer.StartTiming("Drift");
                     FML::NBODY::DriftParticles<NDIM, T>(part, delta_time_drift);
+                    if (part_nu.get_npart_total() > 0)
+                        FML::NBODY::DriftParticles<NDIM, NeutrinoParticle<NDIM>>(part_nu, delta_time_drift);
                     timer.EndTiming("Drift");
                 }
 
                 // Show info about particles
                 part.info();
+                if (part_nu.get_npart_total() > 0)
+                    part_nu.info();
 
                 // Show info about system memory use
                 FML::print_system_memory_use();
@@ -1355,6 +1431,9 @@ void NBodySimulation<NDIM, T>::run() {
         //=============================================================
         // Analyze data and output
         //=============================================================
+#ifdef MEMORY_LOGGING
+        FML::MemoryLog::get()->set_region("Output " + std::to_string(ioutput));
+#endif
         analyze_and_output(ioutput, output_redshifts[ioutput]);
     }
     timer.EndTiming("Timestepping");
@@ -1363,13 +1442,19 @@ void NBodySimulation<NDIM, T>::run() {
     // Print all timings
     //=============================================================
     timer.EndTiming("The whole simulation");
-    if (FML::ThisTask == 0) {
-        timer.PrintAllTimings();
-    }
+    timer.PrintAllTimingsAllTasks();
+
+#ifdef PROFILING
+    // Print min/mean/max over tasks for all regions and output a trace that can be viewed in ui.perfetto.dev
+    FML::UTILS::Profiler::get().exit();
+    FML::UTILS::Profiler::get().print_summary();
+    FML::UTILS::Profiler::get().write_chrome_trace(output_folder + "/trace_" + simulation_name + ".json");
+#endif
 
 #ifdef MEMORY_LOGGING
-    // Simulation is over, output the memory usage (of what we log)
+    // Simulation is over, output the memory usage (of what we log) and the memory as function of time
     FML::MemoryLog::get()->print();
+    FML::MemoryLog::get()->write_timeline(output_folder + "/memory_timeline_" + simulation_name + ".txt");
 #endif
 }
 
@@ -1389,6 +1474,50 @@ void NBodySimulation<NDIM, T>::compute_density_field_fourier(FFTWGrid<NDIM> & de
                                           density_grid_fourier,
                                           force_density_assignment_method);
 
+    //=============================================================
+    // Once we have neutrino particles they replace the linear neutrinos
+    // They are binned to their own (coarser) grid and added to the
+    // density field in real space. We only bin up P(k) for the total
+    // density and the neutrinos here (not for baryons+CDM)
+    //=============================================================
+    const double redshift = 1.0 / a - 1.0;
+    if (part_nu.get_npart_total() > 0) {
+        if (FML::ThisTask == 0) {
+            std::cout << "Adding neutrino particles to the densityfield\n";
+        }
+
+        // We need (at least) one extra slice on the right to interpolate to the force grid
+        const auto nleftright =
+            FML::INTERPOLATION::get_extra_slices_needed_for_density_assignment(force_density_assignment_method);
+        FFTWGrid<NDIM> density_nu(neutrino_particles_nmesh, nleftright.first, std::max(nleftright.second, 1));
+        density_nu.add_memory_label("density_nu(x)");
+        FML::INTERPOLATION::particles_to_grid(part_nu.get_particles_ptr(),
+                                              part_nu.get_npart(),
+                                              part_nu.get_npart_total(),
+                                              density_nu,
+                                              force_density_assignment_method);
+
+        const double fMNu = cosmo->get_OmegaMNu() / cosmo->get_OmegaM();
+        add_neutrino_density_to_grid<NDIM>(density_nu, density_grid_fourier, fMNu);
+        density_grid_fourier.fftw_r2c();
+        density_nu.fftw_r2c();
+
+        PowerSpectrumBinning<NDIM> pofk_total(density_grid_fourier.get_nmesh() / 2);
+        pofk_total.subtract_shotnoise = false;
+        FML::CORRELATIONFUNCTIONS::bin_up_deconvolved_power_spectrum(
+            density_grid_fourier, pofk_total, force_density_assignment_method);
+        pofk_total.scale(simulation_boxsize);
+        pofk_total_every_step.push_back({redshift, pofk_total});
+
+        PowerSpectrumBinning<NDIM> pofk_nu(density_nu.get_nmesh() / 2);
+        pofk_nu.subtract_shotnoise = false;
+        FML::CORRELATIONFUNCTIONS::bin_up_deconvolved_power_spectrum(
+            density_nu, pofk_nu, force_density_assignment_method);
+        pofk_nu.scale(simulation_boxsize);
+        pofk_nu_every_step.push_back({redshift, pofk_nu});
+        return;
+    }
+
     //=============================================================
     // Fourier transform
     //=============================================================
@@ -1397,7 +1526,6 @@ void NBodySimulation<NDIM, T>::compute_density_field_fourier(FFTWGrid<NDIM> & de
     //=============================================================
     // Bin up power-spectrum (its basically free as we have the density field)
     //=============================================================
-    const double redshift = 1.0 / a - 1.0;
     PowerSpectrumBinning<NDIM> pofk_particles(density_grid_fourier.get_nmesh() / 2);
     pofk_particles.subtract_shotnoise = false;
     FML::CORRELATIONFUNCTIONS::bin_up_deconvolved_power_spectrum(
@@ -1409,8 +1537,10 @@ void NBodySimulation<NDIM, T>::compute_density_field_fourier(FFTWGrid<NDIM> & de
     // Add on contribution from massive neutrinos, radiation etc.
     // We need to have transfer functions for what follows and for that we
     // check [transferdata] which is created if "transferinfofile" is used
+    // With neutrino particles we use linear theory until we create them
     //=============================================================
-    if (force_linear_massive_neutrinos and cosmo->get_OmegaMNu() > 0.0 and transferdata) {
+    const bool linear_neutrinos = force_linear_massive_neutrinos or neutrino_particles;
+    if (linear_neutrinos and cosmo->get_OmegaMNu() > 0.0 and transferdata) {
 
         // First step we store the initial  density field
         if (not initial_density_field_fourier) {
@@ -1471,8 +1601,65 @@ void NBodySimulation<NDIM, T>::compute_density_field_fourier(FFTWGrid<NDIM> & de
     }
 }
 
+template <int NDIM, class T>
+void NBodySimulation<NDIM, T>::create_neutrino_particles_from_linear(double apos, double avel) {
+
+    if (FML::ThisTask == 0) {
+        std::cout << "\n";
+        std::cout << "#=====================================================\n";
+        std::cout << "# Creating neutrino particles at z = " << 1.0 / apos - 1.0 << "\n";
+        std::cout << "#=====================================================\n";
+    }
+    FML::assert_mpi(bool(initial_density_field_fourier),
+                    "[create_neutrino_particles_from_linear] The initial density field has not been stored");
+
+    //=============================================================
+    // The 1LPT potential of delta_cb(zini). We get the neutrino displacement and bulk velocity
+    // from this using the transfer functions. After this we no longer need the initial density field
+    //=============================================================
+    FFTWGrid<NDIM> phi_fourier;
+    FML::COSMOLOGY::LPT::compute_1LPT_potential_fourier(initial_density_field_fourier, phi_fourier);
+    initial_density_field_fourier.free();
+
+    const double aini = 1.0 / (1.0 + ic_initial_redshift);
+    const double koverkBox = 1.0 / simulation_boxsize;
+    auto displacement_factor = [&](double kBox) {
+        const double k = kBox * koverkBox;
+        return transferdata->get_massive_neutrino_transfer_function(k, apos) /
+               transferdata->get_cdm_baryon_transfer_function(k, aini);
+    };
+    const double vfac = avel * avel * cosmo->HoverH0_of_a(avel);
+    auto velocity_factor = [&](double kBox) {
+        const double k = kBox * koverkBox;
+        return vfac * transferdata->get_massive_neutrino_growth_rate(k, avel) *
+               transferdata->get_massive_neutrino_transfer_function(k, avel) /
+               transferdata->get_cdm_baryon_transfer_function(k, aini);
+    };
+
+    // Code velocities are a * v / (H0 B) with v in km/s, H0 = 100 km/s/(Mpc/h) and B the boxsize in Mpc/h
+    auto thermal_velocity = [&](double q) {
+        return cosmo->get_neutrino_velocity_kms(q, avel) * avel / (100.0 * simulation_boxsize);
+    };
+
+    // Random shift of the low-discrepancy sequence (its own stream so it does not correlate with the IC)
+    std::array<double, NDIM> shift;
+    FML::RANDOM::PhiloxRandomGenerator(ic_random_seed).fill_uniform(0, shift.data(), NDIM, 2);
+
+    create_neutrino_particles<NDIM>(part_nu,
+                                    neutrino_particles_Npart_1D,
+                                    particle_allocation_factor,
+                                    phi_fourier,
+                                    displacement_factor,
+                                    velocity_factor,
+                                    thermal_velocity,
+                                    shift,
+                                    force_density_assignment_method);
+    part_nu.info();
+}
+
 template <int NDIM, class T>
 void NBodySimulation<NDIM, T>::analyze_and_output(int ioutput, double redshift) {
+    FML_PROFILE_SCOPE("AnalyzeAndOutput");
 
     std::stringstream stream;
     stream << std::fixed << std::setprecision(3) << redshift;
@@ -1531,7 +1718,7 @@ void NBodySimulation<NDIM, T>::analyze_and_output(int ioutput, double redshift)
     // Every step we (might) have computed Pcb(k) and possibly Ptotal(k)
     // and stored this. Output these to file
     //=============================================================
-    if (pofk_cb_every_step.size() > 0 or pofk_total_every_step.size() > 0) {
+    if (pofk_cb_every_step.size() > 0 or pofk_total_every_step.size() > 0 or pofk_nu_every_step.size() > 0) {
         output_pofk_for_every_step(*this);
     }
 
@@ -1597,6 +1784,7 @@ void NBodySimulation<NDIM, T>::analyze_and_output(int ioutput, double redshift)
 template <int NDIM, class T>
 void NBodySimulation<NDIM, T>::free() {
     part.free();
+    part_nu.free();
     initial_density_field_fourier.free();
     phi_1LPT_ini_fourier.free();
     phi_2LPT_ini_fourier.free();
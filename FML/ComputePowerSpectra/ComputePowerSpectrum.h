@@ -15,7 +15,9 @@
 #endif
 
 #include <FML/FFTWGrid/FFTWGrid.h>
+#include <FML/FFTWGrid/OutOfCoreGrid.h>
 #include <FML/Global/Global.h>
+#include <FML/Global/ThreadHistogram.h>
 #include <FML/Interpolation/ParticleGridInterpolation.h>
 #include <FML/LPT/Reconstruction.h>        // For particles->redshiftspace
 #include <FML/MPIParticles/MPIParticles.h> // Only for compute_multipoles from particles
@@ -37,6 +39,8 @@ namespace FML {
 
         template <int N>
         using FFTWGrid = FML::GRID::FFTWGrid<N>;
+        template <int N>
+        using OutOfCoreGrid = FML::GRID::OutOfCoreGrid<N>;
 
         //================================================================================
         // Keep track of everything we need for a binned power-spectrum
@@ -119,6 +123,96 @@ namespace FML {
                                                      size_t NumPart,
                                                      PowerSpectrumBinning<N> & pofk);
 
+        /// @brief Index of the (auto or cross) spectrum of tracer i and j in the result of the multi-tracer methods
+        /// below. The \f$ M(M+1)/2 \f$ spectra of M tracers are stored as (0,0),(0,1),...,(0,M-1),(1,1),(1,2),...
+        inline int get_tracer_pair_index(int i, int j, int ntracers) {
+            if (i > j)
+                std::swap(i, j);
+            return i * ntracers - (i * (i - 1)) / 2 + (j - i);
+        }
+
+        //==========================================================================================
+        /// @brief Bin up all the \f$ M(M+1)/2 \f$ auto and cross power-spectra of M fourier grids (and optionally
+        /// their multipoles) in a single sweep over fourier space. This is much faster than calling
+        /// bin_up_cross_power_spectrum for each pair as we only loop over the grids once and only compute the
+        /// wavevectors once. The result has no scales. Get scales by calling scale(boxsize) on each of the binnings.
+        /// The method assumes the grids are fourier transforms of real grids and we only bin up the real part of
+        /// \f$ f_i(k)f_j^*(k) \f$.
+        ///
+        /// @tparam N Dimension of the grid
+        ///
+        /// @param[in] fourier_grids The M grids in fourier space (all with the same Nmesh).
+        /// @param[out] Pell Vector of size \f$ M(M+1)/2 \f$ (see get_tracer_pair_index). Each element is a vector of
+        /// binnings that has the size of the maximum ell to compute plus one. All binnings has to have nbins, kmin and
+        /// kmax set. At the end Pell[ pair ][ ell ] is a binning of \f$ P_\ell(k) \f$ for the given pair.
+        /// @param[in] line_of_sight_direction The line of sight direction for the multipoles, e.g. \f$ (0,0,1) \f$.
+        /// If empty then we only compute the power-spectrum, i.e. Pell[ pair ] must have size 1.
+        ///
+        //==========================================================================================
+        template <int N>
+        void bin_up_multi_tracer_power_spectra(const std::vector<FFTWGrid<N>> & fourier_grids,
+                                               std::vector<std::vector<PowerSpectrumBinning<N>>> & Pell,
+                                               std::vector<double> line_of_sight_direction = {});
+
+        //==========================================================================================
+        /// @brief All the auto and cross power-spectra of M sets of particles (tracers). Each tracer is assigned to
+        /// a grid and fourier transformed only once (M grids are allocated at the same time) and then all the
+        /// \f$ M(M+1)/2 \f$ spectra are binned up in a single sweep (see bin_up_multi_tracer_power_spectra).
+        /// The shot-noise \f$ 1/{\rm NumPartTotal} \f$ is subtracted from the auto spectra if subtract_shotnoise is
+        /// set. We assume the tracers are different particles so the cross spectra has no shot-noise. Note that with
+        /// interlacing we change the particle positions, but when returning they should be in the same state as when we
+        /// started.
+        ///
+        /// @tparam N The dimension of the particles.
+        /// @tparam T The particle class. Must have a get_pos() method.
+        ///
+        /// @param[in] Ngrid Size of the grid to use.
+        /// @param[in] parts Pointer to the first particle of each tracer.
+        /// @param[in] NumParts Number of particles of each tracer on the local task.
+        /// @param[in] NumPartTotals Total number of particles of each tracer on all tasks.
+        /// @param[out] pofk Vector of size \f$ M(M+1)/2 \f$ (see get_tracer_pair_index) of binnings. We required it to
+        /// be initialized with the number of bins, kmin and kmax.
+        /// @param[in] density_assignment_method The density assignment method (NGP, CIC, TSC, PCS or PQS)
+        /// @param[in] interlacing Use interlaced grids for alias reduction.
+        ///
+        //==========================================================================================
+        template <int N, class T>
+        void compute_multi_tracer_power_spectra(int Ngrid,
+                                                std::vector<T *> parts,
+                                                std::vector<size_t> NumParts,
+                                                std::vector<size_t> NumPartTotals,
+                                                std::vector<PowerSpectrumBinning<N>> & pofk,
+                                                std::string density_assignment_method,
+                                                bool interlacing);
+
+        //==========================================================================================
+        /// @brief All the auto and cross power-spectrum multipoles of M sets of particles (tracers) in redshift
+        /// space. As for compute_power_spectrum_multipoles we put the particles in redshift space along each of the
+        /// coordinate axes and take the mean. For each axis every tracer is assigned to a grid and fourier transformed
+        /// once and all the spectra are binned up in a single sweep. The shot-noise is subtracted from the monopole
+        /// of the auto spectra if subtract_shotnoise is set.
+        ///
+        /// @tparam N The dimension of the particles.
+        /// @tparam T The particle class. Must have a get_pos() and a get_vel() method.
+        ///
+        /// @param[in] Ngrid Size of the grid to use.
+        /// @param[in] tracers The particles of each tracer.
+        /// @param[in] velocity_to_displacement Factor to convert a velocity to a displacement (see
+        /// compute_power_spectrum_multipoles).
+        /// @param[out] Pell Vector of size \f$ M(M+1)/2 \f$ (see get_tracer_pair_index). Each element is a vector of
+        /// binnings that has the size of the maximum ell to compute plus one.
+        /// @param[in] density_assignment_method The density assignment method (NGP, CIC, TSC, PCS or PQS) to use.
+        /// @param[in] interlacing Use interlaced grids for alias reduction when computing the density field
+        ///
+        //==========================================================================================
+        template <int N, class T>
+        void compute_multi_tracer_power_spectrum_multipoles(int Ngrid,
+                                                            std::vector<FML::PARTICLE::MPIParticles<T> *> tracers,
+                                                            double velocity_to_displacement,
+                                                            std::vector<std::vector<PowerSpectrumBinning<N>>> & Pell,
+                                                            std::string density_assignment_method,
+                                                            bool interlacing);
+
         //==========================================================================================
         /// @brief Compute the power-spectrum of a fourier grid. The result has no scales. Get
         /// scales by calling pofk.scale(boxsize) which does \f$ k \to k/B \f$ and
@@ -134,6 +228,19 @@ namespace FML {
         template <int N>
         void bin_up_power_spectrum(const FFTWGrid<N> & fourier_grid, PowerSpectrumBinning<N> & pofk);
 
+        //==========================================================================================
+        /// @brief Compute the power-spectrum of an out-of-core fourier grid by streaming it from disk.
+        /// Same as for FFTWGrid, but the grid is local to this task so there is no summation over tasks.
+        ///
+        /// @tparam N Dimension of the grid
+        ///
+        /// @param[in] fourier_grid Grid in fourier space
+        /// @param[out] pofk Binned power-spectrum
+        ///
+        //==========================================================================================
+        template <int N>
+        void bin_up_power_spectrum(OutOfCoreGrid<N> & fourier_grid, PowerSpectrumBinning<N> & pofk);
+
         //==========================================================================================
         /// @brief Compute the power-spectrum of a fourier grid. The result has no scales. Get
         /// scales by calling pofk.scale(boxsize) which does \f$ k \to k/B \f$ and
@@ -222,6 +329,53 @@ namespace FML {
                                                std::string density_assignment_method,
                                                bool interlacing);
 
+        //================================================================================
+        /// @brief Power-spectrum multipoles for survey data (galaxies + randoms) with a local line of sight
+        /// (the Yamamoto estimator). We use the FFT decomposition of Bianchi et al. 2015 and Scoccimarro 2015 so the
+        /// cost is \f$ 1 + N(N+1)/2 \f$ fourier transforms for the quadrupole and 15 more for the hexadecapole (in
+        /// 3D). Only 3 grids are allocated at the same time. Only the even multipoles up to \f$ \ell = 4 \f$ are
+        /// computed, the odd ones are set to zero.
+        ///
+        /// The weight of each object is the product of its get_weight() (if it exists, e.g. systematic weights) and
+        /// the FKP weight \f$ 1/(1 + \bar{n}P_0) \f$ where \f$ \bar{n} \f$ is estimated from the randoms. The
+        /// normalization is \f$ I_{22} = \alpha\sum_{\rm randoms} \bar{n}w^2 \f$ and the shot-noise
+        /// \f$ (\sum_{\rm galaxies} w^2 + \alpha^2\sum_{\rm randoms} w^2) / I_{22} \f$ is subtracted from the monopole
+        /// if Pell[0].subtract_shotnoise is true.
+        ///
+        /// The positions must be in \f$ [0,1) \f$ (see GalaxiesRandomsToBox) and the box should be large enough
+        /// to avoid aliasing of the survey over the periodic boundary. The result has no scales. Get scales by calling
+        /// scale(boxsize) on each of the binnings.
+        ///
+        /// @tparam N The dimension of the particles.
+        /// @tparam T The galaxy class. Must have a get_pos() method.
+        /// @tparam U The random class. Must have a get_pos() method.
+        ///
+        /// @param[in] Ngrid Size of the grid to use.
+        /// @param[in] galaxies Pointer to the first galaxy.
+        /// @param[in] ngalaxies Number of galaxies on the local task.
+        /// @param[in] randoms Pointer to the first random.
+        /// @param[in] nrandoms Number of randoms on the local task.
+        /// @param[in] observer_position The position of the observer (in the same units as the positions).
+        /// @param[in] P0_FKP The \f$ P_0 \f$ in the FKP weights in units of the boxsize, i.e. \f$ P_0/B^N \f$. Use 0
+        /// to not use FKP weights.
+        /// @param[out] Pell Vector of power-spectrum binnings. The size of Pell is the maximum ell to compute plus one.
+        /// All binnings has to have nbins, kmin and kmax set. At the end Pell[ ell ] is a binning of P_ell(k).
+        /// @param[in] density_assignment_method The density assignment method (NGP, CIC, TSC, PCS or PQS) to use.
+        /// @param[in] interlacing Use interlaced grids for alias reduction when computing the density field
+        ///
+        //================================================================================
+        template <int N, class T, class U>
+        void compute_power_spectrum_multipoles_survey(int Ngrid,
+                                                      const T * galaxies,
+                                                      size_t ngalaxies,
+                                                      const U * randoms,
+                                                      size_t nrandoms,
+                                                      std::vector<double> observer_position,
+                                                      double P0_FKP,
+                                                      std::vector<PowerSpectrumBinning<N>> & Pell,
+                                                      std::string density_assignment_method,
+                                                      bool interlacing);
+
         //================================================================================
         /// @brief Computes the polyspectrum \f$ P(k_1,k_2,\ldots,k_{\rm ORDER}) = \left<\delta(k_1)\cdots\delta(k_{\rm
         /// ORDER})\right> \f$ from particles. Note that with interlacing we change the particle positions, but when
@@ -414,6 +568,44 @@ namespace FML {
         //=====================================================================
         //=====================================================================
 
+        // Pell[ell] contains <mu^ell |delta|^2> for even ell (and nothing for odd ell). Transform this to
+        // (2ell+1) <L_ell(mu) |delta|^2>, i.e. the multipoles P_ell
+        template <int N>
+        void mu_moments_to_multipoles(std::vector<PowerSpectrumBinning<N>> & Pell) {
+
+            // Binomial coefficient
+            auto binomial = [](int n, int k) -> double {
+                double res = 1.0;
+                for (int i = 0; i < k; i++) {
+                    res *= double(n - i) / double(k - i);
+                }
+                return res;
+            };
+
+            // P_ell(x) = Sum_{k=0}^{ell/2} summand_legendre_polynomial * x^(ell - 2k)
+            auto summand_legendre_polynomial = [&](int k, int ell) -> double {
+                double sign = (k % 2) == 0 ? 1.0 : -1.0;
+                return sign * binomial(ell, k) * binomial(2 * ell - 2 * k, ell) / std::pow(2.0, ell);
+            };
+
+            // Go from <mu^k |delta|^2> to (2ell+1) <L_ell(mu) |delta|^2>
+            std::vector<std::vector<double>> temp;
+            for (int ell = 0; ell < int(Pell.size()); ell++) {
+                std::vector<double> sum(Pell[0].pofk.size(), 0.0);
+                for (int k = 0; k <= ell / 2; k++) {
+                    std::vector<double> & mu_power = Pell[ell - 2 * k].pofk;
+                    for (size_t i = 0; i < sum.size(); i++)
+                        sum[i] += mu_power[i] * summand_legendre_polynomial(k, ell) * double(2 * ell + 1);
+                }
+                temp.push_back(sum);
+            }
+
+            // Copy over data. We now have P0,P1,... in Pell
+            for (size_t ell = 0; ell < Pell.size(); ell++) {
+                Pell[ell].pofk = temp[ell];
+            }
+        }
+
         //==========================================================================================
         // Compute the power-spectrum multipoles of a fourier grid assuming a fixed line of sight
         // direction (typically coordinate axes). Provide Pell with [ell+1] initialized binnings to compute
@@ -434,8 +626,6 @@ namespace FML {
                        "[compute_power_spectrum_multipoles_fourier] grid must have Nmesh > 0\n");
 
             int Nmesh = fourier_grid.get_nmesh();
-            auto Local_nx = fourier_grid.get_local_nx();
-            auto Local_x_start = fourier_grid.get_local_x_start();
 
             // Norm of LOS vector
             double rmag = 0.0;
@@ -449,23 +639,17 @@ namespace FML {
             for (size_t ell = 0; ell < Pell.size(); ell++)
                 Pell[ell].reset();
 
-                // Bin up mu^k |delta|^2
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-            for (int islice = 0; islice < Local_nx; islice++) {
-                [[maybe_unused]] double kmag;
-                [[maybe_unused]] std::array<double, N> kvec;
-                for (auto && fourier_index : fourier_grid.get_fourier_range(islice, islice + 1)) {
-                    if (Local_x_start == 0 and fourier_index == 0)
-                        continue; // DC mode( k=0)
+            // Bin up mu^k |delta|^2
+            fourier_grid.for_each_fourier(
+                [&](IndexIntType fourier_index, const std::array<double, N> & kvec, double kmag2, int last_coord) {
+                    if (kmag2 == 0.0)
+                        return; // DC mode( k=0)
 
                     // Special treatment of k = 0 plane
-                    auto last_coord = fourier_index % (Nmesh / 2 + 1);
                     double weight = last_coord > 0 and last_coord < Nmesh / 2 ? 2.0 : 1.0;
 
-                    // Compute kvec, |kvec| and |delta|^2
-                    fourier_grid.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
+                    // Compute |kvec| and |delta|^2
+                    const double kmag = std::sqrt(kmag2);
                     auto delta = fourier_grid.get_fourier_from_index(fourier_index);
                     double power = std::norm(delta);
 
@@ -482,52 +666,14 @@ namespace FML {
                         Pell[ell].add_to_bin(kmag, power * mutotwoell, weight);
                         mutotwoell *= mu2;
                     }
-                }
-            }
+                });
 
-#ifdef USE_MPI
-            for (size_t ell = 0; ell < Pell.size(); ell++) {
-                MPI_Allreduce(MPI_IN_PLACE, Pell[ell].pofk.data(), Pell[ell].n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-                MPI_Allreduce(MPI_IN_PLACE, Pell[ell].count.data(), Pell[ell].n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-                MPI_Allreduce(MPI_IN_PLACE, Pell[ell].kbin.data(), Pell[ell].n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-            }
-#endif
-
-            // Normalize
+            // Normalize (this also sums over threads and tasks)
             for (size_t ell = 0; ell < Pell.size(); ell++)
                 Pell[ell].normalize();
 
-            // Binomial coefficient
-            auto binomial = [](int n, int k) -> double {
-                double res = 1.0;
-                for (int i = 0; i < k; i++) {
-                    res *= double(n - i) / double(k - i);
-                }
-                return res;
-            };
-
-            // P_ell(x) = Sum_{k=0}^{ell/2} summand_legendre_polynomial * x^(ell - 2k)
-            auto summand_legendre_polynomial = [&](int k, int ell) -> double {
-                double sign = (k % 2) == 0 ? 1.0 : -1.0;
-                return sign * binomial(ell, k) * binomial(2 * ell - 2 * k, ell) / std::pow(2.0, ell);
-            };
-
-            // Go from <mu^k |delta|^2> to (2ell+1) <L_ell(mu) |delta|^2>
-            std::vector<std::vector<double>> temp;
-            for (int ell = 0; ell < int(Pell.size()); ell++) {
-                std::vector<double> sum(Pell[0].pofk.size(), 0.0);
-                for (int k = 0; k <= ell / 2; k++) {
-                    std::vector<double> & mu_power = Pell[ell - 2 * k].pofk;
-                    for (size_t i = 0; i < sum.size(); i++)
-                        sum[i] += mu_power[i] * summand_legendre_polynomial(k, ell) * double(2 * ell + 1);
-                }
-                temp.push_back(sum);
-            }
-
-            // Copy over data. We now have P0,P1,... in Pell
-            for (size_t ell = 0; ell < Pell.size(); ell++) {
-                Pell[ell].pofk = temp[ell];
-            }
+            // Go from <mu^2k |delta|^2> to P_ell
+            mu_moments_to_multipoles(Pell);
         }
 
         template <int N>
@@ -540,41 +686,28 @@ namespace FML {
                        "[bin_up_deconvolved_power_spectrum] Binning has inconsistent parameters\n");
 
             const auto Nmesh = fourier_grid.get_nmesh();
-            const auto Local_nx = fourier_grid.get_local_nx();
-            const auto Local_x_start = fourier_grid.get_local_x_start();
             const auto window_function = FML::INTERPOLATION::get_window_function<N>(density_assignment_method, Nmesh);
 
             // Initialize binning just in case
             pofk.reset();
 
             // Bin up P(k)
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-            for (int islice = 0; islice < Local_nx; islice++) {
-                [[maybe_unused]] double kmag;
-                [[maybe_unused]] std::array<double, N> kvec;
-                for (auto && fourier_index : fourier_grid.get_fourier_range(islice, islice + 1)) {
-                    if (Local_x_start == 0 and fourier_index == 0)
-                        continue; // DC mode( k=0)
+            fourier_grid.for_each_fourier(
+                [&](IndexIntType fourier_index, std::array<double, N> kvec, double kmag2, int last_coord) {
+                    if (kmag2 == 0.0)
+                        return; // DC mode( k=0)
 
-                    // Special treatment of k = 0 plane (Safer way: fetch coord)
-                    // auto coord = fourier_grid.get_fourier_coord_from_index(fourier_index);
-                    // int last_coord = coord[N-1];
-                    auto last_coord = fourier_index % (Nmesh / 2 + 1);
+                    // Special treatment of k = 0 plane
                     double weight = last_coord > 0 && last_coord < Nmesh / 2 ? 2.0 : 1.0;
 
-                    fourier_grid.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
-
                     auto delta = fourier_grid.get_fourier_from_index(fourier_index);
                     auto delta_norm = std::norm(delta);
                     auto window = window_function(kvec);
                     delta_norm /= (window * window);
 
                     // Add norm to bin
-                    pofk.add_to_bin(kmag, delta_norm, weight);
-                }
-            }
+                    pofk.add_to_bin(std::sqrt(kmag2), delta_norm, weight);
+                });
 
             // Normalize to get P(k) (this communicates over tasks)
             pofk.normalize();
@@ -589,42 +722,66 @@ namespace FML {
                        "[bin_up_power_spectrum] Binning has inconsistent parameters\n");
 
             const auto Nmesh = fourier_grid.get_nmesh();
-            const auto Local_nx = fourier_grid.get_local_nx();
-            const auto Local_x_start = fourier_grid.get_local_x_start();
 
             // Initialize binning just in case
             pofk.reset();
 
             // Bin up P(k)
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-            for (int islice = 0; islice < Local_nx; islice++) {
-                [[maybe_unused]] double kmag;
-                [[maybe_unused]] std::array<double, N> kvec;
-                for (auto && fourier_index : fourier_grid.get_fourier_range(islice, islice + 1)) {
-                    if (Local_x_start == 0 and fourier_index == 0)
-                        continue; // DC mode( k=0)
+            fourier_grid.for_each_fourier([&](IndexIntType fourier_index,
+                                              [[maybe_unused]] const std::array<double, N> & kvec,
+                                              double kmag2,
+                                              int last_coord) {
+                if (kmag2 == 0.0)
+                    return; // DC mode( k=0)
 
-                    // Special treatment of k = 0 plane (Safer way: fetch coord)
-                    // auto coord = fourier_grid.get_fourier_coord_from_index(fourier_index);
-                    // int last_coord = coord[N-1];
-                    auto last_coord = fourier_index % (Nmesh / 2 + 1);
-                    double weight = last_coord > 0 && last_coord < Nmesh / 2 ? 2.0 : 1.0;
+                // Special treatment of k = 0 plane
+                double weight = last_coord > 0 && last_coord < Nmesh / 2 ? 2.0 : 1.0;
 
-                    auto delta = fourier_grid.get_fourier_from_index(fourier_index);
-                    auto delta_norm = std::norm(delta);
+                auto delta = fourier_grid.get_fourier_from_index(fourier_index);
+                auto delta_norm = std::norm(delta);
 
-                    // Add norm to bin
-                    fourier_grid.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
-                    pofk.add_to_bin(kmag, delta_norm, weight);
-                }
-            }
+                // Add norm to bin
+                pofk.add_to_bin(std::sqrt(kmag2), delta_norm, weight);
+            });
 
             // Normalize to get P(k) (this communicates over tasks)
             pofk.normalize();
         }
 
+        // Bin up the power-spectrum of an out-of-core fourier grid
+        template <int N>
+        void bin_up_power_spectrum(OutOfCoreGrid<N> & fourier_grid, PowerSpectrumBinning<N> & pofk) {
+
+            assert_mpi(fourier_grid.get_nmesh() > 0, "[bin_up_power_spectrum] grid must have Nmesh > 0\n");
+            assert_mpi(pofk.n > 0 && pofk.kmax > pofk.kmin && pofk.kmin >= 0.0,
+                       "[bin_up_power_spectrum] Binning has inconsistent parameters\n");
+
+            const auto Nmesh = fourier_grid.get_nmesh();
+
+            // Initialize binning just in case
+            pofk.reset();
+
+            // Bin up P(k) streaming the grid from disk (read only)
+            fourier_grid.for_each_fourier(
+                [&](const FML::GRID::ComplexType & delta,
+                    [[maybe_unused]] const std::array<double, N> & kvec,
+                    double kmag2,
+                    int last_coord) {
+                    if (kmag2 == 0.0)
+                        return; // DC mode( k=0)
+
+                    // Special treatment of k = 0 plane
+                    double weight = last_coord > 0 && last_coord < Nmesh / 2 ? 2.0 : 1.0;
+
+                    // Add norm to bin
+                    pofk.add_to_bin(std::sqrt(kmag2), std::norm(delta), weight);
+                },
+                false);
+
+            // Normalize to get P(k) (only over threads as the grid is local to this task)
+            pofk.normalize(false);
+        }
+
         // Bin up the cross power-spectrum of a given fourier grids
         template <int N>
         void bin_up_cross_power_spectrum(FFTWGrid<N> & fourier_grid_1,
@@ -638,8 +795,6 @@ namespace FML {
                        "[bin_up_cross_power_spectrum] Binning has inconsistent parameters\n");
 
             const auto Nmesh = fourier_grid_1.get_nmesh();
-            const auto Local_nx = fourier_grid_1.get_local_nx();
-            const auto Local_x_start = fourier_grid_1.get_local_x_start();
 
             // Initialize binning just in case
             pofk.reset();
@@ -649,52 +804,292 @@ namespace FML {
             pofk_imag.reset();
 
             // Bin up P(k)
+            fourier_grid_1.for_each_fourier([&](IndexIntType fourier_index,
+                                                [[maybe_unused]] const std::array<double, N> & kvec,
+                                                double kmag2,
+                                                int last_coord) {
+                if (kmag2 == 0.0)
+                    return; // DC mode( k=0)
+
+                // Special treatment of k = 0 plane
+                double weight = last_coord > 0 && last_coord < Nmesh / 2 ? 2.0 : 1.0;
+
+                auto delta_1 = fourier_grid_1.get_fourier_from_index(fourier_index);
+                auto delta_2 = fourier_grid_2.get_fourier_from_index(fourier_index);
+                auto delta12_real = delta_1.real() * delta_2.real() + delta_1.imag() * delta_2.imag();
+                auto delta12_imag = -delta_1.real() * delta_2.imag() + delta_1.imag() * delta_2.real();
+
+                // Add norm to bin
+                const double kmag = std::sqrt(kmag2);
+                pofk.add_to_bin(kmag, delta12_real, weight);
+                pofk_imag.add_to_bin(kmag, delta12_imag, weight);
+            });
+
+            // Normalize to get P(k) (this communicates over tasks)
+            pofk.normalize();
+            pofk_imag.normalize();
+
+            // NB: we currently don't return the imaginary part. For real fields this should be zero
+            // so we just check this and give a warning if its large
+            const bool show_warning = false;
+            if (show_warning) {
+                for (int i = 0; i < pofk.n; i++) {
+                    if (std::abs(pofk.pofk[i]) < 1e3 * std::abs(pofk_imag.pofk[i]) and
+                        std::abs(pofk_imag.pofk[i]) > 1e-15) {
+                        std::cout
+                            << "Warning: the imaginary part of the cross spectrum is > 0.1%% times the real part [ k: "
+                            << pofk.kbin[i] << " Real(d1d2): " << pofk.pofk[i] << " Imag(d1d2): " << pofk_imag.pofk[i]
+                            << "]\n";
+                    }
+                }
+            }
+        }
+
+        // Bin up all auto and cross spectra (and multipoles) of a set of fourier grids in one sweep
+        template <int N>
+        void bin_up_multi_tracer_power_spectra(const std::vector<FFTWGrid<N>> & fourier_grids,
+                                               std::vector<std::vector<PowerSpectrumBinning<N>>> & Pell,
+                                               std::vector<double> line_of_sight_direction) {
+
+            const int ntracers = int(fourier_grids.size());
+            const int npairs = ntracers * (ntracers + 1) / 2;
+            assert_mpi(ntracers > 0, "[bin_up_multi_tracer_power_spectra] No grids provided\n");
+            assert_mpi(int(Pell.size()) == npairs,
+                       "[bin_up_multi_tracer_power_spectra] Pell must have size M(M+1)/2 for M grids\n");
+
+            const bool compute_multipoles = line_of_sight_direction.size() > 0;
+            const int nell = int(Pell[0].size());
+            assert_mpi(nell > 0, "[bin_up_multi_tracer_power_spectra] Pell[pair] must have size > 0\n");
+            assert_mpi(compute_multipoles or nell == 1,
+                       "[bin_up_multi_tracer_power_spectra] Pell[pair] must have size 1 without a line of sight\n");
+            for (auto & P : Pell) {
+                assert_mpi(int(P.size()) == nell, "[bin_up_multi_tracer_power_spectra] Pell[pair] differ in size\n");
+                for (auto & binning : P) {
+                    assert_mpi(binning.n > 0 && binning.kmax > binning.kmin && binning.kmin >= 0.0,
+                               "[bin_up_multi_tracer_power_spectra] Binning has inconsistent parameters\n");
+                    binning.reset();
+                }
+            }
+
+            const auto Nmesh = fourier_grids[0].get_nmesh();
+            const auto Local_nx = fourier_grids[0].get_local_nx();
+            const auto Local_x_start = fourier_grids[0].get_local_x_start();
+            assert_mpi(Nmesh > 0, "[bin_up_multi_tracer_power_spectra] grid must have Nmesh > 0\n");
+            for (auto & grid : fourier_grids)
+                assert_mpi(grid.get_nmesh() == Nmesh and grid.get_local_nx() == Local_nx,
+                           "[bin_up_multi_tracer_power_spectra] Grids must have the same gridsize\n");
+
+            // Unit line of sight vector
+            std::array<double, N> los{};
+            if (compute_multipoles) {
+                assert_mpi(line_of_sight_direction.size() == N,
+                           "[bin_up_multi_tracer_power_spectra] Line of sight direction has wrong dimension\n");
+                double rmag = 0.0;
+                for (int idim = 0; idim < N; idim++)
+                    rmag += line_of_sight_direction[idim] * line_of_sight_direction[idim];
+                rmag = std::sqrt(rmag);
+                assert_mpi(rmag > 0.0, "[bin_up_multi_tracer_power_spectra] Line of sight vector has zero length\n");
+                for (int idim = 0; idim < N; idim++)
+                    los[idim] = line_of_sight_direction[idim] / rmag;
+            }
+
+            // Bin up mu^ell Re[delta_i delta_j^*] for all pairs i <= j
 #ifdef USE_OMP
 #pragma omp parallel for
 #endif
             for (int islice = 0; islice < Local_nx; islice++) {
                 [[maybe_unused]] double kmag;
                 [[maybe_unused]] std::array<double, N> kvec;
-                for (auto && fourier_index : fourier_grid_1.get_fourier_range(islice, islice + 1)) {
+                std::vector<FML::GRID::ComplexType> delta(ntracers);
+                for (auto && fourier_index : fourier_grids[0].get_fourier_range(islice, islice + 1)) {
                     if (Local_x_start == 0 and fourier_index == 0)
                         continue; // DC mode( k=0)
 
-                    // Special treatment of k = 0 plane (Safer way: fetch coord)
-                    // auto coord = fourier_grid.get_fourier_coord_from_index(fourier_index);
-                    // int last_coord = coord[N-1];
+                    // Special treatment of k = 0 plane
                     auto last_coord = fourier_index % (Nmesh / 2 + 1);
                     double weight = last_coord > 0 && last_coord < Nmesh / 2 ? 2.0 : 1.0;
 
-                    auto delta_1 = fourier_grid_1.get_fourier_from_index(fourier_index);
-                    auto delta_2 = fourier_grid_2.get_fourier_from_index(fourier_index);
-                    auto delta12_real = delta_1.real() * delta_2.real() + delta_1.imag() * delta_2.imag();
-                    auto delta12_imag = -delta_1.real() * delta_2.imag() + delta_1.imag() * delta_2.real();
+                    // The wavevector is the same for all grids
+                    fourier_grids[0].get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
+                    double mu2 = 0.0;
+                    if (compute_multipoles) {
+                        for (int idim = 0; idim < N; idim++)
+                            mu2 += kvec[idim] * los[idim];
+                        mu2 /= kmag;
+                        mu2 = mu2 * mu2;
+                    }
 
-                    // Add norm to bin
-                    fourier_grid_1.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
-                    pofk.add_to_bin(kmag, delta12_real, weight);
-                    pofk_imag.add_to_bin(kmag, delta12_imag, weight);
+                    for (int i = 0; i < ntracers; i++)
+                        delta[i] = fourier_grids[i].get_fourier_from_index(fourier_index);
+
+                    int ipair = 0;
+                    for (int i = 0; i < ntracers; i++) {
+                        for (int j = i; j < ntracers; j++, ipair++) {
+                            const double power = delta[i].real() * delta[j].real() + delta[i].imag() * delta[j].imag();
+                            double mutotwoell = 1.0;
+                            for (int ell = 0; ell < nell; ell += 2) {
+                                Pell[ipair][ell].add_to_bin(kmag, power * mutotwoell, weight);
+                                mutotwoell *= mu2;
+                            }
+                        }
+                    }
                 }
             }
 
-            // Normalize to get P(k) (this communicates over tasks)
-            pofk.normalize();
-            pofk_imag.normalize();
+            // Normalize (this also sums over threads and tasks) and go from <mu^ell ...> to P_ell
+            for (auto & P : Pell) {
+                for (auto & binning : P)
+                    binning.normalize();
+                if (compute_multipoles)
+                    mu_moments_to_multipoles(P);
+            }
+        }
 
-            // NB: we currently don't return the imaginary part. For real fields this should be zero
-            // so we just check this and give a warning if its large
-            const bool show_warning = false;
-            if (show_warning) {
-                for (int i = 0; i < pofk.n; i++) {
-                    if (std::abs(pofk.pofk[i]) < 1e3 * std::abs(pofk_imag.pofk[i]) and
-                        std::abs(pofk_imag.pofk[i]) > 1e-15) {
-                        std::cout
-                            << "Warning: the imaginary part of the cross spectrum is > 0.1%% times the real part [ k: "
-                            << pofk.kbin[i] << " Real(d1d2): " << pofk.pofk[i] << " Imag(d1d2): " << pofk_imag.pofk[i]
-                            << "]\n";
+        // Assigns particles to grid, fourier transform and deconvolve the window function for each tracer
+        template <int N, class T>
+        std::vector<FFTWGrid<N>> multi_tracer_density_fields(int Ngrid,
+                                                             const std::vector<T *> & parts,
+                                                             const std::vector<size_t> & NumParts,
+                                                             const std::vector<size_t> & NumPartTotals,
+                                                             std::string density_assignment_method,
+                                                             bool interlacing) {
+
+            // Set how many extra slices we need for the density assignment to go smoothly
+            const auto nleftright = get_extra_slices_needed_for_density_assignment(density_assignment_method);
+            const int nleft = nleftright.first;
+            const int nright = nleftright.second + (interlacing ? 1 : 0);
+
+            std::vector<FFTWGrid<N>> density_k(parts.size());
+            for (size_t i = 0; i < parts.size(); i++) {
+                density_k[i] = FFTWGrid<N>(Ngrid, nleft, nright);
+                density_k[i].add_memory_label("FFTWGrid::compute_multi_tracer_power_spectra::density_k_" +
+                                              std::to_string(i));
+                if (interlacing) {
+                    FML::INTERPOLATION::particles_to_fourier_grid_interlacing(
+                        parts[i], NumParts[i], NumPartTotals[i], density_k[i], density_assignment_method);
+                } else {
+                    particles_to_grid<N, T>(
+                        parts[i], NumParts[i], NumPartTotals[i], density_k[i], density_assignment_method);
+                    density_k[i].fftw_r2c();
+                }
+                deconvolve_window_function_fourier<N>(density_k[i], density_assignment_method);
+            }
+            return density_k;
+        }
+
+        template <int N, class T>
+        void compute_multi_tracer_power_spectra(int Ngrid,
+                                                std::vector<T *> parts,
+                                                std::vector<size_t> NumParts,
+                                                std::vector<size_t> NumPartTotals,
+                                                std::vector<PowerSpectrumBinning<N>> & pofk,
+                                                std::string density_assignment_method,
+                                                bool interlacing) {
+
+            static_assert(FML::PARTICLE::has_get_pos<T>(),
+                          "[compute_multi_tracer_power_spectra] Particle class needs to have positions\n");
+            const int ntracers = int(parts.size());
+            assert_mpi(ntracers > 0 and NumParts.size() == parts.size() and NumPartTotals.size() == parts.size(),
+                       "[compute_multi_tracer_power_spectra] Inconsistent number of tracers\n");
+            assert_mpi(int(pofk.size()) == ntracers * (ntracers + 1) / 2,
+                       "[compute_multi_tracer_power_spectra] pofk must have size M(M+1)/2 for M tracers\n");
+
+            // Assign and fourier transform each tracer once
+            auto density_k = multi_tracer_density_fields<N, T>(
+                Ngrid, parts, NumParts, NumPartTotals, density_assignment_method, interlacing);
+
+            // Bin up all spectra in one go
+            std::vector<std::vector<PowerSpectrumBinning<N>>> Pell(pofk.size());
+            for (size_t i = 0; i < pofk.size(); i++)
+                Pell[i] = {pofk[i]};
+            bin_up_multi_tracer_power_spectra<N>(density_k, Pell);
+            for (size_t i = 0; i < pofk.size(); i++)
+                pofk[i] = Pell[i][0];
+
+            // Subtract shotnoise from the auto spectra
+            for (int i = 0; i < ntracers; i++) {
+                auto & binning = pofk[get_tracer_pair_index(i, i, ntracers)];
+                if (binning.subtract_shotnoise)
+                    for (int j = 0; j < binning.n; j++)
+                        binning.pofk[j] -= 1.0 / double(NumPartTotals[i]);
+            }
+        }
+
+        template <int N, class T>
+        void compute_multi_tracer_power_spectrum_multipoles(int Ngrid,
+                                                            std::vector<FML::PARTICLE::MPIParticles<T> *> tracers,
+                                                            double velocity_to_displacement,
+                                                            std::vector<std::vector<PowerSpectrumBinning<N>>> & Pell,
+                                                            std::string density_assignment_method,
+                                                            bool interlacing) {
+
+            static_assert(FML::PARTICLE::has_get_pos<T>() and FML::PARTICLE::has_get_vel<T>(),
+                          "[compute_multi_tracer_power_spectrum_multipoles] Particle class needs to have positions "
+                          "and velocities to use this method");
+            const int ntracers = int(tracers.size());
+            assert_mpi(ntracers > 0, "[compute_multi_tracer_power_spectrum_multipoles] No tracers provided\n");
+            assert_mpi(int(Pell.size()) == ntracers * (ntracers + 1) / 2,
+                       "[compute_multi_tracer_power_spectrum_multipoles] Pell must have size M(M+1)/2\n");
+
+            std::vector<T *> parts(ntracers);
+            std::vector<size_t> NumParts(ntracers);
+            std::vector<size_t> NumPartTotals(ntracers);
+
+            // Sum over the N axes we put the particles into redshift space along
+            auto Pell_sum = Pell;
+            for (auto & P : Pell_sum)
+                for (auto & binning : P)
+                    binning.reset();
+            for (int idim = 0; idim < N; idim++) {
+
+                // Make line of sight direction unit vector
+                std::vector<double> line_of_sight_direction(N, 0.0);
+                line_of_sight_direction[idim] = 1.0;
+
+                // Transform to redshift-space
+                for (int i = 0; i < ntracers; i++) {
+                    FML::COSMOLOGY::particles_to_redshiftspace(
+                        *tracers[i], line_of_sight_direction, velocity_to_displacement);
+                    parts[i] = tracers[i]->get_particles_ptr();
+                    NumParts[i] = tracers[i]->get_npart();
+                    NumPartTotals[i] = tracers[i]->get_npart_total();
+                }
+
+                // Compute and bin up all the spectra
+                auto density_k = multi_tracer_density_fields<N, T>(
+                    Ngrid, parts, NumParts, NumPartTotals, density_assignment_method, interlacing);
+                auto Pell_current = Pell;
+                bin_up_multi_tracer_power_spectra<N>(density_k, Pell_current, line_of_sight_direction);
+                for (size_t ipair = 0; ipair < Pell.size(); ipair++)
+                    for (size_t ell = 0; ell < Pell[ipair].size(); ell++)
+                        Pell_sum[ipair][ell] += Pell_current[ipair][ell];
+
+                // Transform particles back to real-space
+                for (int i = 0; i < ntracers; i++)
+                    FML::COSMOLOGY::particles_to_redshiftspace(
+                        *tracers[i], line_of_sight_direction, -velocity_to_displacement);
+            }
+
+            // Take the mean over the axes
+            for (size_t ipair = 0; ipair < Pell.size(); ipair++) {
+                for (size_t ell = 0; ell < Pell[ipair].size(); ell++) {
+                    auto & binning = Pell[ipair][ell];
+                    binning = Pell_sum[ipair][ell];
+                    for (int i = 0; i < binning.n; i++) {
+                        binning.pofk[i] /= double(N);
+                        binning.count[i] /= double(N);
+                        binning.kbin[i] /= double(N);
                     }
                 }
             }
+
+            // Subtract shotnoise for the monopole of the auto spectra
+            for (int i = 0; i < ntracers; i++) {
+                auto & binning = Pell[get_tracer_pair_index(i, i, ntracers)][0];
+                if (binning.subtract_shotnoise)
+                    for (int j = 0; j < binning.n; j++)
+                        binning.pofk[j] -= 1.0 / double(NumPartTotals[i]);
+            }
         }
 
         // Brute force. Add particles to the grid using direct summation
@@ -930,100 +1325,303 @@ namespace FML {
                 }
         }
 
-        // https://arxiv.org/pdf/1506.02729.pdf
-        // The general quadrupole estimator Eq. 20
-        // P(k) = <delta0(k)delta2^*(k>>
-        // We compute delta0 and delta2
-        // template<int N>
-        //  void quadrupole_estimator_3D(FFTWGrid<N> & density_real)
-        //  {
-
-        //    FFTWGrid<N> Q_xx, Q_yy, Q_zz, Q_xy, Q_yz, Q_zx;
-
-        //    compute_multipole_Q_term(density_real, Q_xx, {0,0}, origin);
-        //    compute_multipole_Q_term(density_real, Q_xy, {0,1}, origin);
-        //    compute_multipole_Q_term(density_real, Q_yy, {1,1}, origin);
-        //    Q_xx.fftw_r2c();
-        //    Q_xy.fftw_r2c();
-        //    Q_yy.fftw_r2c();
-        //    if constexpr (N > 2){
-        //      compute_multipole_Q_term(density_real, Q_yz, {1,2}, origin);
-        //      compute_multipole_Q_term(density_real, Q_zx, {2,0}, origin);
-        //      compute_multipole_Q_term(density_real, Q_zz, {2,2}, origin);
-        //      Q_yz.fftw_r2c();
-        //      Q_zx.fftw_r2c();
-        //      Q_zz.fftw_r2c();
-        //    }
-
-        //    // Density to fourier space
-        //    density_real.fftw_r2c();
-
-        //    FFTWGrid<N> delta2 =  density_real;
-
-        //    double kmag;
-        //    std::array<double,N> kvec;
-        //    for(auto & fourier_index : density_real.get_fourier_range()){
-        //      density_real.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag2);
-
-        //      // Unit kvector
-        //      if(kmag > 0.0)
-        //        for(auto & k : kvec)
-        //          k /= kmag;
-
-        //      auto Q_xx_of_k = Q_xx.get_fourier_from_index(fourier_index);
-        //      auto Q_xy_of_k = Q_xy.get_fourier_from_index(fourier_index);
-        //      auto Q_yy_of_k = Q_yy.get_fourier_from_index(fourier_index);
-
-        //      auto Q_yz_of_k = Q_yz.get_fourier_from_index(fourier_index);
-        //      auto Q_zx_of_k = Q_zx.get_fourier_from_index(fourier_index);
-        //      auto Q_zz_of_k = Q_zz.get_fourier_from_index(fourier_index);
-        //      auto delta0    = density_real.get_fourier_from_index(fourier_index);
-
-        //      auto res = Q_xx_of_k * kvec[0] * kvec[0] + Q_yy_of_k * kvec[1] * kvec[1] +  2.0 * (Q_xy_of_k *
-        //      kvec[0] * kvec[1])
-        //        if constexpr (N > 2) res += Q_zz_of_k * kvec[2] * kvec[2] + 2.0 * (Q_yz_of_k * kvec[1] *
-        //        kvec[2] + Q_zx_of_k * kvec[2] * kvec[0]);
-        //      res = 1.5 * res - 0.5 * delta0;
-
-        //      delta2.set_real_from_fourier(fourier_index, res);
-        //    }
-        //  }
-
-        // Compute delta(x) -> delta(x) * xi * xj * xk * .... (i,j,k,... in Qindex)
-        // where xi's being the i'th component of the unit norm line of sight direction
-        // For the quadrupole we put Qindex = {ii,jj} and we need the 6 combinations xx,yy,zz,xy,yz,zx
-        // For the hexadecapole we need {ii,jj,kk,ll} for 15 different combinations
-        // xxxx + cyc (3), xxxy + cyc, xxyy + cyc and xxyz + cyc
-        // template<int N>
-        //  void compute_multipole_Q_term(
-        //      FFTWGrid<N> & density_real,
-        //      FFTWGrid<N> & Q_real,
-        //      std::vector<int> Qindex,
-        //      std::vector<double> origin)
-        //  {
-        //    assert(Qindex.size() > 0);
-        //    assert(origin.size() == N);
-
-        //    for(auto && real_index : density_real.get_real_range()){
-        //      auto coord = density_real.get_coord_from_index(real_index);
-        //      auto pos = density_real.get_real_position(coord);
-
-        //      double norm = 0.0;
-        //      for(int idim = 0; idim < N; idim++){
-        //        pos[idim] -= origin[idim];
-        //        norm += pos[idim]*pos[idim];
-        //      }
-        //      norm = std::sqrt(norm);
-        //      for(int idim = 0; idim < N; idim++){
-        //        pos[idim] /= norm;
-        //      }
-        //      auto value = density_real.get_real_from_index(real_index);
-        //      for(auto ii: Qindex)
-        //        value *= pos[ii];
-
-        //      Q_real.set_real_from_index(real_index, value);
-        //    }
-        //  }
+        // All the non-decreasing index combinations (i1 <= i2 <= ... <= i_rank) of a symmetric tensor of a given rank
+        // in N dimensions together with their multiplicity rank! / (n_0! n_1! ...) where n_i is the number of times
+        // index i appears. Sum_{i1,i2,...} T_{i1i2...} = Sum_{components} multiplicity * T_{component}
+        template <int N>
+        std::vector<std::pair<std::vector<int>, double>> get_symmetric_tensor_components(int rank) {
+            std::vector<std::pair<std::vector<int>, double>> components;
+            std::vector<int> index(rank, 0);
+            while (true) {
+                double multiplicity = 1.0;
+                std::array<int, N> count_index{};
+                for (int j = 0; j < rank; j++) {
+                    multiplicity *= double(j + 1);
+                    count_index[index[j]]++;
+                    multiplicity /= double(count_index[index[j]]);
+                }
+                components.push_back({index, multiplicity});
+
+                int pos = rank - 1;
+                while (pos >= 0 and index[pos] == N - 1)
+                    pos--;
+                if (pos < 0)
+                    break;
+                index[pos]++;
+                for (int j = pos + 1; j < rank; j++)
+                    index[j] = index[pos];
+            }
+            return components;
+        }
+
+        // The Yamamoto estimator with the FFT decomposition of Bianchi et al. (1505.05341) and Scoccimarro
+        // (1506.02729). With F(x) = w(x)[n_g(x) - alpha n_r(x)] we have
+        // F_ell(k) = Int F(x) L_ell(khat * xhat) e^{-ikx} dx and P_ell(k) = (2ell+1)/I22 <Re[F_ell(k) F_0^*(k)]>
+        // Expanding L_ell(khat * xhat) in powers of khat_i xhat_i we only need the fourier transforms of
+        // Q_ij..(x) = F(x) xhat_i xhat_j ... for the symmetric index combinations (6 for ell=2 and 15 more for ell=4 in
+        // 3D). We never store F_ell(k): the bin-average is linear so we bin up khat_i khat_j.. Re[Q_ij..(k) F_0^*(k)]
+        // one component at the time and add up the results. This way we only need 3 grids in memory.
+        template <int N, class T, class U>
+        void compute_power_spectrum_multipoles_survey(int Ngrid,
+                                                      const T * galaxies,
+                                                      size_t ngalaxies,
+                                                      const U * randoms,
+                                                      size_t nrandoms,
+                                                      std::vector<double> observer_position,
+                                                      double P0_FKP,
+                                                      std::vector<PowerSpectrumBinning<N>> & Pell,
+                                                      std::string density_assignment_method,
+                                                      bool interlacing) {
+
+            static_assert(FML::PARTICLE::has_get_pos<T>() and FML::PARTICLE::has_get_pos<U>(),
+                          "[compute_power_spectrum_multipoles_survey] Particle classes needs to have positions\n");
+            assert_mpi(observer_position.size() == N,
+                       "[compute_power_spectrum_multipoles_survey] Observer position has wrong number of dimensions\n");
+            assert_mpi(Pell.size() > 0 and Pell.size() <= 5,
+                       "[compute_power_spectrum_multipoles_survey] Pell must have size 1 to 5 (ell = 0 to 4)\n");
+            const int ell_max = int(Pell.size()) - 1;
+
+            // Set how many extra slices we need for the density assignment to go smoothly
+            // One extra slice if we use interlacing due to displacing particles by one half cell to the right
+            const auto nleftright = get_extra_slices_needed_for_density_assignment(density_assignment_method);
+            const int nleft = nleftright.first;
+            const int nright = nleftright.second + (interlacing ? 1 : 0);
+
+            //=====================================================================
+            // Weights: the weight of the particles (e.g. systematic weights) times
+            // the FKP weight 1/(1 + nbar P0) where nbar is estimated from the randoms
+            //=====================================================================
+
+            std::vector<double> weights_galaxies(ngalaxies);
+            std::vector<double> weights_randoms(nrandoms);
+            double sum_weights_galaxies = 0.0;
+            double sum_weights_randoms = 0.0;
+            for (size_t i = 0; i < ngalaxies; i++) {
+                weights_galaxies[i] = FML::PARTICLE::GetWeight(const_cast<T &>(galaxies[i]));
+                sum_weights_galaxies += weights_galaxies[i];
+            }
+            for (size_t i = 0; i < nrandoms; i++) {
+                weights_randoms[i] = FML::PARTICLE::GetWeight(const_cast<U &>(randoms[i]));
+                sum_weights_randoms += weights_randoms[i];
+            }
+            FML::SumOverTasks(&sum_weights_galaxies);
+            FML::SumOverTasks(&sum_weights_randoms);
+            assert_mpi(sum_weights_galaxies > 0.0 and sum_weights_randoms > 0.0,
+                       "[compute_power_spectrum_multipoles_survey] No galaxies or no randoms\n");
+            const double alpha_nbar = sum_weights_galaxies / sum_weights_randoms;
+
+            // The work grid. Used for nbar, the interlaced grid and the Q_ij.. terms
+            FFTWGrid<N> work(Ngrid, nleft, nright);
+            work.add_memory_label("FFTWGrid::compute_power_spectrum_multipoles_survey::work");
+
+            // The number density nbar = alpha n_r at the position of the galaxies and randoms
+            std::vector<FloatType> nbar_galaxies;
+            std::vector<FloatType> nbar_randoms;
+            weighted_particles_to_grid<N, U>(randoms, nrandoms, weights_randoms, work, density_assignment_method);
+            work.communicate_boundaries();
+            interpolate_grid_to_particle_positions<N, T>(
+                work, galaxies, ngalaxies, nbar_galaxies, density_assignment_method);
+            interpolate_grid_to_particle_positions<N, U>(
+                work, randoms, nrandoms, nbar_randoms, density_assignment_method);
+
+            // Add the FKP weights and compute alpha, the normalization and the shot-noise
+            double sum_w_galaxies = 0.0;
+            double sum_w2_galaxies = 0.0;
+            double sum_w_randoms = 0.0;
+            double sum_w2_randoms = 0.0;
+            double sum_nbar_w2_randoms = 0.0;
+            for (size_t i = 0; i < ngalaxies; i++) {
+                const double nbar = alpha_nbar * std::max(nbar_galaxies[i], FloatType(0.0));
+                if (P0_FKP > 0.0)
+                    weights_galaxies[i] /= (1.0 + nbar * P0_FKP);
+                sum_w_galaxies += weights_galaxies[i];
+                sum_w2_galaxies += weights_galaxies[i] * weights_galaxies[i];
+            }
+            for (size_t i = 0; i < nrandoms; i++) {
+                const double nbar = alpha_nbar * std::max(nbar_randoms[i], FloatType(0.0));
+                if (P0_FKP > 0.0)
+                    weights_randoms[i] /= (1.0 + nbar * P0_FKP);
+                sum_w_randoms += weights_randoms[i];
+                sum_w2_randoms += weights_randoms[i] * weights_randoms[i];
+                sum_nbar_w2_randoms += nbar * weights_randoms[i] * weights_randoms[i];
+            }
+            FML::SumOverTasks(&sum_w_galaxies);
+            FML::SumOverTasks(&sum_w2_galaxies);
+            FML::SumOverTasks(&sum_w_randoms);
+            FML::SumOverTasks(&sum_w2_randoms);
+            FML::SumOverTasks(&sum_nbar_w2_randoms);
+            nbar_galaxies.clear();
+            nbar_galaxies.shrink_to_fit();
+            nbar_randoms.clear();
+            nbar_randoms.shrink_to_fit();
+
+            const double alpha = sum_w_galaxies / sum_w_randoms;
+            const double I22 = alpha * sum_nbar_w2_randoms;
+            const double shotnoise = (sum_w2_galaxies + alpha * alpha * sum_w2_randoms) / I22;
+            assert_mpi(I22 > 0.0, "[compute_power_spectrum_multipoles_survey] Normalization is zero\n");
+
+            // Randoms enter with weight -alpha w
+            for (auto & w : weights_randoms)
+                w *= -alpha;
+
+            //=====================================================================
+            // F(x) = w(x)[n_g(x) - alpha n_r(x)] in fourier space
+            //=====================================================================
+
+            FFTWGrid<N> F_fourier(Ngrid, nleft, nright);
+            F_fourier.add_memory_label("FFTWGrid::compute_power_spectrum_multipoles_survey::F_fourier");
+            weighted_particles_to_grid<N, T>(
+                galaxies, ngalaxies, weights_galaxies, F_fourier, density_assignment_method);
+            weighted_particles_to_grid<N, U>(
+                randoms, nrandoms, weights_randoms, F_fourier, density_assignment_method, true);
+            F_fourier.fftw_r2c();
+
+            if (interlacing) {
+                // Same but with the particles shifted by half a grid-cell. Average the two with the phase
+                // factor to cancel the leading aliasing contribution
+                const double shift = 0.5;
+                weighted_particles_to_grid<N, T>(
+                    galaxies, ngalaxies, weights_galaxies, work, density_assignment_method, false, shift);
+                weighted_particles_to_grid<N, U>(
+                    randoms, nrandoms, weights_randoms, work, density_assignment_method, true, shift);
+                work.fftw_r2c();
+
+                auto Local_nx = F_fourier.get_local_nx();
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                for (int islice = 0; islice < Local_nx; islice++) {
+                    const std::complex<FML::GRID::FloatType> I(0, 1);
+                    for (auto && fourier_index : F_fourier.get_fourier_range(islice, islice + 1)) {
+                        auto kvec = F_fourier.get_fourier_wavevector_from_index(fourier_index);
+                        auto ksum = kvec[0];
+                        for (int idim = 1; idim < N; idim++)
+                            ksum += kvec[idim];
+                        auto norm = std::exp(I * FML::GRID::FloatType(ksum * shift / double(Ngrid)));
+                        auto grid1 = F_fourier.get_fourier_from_index(fourier_index);
+                        auto grid2 = work.get_fourier_from_index(fourier_index);
+                        F_fourier.set_fourier_from_index(fourier_index,
+                                                         (grid1 + norm * grid2) / FML::GRID::FloatType(2.0));
+                    }
+                }
+            }
+            deconvolve_window_function_fourier<N>(F_fourier, density_assignment_method);
+            weights_galaxies.clear();
+            weights_galaxies.shrink_to_fit();
+            weights_randoms.clear();
+            weights_randoms.shrink_to_fit();
+
+            // Bin up the monopole <|F_0|^2>. The other multipoles share the bin-count and k of this
+            for (auto & pofk : Pell)
+                pofk.reset();
+            bin_up_power_spectrum<N>(F_fourier, Pell[0]);
+            const std::vector<double> F0F0 = Pell[0].pofk;
+
+            //=====================================================================
+            // Add up <khat_i khat_j.. Re[Q_ij..(k) F_0^*(k)]> for the symmetric
+            // index combinations of rank 2 and 4
+            //=====================================================================
+
+            std::vector<double> F0Q2(Pell[0].n, 0.0);
+            std::vector<double> F0Q4(Pell[0].n, 0.0);
+            if (ell_max >= 2) {
+
+                // The real space field F(x). We keep this and compute Q_ij..(x) from it
+                FFTWGrid<N> F_real = F_fourier;
+                F_real.add_memory_label("FFTWGrid::compute_power_spectrum_multipoles_survey::F_real");
+                F_real.fftw_c2r();
+
+                const auto Local_nx = F_real.get_local_nx();
+                const auto Local_x_start = F_real.get_local_x_start();
+                for (int rank = 2; rank <= ell_max; rank += 2) {
+
+                    // All non-decreasing index combinations (i1 <= i2 <= ...) and their multiplicity
+                    const auto components = get_symmetric_tensor_components<N>(rank);
+                    for (auto & c : components) {
+                        const auto & component = c.first;
+                        const double multiplicity = c.second;
+
+                        // Q(x) = F(x) xhat_i xhat_j ...
+                        work.set_grid_status_real(true);
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                        for (int islice = 0; islice < Local_nx; islice++) {
+                            for (auto && real_index : F_real.get_real_range(islice, islice + 1)) {
+                                auto coord = F_real.get_coord_from_index(real_index);
+                                auto pos = F_real.get_real_position(coord);
+                                double r2 = 0.0;
+                                for (int idim = 0; idim < N; idim++) {
+                                    pos[idim] -= observer_position[idim];
+                                    r2 += pos[idim] * pos[idim];
+                                }
+                                double value = F_real.get_real_from_index(real_index);
+                                if (r2 > 0.0) {
+                                    for (auto idim : component)
+                                        value *= pos[idim];
+                                    value /= std::pow(r2, rank / 2);
+                                }
+                                work.set_real_from_index(real_index, value);
+                            }
+                        }
+                        work.fftw_r2c();
+
+                        // Bin up multiplicity * khat_i khat_j ... Re[Q(k) F_0^*(k)]
+                        PowerSpectrumBinning<N> binning(Pell[0].kmin, Pell[0].kmax, Pell[0].n, Pell[0].bin_type);
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                        for (int islice = 0; islice < Local_nx; islice++) {
+                            [[maybe_unused]] double kmag;
+                            [[maybe_unused]] std::array<double, N> kvec;
+                            for (auto && fourier_index : work.get_fourier_range(islice, islice + 1)) {
+                                if (Local_x_start == 0 and fourier_index == 0)
+                                    continue; // DC mode( k=0)
+
+                                // Special treatment of k = 0 plane
+                                auto last_coord = fourier_index % (Ngrid / 2 + 1);
+                                double weight = last_coord > 0 and last_coord < Ngrid / 2 ? 2.0 : 1.0;
+
+                                work.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
+                                double khat_product = multiplicity;
+                                for (auto idim : component)
+                                    khat_product *= kvec[idim] / kmag;
+
+                                auto Q = work.get_fourier_from_index(fourier_index);
+                                auto F0 = F_fourier.get_fourier_from_index(fourier_index);
+                                double value = khat_product * (Q.real() * F0.real() + Q.imag() * F0.imag());
+                                binning.add_to_bin(kmag, value, weight);
+                            }
+                        }
+                        binning.normalize();
+
+                        auto & F0Q = rank == 2 ? F0Q2 : F0Q4;
+                        for (int i = 0; i < Pell[0].n; i++)
+                            F0Q[i] += binning.pofk[i];
+                    }
+                }
+            }
+
+            // Copy over bin-count and k to the other multipoles
+            for (int ell = 1; ell <= ell_max; ell++) {
+                Pell[ell].count = Pell[0].count;
+                Pell[ell].kbin = Pell[0].kbin;
+            }
+
+            // P_ell = (2ell+1)/I22 <Re[F_ell F_0^*]> with L_2 = (3mu^2 - 1)/2 and L_4 = (35mu^4 - 30mu^2 + 3)/8
+            for (int i = 0; i < Pell[0].n; i++) {
+                Pell[0].pofk[i] = F0F0[i] / I22;
+                if (ell_max >= 2)
+                    Pell[2].pofk[i] = 5.0 * (1.5 * F0Q2[i] - 0.5 * F0F0[i]) / I22;
+                if (ell_max >= 4)
+                    Pell[4].pofk[i] = 9.0 * (35.0 * F0Q4[i] - 30.0 * F0Q2[i] + 3.0 * F0F0[i]) / 8.0 / I22;
+            }
+
+            // Subtract shotnoise for monopole
+            if (Pell[0].subtract_shotnoise)
+                for (int i = 0; i < Pell[0].n; i++)
+                    Pell[0].pofk[i] -= shotnoise;
+        }
 
         template <int N, class T>
         void compute_monospectrum(int Ngrid,
@@ -1145,6 +1743,7 @@ namespace FML {
         //================================================================================
         template <int N, int ORDER>
         void compute_polyspectrum_bincount(int Nmesh, PolyspectrumBinning<N, ORDER> & polyofk) {
+            FML_MEMORY_TAG_SCOPE(Polyspectrum);
 
             const auto nbins = polyofk.n;
             const auto klow = polyofk.klow;
@@ -1230,14 +1829,17 @@ namespace FML {
                         }
                     }
                 }
-                FML::SumOverTasks(&N123_current);
                 N123[i] = N123_current * norm;
+            }
 
-                // We cannot have less than 1 generalized triangle so put to zero if small
-                // due to numerical noise
+            // Sum over tasks (one communication for all bins)
+            FML::SumArrayOverTasks(N123.data(), int(nbins_tot));
+
+            // We cannot have less than 1 generalized triangle so put to zero if small
+            // due to numerical noise
+            for (size_t i = 0; i < nbins_tot; i++)
                 if (N123[i] < 1.0)
                     N123[i] = 0.0;
-            }
 
             // Set stuff not computed
             for (size_t i = 0; i < nbins_tot; i++) {
@@ -1278,6 +1880,7 @@ namespace FML {
 
         template <int N, int ORDER>
         void compute_polyspectrum(const FFTWGrid<N> & fourier_grid, PolyspectrumBinning<N, ORDER> & polyofk) {
+            FML_MEMORY_TAG_SCOPE(Polyspectrum);
 
             const auto Nmesh = fourier_grid.get_nmesh();
             const auto Local_nx = fourier_grid.get_local_nx();
@@ -1314,6 +1917,12 @@ namespace FML {
                 F_k[i].add_memory_label("FFTWGrid::compute_polyspectrum::F_" + std::to_string(i));
             }
 
+            // Per-thread sums of (number of modes, k, |delta|^2) in each bin
+            ThreadHistogram<3> bin_sums(nbins);
+            std::vector<double> nk(nbins, 0.0);
+            std::fill(kmean.begin(), kmean.end(), 0.0);
+            std::fill(pofk_bin.begin(), pofk_bin.end(), 0.0);
+
             for (int i = 0; i < nbins; i++) {
 #ifdef DEBUG_POLYSPECTRUM
                 if (FML::ThisTask == 0)
@@ -1328,44 +1937,51 @@ namespace FML {
                 const double kmag2_min = klow[i] * klow[i];
 
                 // Loop over all cells
-                double kmean_bin = 0.0;
-                double nk = 0;
-                double kmag2;
-                pofk_bin[i] = 0.0;
-                std::array<double, N> kvec;
-                for (auto && fourier_index : grid.get_fourier_range()) {
-                    grid.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
-
-                    // Set to zero outside the bin
-                    if (kmag2 >= kmag2_max or kmag2 < kmag2_min) {
-                        grid.set_fourier_from_index(fourier_index, 0.0);
-                    } else {
-                        // Compute mean k in the bin
-                        kmean_bin += std::sqrt(kmag2);
-                        pofk_bin[i] += std::norm(grid.get_fourier_from_index(fourier_index));
-                        nk += 1.0;
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                for (int islice = 0; islice < Local_nx; islice++) {
+                    int id = 0;
+#ifdef USE_OMP
+                    id = omp_get_thread_num();
+#endif
+                    double kmag2;
+                    std::array<double, N> kvec;
+                    for (auto && fourier_index : grid.get_fourier_range(islice, islice + 1)) {
+                        grid.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
+
+                        // Set to zero outside the bin
+                        if (kmag2 >= kmag2_max or kmag2 < kmag2_min) {
+                            grid.set_fourier_from_index(fourier_index, 0.0);
+                        } else {
+                            // Compute mean k and power in the bin
+                            bin_sums.add(
+                                id, i, 1.0, std::sqrt(kmag2), std::norm(grid.get_fourier_from_index(fourier_index)));
+                        }
                     }
                 }
-                FML::SumOverTasks(&kmean_bin);
-                FML::SumOverTasks(&pofk_bin[i]);
-                FML::SumOverTasks(&nk);
 
+                // Transform to real space
+                grid.fftw_c2r();
+            }
+
+            // Sum over threads and tasks (one communication for all bins)
+            bin_sums.reduce({nk.data(), kmean.data(), pofk_bin.data()});
+            for (int i = 0; i < nbins; i++) {
                 // The mean k in the bin
-                kmean[i] = (nk == 0) ? kbin[i] : kmean_bin / double(nk);
+                kmean[i] = (nk[i] == 0) ? kbin[i] : kmean[i] / nk[i];
 
                 // Power spectrum in the bin
-                pofk_bin[i] = (nk == 0) ? 0.0 : pofk_bin[i] / double(nk);
+                pofk_bin[i] = (nk[i] == 0) ? 0.0 : pofk_bin[i] / nk[i];
 
 #ifdef DEBUG_POLYSPECTRUM
                 if (FML::ThisTask == 0)
                     std::cout << "kmean: " << kmean[i] / (2.0 * M_PI) << "\n";
 #endif
-
-                // Transform to real space
-                grid.fftw_c2r();
             }
 
             // We now have F_k and N_k for all bins
+            FML_PROFILE_SCOPE("polyspectrum_integration");
             for (size_t i = 0; i < nbins_tot; i++) {
 #ifdef DEBUG_POLYSPECTRUM
                 if (FML::ThisTask == 0)
@@ -1398,14 +2014,16 @@ namespace FML {
                         F123_current += Fproduct;
                     }
                 }
-                FML::SumOverTasks(&F123_current);
 
                 // Normalize by the integration measure dx^N / (2pi)^N
-                F123_current *= std::pow(1.0 / double(Nmesh) / (2.0 * M_PI), N);
+                P123[i] = F123_current * std::pow(1.0 / double(Nmesh) / (2.0 * M_PI), N);
+            }
 
-                // Set the result
+            // Sum over tasks (one communication for all bins) and set the result
+            FML::SumArrayOverTasks(P123.data(), int(nbins_tot));
+            for (size_t i = 0; i < nbins_tot; i++) {
                 const double N123_current = N123[i];
-                P123[i] = (N123_current > 0.0) ? F123_current / N123_current : 0.0;
+                P123[i] = (N123_current > 0.0) ? P123[i] / N123_current : 0.0;
             }
 
             // Set stuff not computed above which follows from symmetry
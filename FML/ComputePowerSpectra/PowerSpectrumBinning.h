@@ -1,6 +1,7 @@
 #ifndef POWERSPECTRUMBINNING_HEADER
 #define POWERSPECTRUMBINNING_HEADER
 #include <FML/Global/Global.h>
+#include <FML/Global/ThreadHistogram.h>
 #include <cmath>
 #include <vector>
 
@@ -35,12 +36,11 @@ namespace FML {
             /// The power-spectrum in the bin
             std::vector<double> pofk;
 
-#ifdef USE_OMP
-            // Temporary storage for OpenMP parallization
-            std::vector<std::vector<double>> count_thread;
-            std::vector<std::vector<double>> pofk_thread;
-            std::vector<std::vector<double>> kbin_thread;
-#endif
+            // Per-thread accumulators for (count, pofk, kbin). Summed up in normalize()
+            ThreadHistogram<3> histogram;
+            // Precomputed for get_bin_index: bin index = floor((k - k0) * inv_dk + 0.5) with k -> log(k) for log bins
+            double bin_k0{0.0};
+            double bin_inv_dk{0.0};
 
             PowerSpectrumBinning() = default;
             PowerSpectrumBinning(int n);
@@ -65,8 +65,9 @@ namespace FML {
             /// Add a new point to a bin
             void add_to_bin(double kvalue, double power, double weight = 1.0);
 
-            /// Normalize (i.e. find mean in each bin) Do summation over MPI tasks
-            void normalize();
+            /// Normalize (i.e. find mean in each bin) Do summation over MPI tasks unless sum_over_tasks is false
+            /// (for data that is local to this task)
+            void normalize(bool sum_over_tasks = true);
 
             /// From k to the index of the bin
             int get_bin_index(double kvalue, double kmin, double kmax, int n, int bin_type);
@@ -118,18 +119,19 @@ namespace FML {
             for (int i = 0; i < n; i++)
                 k[i] = get_k_from_bin_index(i, kmin, kmax, n, bin_type);
 
+            if (bin_type == LOG_SPACING) {
+                bin_k0 = std::log(kmin);
+                bin_inv_dk = (n - 1) / std::log(kmax / kmin);
+            } else {
+                bin_k0 = kmin;
+                bin_inv_dk = (n - 1) / (kmax - kmin);
+            }
+
 #ifdef USE_OMP
             assert_mpi(omp_get_thread_num() == 0,
                        "[PowerSpectrumBinning] You cannot create a binning inside a parallel region\n");
-            count_thread.resize(NThreads);
-            pofk_thread.resize(NThreads);
-            kbin_thread.resize(NThreads);
-            for (int i = 0; i < NThreads; i++) {
-                count_thread[i] = std::vector<double>(n, 0.0);
-                pofk_thread[i] = std::vector<double>(n, 0.0);
-                kbin_thread[i] = std::vector<double>(n, 0.0);
-            }
 #endif
+            histogram = ThreadHistogram<3>(n, NThreads);
         }
 
         template <int N>
@@ -154,21 +156,14 @@ namespace FML {
             // Do not include zero-mode
             if (kvalue == 0.0)
                 return;
-            const int index = get_bin_index(kvalue, kmin, kmax, n, bin_type);
+            const int index = bin_type == LOG_SPACING ? get_bin_index_log(kvalue, bin_k0, bin_inv_dk, 0.5, n) :
+                                                        get_bin_index_linear(kvalue, bin_k0, bin_inv_dk, 0.5, n);
 #ifdef USE_OMP
             const int myid = NThreads == 1 ? 0 : omp_get_thread_num();
-            if (0 <= index and index < n) {
-                count_thread[myid][index] += weight;
-                pofk_thread[myid][index] += power * weight;
-                kbin_thread[myid][index] += kvalue * weight;
-            }
 #else
-            if (0 <= index and index < n) {
-                count[index] += weight;
-                pofk[index] += power * weight;
-                kbin[index] += kvalue * weight;
-            }
+            const int myid = 0;
 #endif
+            histogram.add(myid, index, weight, power * weight, kvalue * weight);
         }
 
         template <int N>
@@ -176,35 +171,14 @@ namespace FML {
             for (int i = 0; i < n; i++) {
                 count[i] = pofk[i] = kbin[i] = 0.0;
             }
-#ifdef USE_OMP
-            for (int id = 0; id < NThreads; id++) {
-                for (int i = 0; i < n; i++) {
-                    count_thread[id][i] = pofk_thread[id][i] = kbin_thread[id][i] = 0.0;
-                }
-            }
-#endif
+            histogram.reset();
         }
 
         template <int N>
-        void PowerSpectrumBinning<N>::normalize() {
+        void PowerSpectrumBinning<N>::normalize(bool sum_over_tasks) {
 
-#ifdef USE_OMP
-            assert_mpi(omp_get_thread_num() == 0,
-                       "[PowerSpectrumBinning::normalize] This method can only be run by the main thread\n");
-            for (int id = 0; id < NThreads; id++) {
-                for (int i = 0; i < n; i++) {
-                    count[i] += count_thread[id][i];
-                    pofk[i] += pofk_thread[id][i];
-                    kbin[i] += kbin_thread[id][i];
-                }
-            }
-#endif
-
-#ifdef USE_MPI
-            MPI_Allreduce(MPI_IN_PLACE, pofk.data(), n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-            MPI_Allreduce(MPI_IN_PLACE, count.data(), n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-            MPI_Allreduce(MPI_IN_PLACE, kbin.data(), n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-#endif
+            // Sum over threads and tasks
+            histogram.reduce({count.data(), pofk.data(), kbin.data()}, sum_over_tasks);
 
             for (int i = 0; i < n; i++) {
                 if (count[i] > 0) {
@@ -223,16 +197,14 @@ namespace FML {
             }
         }
 
-        // This method can return values out of bounds
+        // Returns -1 if out of bounds
         template <int N>
         int PowerSpectrumBinning<N>::get_bin_index(double kvalue, double kmin, double kmax, int n, int bin_type) {
             int index = -1;
             if (bin_type == LINEAR_SPACING) {
-                index = int((kvalue - kmin) / (kmax - kmin) * (n - 1) + 0.5);
+                index = get_bin_index_linear(kvalue, kmin, (n - 1) / (kmax - kmin), 0.5, n);
             } else if (bin_type == LOG_SPACING) {
-                if (kvalue <= 0.0)
-                    return -1;
-                index = int(std::log(kvalue / kmin) / std::log(kmax / kmin) * (n - 1) + 0.5);
+                index = get_bin_index_log(kvalue, std::log(kmin), (n - 1) / std::log(kmax / kmin), 0.5, n);
             } else {
                 assert_mpi(false, "[PowerSpectrumBinning::get_bin_index] Unknown binning type\n");
             }
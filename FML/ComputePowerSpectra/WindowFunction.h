@@ -0,0 +1,677 @@
+#ifndef WINDOWFUNCTION_HEADER
+#define WINDOWFUNCTION_HEADER
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include <FML/ComputePowerSpectra/ComputePowerSpectrum.h>
+#include <FML/FFTLog/FFTLog.h>
+#include <FML/FFTWGrid/FFTWGrid.h>
+#include <FML/Global/Global.h>
+#include <FML/Global/ThreadHistogram.h>
+#include <FML/Math/Math.h>
+
+//=====================================================================================
+//
+// The survey window and the mode-coupling (convolution) matrix needed to compare the
+// output of compute_power_spectrum_multipoles_survey with theory.
+//
+// We follow Wilson et al. 2017 (1511.07799) and Beutler et al. 2017 (1607.03150). The window
+// multipoles are
+//    Q_L(s) = (2L+1) < W(x) W(x+s) L_L(shat * xhat) >
+// averaged over all directions of s (xhat is the end-point line of sight as in the power-spectrum
+// estimator). The windowed correlation function multipoles are then
+//    xihat_l(s) = (2l+1) Sum_{l',L} (l l' L; 0 0 0)^2 xi_l'(s) Q_L(s)
+// and P_l(k) and xi_l(s) are related by Hankel transforms.
+//
+// compute_window_function_multipoles: Q_L(s) from randoms using FFTs. Same decomposition as in the
+// power-spectrum estimator: L_L(shat * xhat) is a polynomial in shat_i xhat_i so we only need the
+// correlation of W(x) xhat_i xhat_j... with W(x) for the symmetric index combinations. Each of
+// these is a product in fourier space.
+//
+// convolve_power_spectrum_multipoles_with_window: apply the window to a theory P_l(k) (sampled at
+// logarithmically spaced k) using the FFTLog Hankel transforms. This is the fast way if one only
+// needs to convolve a few models.
+//
+// compute_mode_coupling_matrix: the full matrix M such that Phat_l(k_i) = Sum_{l',j} M[l,i;l',j] P_l'(k_j)
+// (the bin-averaged windowed multipoles in terms of the theory at the points k_j). The rows (k-bins)
+// are distributed over MPI tasks and OpenMP threads. Write and read it in a compact binary format with
+// ModeCouplingMatrix::write_binary / read_binary.
+//
+// The window is computed in units of the boxsize. Call window.scale(boxsize) before using it
+// together with k in physical units. The box must be at least twice the size of the survey for
+// the window to not wrap around the periodic boundary.
+//
+// Requires FFTLog.cpp and Math.cpp to be compiled.
+//
+//=====================================================================================
+
+namespace FML {
+    namespace CORRELATIONFUNCTIONS {
+
+        //=====================================================================================
+        /// The multipoles of the survey window \f$ Q_L(s) \f$ for L = 0,1,...,ellmax (odd multipoles are zero).
+        /// Normalized such that \f$ Q_0(s \to 0) = 1 \f$.
+        //=====================================================================================
+        struct WindowFunctionMultipoles {
+            /// The maximum multipole we have
+            int ellmax{0};
+            /// The mean separation in each bin
+            std::vector<double> s;
+            /// The multipoles Q[L][i] at s[i]
+            std::vector<std::vector<double>> Q;
+            /// The normalization we divided by (the raw Q_0 extrapolated to s = 0)
+            double norm{1.0};
+
+            /// To physical units: s *= boxsize
+            void scale(double boxsize) {
+                for (auto & si : s)
+                    si *= boxsize;
+            }
+
+            /// Linear interpolation in s. Constant below the first bin and zero beyond the last bin
+            double operator()(int L, double sval) const {
+                if (L > ellmax or s.empty())
+                    return 0.0;
+                const auto & y = Q[L];
+                if (sval <= s.front())
+                    return y.front();
+                if (sval >= s.back())
+                    return sval > s.back() + (s.back() - s[s.size() - 2]) ? 0.0 : y.back();
+                const size_t i = std::upper_bound(s.begin(), s.end(), sval) - s.begin() - 1;
+                const double t = (sval - s[i]) / (s[i + 1] - s[i]);
+                return y[i] + t * (y[i + 1] - y[i]);
+            }
+        };
+
+        //=====================================================================================
+        /// The mode-coupling matrix \f$ \hat{P}_\ell(k_i) = \sum_{\ell',j} M_{\ell i,\ell' j} P_{\ell'}(k_j) \f$.
+        /// Rows are (ell_out, k_out) and columns (ell_in, k_in) stored row-major with the ell index outermost.
+        //=====================================================================================
+        struct ModeCouplingMatrix {
+            /// The multipoles of the binned power-spectrum (rows)
+            std::vector<int> ells_out;
+            /// The multipoles of the theory (columns)
+            std::vector<int> ells_in;
+            /// The edges of the k-bins of the binned power-spectrum
+            std::vector<double> k_edges_out;
+            /// The k-values the theory is sampled at
+            std::vector<double> k_in;
+            /// The matrix
+            std::vector<double> matrix;
+
+            int nrows() const { return int(ells_out.size() * (k_edges_out.size() - 1)); }
+            int ncols() const { return int(ells_in.size() * k_in.size()); }
+            double & operator()(int iell_out, int ik_out, int iell_in, int ik_in) {
+                const size_t row = size_t(iell_out) * (k_edges_out.size() - 1) + ik_out;
+                const size_t col = size_t(iell_in) * k_in.size() + ik_in;
+                return matrix[row * ncols() + col];
+            }
+
+            /// Apply to theory multipoles Pell_in[iell_in][ik_in]. Returns Pell_out[iell_out][ik_out]
+            std::vector<std::vector<double>> apply(const std::vector<std::vector<double>> & Pell_in) const;
+
+            /// Write the matrix to file (only task 0 writes)
+            void write_binary(std::string filename) const;
+            /// Read a matrix written with write_binary
+            void read_binary(std::string filename);
+        };
+
+        //=====================================================================================
+        /// @brief Compute the window multipoles \f$ Q_L(s) \f$ for L = 0,2,...,ellmax from randoms. The weight of
+        /// each random is get_weight() if it exists (e.g. FKP times systematic weights) otherwise 1. This requires
+        /// \f$ \sum_{m=0}^{\ell_{\rm max}/2} (2m+1)(m+1) \f$ pairs of fourier transforms in 3D (95 for ellmax = 8)
+        /// and 3 grids in memory. The zero-lag (which contains the shot-noise of the randoms) is not included and the
+        /// first few bins (s of a few cells) are affected by the cubic grid (mainly Q_4) so use Ngrid large enough.
+        ///
+        /// @tparam N The dimension of the particles.
+        /// @tparam U The random class. Must have a get_pos() method.
+        ///
+        /// @param[in] Ngrid Size of the grid to use.
+        /// @param[in] randoms Pointer to the first random.
+        /// @param[in] nrandoms Number of randoms on the local task.
+        /// @param[in] observer_position The position of the observer (in the same units as the positions).
+        /// @param[in] ellmax The maximum multipole (even). For the convolution of P_0, P_2, P_4 we need ellmax = 8.
+        /// @param[in] nbins Number of linear bins in s.
+        /// @param[in] smax The maximum separation in units of the boxsize (at most 0.5).
+        /// @param[in] density_assignment_method The density assignment method (NGP, CIC, TSC, PCS or PQS) to use.
+        ///
+        //=====================================================================================
+        template <int N, class U>
+        WindowFunctionMultipoles compute_window_function_multipoles(int Ngrid,
+                                                                    const U * randoms,
+                                                                    size_t nrandoms,
+                                                                    std::vector<double> observer_position,
+                                                                    int ellmax,
+                                                                    int nbins,
+                                                                    double smax,
+                                                                    std::string density_assignment_method);
+
+        //=====================================================================================
+        /// @brief Convolve theory multipoles with the window using FFTLog Hankel transforms. The k-values must be
+        /// logarithmically spaced and cover the range where the window is non-zero (i.e. 1/k[N-1] below the first
+        /// bin of the window and 1/k[0] above smax). The window and k must be in the same units.
+        ///
+        /// @param[in] window The window multipoles.
+        /// @param[in] ells The multipoles we have (and want), e.g. {0,2,4}.
+        /// @param[in] k Logarithmically spaced k-values.
+        /// @param[in] Pell Pell[iell][ik] the theory multipole ells[iell] at k[ik].
+        ///
+        /// @return The windowed multipoles at the same k-values.
+        ///
+        //=====================================================================================
+        std::vector<std::vector<double>>
+        convolve_power_spectrum_multipoles_with_window(const WindowFunctionMultipoles & window,
+                                                       const std::vector<int> & ells,
+                                                       const std::vector<double> & k,
+                                                       const std::vector<std::vector<double>> & Pell);
+
+        //=====================================================================================
+        /// @brief Compute the mode-coupling matrix. The output is the bin-average (with weight \f$ k^2 \f$) over the
+        /// bins with edges k_edges_out. The theory is integrated with the trapezoidal rule over the points k_in and
+        /// the s-integrals are done over the bins of the window. The window and k must be in the same units. The
+        /// rows are distributed over tasks and threads and all tasks have the full matrix at the end.
+        ///
+        /// @param[in] window The window multipoles (we use all the multipoles it has).
+        /// @param[in] ells_out The multipoles of the binned power-spectrum, e.g. {0,2,4}.
+        /// @param[in] k_edges_out The edges of the k-bins of the binned power-spectrum.
+        /// @param[in] ells_in The multipoles of the theory, e.g. {0,2,4}.
+        /// @param[in] k_in The points the theory is sampled at (increasing).
+        /// @param[in] nsub Number of points used for the bin-average of each k-bin.
+        ///
+        //=====================================================================================
+        ModeCouplingMatrix compute_mode_coupling_matrix(const WindowFunctionMultipoles & window,
+                                                        const std::vector<int> & ells_out,
+                                                        const std::vector<double> & k_edges_out,
+                                                        const std::vector<int> & ells_in,
+                                                        const std::vector<double> & k_in,
+                                                        int nsub = 8);
+
+        /// The Wigner 3j symbol \f$ \begin{pmatrix} l_1 & l_2 & l_3 \\ 0 & 0 & 0 \end{pmatrix} \f$
+        double wigner_3j_000(int l1, int l2, int l3);
+
+        //=====================================================================================
+        // Implementation
+        //=====================================================================================
+
+        inline double wigner_3j_000(int l1, int l2, int l3) {
+            const int J = l1 + l2 + l3;
+            if (J % 2 == 1 or l3 < std::abs(l1 - l2) or l3 > l1 + l2)
+                return 0.0;
+            const int g = J / 2;
+            const double logval = 0.5 * (std::lgamma(J - 2 * l1 + 1) + std::lgamma(J - 2 * l2 + 1) +
+                                         std::lgamma(J - 2 * l3 + 1) - std::lgamma(J + 2)) +
+                                  std::lgamma(g + 1) - std::lgamma(g - l1 + 1) - std::lgamma(g - l2 + 1) -
+                                  std::lgamma(g - l3 + 1);
+            return (g % 2 == 0 ? 1.0 : -1.0) * std::exp(logval);
+        }
+
+        // The coefficient of x^(ell-2k) in the Legendre polynomial L_ell(x)
+        inline double legendre_polynomial_coefficient(int ell, int k) {
+            auto binomial = [](int n, int m) -> double {
+                double res = 1.0;
+                for (int i = 0; i < m; i++)
+                    res *= double(n - i) / double(m - i);
+                return res;
+            };
+            const double sign = (k % 2) == 0 ? 1.0 : -1.0;
+            return sign * binomial(ell, k) * binomial(2 * ell - 2 * k, ell) / std::pow(2.0, ell);
+        }
+
+        // The coefficient of xi_l'(s) Q_L(s) in xihat_l(s)
+        inline double window_coupling_coefficient(int ell, int ell_prime, int L) {
+            const double w3j = wigner_3j_000(ell, ell_prime, L);
+            return (2 * ell + 1) * w3j * w3j;
+        }
+
+        template <int N, class U>
+        WindowFunctionMultipoles compute_window_function_multipoles(int Ngrid,
+                                                                    const U * randoms,
+                                                                    size_t nrandoms,
+                                                                    std::vector<double> observer_position,
+                                                                    int ellmax,
+                                                                    int nbins,
+                                                                    double smax,
+                                                                    std::string density_assignment_method) {
+            FML_PROFILE_SCOPE("compute_window_function_multipoles");
+
+            static_assert(FML::PARTICLE::has_get_pos<U>(),
+                          "[compute_window_function_multipoles] Particle class needs to have positions\n");
+            assert_mpi(observer_position.size() == N,
+                       "[compute_window_function_multipoles] Observer position has wrong number of dimensions\n");
+            assert_mpi(ellmax >= 0 and ellmax % 2 == 0, "[compute_window_function_multipoles] ellmax must be even\n");
+            assert_mpi(nbins > 0 and smax > 0.0 and smax <= 0.5,
+                       "[compute_window_function_multipoles] Need nbins > 0 and 0 < smax <= 0.5\n");
+
+            const auto nleftright = get_extra_slices_needed_for_density_assignment(density_assignment_method);
+            const int nleft = nleftright.first;
+            const int nright = nleftright.second;
+
+            //=====================================================================
+            // W(x) in real and fourier space
+            //=====================================================================
+
+            std::vector<double> weights(nrandoms);
+            for (size_t i = 0; i < nrandoms; i++)
+                weights[i] = FML::PARTICLE::GetWeight(const_cast<U &>(randoms[i]));
+
+            FFTWGrid<N> W_fourier(Ngrid, nleft, nright);
+            W_fourier.add_memory_label("FFTWGrid::compute_window_function_multipoles::W_fourier");
+            weighted_particles_to_grid<N, U>(randoms, nrandoms, weights, W_fourier, density_assignment_method);
+            std::vector<double>().swap(weights);
+            W_fourier.fftw_r2c();
+            deconvolve_window_function_fourier<N>(W_fourier, density_assignment_method);
+
+            FFTWGrid<N> W_real = W_fourier;
+            W_real.add_memory_label("FFTWGrid::compute_window_function_multipoles::W_real");
+            W_real.fftw_c2r();
+
+            FFTWGrid<N> work(Ngrid, nleft, nright);
+            work.add_memory_label("FFTWGrid::compute_window_function_multipoles::work");
+
+            const auto Local_nx = W_real.get_local_nx();
+            const auto Local_x_start = W_real.get_local_x_start();
+            const double inv_ds = nbins / smax;
+
+            // The number of cells and the sum of s in each bin
+            ThreadHistogram<2> counts(nbins);
+            // The moments M_2m(s) = < W(x)W(x+s) (shat*xhat)^2m >
+            const int nmoments = ellmax / 2 + 1;
+            std::vector<std::vector<double>> moments(nmoments, std::vector<double>(nbins, 0.0));
+            std::vector<double> count(nbins, 0.0);
+            std::vector<double> s_mean(nbins, 0.0);
+
+            for (int m = 0; m < nmoments; m++) {
+                const int rank = 2 * m;
+                ThreadHistogram<1> moment(nbins);
+
+                for (auto & c : get_symmetric_tensor_components<N>(rank)) {
+                    const auto & component = c.first;
+                    const double multiplicity = c.second;
+
+                    // G(x) = W(x) xhat_i xhat_j ...
+                    work.set_grid_status_real(true);
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        for (auto && real_index : W_real.get_real_range(islice, islice + 1)) {
+                            double value = W_real.get_real_from_index(real_index);
+                            if (rank > 0) {
+                                auto pos = W_real.get_real_position(W_real.get_coord_from_index(real_index));
+                                double r2 = 0.0;
+                                for (int idim = 0; idim < N; idim++) {
+                                    pos[idim] -= observer_position[idim];
+                                    r2 += pos[idim] * pos[idim];
+                                }
+                                if (r2 > 0.0) {
+                                    for (auto idim : component)
+                                        value *= pos[idim];
+                                    value /= std::pow(r2, rank / 2);
+                                }
+                            }
+                            work.set_real_from_index(real_index, value);
+                        }
+                    }
+                    work.fftw_r2c();
+
+                    // Correlation Sum_x G(x)W(x+s) is G^*(k)W(k) in fourier space
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        for (auto && fourier_index : work.get_fourier_range(islice, islice + 1)) {
+                            auto G = work.get_fourier_from_index(fourier_index);
+                            auto W = W_fourier.get_fourier_from_index(fourier_index);
+                            work.set_fourier_from_index(fourier_index, std::conj(G) * W);
+                        }
+                    }
+                    work.fftw_c2r();
+
+                    // Bin up multiplicity * shat_i shat_j ... * correlation(s)
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        int id = 0;
+#ifdef USE_OMP
+                        id = omp_get_thread_num();
+#endif
+                        for (auto && real_index : work.get_real_range(islice, islice + 1)) {
+                            auto coord = work.get_coord_from_index(real_index);
+                            coord[0] += int(Local_x_start);
+                            std::array<double, N> svec;
+                            double s2 = 0.0;
+                            for (int idim = 0; idim < N; idim++) {
+                                const int ci = coord[idim] < Ngrid / 2 ? coord[idim] : coord[idim] - Ngrid;
+                                svec[idim] = ci / double(Ngrid);
+                                s2 += svec[idim] * svec[idim];
+                            }
+                            if (s2 == 0.0)
+                                continue;
+                            const double smag = std::sqrt(s2);
+                            const int ibin = get_bin_index_linear(smag, 0.0, inv_ds, 0.0, nbins);
+                            if (ibin < 0)
+                                continue;
+
+                            double shat_product = multiplicity;
+                            for (auto idim : component)
+                                shat_product *= svec[idim] / smag;
+                            moment.add(id, ibin, shat_product * work.get_real_from_index(real_index));
+                            if (rank == 0)
+                                counts.add(id, ibin, 1.0, smag);
+                        }
+                    }
+                }
+
+                // Sum over threads and tasks
+                moment.reduce({moments[m].data()});
+                if (rank == 0)
+                    counts.reduce({count.data(), s_mean.data()});
+            }
+
+            //=====================================================================
+            // Shell average and Q_L = (2L+1) Sum_k c_k(L) M_(L-2k)
+            //=====================================================================
+
+            WindowFunctionMultipoles window;
+            window.ellmax = ellmax;
+            window.s.resize(nbins);
+            window.Q = std::vector<std::vector<double>>(ellmax + 1, std::vector<double>(nbins, 0.0));
+            for (int i = 0; i < nbins; i++) {
+                window.s[i] = count[i] > 0.0 ? s_mean[i] / count[i] : (i + 0.5) / inv_ds;
+                if (count[i] > 0.0)
+                    for (auto & M : moments)
+                        M[i] /= count[i];
+            }
+            for (int L = 0; L <= ellmax; L += 2) {
+                for (int k = 0; k <= L / 2; k++) {
+                    const double coeff = (2 * L + 1) * legendre_polynomial_coefficient(L, k);
+                    for (int i = 0; i < nbins; i++)
+                        window.Q[L][i] += coeff * moments[(L - 2 * k) / 2][i];
+                }
+            }
+
+            // Normalize to Q_0(s -> 0) = 1. We extrapolate linearly to s = 0 from the first two non-empty bins
+            // (Q_0 falls off linearly for small s, so using the first bin would be off by O(s/size of survey))
+            std::vector<int> nonempty;
+            for (int i = 0; i < nbins and nonempty.size() < 2; i++)
+                if (count[i] > 0.0)
+                    nonempty.push_back(i);
+            window.norm = nonempty.empty() ? 0.0 : window.Q[0][nonempty[0]];
+            if (nonempty.size() == 2) {
+                const int i0 = nonempty[0];
+                const int i1 = nonempty[1];
+                const double slope = (window.Q[0][i1] - window.Q[0][i0]) / (window.s[i1] - window.s[i0]);
+                window.norm = std::max(window.norm, window.Q[0][i0] - slope * window.s[i0]);
+            }
+            assert_mpi(window.norm > 0.0,
+                       "[compute_window_function_multipoles] The window is zero. No randoms or smax too small?\n");
+            for (auto & Q : window.Q)
+                for (auto & q : Q)
+                    q /= window.norm;
+
+            return window;
+        }
+
+        inline std::vector<std::vector<double>>
+        convolve_power_spectrum_multipoles_with_window(const WindowFunctionMultipoles & window,
+                                                       const std::vector<int> & ells,
+                                                       const std::vector<double> & k,
+                                                       const std::vector<std::vector<double>> & Pell) {
+            assert_mpi(Pell.size() == ells.size(),
+                       "[convolve_power_spectrum_multipoles_with_window] Need one P(k) per multipole\n");
+            for (size_t i = 0; i < ells.size(); i++)
+                assert_mpi(ells[i] % 2 == 0 and Pell[i].size() == k.size(),
+                           "[convolve_power_spectrum_multipoles_with_window] Only even multipoles and P(k) must have "
+                           "the same size as k\n");
+
+            // xi_l(s) = i^l Int k^2dk/(2pi^2) P_l(k) j_l(ks)
+            std::vector<double> r;
+            std::vector<std::vector<double>> xi(ells.size());
+            for (size_t i = 0; i < ells.size(); i++) {
+                auto res = FML::SOLVERS::FFTLog::ComputeXiLM(ells[i], 2, k, Pell[i]);
+                r = res.first;
+                xi[i] = res.second;
+                const double phase = (ells[i] / 2) % 2 == 0 ? 1.0 : -1.0;
+                for (auto & x : xi[i])
+                    x *= phase;
+            }
+
+            // The window at the r-values
+            std::vector<std::vector<double>> Q(window.ellmax + 1, std::vector<double>(r.size(), 0.0));
+            for (int L = 0; L <= window.ellmax; L += 2)
+                for (size_t j = 0; j < r.size(); j++)
+                    Q[L][j] = window(L, r[j]);
+
+            // xihat_l and back to fourier space: P_l(k) = (-i)^l (2pi)^3 Int s^2ds/(2pi^2) xi_l(s) j_l(ks)
+            std::vector<std::vector<double>> result(ells.size());
+            for (size_t i = 0; i < ells.size(); i++) {
+                std::vector<double> xihat(r.size(), 0.0);
+                for (size_t ip = 0; ip < ells.size(); ip++)
+                    for (int L = 0; L <= window.ellmax; L += 2) {
+                        const double coeff = window_coupling_coefficient(ells[i], ells[ip], L);
+                        if (coeff == 0.0)
+                            continue;
+                        for (size_t j = 0; j < r.size(); j++)
+                            xihat[j] += coeff * Q[L][j] * xi[ip][j];
+                    }
+                auto res = FML::SOLVERS::FFTLog::ComputeXiLM(ells[i], 2, r, xihat);
+                const double phase = (ells[i] / 2) % 2 == 0 ? 1.0 : -1.0;
+                result[i] = res.second;
+                for (auto & p : result[i])
+                    p *= phase * 8.0 * M_PI * M_PI * M_PI;
+            }
+            return result;
+        }
+
+        inline ModeCouplingMatrix compute_mode_coupling_matrix(const WindowFunctionMultipoles & window,
+                                                               const std::vector<int> & ells_out,
+                                                               const std::vector<double> & k_edges_out,
+                                                               const std::vector<int> & ells_in,
+                                                               const std::vector<double> & k_in,
+                                                               int nsub) {
+            FML_PROFILE_SCOPE("compute_mode_coupling_matrix");
+            assert_mpi(k_edges_out.size() >= 2 and k_in.size() >= 2 and nsub > 0 and window.s.size() >= 2,
+                       "[compute_mode_coupling_matrix] Need at least one output bin, two input k and two s-bins\n");
+
+            ModeCouplingMatrix M;
+            M.ells_out = ells_out;
+            M.ells_in = ells_in;
+            M.k_edges_out = k_edges_out;
+            M.k_in = k_in;
+            const int nk_out = int(k_edges_out.size()) - 1;
+            const int nk_in = int(k_in.size());
+            const int ns = int(window.s.size());
+            const int ncols = M.ncols();
+            const int nrows = M.nrows();
+            M.matrix.assign(size_t(nrows) * ncols, 0.0);
+
+            // The s-integration: Int s^2 ds f(s) = Sum_b ds_b s_b^2 f(s_b) over the bins of the window
+            std::vector<double> s2ds(ns);
+            for (int b = 0; b < ns; b++) {
+                const double ds = b == 0 ? window.s[1] - window.s[0] :
+                                           (b == ns - 1 ? window.s[b] - window.s[b - 1] :
+                                                          0.5 * (window.s[b + 1] - window.s[b - 1]));
+                s2ds[b] = window.s[b] * window.s[b] * ds;
+            }
+
+            // The k-integration: Int k^2dk/(2pi^2) f(k) with the trapezoidal rule
+            std::vector<double> k2dk(nk_in);
+            for (int j = 0; j < nk_in; j++) {
+                const double kl = j == 0 ? k_in[0] : k_in[j - 1];
+                const double kr = j == nk_in - 1 ? k_in[nk_in - 1] : k_in[j + 1];
+                k2dk[j] = k_in[j] * k_in[j] * 0.5 * (kr - kl) / (2.0 * M_PI * M_PI);
+            }
+
+            // B[iell_in][j][b] = k2dk_j j_l'(k_j s_b): the xi_l'(s) from a unit P_l'(k_j) (up to the phase)
+            std::vector<std::vector<double>> B(ells_in.size(), std::vector<double>(size_t(nk_in) * ns));
+#ifdef USE_OMP
+#pragma omp parallel for collapse(2)
+#endif
+            for (size_t il = 0; il < ells_in.size(); il++)
+                for (int j = 0; j < nk_in; j++)
+                    for (int b = 0; b < ns; b++)
+                        B[il][size_t(j) * ns + b] = k2dk[j] * FML::MATH::j_ell(ells_in[il], k_in[j] * window.s[b]);
+
+            // Distribute the rows over tasks (round robin as the cost is the same for all rows)
+            std::vector<int> my_rows;
+            for (int row = FML::ThisTask; row < nrows; row += FML::NTasks)
+                my_rows.push_back(row);
+
+#ifdef USE_OMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+            for (size_t irow = 0; irow < my_rows.size(); irow++) {
+                const int row = my_rows[irow];
+                const int iell_out = row / nk_out;
+                const int ik_out = row % nk_out;
+                const int ell = ells_out[iell_out];
+
+                // A(s) = 4pi s^2 ds <j_l(k s)> averaged over the bin with weight k^2
+                std::vector<double> A(ns, 0.0);
+                const double klow = k_edges_out[ik_out];
+                const double khigh = k_edges_out[ik_out + 1];
+                double sumw = 0.0;
+                for (int isub = 0; isub < nsub; isub++) {
+                    const double kval = klow + (khigh - klow) * (isub + 0.5) / double(nsub);
+                    const double w = kval * kval;
+                    sumw += w;
+                    for (int b = 0; b < ns; b++)
+                        A[b] += w * FML::MATH::j_ell(ell, kval * window.s[b]);
+                }
+                for (int b = 0; b < ns; b++)
+                    A[b] *= 4.0 * M_PI * s2ds[b] / sumw;
+
+                std::vector<double> AC(ns);
+                for (size_t iell_in = 0; iell_in < ells_in.size(); iell_in++) {
+                    const int ell_prime = ells_in[iell_in];
+
+                    // The window coupling C(s) and the phase i^(l'-l)
+                    const double phase = ((ell_prime - ell) / 2) % 2 == 0 ? 1.0 : -1.0;
+                    std::fill(AC.begin(), AC.end(), 0.0);
+                    for (int L = 0; L <= window.ellmax; L += 2) {
+                        const double coeff = window_coupling_coefficient(ell, ell_prime, L);
+                        if (coeff == 0.0)
+                            continue;
+                        for (int b = 0; b < ns; b++)
+                            AC[b] += coeff * window.Q[L][b];
+                    }
+                    for (int b = 0; b < ns; b++)
+                        AC[b] *= phase * A[b];
+
+                    double * Mrow = &M.matrix[size_t(row) * ncols + iell_in * nk_in];
+                    for (int j = 0; j < nk_in; j++) {
+                        const double * Bj = &B[iell_in][size_t(j) * ns];
+                        double sum = 0.0;
+                        for (int b = 0; b < ns; b++)
+                            sum += AC[b] * Bj[b];
+                        Mrow[j] = sum;
+                    }
+                }
+            }
+
+            // Every task has computed its own rows (the rest is zero)
+            FML::SumArrayOverTasks(M.matrix.data(), int(M.matrix.size()));
+            return M;
+        }
+
+        inline std::vector<std::vector<double>>
+        ModeCouplingMatrix::apply(const std::vector<std::vector<double>> & Pell_in) const {
+            const int nk_out = int(k_edges_out.size()) - 1;
+            const int nk_in = int(k_in.size());
+            assert_mpi(Pell_in.size() == ells_in.size(), "[ModeCouplingMatrix::apply] Need one P(k) per multipole\n");
+            std::vector<std::vector<double>> Pell_out(ells_out.size(), std::vector<double>(nk_out, 0.0));
+            for (size_t iell_out = 0; iell_out < ells_out.size(); iell_out++) {
+                for (int ik_out = 0; ik_out < nk_out; ik_out++) {
+                    const double * row = &matrix[(iell_out * nk_out + ik_out) * size_t(ncols())];
+                    double sum = 0.0;
+                    for (size_t iell_in = 0; iell_in < ells_in.size(); iell_in++) {
+                        assert_mpi(int(Pell_in[iell_in].size()) == nk_in,
+                                   "[ModeCouplingMatrix::apply] P(k) has the wrong size\n");
+                        for (int j = 0; j < nk_in; j++)
+                            sum += row[iell_in * nk_in + j] * Pell_in[iell_in][j];
+                    }
+                    Pell_out[iell_out][ik_out] = sum;
+                }
+            }
+            return Pell_out;
+        }
+
+        // The format: "FMLMCM" + int32 version, 4 x int32 (nell_out, nk_out + 1, nell_in, nk_in), the ells as int32,
+        // k_edges_out and k_in as float64 and then the matrix as float64 in row-major order
+        inline void ModeCouplingMatrix::write_binary(std::string filename) const {
+            if (FML::ThisTask > 0)
+                return;
+            std::ofstream fp(filename.c_str(), std::ios::binary);
+            if (not fp.is_open())
+                throw std::runtime_error("[ModeCouplingMatrix::write_binary] Failed to open " + filename + "\n");
+            const char magic[6] = {'F', 'M', 'L', 'M', 'C', 'M'};
+            const std::int32_t header[5] = {1,
+                                            std::int32_t(ells_out.size()),
+                                            std::int32_t(k_edges_out.size()),
+                                            std::int32_t(ells_in.size()),
+                                            std::int32_t(k_in.size())};
+            fp.write(magic, sizeof(magic));
+            fp.write(reinterpret_cast<const char *>(header), sizeof(header));
+            for (auto ell : ells_out) {
+                std::int32_t e = ell;
+                fp.write(reinterpret_cast<const char *>(&e), sizeof(e));
+            }
+            for (auto ell : ells_in) {
+                std::int32_t e = ell;
+                fp.write(reinterpret_cast<const char *>(&e), sizeof(e));
+            }
+            fp.write(reinterpret_cast<const char *>(k_edges_out.data()), sizeof(double) * k_edges_out.size());
+            fp.write(reinterpret_cast<const char *>(k_in.data()), sizeof(double) * k_in.size());
+            fp.write(reinterpret_cast<const char *>(matrix.data()), sizeof(double) * matrix.size());
+        }
+
+        inline void ModeCouplingMatrix::read_binary(std::string filename) {
+            std::ifstream fp(filename.c_str(), std::ios::binary);
+            if (not fp.is_open())
+                throw std::runtime_error("[ModeCouplingMatrix::read_binary] Failed to open " + filename + "\n");
+            char magic[6];
+            std::int32_t header[5];
+            fp.read(magic, sizeof(magic));
+            fp.read(reinterpret_cast<char *>(header), sizeof(header));
+            if (not fp.good() or std::string(magic, 6) != "FMLMCM" or header[0] != 1)
+                throw std::runtime_error("[ModeCouplingMatrix::read_binary] Not a mode-coupling matrix file: " +
+                                         filename + "\n");
+            auto read_ells = [&](std::vector<int> & ells, int n) {
+                ells.resize(n);
+                for (auto & ell : ells) {
+                    std::int32_t e;
+                    fp.read(reinterpret_cast<char *>(&e), sizeof(e));
+                    ell = e;
+                }
+            };
+            read_ells(ells_out, header[1]);
+            read_ells(ells_in, header[3]);
+            k_edges_out.resize(header[2]);
+            k_in.resize(header[4]);
+            fp.read(reinterpret_cast<char *>(k_edges_out.data()), sizeof(double) * k_edges_out.size());
+            fp.read(reinterpret_cast<char *>(k_in.data()), sizeof(double) * k_in.size());
+            matrix.resize(size_t(nrows()) * ncols());
+            fp.read(reinterpret_cast<char *>(matrix.data()), sizeof(double) * matrix.size());
+            if (not fp.good())
+                throw std::runtime_error("[ModeCouplingMatrix::read_binary] File is truncated: " + filename + "\n");
+        }
+
+    } // namespace CORRELATIONFUNCTIONS
+} // namespace FML
+
+#endif
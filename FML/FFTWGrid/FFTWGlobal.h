@@ -52,6 +52,9 @@ using my_fftw_plan = fftwf_plan;
 #define MAKE_PLAN_R2C fftwf_plan_dft_r2c
 #define MAKE_PLAN_C2R fftwf_plan_dft_c2r
 #endif
+#define SERIAL_MAKE_PLAN_R2C fftwf_plan_dft_r2c
+#define SERIAL_MAKE_PLAN_C2R fftwf_plan_dft_c2r
+#define MAKE_PLAN_MANY_DFT fftwf_plan_many_dft
 #define EXECUTE_FFT fftwf_execute
 #define DESTROY_PLAN fftwf_destroy_plan
 #else // Single precision
@@ -70,6 +73,9 @@ using my_fftw_plan = fftwl_plan;
 #define MAKE_PLAN_R2C fftwl_plan_dft_r2c
 #define MAKE_PLAN_C2R fftwl_plan_dft_c2r
 #endif
+#define SERIAL_MAKE_PLAN_R2C fftwl_plan_dft_r2c
+#define SERIAL_MAKE_PLAN_C2R fftwl_plan_dft_c2r
+#define MAKE_PLAN_MANY_DFT fftwl_plan_many_dft
 #define EXECUTE_FFT fftwl_execute
 #define DESTROY_PLAN fftwl_destroy_plan
 #else // Long double precision
@@ -87,6 +93,9 @@ using my_fftw_plan = fftw_plan;
 #define MAKE_PLAN_R2C fftw_plan_dft_r2c
 #define MAKE_PLAN_C2R fftw_plan_dft_c2r
 #endif
+#define SERIAL_MAKE_PLAN_R2C fftw_plan_dft_r2c
+#define SERIAL_MAKE_PLAN_C2R fftw_plan_dft_c2r
+#define MAKE_PLAN_MANY_DFT fftw_plan_many_dft
 #define EXECUTE_FFT fftw_execute
 #define DESTROY_PLAN fftw_destroy_plan
 #endif // Double precision
@@ -7,6 +7,7 @@
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <type_traits>
 #include <vector>
 #ifdef USE_FFTW
 #include <fftw3.h>
@@ -258,6 +259,20 @@ namespace FML {
             /// For the Fourier range islice denotes the ikx value
             FourierRange get_fourier_range(int islice_begin = 0, int islice_end = 0) const;
 
+            /// Loop over all active cells in the main fourier grid calling kernel(fourier_index, kvec, kmag2) or
+            /// kernel(fourier_index, kvec, kmag2, last_coord) for every cell (last_coord is the coordinate along the
+            /// last axis, useful for the weight of the k_N = 0 and k_N = Nmesh/2 planes). The loop is parallelized
+            /// over slices with OpenMP so the kernel must be thread-safe. Faster than looping with get_fourier_range
+            /// and calling get_fourier_wavevector_and_norm2_by_index as we walk the cells in order and update the
+            /// wave-vector from tables instead of computing the coordinates from the index (no divisions per cell).
+            /// For physical [k] multiply by 1/Boxsize
+            template <class Kernel>
+            void for_each_fourier(Kernel && kernel) const;
+
+            /// The wave-numbers \f$ 2\pi i \f$ for \f$ i \in [0,N/2] \f$ and \f$ 2\pi (i - N) \f$ otherwise for
+            /// i = 0,1,...,Nmesh-1. The wave-vector of a cell is (table[Local_x_start + ix], table[iy], ...)
+            std::vector<double> get_fourier_wavenumber_table() const;
+
             /// The number of cells per slice that we alloc. Useful to jump from slice to slice
             ptrdiff_t get_ntot_real_slice_alloc() const;
 
@@ -775,6 +790,7 @@ namespace FML {
             NmeshTotRealAlloc = 2 * NmeshTotComplexAlloc;
 
             // Allocate memory and initialize to 0
+            FML_MEMORY_DEFAULT_TAG_SCOPE(Grids);
             fourier_grid_raw.resize(NmeshTotComplexAlloc);
             add_memory_label("FFTWGrid");
             std::fill(fourier_grid_raw.begin(), fourier_grid_raw.end(), 0.0);
@@ -880,6 +896,8 @@ namespace FML {
         template <int N>
         void FFTWGrid<N>::fftw_r2c() {
 #ifdef USE_FFTW
+            FML_PROFILE_SCOPE("fftw_r2c");
+            FML_PROFILE_ADD_BYTES(sizeof(FloatType) * NmeshTotRealAlloc);
 
 #ifdef DEBUG_FFTWGRID
             if (FML::ThisTask == 0) {
@@ -945,6 +963,8 @@ namespace FML {
         template <int N>
         void FFTWGrid<N>::fftw_c2r() {
 #ifdef USE_FFTW
+            FML_PROFILE_SCOPE("fftw_c2r");
+            FML_PROFILE_ADD_BYTES(sizeof(FloatType) * NmeshTotRealAlloc);
 
 #ifdef DEBUG_FFTWGRID
             if (FML::ThisTask == 0) {
@@ -1221,6 +1241,74 @@ namespace FML {
             return fcoord;
         }
 
+        template <int N>
+        std::vector<double> FFTWGrid<N>::get_fourier_wavenumber_table() const {
+            const double twopi = 2.0 * M_PI;
+            std::vector<double> table(Nmesh);
+            for (int i = 0; i < Nmesh; i++)
+                table[i] = twopi * double(i <= Nmesh / 2 ? i : i - Nmesh);
+            return table;
+        }
+
+        template <int N>
+        template <class Kernel>
+        void FFTWGrid<N>::for_each_fourier(Kernel && kernel) const {
+            constexpr bool kernel_takes_last_coord =
+                std::is_invocable_v<Kernel &, IndexIntType, const std::array<double, N> &, double, int>;
+
+            // The wave-numbers and their squares along an axis
+            const int nover2plus1 = Nmesh / 2 + 1;
+            const std::vector<double> ktable = get_fourier_wavenumber_table();
+            std::vector<double> k2table(Nmesh);
+            for (int i = 0; i < Nmesh; i++)
+                k2table[i] = ktable[i] * ktable[i];
+
+            // Number of rows (cells along the last axis) per slice. In 1D every slice is a single cell
+            const IndexIntType rows_per_slice = N > 1 ? FML::power(Nmesh, N - 2) : 1;
+            const IndexIntType cells_per_slice = N > 1 ? rows_per_slice * nover2plus1 : 1;
+            const int nlast = N > 1 ? nover2plus1 : 1;
+            const int nslices = N > 1 ? int(Local_nx) : nover2plus1;
+
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+            for (int islice = 0; islice < nslices; islice++) {
+                std::array<double, N> kvec;
+                std::array<int, N> coord{};
+                kvec[0] = ktable[Local_x_start + islice];
+
+                IndexIntType index = cells_per_slice * islice;
+                for (IndexIntType irow = 0; irow < rows_per_slice; irow++) {
+                    // |k|^2 from all but the last axis is the same along the row
+                    double kmag2_row = k2table[Local_x_start + islice];
+                    for (int idim = 1; idim < N - 1; idim++) {
+                        kvec[idim] = ktable[coord[idim]];
+                        kmag2_row += k2table[coord[idim]];
+                    }
+
+                    for (int ilast = 0; ilast < nlast; ilast++, index++) {
+                        double kmag2 = kmag2_row;
+                        if constexpr (N > 1) {
+                            kvec[N - 1] = ktable[ilast];
+                            kmag2 += k2table[ilast];
+                        }
+                        if constexpr (kernel_takes_last_coord) {
+                            kernel(index, kvec, kmag2, N > 1 ? ilast : int(Local_x_start) + islice);
+                        } else {
+                            kernel(index, kvec, kmag2);
+                        }
+                    }
+
+                    // Next row: increment the coordinates of the middle axes
+                    for (int idim = N - 2; idim >= 1; idim--) {
+                        if (++coord[idim] < Nmesh)
+                            break;
+                        coord[idim] = 0;
+                    }
+                }
+            }
+        }
+
         template <int N>
         void fftw_c2r(FFTWGrid<N> & in_grid, FFTWGrid<N> & out_grid) {
 #ifdef DEBUG_FFTWGRID
@@ -1347,6 +1435,7 @@ namespace FML {
 
             // Allocate and read main grid
             size_t bytes = sizeof(ComplexType) * NmeshTotComplexAlloc;
+            FML_MEMORY_DEFAULT_TAG_SCOPE(Grids);
             fourier_grid_raw.resize(NmeshTotComplexAlloc);
             myfile.read((char *)fourier_grid_raw.data(), bytes);
 
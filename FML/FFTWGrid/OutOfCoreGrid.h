@@ -0,0 +1,530 @@
+#ifndef OUTOFCOREGRID_HEADER
+#define OUTOFCOREGRID_HEADER
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include <FML/FFTWGrid/FFTWGrid.h>
+#include <FML/Global/Global.h>
+
+namespace FML {
+    namespace GRID {
+
+        //==========================================================================
+        ///
+        /// Class for holding grids that are too large to fit in memory. The grid is
+        /// stored in a scratch file (preferably on a fast node-local disk) and only a
+        /// few pieces of it are in memory at any time. Templated on dimension (N >= 2).
+        ///
+        /// The file holds Nmesh x-slabs with the same padded layout as a slice of FFTWGrid:
+        /// Nmesh^(N-2) rows of 2(Nmesh/2+1) reals in real space or of (Nmesh/2+1) complex
+        /// numbers in fourier space. The fourier grid is stored with x as the slowest axis
+        /// just like FFTWGrid so a slab can be processed with the same index arithmetic.
+        ///
+        /// All sweeps over the grid stream it through three buffers: while one buffer is
+        /// being processed the next one is read ahead and the previous one is written
+        /// behind asynchronously.
+        ///
+        /// The FFT is done in two passes over the file:
+        ///
+        ///   1) An in-core (N-1)-dimensional real-to-complex transform of every slab
+        ///
+        ///   2) An out-of-core transpose: blocks of cells are gathered from all the slabs,
+        ///      transformed with 1D complex FFTs along x and scattered back
+        ///
+        /// with the same normalization as FFTWGrid. The complex-to-real transform does the same in reverse.
+        ///
+        /// The constructor arguments are:
+        ///
+        ///   Nmesh            : Number of grid-nodes per dimension
+        ///
+        ///   filename         : The scratch file to store the grid in (created, and deleted with the grid)
+        ///
+        ///   memory_budget    : Memory (in bytes) to use for the transpose blocks. Larger blocks give larger
+        ///                      (and fewer) reads in the transpose pass. Three slabs are kept in memory
+        ///                      in the slab sweeps regardless of this value
+        ///
+        /// The grid is local to the task that creates it, i.e. it is not distributed over MPI tasks.
+        ///
+        //==========================================================================
+
+        template <int N>
+        class OutOfCoreGrid {
+            static_assert(N >= 2, "[OutOfCoreGrid] Only implemented for N >= 2");
+
+          private:
+            int Nmesh{0};
+            std::string filename{};
+            int fd{-1};
+            size_t memory_budget{0};
+            bool grid_is_in_real_space{true};
+
+            // Number of rows per slab and number of complex cells per row
+            IndexIntType rows_per_slab{0};
+            IndexIntType cells_per_row{0};
+
+            void read_bytes(void * buffer, size_t nbytes, size_t offset) const;
+            void write_bytes(const void * buffer, size_t nbytes, size_t offset);
+
+            template <class Read, class Process, class Write>
+            void stream(
+                int nitems, size_t buffer_size, Read && read, Process && process, Write && write, bool write_back);
+
+            void transform_slabs(bool real_to_complex);
+            // sign is the sign in the exponent (-1 = FFTW_FORWARD, +1 = FFTW_BACKWARD)
+            void transform_along_x(int sign, double norm);
+
+            void close_file();
+
+          public:
+            OutOfCoreGrid() = default;
+            OutOfCoreGrid(int Nmesh, std::string filename, size_t memory_budget = size_t(1) << 30);
+            OutOfCoreGrid(const OutOfCoreGrid & rhs) = delete;
+            OutOfCoreGrid & operator=(const OutOfCoreGrid & rhs) = delete;
+            OutOfCoreGrid(OutOfCoreGrid && rhs) noexcept;
+            OutOfCoreGrid & operator=(OutOfCoreGrid && rhs) noexcept;
+            ~OutOfCoreGrid();
+
+            /// Get the number of cells per dimension
+            int get_nmesh() const;
+            /// Get the name of the scratch file
+            std::string get_filename() const;
+            /// Is the grid in real space (or fourier space)
+            bool get_grid_status_real() const;
+            /// Set the status of the grid (only a label, no transforms are done)
+            void set_grid_status_real(bool grid_is_in_real_space);
+
+            /// Number of reals in a slab (including the padding)
+            IndexIntType get_ntot_real_slab_alloc() const;
+            /// Number of complex cells in a slab
+            IndexIntType get_ntot_fourier_slab() const;
+
+            /// Read a slab from disk. The buffer must have room for get_ntot_real_slab_alloc() reals
+            void read_slab(int islab, FloatType * slab) const;
+            /// Write a slab to disk. The buffer must have get_ntot_real_slab_alloc() reals
+            void write_slab(int islab, const FloatType * slab);
+
+            /// Stream over all the slabs calling func(islab, slab) where slab points to the slab in memory.
+            /// If write_back the (modified) slabs are written back to disk
+            void for_each_slab(std::function<void(int, FloatType *)> func, bool write_back);
+
+            /// Loop over all real cells calling kernel(FloatType & value, const std::array<int, N> & coord).
+            /// The kernel is called from several threads. If write_back the values are written back to disk
+            template <class Kernel>
+            void for_each_real(Kernel && kernel, bool write_back);
+
+            /// Loop over all fourier cells calling
+            /// kernel(ComplexType & value, const std::array<double, N> & kvec, double kmag2, int last_coord)
+            /// where last_coord is the cell coordinate along the last axis (to identify the k_last = 0 and
+            /// Nyquist planes). The kernel is called from several threads. If write_back the values are written
+            /// back to disk
+            template <class Kernel>
+            void for_each_fourier(Kernel && kernel, bool write_back);
+
+            /// Fourier transform the grid (same normalization as FFTWGrid)
+            void fftw_r2c();
+            /// Inverse fourier transform the grid
+            void fftw_c2r();
+
+            /// Copy the content (and status) of an in-core grid. The grid must have all the slabs on this task
+            void copy_from(FFTWGrid<N> & grid);
+            /// Copy the content (and status) to an in-core grid. The grid must have all the slabs on this task
+            void copy_to(FFTWGrid<N> & grid) const;
+        };
+
+        template <int N>
+        OutOfCoreGrid<N>::OutOfCoreGrid(int _Nmesh, std::string _filename, size_t _memory_budget)
+            : Nmesh(_Nmesh), filename(_filename), memory_budget(_memory_budget) {
+            assert_mpi(Nmesh > 0, "[OutOfCoreGrid] Nmesh must be positive\n");
+            rows_per_slab = FML::power(Nmesh, N - 2);
+            cells_per_row = Nmesh / 2 + 1;
+
+            fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+            if (fd < 0)
+                throw std::runtime_error("[OutOfCoreGrid] Cannot create scratch file " + filename + ": " +
+                                         std::strerror(errno));
+
+            // Allocate the whole file (the grid starts out as zero)
+            const size_t slab_bytes = sizeof(ComplexType) * get_ntot_fourier_slab();
+            if (ftruncate(fd, off_t(slab_bytes * Nmesh)) != 0) {
+                std::string error = std::strerror(errno);
+                close_file();
+                throw std::runtime_error("[OutOfCoreGrid] Cannot allocate scratch file " + filename + ": " + error);
+            }
+        }
+
+        template <int N>
+        OutOfCoreGrid<N>::OutOfCoreGrid(OutOfCoreGrid && rhs) noexcept {
+            *this = std::move(rhs);
+        }
+
+        template <int N>
+        OutOfCoreGrid<N> & OutOfCoreGrid<N>::operator=(OutOfCoreGrid && rhs) noexcept {
+            if (this == &rhs)
+                return *this;
+            close_file();
+            Nmesh = rhs.Nmesh;
+            filename = std::move(rhs.filename);
+            fd = rhs.fd;
+            memory_budget = rhs.memory_budget;
+            grid_is_in_real_space = rhs.grid_is_in_real_space;
+            rows_per_slab = rhs.rows_per_slab;
+            cells_per_row = rhs.cells_per_row;
+            rhs.fd = -1;
+            rhs.Nmesh = 0;
+            return *this;
+        }
+
+        template <int N>
+        OutOfCoreGrid<N>::~OutOfCoreGrid() {
+            close_file();
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::close_file() {
+            if (fd < 0)
+                return;
+            close(fd);
+            unlink(filename.c_str());
+            fd = -1;
+        }
+
+        template <int N>
+        int OutOfCoreGrid<N>::get_nmesh() const {
+            return Nmesh;
+        }
+
+        template <int N>
+        std::string OutOfCoreGrid<N>::get_filename() const {
+            return filename;
+        }
+
+        template <int N>
+        bool OutOfCoreGrid<N>::get_grid_status_real() const {
+            return grid_is_in_real_space;
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::set_grid_status_real(bool _grid_is_in_real_space) {
+            grid_is_in_real_space = _grid_is_in_real_space;
+        }
+
+        template <int N>
+        IndexIntType OutOfCoreGrid<N>::get_ntot_real_slab_alloc() const {
+            return 2 * rows_per_slab * cells_per_row;
+        }
+
+        template <int N>
+        IndexIntType OutOfCoreGrid<N>::get_ntot_fourier_slab() const {
+            return rows_per_slab * cells_per_row;
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::read_bytes(void * buffer, size_t nbytes, size_t offset) const {
+            char * ptr = static_cast<char *>(buffer);
+            while (nbytes > 0) {
+                ssize_t nread = pread(fd, ptr, nbytes, off_t(offset));
+                if (nread < 0 and errno == EINTR)
+                    continue;
+                if (nread <= 0)
+                    throw std::runtime_error("[OutOfCoreGrid] Read from " + filename + " failed: " +
+                                             (nread == 0 ? "unexpected end of file" : std::strerror(errno)));
+                ptr += nread;
+                offset += size_t(nread);
+                nbytes -= size_t(nread);
+            }
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::write_bytes(const void * buffer, size_t nbytes, size_t offset) {
+            const char * ptr = static_cast<const char *>(buffer);
+            while (nbytes > 0) {
+                ssize_t nwritten = pwrite(fd, ptr, nbytes, off_t(offset));
+                if (nwritten < 0 and errno == EINTR)
+                    continue;
+                if (nwritten <= 0)
+                    throw std::runtime_error("[OutOfCoreGrid] Write to " + filename + " failed: " +
+                                             std::strerror(errno));
+                ptr += nwritten;
+                offset += size_t(nwritten);
+                nbytes -= size_t(nwritten);
+            }
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::read_slab(int islab, FloatType * slab) const {
+            assert_mpi(islab >= 0 and islab < Nmesh, "[OutOfCoreGrid::read_slab] Slab out of range\n");
+            const size_t slab_bytes = sizeof(FloatType) * get_ntot_real_slab_alloc();
+            read_bytes(slab, slab_bytes, slab_bytes * islab);
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::write_slab(int islab, const FloatType * slab) {
+            assert_mpi(islab >= 0 and islab < Nmesh, "[OutOfCoreGrid::write_slab] Slab out of range\n");
+            const size_t slab_bytes = sizeof(FloatType) * get_ntot_real_slab_alloc();
+            write_bytes(slab, slab_bytes, slab_bytes * islab);
+        }
+
+        //==========================================================================
+        /// Process nitems items that are read from and written to disk. We use three
+        /// buffers of buffer_size reals: while item i is processed item i+1 is read
+        /// into the next buffer and item i-1 is written from the previous one.
+        /// The I/O is done asynchronously while process is called on this thread
+        /// (so it is free to use OpenMP and FFTW).
+        //==========================================================================
+        template <int N>
+        template <class Read, class Process, class Write>
+        void OutOfCoreGrid<N>::stream(
+            int nitems, size_t buffer_size, Read && read, Process && process, Write && write, bool write_back) {
+            if (nitems == 0)
+                return;
+
+            std::array<std::vector<FloatType>, 3> buffers;
+            for (auto & buffer : buffers)
+                buffer.resize(buffer_size);
+            std::future<void> read_ahead;
+            std::future<void> write_behind;
+
+            read(0, buffers[0].data());
+            for (int i = 0; i < nitems; i++) {
+                FloatType * current = buffers[i % 3].data();
+
+                // The buffer of item i+1 was last used by item i-2 which has been written
+                if (i + 1 < nitems) {
+                    FloatType * next = buffers[(i + 1) % 3].data();
+                    read_ahead = std::async(std::launch::async, [&read, next, i]() { read(i + 1, next); });
+                }
+
+                process(i, current);
+
+                if (write_behind.valid())
+                    write_behind.get();
+                if (write_back)
+                    write_behind = std::async(std::launch::async, [&write, current, i]() { write(i, current); });
+                if (read_ahead.valid())
+                    read_ahead.get();
+            }
+            if (write_behind.valid())
+                write_behind.get();
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::for_each_slab(std::function<void(int, FloatType *)> func, bool write_back) {
+            assert_mpi(fd >= 0, "[OutOfCoreGrid::for_each_slab] Grid is not allocated\n");
+            stream(
+                Nmesh,
+                get_ntot_real_slab_alloc(),
+                [&](int islab, FloatType * slab) { read_slab(islab, slab); },
+                func,
+                [&](int islab, FloatType * slab) { write_slab(islab, slab); },
+                write_back);
+        }
+
+        template <int N>
+        template <class Kernel>
+        void OutOfCoreGrid<N>::for_each_real(Kernel && kernel, bool write_back) {
+            const IndexIntType padded_row = 2 * cells_per_row;
+            for_each_slab(
+                [&](int islab, FloatType * slab) {
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                    for (IndexIntType irow = 0; irow < rows_per_slab; irow++) {
+                        std::array<int, N> coord;
+                        coord[0] = islab;
+                        for (IndexIntType idim = N - 2, row = irow; idim >= 1; idim--, row /= Nmesh)
+                            coord[idim] = int(row % Nmesh);
+                        FloatType * row_ptr = slab + padded_row * irow;
+                        for (int ilast = 0; ilast < Nmesh; ilast++) {
+                            coord[N - 1] = ilast;
+                            kernel(row_ptr[ilast], coord);
+                        }
+                    }
+                },
+                write_back);
+        }
+
+        template <int N>
+        template <class Kernel>
+        void OutOfCoreGrid<N>::for_each_fourier(Kernel && kernel, bool write_back) {
+            const double twopi = 2.0 * M_PI;
+            std::vector<double> ktable(Nmesh);
+            std::vector<double> k2table(Nmesh);
+            for (int i = 0; i < Nmesh; i++) {
+                ktable[i] = twopi * double(i <= Nmesh / 2 ? i : i - Nmesh);
+                k2table[i] = ktable[i] * ktable[i];
+            }
+
+            for_each_slab(
+                [&](int islab, FloatType * slab) {
+                    ComplexType * cslab = reinterpret_cast<ComplexType *>(slab);
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                    for (IndexIntType irow = 0; irow < rows_per_slab; irow++) {
+                        std::array<double, N> kvec;
+                        kvec[0] = ktable[islab];
+                        double kmag2_row = k2table[islab];
+                        for (IndexIntType idim = N - 2, row = irow; idim >= 1; idim--, row /= Nmesh) {
+                            kvec[idim] = ktable[row % Nmesh];
+                            kmag2_row += k2table[row % Nmesh];
+                        }
+                        ComplexType * row_ptr = cslab + cells_per_row * irow;
+                        for (int ilast = 0; ilast < cells_per_row; ilast++) {
+                            kvec[N - 1] = ktable[ilast];
+                            kernel(row_ptr[ilast], kvec, kmag2_row + k2table[ilast], ilast);
+                        }
+                    }
+                },
+                write_back);
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::transform_slabs([[maybe_unused]] bool real_to_complex) {
+#ifdef USE_FFTW
+            std::vector<int> NmeshPerDim(N - 1, Nmesh);
+            for_each_slab(
+                [&](int, FloatType * slab) {
+                    // Planning with FFTW_ESTIMATE does not touch the data and is cheap compared to the I/O
+                    my_fftw_complex * cslab = reinterpret_cast<my_fftw_complex *>(slab);
+                    my_fftw_plan plan =
+                        real_to_complex ? SERIAL_MAKE_PLAN_R2C(N - 1, NmeshPerDim.data(), slab, cslab, FFTW_ESTIMATE) :
+                                          SERIAL_MAKE_PLAN_C2R(N - 1, NmeshPerDim.data(), cslab, slab, FFTW_ESTIMATE);
+                    EXECUTE_FFT(plan);
+                    DESTROY_PLAN(plan);
+                },
+                true);
+#else
+            assert_mpi(false, "[OutOfCoreGrid] Compiled without FFTW support so cannot take Fourier transforms\n");
+#endif
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::transform_along_x([[maybe_unused]] int sign, [[maybe_unused]] double norm) {
+#ifdef USE_FFTW
+            // Split the cells of a slab into blocks such that three blocks (with all Nmesh slabs) fit in memory
+            const IndexIntType cells_per_slab = get_ntot_fourier_slab();
+            const IndexIntType cells_per_block = std::clamp(
+                IndexIntType(memory_budget / (3 * sizeof(ComplexType) * Nmesh)), IndexIntType(1), cells_per_slab);
+            const int nblocks = int((cells_per_slab + cells_per_block - 1) / cells_per_block);
+            const size_t slab_bytes = sizeof(ComplexType) * cells_per_slab;
+            auto block_begin = [&](int iblock) { return cells_per_block * iblock; };
+            auto block_size = [&](int iblock) {
+                return std::min(cells_per_block, cells_per_slab - block_begin(iblock));
+            };
+
+            // The block is stored as [x][cell] so each read/write is a contiguous piece of a slab
+            auto read_block = [&](int iblock, FloatType * buffer) {
+                const IndexIntType ncells = block_size(iblock);
+                for (int islab = 0; islab < Nmesh; islab++)
+                    read_bytes(buffer + 2 * ncells * islab,
+                               sizeof(ComplexType) * ncells,
+                               slab_bytes * islab + sizeof(ComplexType) * block_begin(iblock));
+            };
+            auto write_block = [&](int iblock, FloatType * buffer) {
+                const IndexIntType ncells = block_size(iblock);
+                for (int islab = 0; islab < Nmesh; islab++)
+                    write_bytes(buffer + 2 * ncells * islab,
+                                sizeof(ComplexType) * ncells,
+                                slab_bytes * islab + sizeof(ComplexType) * block_begin(iblock));
+            };
+            auto transform_block = [&](int iblock, FloatType * buffer) {
+                const int ncells = int(block_size(iblock));
+                my_fftw_complex * cbuffer = reinterpret_cast<my_fftw_complex *>(buffer);
+                my_fftw_plan plan = MAKE_PLAN_MANY_DFT(
+                    1, &Nmesh, ncells, cbuffer, nullptr, ncells, 1, cbuffer, nullptr, ncells, 1, sign, FFTW_ESTIMATE);
+                EXECUTE_FFT(plan);
+                DESTROY_PLAN(plan);
+
+                if (norm != 1.0) {
+                    const IndexIntType nreals = 2 * IndexIntType(ncells) * Nmesh;
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                    for (IndexIntType i = 0; i < nreals; i++)
+                        buffer[i] *= norm;
+                }
+            };
+
+            stream(nblocks, 2 * cells_per_block * Nmesh, read_block, transform_block, write_block, true);
+#else
+            assert_mpi(false, "[OutOfCoreGrid] Compiled without FFTW support so cannot take Fourier transforms\n");
+#endif
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::fftw_r2c() {
+            FML_PROFILE_SCOPE("OutOfCoreGrid::fftw_r2c");
+            FML_PROFILE_ADD_BYTES(4 * sizeof(FloatType) * get_ntot_real_slab_alloc() * Nmesh);
+
+#ifdef DEBUG_FFTWGRID
+            if (not grid_is_in_real_space) {
+                std::cout << "Warning: [OutOfCoreGrid::fftw_r2c] Transforming grid whose status is already "
+                             "[Fourierspace]\n";
+            }
+#endif
+
+            transform_slabs(true);
+            transform_along_x(-1, 1.0 / std::pow(double(Nmesh), N));
+            grid_is_in_real_space = false;
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::fftw_c2r() {
+            FML_PROFILE_SCOPE("OutOfCoreGrid::fftw_c2r");
+            FML_PROFILE_ADD_BYTES(4 * sizeof(FloatType) * get_ntot_real_slab_alloc() * Nmesh);
+
+#ifdef DEBUG_FFTWGRID
+            if (grid_is_in_real_space) {
+                std::cout << "Warning: [OutOfCoreGrid::fftw_c2r] Transforming grid whose status is already "
+                             "[Realspace]\n";
+            }
+#endif
+
+            transform_along_x(+1, 1.0);
+            transform_slabs(false);
+            grid_is_in_real_space = true;
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::copy_from(FFTWGrid<N> & grid) {
+            assert_mpi(grid.get_nmesh() == Nmesh, "[OutOfCoreGrid::copy_from] Grids must have the same size\n");
+            assert_mpi(grid.get_local_nx() == Nmesh,
+                       "[OutOfCoreGrid::copy_from] The in-core grid must have all slabs on this task\n");
+            const IndexIntType nslab = get_ntot_real_slab_alloc();
+            FloatType * data = grid.get_real_grid();
+            for (int islab = 0; islab < Nmesh; islab++)
+                write_slab(islab, data + nslab * islab);
+            grid_is_in_real_space = grid.get_grid_status_real();
+        }
+
+        template <int N>
+        void OutOfCoreGrid<N>::copy_to(FFTWGrid<N> & grid) const {
+            assert_mpi(grid.get_nmesh() == Nmesh, "[OutOfCoreGrid::copy_to] Grids must have the same size\n");
+            assert_mpi(grid.get_local_nx() == Nmesh,
+                       "[OutOfCoreGrid::copy_to] The in-core grid must have all slabs on this task\n");
+            const IndexIntType nslab = get_ntot_real_slab_alloc();
+            FloatType * data = grid.get_real_grid();
+            for (int islab = 0; islab < Nmesh; islab++)
+                read_slab(islab, data + nslab * islab);
+            grid.set_grid_status_real(grid_is_in_real_space);
+        }
+
+    } // namespace GRID
+} // namespace FML
+#endif
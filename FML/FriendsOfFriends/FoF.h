@@ -10,6 +10,7 @@
 #include <FML/FriendsOfFriends/FoFBinning.h>
 #include <FML/Global/Global.h>
 #include <FML/ParticleTypes/ReflectOnParticleMethods.h>
+#include <FML/ParticlesInBoxes/ParticlesInBoxes.h>
 
 namespace FML {
 
@@ -58,15 +59,11 @@ namespace FML {
                               int Ngrid = 0,
                               bool merging_in_parallel = false);
 
-        /// Internal method: bin particles to a grid
-        template <class T, int NDIM>
-        void ParticlesToCells(int Ngrid, T * part, size_t NumPart, std::vector<FoFCells> & PartCells);
-
         /// Internal method: do FoF linking on a local task (ignoring the particles on other tasks)
         template <class T, int NDIM>
         void FriendsOfFriendsLinkingLocal(T * part,
                                           size_t NumPart,
-                                          std::vector<FoFCells> & PartCells,
+                                          FML::PARTICLE::ParticlesInBoxes<T> & PartCells,
                                           int Ngrid,
                                           int Local_nx,
                                           double fof_distance,
@@ -79,7 +76,7 @@ namespace FML {
                              T * part,
                              size_t NumPart,
                              int Ngrid,
-                             const std::vector<FoFCells> & PartCells,
+                             FML::PARTICLE::ParticlesInBoxes<T> & PartCells,
                              std::vector<size_t> & particle_id_FoF,
                              std::vector<size_t> & BoundaryParticleIndex,
                              std::vector<size_t> & BoundaryParticleRightFoFIndex,
@@ -87,61 +84,12 @@ namespace FML {
                              bool periodic,
                              bool merging_in_parallel);
 
-        //=========================================================================
-        // Bin local particles to cells in a grid
-        //=========================================================================
-        template <class T, int NDIM>
-        void ParticlesToCells(int Ngrid, T * part, size_t NumPart, std::vector<FoFCells> & PartCells) {
-
-            // Adjust Ngrid if it doesnt divide the gridsize
-            Ngrid = Ngrid - Ngrid % FML::NTasks;
-            if (Ngrid % FML::NTasks > Ngrid / 2)
-                Ngrid *= 2;
-            const int Local_nx = Ngrid / FML::NTasks;
-            const size_t NgridTot = size_t(Local_nx) * FML::power(Ngrid, NDIM - 1);
-
-            // Make a grid containing particles
-            PartCells.resize(NgridTot);
-
-            // Get index of the cell the particle lives in
-            auto get_cell_index = [&](size_t ipart, std::vector<int> & coord) -> size_t {
-                auto * pos = FML::PARTICLE::GetPos(part[ipart]);
-                size_t index_cell = 0;
-                for (int idim = 0; idim < NDIM; idim++) {
-                    coord[idim] = int((pos[idim] - FML::xmin_domain * (idim == 0 ? 1 : 0)) * Ngrid);
-                    index_cell = index_cell * Ngrid + coord[idim];
-                    assert(coord[idim] >= 0 and coord[idim] < (idim == 0 ? Local_nx : Ngrid));
-                }
-                return index_cell;
-            };
-
-            // Add up number of particles in cells
-            std::vector<int> coord(NDIM);
-            for (size_t i = 0; i < NumPart; i++) {
-                const size_t index_cell = get_cell_index(i, coord);
-                PartCells[index_cell].np++;
-            }
-
-            // Allocate cells
-            for (auto & cell : PartCells) {
-                cell.ParticleIndex.resize(cell.np);
-                cell.np = 0;
-            }
-
-            for (size_t i = 0; i < NumPart; i++) {
-                const size_t index_cell = get_cell_index(i, coord);
-                auto & np = PartCells[index_cell].np;
-                PartCells[index_cell].ParticleIndex[np] = i;
-                np++;
-            }
-        }
-
         template <class T, int NDIM>
         void BoundaryLinking(double fof_distance,
                              T * part,
                              size_t NumPart,
                              int Ngrid,
-                             const std::vector<FoFCells> & PartCells,
+                             FML::PARTICLE::ParticlesInBoxes<T> & PartCells,
                              std::vector<size_t> & particle_id_FoF,
                              std::vector<size_t> & BoundaryParticleIndex,
                              std::vector<size_t> & BoundaryParticleRightFoFIndex,
@@ -374,10 +322,11 @@ namespace FML {
                                     continue;
 
                                 // Loop over all particles in nbor cell
-                                const size_t np = size_t(PartCells[index_nbor_cell].np);
+                                const auto cell = PartCells.get_cell(index_nbor_cell);
+                                const size_t np = cell.get_np();
                                 for (size_t ii = 0; ii < np; ii++) {
-                                    const auto pindex = PartCells[index_nbor_cell].ParticleIndex[ii];
-                                    const auto * pos1 = FML::PARTICLE::GetPos(part[pindex]);
+                                    const auto pindex = cell.get_index(ii);
+                                    const auto * pos1 = cell.get_pos(ii);
 
                                     double dist2 = 0.0;
                                     for (int idim = 0; idim < NDIM; idim++) {
@@ -621,7 +570,7 @@ namespace FML {
         template <class T, int NDIM>
         void FriendsOfFriendsLinkingLocal(T * part,
                                           size_t NumPart,
-                                          std::vector<FoFCells> & PartCells,
+                                          FML::PARTICLE::ParticlesInBoxes<T> & PartCells,
                                           int Ngrid,
                                           int Local_nx,
                                           double fof_distance,
@@ -718,13 +667,14 @@ namespace FML {
                         continue;
 
                     // Loop over all particles in nbor cell
-                    const size_t np = PartCells[index_nbor_cell].np;
+                    const auto cell = PartCells.get_cell(index_nbor_cell);
+                    const size_t np = cell.get_np();
                     for (size_t ii = 0; ii < np; ii++) {
-                        const auto nborIndex = PartCells[index_nbor_cell].ParticleIndex[ii];
+                        const auto nborIndex = cell.get_index(ii);
                         if (nborIndex == particleIndex or particle_id_FoF[nborIndex] != no_FoF_ID)
                             continue;
 
-                        const auto * pos2 = FML::PARTICLE::GetPos(part[nborIndex]);
+                        const auto * pos2 = cell.get_pos(ii);
 
                         // Compute distance
                         std::array<float, NDIM> dx2;
@@ -815,6 +765,8 @@ namespace FML {
                               std::vector<FoFHaloClass> & LocalFoFGroups,
                               int Ngrid,
                               bool merging_in_parallel) {
+            FML_PROFILE_SCOPE("FriendsOfFriends");
+            FML_MEMORY_TAG_SCOPE(FoF);
 
             // Sort particles by x position
             // This will make it more cache friendly and speed it up when doing the linking
@@ -836,11 +788,11 @@ namespace FML {
                 if (mean_particle_seperation < fof_distance)
                     mean_particle_seperation = fof_distance;
                 Ngrid = int(1.0 / mean_particle_seperation);
-                // Ensure that NTasks divides Ngrid
-                Ngrid = Ngrid - Ngrid % FML::NTasks;
-                if (Ngrid < FML::NTasks)
-                    Ngrid = FML::NTasks;
             }
+            // Ensure that NTasks divides Ngrid
+            Ngrid = Ngrid - Ngrid % FML::NTasks;
+            if (Ngrid < FML::NTasks)
+                Ngrid = FML::NTasks;
             const int Local_nx = Ngrid / FML::NTasks;
 
             if (FML::ThisTask == 0) {
@@ -867,8 +819,11 @@ namespace FML {
             //=============================================================================
             // Add particles to cells to speed up the linking below
             //=============================================================================
-            std::vector<FoFCells> PartCells;
-            ParticlesToCells<T, NDIM>(Ngrid, part, NumPart, PartCells);
+            // We only need the positions (and the index) of the particles for the linking
+            FML::PARTICLE::ParticlesInBoxes<T> PartCells;
+            PartCells.set_storage(FML::PARTICLE::CellStorage::Positions);
+            PartCells.set_local_x_domain(FML::xmin_domain, Local_nx);
+            PartCells.create(part, NumPart, Ngrid);
 
             //=============================================================================
             // Do local FoF linking
@@ -903,7 +858,6 @@ namespace FML {
 
             // Free memory no longer needed
             PartCells.clear();
-            PartCells.shrink_to_fit();
 
             // If particles have a set_fofid method then set the ID in the particles
             // and set it to -1 if the particle is not part of a group
@@ -992,12 +946,13 @@ namespace FML {
                 }
             }
 
-            // Sum up total number of local non-shared groups
+            // Sum up total number of local non-shared groups. This is not needed before we have
+            // gathered the shared groups so we overlap the communication with that
             int non_shared_total = nnonshared;
-            FML::SumOverTasks(&non_shared_total);
+            FML::ReductionRequest non_shared_total_request = FML::SumOverTasksAsync(&non_shared_total);
 
 #ifdef DEBUG_FOF
-            std::cout << FML::ThisTask << " has " << non_shared_total << " nonshared halos\n";
+            std::cout << FML::ThisTask << " has " << nnonshared << " nonshared halos\n";
             std::cout << FML::ThisTask << " has " << count << " FoF groups before merging. The number of shared groups "
                       << nshared_groups << " Nlocal groups: "
                       << "\n";
@@ -1022,7 +977,7 @@ namespace FML {
             // Gather data about shared groups
             std::vector<int> shared_groups_in_task(FML::NTasks, 0);
             shared_groups_in_task[FML::ThisTask] = int(ninSharedGroup.size());
-            MPI_Allreduce(MPI_IN_PLACE, shared_groups_in_task.data(), FML::NTasks, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+            FML::SumArrayOverTasks(shared_groups_in_task.data(), FML::NTasks);
             std::vector<std::vector<size_t>> FoFIDSharedGroupFromOtherTasks(FML::NTasks);
             std::vector<std::vector<size_t>> ninSharedGroupFromOtherTasks(FML::NTasks);
             if (FML::ThisTask == 0) {
@@ -1053,6 +1008,7 @@ namespace FML {
 
             // This variable only correct on task 0
             int ntotal_halos = 0;
+            non_shared_total_request.wait();
             if (FML::ThisTask == 0) {
                 int nshared_halos = 0;
 
@@ -1106,6 +1062,7 @@ namespace FML {
 #else
             // No MPI no shared halos
             std::vector<size_t> LocalSharedHalos;
+            non_shared_total_request.wait();
             size_t ntotal_halos = non_shared_total;
 #endif
 
@@ -1149,7 +1106,7 @@ namespace FML {
 #ifdef USE_MPI
             std::vector<int> nhalosontask(FML::NTasks, 0);
             nhalosontask[FML::ThisTask] = int(halos.size());
-            MPI_Allreduce(MPI_IN_PLACE, nhalosontask.data(), FML::NTasks, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+            FML::SumArrayOverTasks(nhalosontask.data(), FML::NTasks);
             for (int i = 1; i < FML::NTasks; i++) {
                 if (FML::ThisTask == i) {
                     MPI_Send(halos.data(), int(sizeof(FoFHaloClass) * nhalosontask[i]), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
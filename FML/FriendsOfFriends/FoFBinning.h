@@ -142,20 +142,6 @@ namespace FML {
             }
         };
 
-        //=========================================================================
-        /// A gridcell in a grid used for speeding up the linking of particles
-        /// The ID of the particles is their position in the particle list
-        ///
-        //=========================================================================
-        class FoFCells {
-          public:
-            /// Number of particles in the cell
-            int np{0};
-            /// List of indices of particles that are in the cell
-            std::vector<size_t> ParticleIndex{};
-            FoFCells() = default;
-        };
-
     } // namespace FOF
 } // namespace FML
 #endif
@@ -7,6 +7,7 @@
 #include <sys/stat.h>
 #include <thread>
 #include <unistd.h>
+#include <utility>
 
 #include "Global.h"
 #include "SystemMemory.h"
@@ -253,13 +254,55 @@ namespace FML {
         }
     }
 
+#ifdef USE_MPI
+    ReductionRequest::ReductionRequest(MPI_Request _request) : request(_request) {}
+#endif
+
+    ReductionRequest::ReductionRequest(ReductionRequest && rhs) noexcept {
+        *this = std::move(rhs);
+    }
+
+    ReductionRequest & ReductionRequest::operator=(ReductionRequest && rhs) noexcept {
+        if (this == &rhs)
+            return *this;
+        wait();
+#ifdef USE_MPI
+        request = rhs.request;
+        rhs.request = MPI_REQUEST_NULL;
+#endif
+        return *this;
+    }
+
+    ReductionRequest::~ReductionRequest() {
+        wait();
+    }
+
+    void ReductionRequest::wait() {
+#ifdef USE_MPI
+        if (request != MPI_REQUEST_NULL)
+            MPI_Wait(&request, MPI_STATUS_IGNORE);
+#endif
+    }
+
+    bool ReductionRequest::test() {
+#ifdef USE_MPI
+        if (request == MPI_REQUEST_NULL)
+            return true;
+        int done = 0;
+        MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+        return done != 0;
+#else
+        return true;
+#endif
+    }
+
     // Make sure the most common types we use for comm gets instansiated
 #define TYPES(TYPE)                                                                                                    \
     template std::vector<TYPE> GatherFromTasks<TYPE>(TYPE *);                                                          \
-    template void MinOverTasks<TYPE>(TYPE *);                                                                          \
-    template void MaxOverTasks<TYPE>(TYPE *);                                                                          \
-    template void SumOverTasks<TYPE>(TYPE *);                                                                          \
-    template void SumArrayOverTasks<TYPE>(TYPE *, int);
+    template void MinOverTasks<TYPE>(TYPE *, Communicator);                                                            \
+    template void MaxOverTasks<TYPE>(TYPE *, Communicator);                                                            \
+    template void SumOverTasks<TYPE>(TYPE *, Communicator);                                                            \
+    template void SumArrayOverTasks<TYPE>(TYPE *, int, Communicator);
     TYPES(char);
     TYPES(int);
     TYPES(unsigned int);
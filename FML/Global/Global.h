@@ -13,15 +13,18 @@
 // USE_FFTW              : Use FFTW (here its just for initialization for MPI/threads)
 // MEMORY_LOGGING        : Log all (big) allocations with the standard container (see MemoryLogging.h)
 //    MIN_BYTES_TO_LOG   : How many bytes to enable logging of allocation
-//    MAX_ALLOCATIONS_IN_MEMORY : Maximum number of allocations to keep (above which we give up)
+//    MAX_ALLOCATIONS_IN_MEMORY : Maximum number of points in the memory timeline per thread
+// PROFILING             : Profile the main routines of the library (see Profiler.h)
 //
 //===========================================================================
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <complex>
 #include <cstring>
 #include <iostream>
+#include <type_traits>
 #include <vector>
 
 #ifdef USE_MPI
@@ -34,8 +37,12 @@
 
 #ifdef MEMORY_LOGGING
 #include <FML/MemoryLogging/MemoryLogging.h>
+#else
+#define FML_MEMORY_TAG_SCOPE(tag)
+#define FML_MEMORY_DEFAULT_TAG_SCOPE(tag)
 #endif
 
+#include <FML/Timing/Profiler.h>
 #include <FML/Timing/Timings.h>
 
 namespace FML {
@@ -104,6 +111,18 @@ namespace FML {
     // over tasks
     void print_system_memory_use(); 
 
+    //================================================
+    // MPI communicators. Without MPI this is just a
+    // placeholder so the signatures are the same
+    //================================================
+#ifdef USE_MPI
+    using Communicator = MPI_Comm;
+#define FML_COMM_WORLD MPI_COMM_WORLD
+#else
+    using Communicator = int;
+#define FML_COMM_WORLD 0
+#endif
+
     /// Gather a single value from all tasks. Value from task ThisTask is stored in values[ThisTask]
     template <class T>
     std::vector<T> GatherFromTasks(T * value) {
@@ -116,55 +135,214 @@ namespace FML {
         return values;
     }
 
-    /// Inplace max over tasks of a single value
+    //================================================
+    /// The reductions over tasks we support
+    //================================================
+    enum class ReduceOp { Sum, Max, Min };
+
+#ifdef USE_MPI
+    /// The native MPI type of T. MPI_DATATYPE_NULL if there is none (e.g. user defined types)
     template <class T>
-    void MaxOverTasks([[maybe_unused]] T * value) {
-        if (FML::NTasks == 1)
+    MPI_Datatype get_mpi_type() {
+        using U = std::remove_cv_t<T>;
+        if constexpr (std::is_same_v<U, bool>)
+            return MPI_CXX_BOOL;
+        else if constexpr (std::is_same_v<U, char>)
+            return MPI_CHAR;
+        else if constexpr (std::is_same_v<U, signed char>)
+            return MPI_SIGNED_CHAR;
+        else if constexpr (std::is_same_v<U, unsigned char>)
+            return MPI_UNSIGNED_CHAR;
+        else if constexpr (std::is_same_v<U, short>)
+            return MPI_SHORT;
+        else if constexpr (std::is_same_v<U, unsigned short>)
+            return MPI_UNSIGNED_SHORT;
+        else if constexpr (std::is_same_v<U, int>)
+            return MPI_INT;
+        else if constexpr (std::is_same_v<U, unsigned int>)
+            return MPI_UNSIGNED;
+        else if constexpr (std::is_same_v<U, long>)
+            return MPI_LONG;
+        else if constexpr (std::is_same_v<U, unsigned long>)
+            return MPI_UNSIGNED_LONG;
+        else if constexpr (std::is_same_v<U, long long>)
+            return MPI_LONG_LONG;
+        else if constexpr (std::is_same_v<U, unsigned long long>)
+            return MPI_UNSIGNED_LONG_LONG;
+        else if constexpr (std::is_same_v<U, float>)
+            return MPI_FLOAT;
+        else if constexpr (std::is_same_v<U, double>)
+            return MPI_DOUBLE;
+        else if constexpr (std::is_same_v<U, long double>)
+            return MPI_LONG_DOUBLE;
+        else if constexpr (std::is_same_v<U, std::complex<float>>)
+            return MPI_CXX_FLOAT_COMPLEX;
+        else if constexpr (std::is_same_v<U, std::complex<double>>)
+            return MPI_CXX_DOUBLE_COMPLEX;
+        else if constexpr (std::is_same_v<U, std::complex<long double>>)
+            return MPI_CXX_LONG_DOUBLE_COMPLEX;
+        else
+            return MPI_DATATYPE_NULL;
+    }
+
+    /// The MPI operation corresponding to a ReduceOp
+    template <ReduceOp op>
+    MPI_Op get_mpi_op() {
+        if constexpr (op == ReduceOp::Sum)
+            return MPI_SUM;
+        else if constexpr (op == ReduceOp::Max)
+            return MPI_MAX;
+        else
+            return MPI_MIN;
+    }
+#endif
+
+    //================================================
+    /// Inplace reduction of a contiguous array of n values over all tasks in the communicator.
+    /// Types with a native MPI type (see get_mpi_type) use a single MPI_Allreduce. Other types
+    /// (which need operator+ for sums and operator< for max/min) are gathered and reduced locally.
+    //================================================
+    template <ReduceOp op, class T>
+    void AllReduceOverTasks([[maybe_unused]] T * values,
+                            [[maybe_unused]] int n,
+                            [[maybe_unused]] Communicator comm = FML_COMM_WORLD) {
+#ifdef USE_MPI
+        int ntasks;
+        MPI_Comm_size(comm, &ntasks);
+        if (ntasks == 1 or n == 0)
+            return;
+
+        MPI_Datatype type = get_mpi_type<T>();
+        if (type != MPI_DATATYPE_NULL) {
+            MPI_Allreduce(MPI_IN_PLACE, values, n, type, get_mpi_op<op>(), comm);
             return;
-        std::vector<T> values = GatherFromTasks(value);
-        T maxvalue = *value;
-        for (auto v : values)
-            if (maxvalue < v)
-                maxvalue = v;
-        *value = maxvalue;
+        }
+
+        const int bytes = int(sizeof(T)) * n;
+        std::vector<T> all(size_t(n) * ntasks);
+        MPI_Allgather(values, bytes, MPI_BYTE, all.data(), bytes, MPI_BYTE, comm);
+        for (int i = 0; i < n; i++) {
+            T result = all[i];
+            for (int task = 1; task < ntasks; task++) {
+                const T & value = all[size_t(task) * n + i];
+                if constexpr (op == ReduceOp::Sum)
+                    result = result + value;
+                else if constexpr (op == ReduceOp::Max)
+                    result = result < value ? value : result;
+                else
+                    result = value < result ? value : result;
+            }
+            values[i] = result;
+        }
+#endif
     }
-    
+
+    /// Inplace max over tasks of a single value
+    template <class T>
+    void MaxOverTasks(T * value, Communicator comm = FML_COMM_WORLD) {
+        AllReduceOverTasks<ReduceOp::Max>(value, 1, comm);
+    }
+
     /// Inplace min over tasks of a single value
     template <class T>
-    void MinOverTasks([[maybe_unused]] T * value) {
-        if (FML::NTasks == 1)
-            return;
-        std::vector<T> values = GatherFromTasks(value);
-        T minvalue = *value;
-        for (auto v : values)
-            if (minvalue > v)
-                minvalue = v;
-        *value = minvalue;
+    void MinOverTasks(T * value, Communicator comm = FML_COMM_WORLD) {
+        AllReduceOverTasks<ReduceOp::Min>(value, 1, comm);
     }
-    
+
     /// Inplace sum over tasks of a single value
     template <class T>
-    void SumOverTasks([[maybe_unused]] T * value) {
-        if (FML::NTasks == 1)
-            return;
-        std::vector<T> values = GatherFromTasks(value);
-        T sum = 0;
-        for (auto v : values) {
-            sum += v;
-        }
-        *value = sum;
+    void SumOverTasks(T * value, Communicator comm = FML_COMM_WORLD) {
+        AllReduceOverTasks<ReduceOp::Sum>(value, 1, comm);
     }
-    
-    /// Inplace sum over tasks of a contigious array of values
+
+    /// Inplace sum over tasks of a contigious array of values (one communication)
     template <class T>
-    void SumArrayOverTasks([[maybe_unused]] T * value, int n) {
-        if (FML::NTasks == 1)
+    void SumArrayOverTasks(T * value, int n, Communicator comm = FML_COMM_WORLD) {
+        AllReduceOverTasks<ReduceOp::Sum>(value, n, comm);
+    }
+
+    /// Inplace max over tasks of a contigious array of values (one communication)
+    template <class T>
+    void MaxArrayOverTasks(T * value, int n, Communicator comm = FML_COMM_WORLD) {
+        AllReduceOverTasks<ReduceOp::Max>(value, n, comm);
+    }
+
+    /// Inplace min over tasks of a contigious array of values (one communication)
+    template <class T>
+    void MinArrayOverTasks(T * value, int n, Communicator comm = FML_COMM_WORLD) {
+        AllReduceOverTasks<ReduceOp::Min>(value, n, comm);
+    }
+
+    /// Inplace sum over tasks of several arrays of n values each (packed into one communication)
+    template <class T, size_t NARRAYS>
+    void SumArraysOverTasks(std::array<T *, NARRAYS> arrays, int n, Communicator comm = FML_COMM_WORLD) {
+        if (FML::NTasks == 1 or n == 0)
             return;
-        for(int i = 0; i < n; i++){
-          SumOverTasks(&value[i]);
+        std::vector<T> buffer(NARRAYS * size_t(n));
+        for (size_t iarray = 0; iarray < NARRAYS; iarray++)
+            std::copy(arrays[iarray], arrays[iarray] + n, buffer.begin() + iarray * n);
+        SumArrayOverTasks(buffer.data(), int(buffer.size()), comm);
+        for (size_t iarray = 0; iarray < NARRAYS; iarray++)
+            std::copy(buffer.begin() + iarray * n, buffer.begin() + (iarray + 1) * n, arrays[iarray]);
+    }
+
+    //================================================
+    /// Handle for a non-blocking reduction (see SumArrayOverTasksAsync).
+    /// The values are only reduced after wait() has returned (or test()
+    /// has returned true) and must not be touched before that.
+    /// The destructor waits for the reduction to complete.
+    //================================================
+    class ReductionRequest {
+#ifdef USE_MPI
+        MPI_Request request{MPI_REQUEST_NULL};
+#endif
+      public:
+        ReductionRequest() = default;
+#ifdef USE_MPI
+        ReductionRequest(MPI_Request request);
+#endif
+        ReductionRequest(const ReductionRequest & rhs) = delete;
+        ReductionRequest & operator=(const ReductionRequest & rhs) = delete;
+        ReductionRequest(ReductionRequest && rhs) noexcept;
+        ReductionRequest & operator=(ReductionRequest && rhs) noexcept;
+        ~ReductionRequest();
+
+        /// Block until the reduction is done
+        void wait();
+        /// Check (without blocking) if the reduction is done
+        bool test();
+    };
+
+    /// Start a non-blocking inplace reduction of a contiguous array (MPI_Iallreduce) that can
+    /// be overlapped with computations. Types without a native MPI type are reduced right away
+    template <ReduceOp op, class T>
+    ReductionRequest AllReduceOverTasksAsync([[maybe_unused]] T * values,
+                                             [[maybe_unused]] int n,
+                                             [[maybe_unused]] Communicator comm = FML_COMM_WORLD) {
+#ifdef USE_MPI
+        MPI_Datatype type = get_mpi_type<T>();
+        if (type != MPI_DATATYPE_NULL and n > 0) {
+            MPI_Request request;
+            MPI_Iallreduce(MPI_IN_PLACE, values, n, type, get_mpi_op<op>(), comm, &request);
+            return ReductionRequest(request);
         }
+        AllReduceOverTasks<op>(values, n, comm);
+#endif
+        return ReductionRequest();
     }
-    
+
+    /// Start a non-blocking inplace sum over tasks of a single value
+    template <class T>
+    ReductionRequest SumOverTasksAsync(T * value, Communicator comm = FML_COMM_WORLD) {
+        return AllReduceOverTasksAsync<ReduceOp::Sum>(value, 1, comm);
+    }
+
+    /// Start a non-blocking inplace sum over tasks of a contigious array of values
+    template <class T>
+    ReductionRequest SumArrayOverTasksAsync(T * value, int n, Communicator comm = FML_COMM_WORLD) {
+        return AllReduceOverTasksAsync<ReduceOp::Sum>(value, n, comm);
+    }
+
     //============================================
     /// An assert function that calls MPI_Abort
     /// instead of just abort to avoid deadlock
@@ -0,0 +1,188 @@
+#ifndef THREADHISTOGRAM_HEADER
+#define THREADHISTOGRAM_HEADER
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include <FML/Global/Global.h>
+
+namespace FML {
+
+    /// Size of a cache line in bytes. Used to pad per-thread storage to avoid false sharing
+    constexpr size_t cache_line_size = 64;
+
+    //=====================================================================
+    ///
+    /// Branch-free bin index computation for histograms. Returns the
+    /// index floor((x - x0) * inv_dx + offset) if it is in [0,n) and -1 otherwise.
+    /// With offset = 0.5 this gives the bin whose center x0 + i dx is closest to x
+    /// and with offset = 0.0 the bin with left edge x0 + i dx.
+    /// NB: this floors (the old inline int(...) truncated towards zero) so values just
+    /// below the lower edge of bin 0 (e.g. k slightly below kmin - dk/2) are now dropped
+    /// instead of being put in bin 0.
+    /// The value is clamped before the conversion to int so this is safe for
+    /// any input (also inf) and compiles to min/max/floor so loops over it vectorize.
+    ///
+    //=====================================================================
+    inline int get_bin_index_linear(double x, double x0, double inv_dx, double offset, int n) {
+        const double f = std::min(std::max((x - x0) * inv_dx + offset, -1.0), double(n));
+        const int index = int(std::floor(f));
+        return index < n ? index : -1;
+    }
+
+    /// Same as get_bin_index_linear but for logarithmic bins in x. Takes log(x0) and 1/dlog(x).
+    /// Non-positive x gives -1
+    inline int get_bin_index_log(double x, double logx0, double inv_dlogx, double offset, int n) {
+        return get_bin_index_linear(std::log(std::max(x, DBL_MIN)), logx0, inv_dlogx, offset, n);
+    }
+
+    //=====================================================================
+    ///
+    /// Per-thread accumulators for NARRAYS histograms with nbins bins each
+    /// (e.g. count, sum of P(k) and sum of k for a power spectrum).
+    ///
+    /// Every thread has its own block of memory that starts on a new cache line
+    /// so threads never write to the same cache line (no false sharing). Inside
+    /// a block the arrays are stored after each other so all the arrays of all
+    /// the threads can be reduced in one go: reduce() sums over threads and then
+    /// over MPI tasks with a single MPI_Allreduce of all the arrays.
+    ///
+    /// Usage:
+    ///   ThreadHistogram<2> hist(nbins);
+    ///   #pragma omp parallel for
+    ///   for(...) hist.add(omp_get_thread_num(), ibin, weight, weight * value);
+    ///   hist.reduce({count.data(), sum.data()});
+    ///
+    /// add() ignores bins outside [0,nbins) so it can be called directly with
+    /// the result of get_bin_index_linear/log.
+    /// The class must be created and reduced outside of parallel regions.
+    ///
+    //=====================================================================
+    template <int NARRAYS>
+    class ThreadHistogram {
+      private:
+        int nbins{0};
+        int nthreads{0};
+        /// Number of doubles between the blocks of two threads (a multiple of the cache line)
+        size_t stride{0};
+        std::vector<double> storage;
+        /// Start of the (cache line aligned) data in storage
+        double * data{nullptr};
+
+        void allocate(int nbins, int nthreads);
+
+      public:
+        ThreadHistogram() = default;
+        ThreadHistogram(int nbins, int nthreads = FML::NThreads);
+        ThreadHistogram(const ThreadHistogram & rhs);
+        ThreadHistogram & operator=(const ThreadHistogram & rhs);
+
+        /// Add values[iarray] to bin ibin of array iarray (for iarray = 0,...,NARRAYS-1) for thread thread_id
+        template <class... Values>
+        void add(int thread_id, int ibin, Values... values) {
+            static_assert(sizeof...(Values) == NARRAYS, "[ThreadHistogram::add] Need one value per array");
+            if (ibin < 0 or ibin >= nbins)
+                return;
+            double * block = data + thread_id * stride + ibin;
+            int iarray = 0;
+            ((block[nbins * iarray++] += values), ...);
+        }
+
+        /// The array iarray of thread thread_id (for hand-written accumulation loops)
+        double * get_thread_array(int thread_id, int iarray) { return data + thread_id * stride + iarray * nbins; }
+
+        int get_nbins() const { return nbins; }
+        int get_nthreads() const { return nthreads; }
+
+        /// Set all the accumulators to zero
+        void reset();
+
+        /// Add the accumulated array iarray to out[iarray] (nbins elements) and sum the result over
+        /// all tasks (if sum_over_tasks). The accumulators are reset afterwards
+        void reduce(std::array<double *, NARRAYS> out, bool sum_over_tasks = true);
+    };
+
+    template <int NARRAYS>
+    ThreadHistogram<NARRAYS>::ThreadHistogram(int _nbins, int _nthreads) {
+        allocate(_nbins, _nthreads);
+    }
+
+    template <int NARRAYS>
+    ThreadHistogram<NARRAYS>::ThreadHistogram(const ThreadHistogram<NARRAYS> & rhs) {
+        *this = rhs;
+    }
+
+    template <int NARRAYS>
+    ThreadHistogram<NARRAYS> & ThreadHistogram<NARRAYS>::operator=(const ThreadHistogram<NARRAYS> & rhs) {
+        if (this == &rhs)
+            return *this;
+        // The copy must point into its own storage so we cannot just copy the members
+        allocate(rhs.nbins, rhs.nthreads);
+        if (rhs.data)
+            std::copy(rhs.data, rhs.data + stride * nthreads, data);
+        return *this;
+    }
+
+    template <int NARRAYS>
+    void ThreadHistogram<NARRAYS>::allocate(int _nbins, int _nthreads) {
+        assert_mpi(_nbins >= 0 and _nthreads > 0, "[ThreadHistogram] Invalid nbins or nthreads\n");
+        nbins = _nbins;
+        nthreads = _nthreads;
+        constexpr size_t doubles_per_line = cache_line_size / sizeof(double);
+        stride = (size_t(NARRAYS) * nbins + doubles_per_line - 1) / doubles_per_line * doubles_per_line;
+        // Allocate one extra cache line so that we can align the start
+        storage.assign(stride * nthreads + doubles_per_line, 0.0);
+        const size_t misalignment = reinterpret_cast<std::uintptr_t>(storage.data()) % cache_line_size;
+        data = storage.data() + (misalignment == 0 ? 0 : (cache_line_size - misalignment) / sizeof(double));
+    }
+
+    template <int NARRAYS>
+    void ThreadHistogram<NARRAYS>::reset() {
+        std::fill(storage.begin(), storage.end(), 0.0);
+    }
+
+    template <int NARRAYS>
+    void ThreadHistogram<NARRAYS>::reduce(std::array<double *, NARRAYS> out, bool sum_over_tasks) {
+#ifdef USE_OMP
+        assert_mpi(omp_get_thread_num() == 0,
+                   "[ThreadHistogram::reduce] This method can only be run by the main thread\n");
+#endif
+        if (data == nullptr)
+            return;
+
+        // Sum all threads into the block of thread 0 together with the values already in out
+        const size_t ntot = size_t(NARRAYS) * nbins;
+        double * sum = data;
+        for (int id = 1; id < nthreads; id++) {
+            const double * block = data + id * stride;
+            for (size_t i = 0; i < ntot; i++)
+                sum[i] += block[i];
+        }
+        for (int iarray = 0; iarray < NARRAYS; iarray++)
+            for (int i = 0; i < nbins; i++)
+                sum[iarray * nbins + i] += out[iarray][i];
+
+        // One communication for all the arrays
+        if (sum_over_tasks)
+            FML::SumArrayOverTasks(sum, int(ntot));
+
+        for (int iarray = 0; iarray < NARRAYS; iarray++)
+            std::copy(sum + iarray * nbins, sum + (iarray + 1) * nbins, out[iarray]);
+        reset();
+    }
+
+} // namespace FML
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef PARTICLEGRIDINTERPOLATION_HEADER
 #define PARTICLEGRIDINTERPOLATION_HEADER
 
+#include <algorithm>
 #include <array>
 #include <functional>
 #include <vector>
@@ -169,6 +170,42 @@ namespace FML {
         template <int N, int ORDER, class T>
         void particles_to_grid(const T * part, size_t NumPart, size_t NumPartTot, FFTWGrid<N> & density);
 
+        /// @brief Internal method. Add particles to the grid with the value weight_of_particle(i) for particle i.
+        /// The grid (and the extra slices) must be initialized and add_contribution_from_extra_slices must be called
+        /// afterwards. The positions are shifted by shift (in units of the cell size) in all directions which is
+        /// used for interlacing (this requires one more extra slice on the right).
+        template <int N, int ORDER, class T, class WeightFunction>
+        void add_particles_to_grid(const T * part,
+                                   size_t NumPart,
+                                   FFTWGrid<N> & density,
+                                   WeightFunction && weight_of_particle,
+                                   double shift);
+
+        /// @brief Assign particles with a weight per particle to a grid. The result is the weighted number density
+        /// \f$ \sum_i w_i W(x - x_i) \f$ in units of the box volume (i.e. not the overdensity), which is what we need
+        /// for survey data where we combine galaxies and randoms.
+        ///
+        /// @tparam N The dimension of the grid
+        /// @tparam T The particle class. Must have a get_pos() method.
+        ///
+        /// @param[in] part A pointer the first particle.
+        /// @param[in] NumPart How many particles we have on the local task.
+        /// @param[in] weights The weight of each of the particles.
+        /// @param[out] density The weighted number density.
+        /// @param[in] density_assignment_method The assignment method: NGP, CIC, TSC, PCS or PQS.
+        /// @param[in] add_to_grid If true we add to what is already in the grid, otherwise we start from zero.
+        /// @param[in] shift Shift the particles by this amount (in units of the cell size) in all directions. Used
+        /// for interlacing and requires one more extra slice on the right.
+        ///
+        template <int N, class T>
+        void weighted_particles_to_grid(const T * part,
+                                        size_t NumPart,
+                                        const std::vector<double> & weights,
+                                        FFTWGrid<N> & density,
+                                        std::string density_assignment_method,
+                                        bool add_to_grid = false,
+                                        double shift = 0.0);
+
         /// Internal method
         template <int N, class T>
         void particles_to_fourier_grid_interlacing(T * part,
@@ -378,7 +415,7 @@ namespace FML {
 
         /// @brief Internal method. For communication between tasks needed when adding particles to grid
         template <int N>
-        void add_contribution_from_extra_slices(FFTWGrid<N> & density);
+        void add_contribution_from_extra_slices(FFTWGrid<N> & density, FloatType background = -1.0);
 
         /// @brief This returns the a function giving the window function for a given density assignement method as
         /// function of the wave-vector in dimensionless units.
@@ -473,13 +510,17 @@ namespace FML {
         // comments WEIGHTS below)
         //==============================================================================
 
-        template <int N, int ORDER, class T>
-        void particles_to_grid(const T * part, size_t NumPart, size_t NumPartTot, FFTWGrid<N> & density) {
+        template <int N, int ORDER, class T, class WeightFunction>
+        void add_particles_to_grid(const T * part,
+                                   size_t NumPart,
+                                   FFTWGrid<N> & density,
+                                   WeightFunction && weight_of_particle,
+                                   double shift) {
 
             const auto nextra = get_extra_slices_needed_by_order<ORDER>();
             assert_mpi(density.get_n_extra_slices_left() >= nextra.first and
-                           density.get_n_extra_slices_right() >= nextra.second,
-                       "[particles_to_grid] Too few extra slices\n");
+                           density.get_n_extra_slices_right() >= nextra.second + (shift > 0.0 ? 1 : 0),
+                       "[add_particles_to_grid] Too few extra slices\n");
 
             //==========================================================
             // This is a generic method. You have to specify the kernel
@@ -496,26 +537,6 @@ namespace FML {
             const auto Local_x_start = density.get_local_x_start();
             const int Nmesh = density.get_nmesh();
 
-            // Set whole grid (also extra slices) to -1.0
-            density.fill_real_grid(-1.0);
-
-            // Factor to normalize density to the mean density
-            double norm_fac = std::pow((double)Nmesh, N) / double(NumPartTot);
-
-            // Check if particles has a get_mass method and if so
-            // compute the mean mass
-            constexpr bool has_mass = FML::PARTICLE::has_get_mass<T>();
-            if constexpr (has_mass) {
-                double mean_mass = 0.0;
-                for (size_t i = 0; i < NumPart; i++) {
-                    mean_mass += FML::PARTICLE::GetMass(part[i]);
-                }
-                SumOverTasks(&mean_mass);
-                mean_mass /= double(NumPartTot);
-                norm_fac /= mean_mass;
-            }
-            double mass = 1.0;
-
             // Loop over all particles and add them to the grid
             // OpenMP will not be very good due to critical section needed in add_real
             for (size_t i = 0; i < NumPart; i++) {
@@ -523,16 +544,17 @@ namespace FML {
                 // Particle position
                 const auto * pos = FML::PARTICLE::GetPos(const_cast<T *>(part)[i]);
 
-                // Fetch mass if this is availiable
-                if constexpr (has_mass)
-                    mass = FML::PARTICLE::GetMass(part[i]);
+                // The weight we assign the particle with
+                const double mass = weight_of_particle(i);
 
                 std::array<double, N> x;
                 std::array<int, N> ix;
                 [[maybe_unused]] std::array<int, N> ix_nbor;
                 for (int idim = 0; idim < N; idim++) {
-                    // Scale positions to be in [0, Nmesh]
-                    x[idim] = pos[idim] * Nmesh;
+                    // Scale positions to be in [0, Nmesh] (and shift them if we are interlacing)
+                    x[idim] = pos[idim] * Nmesh + shift;
+                    if (idim > 0 and x[idim] >= Nmesh)
+                        x[idim] -= Nmesh;
                     // Grid-index for cell containing particle
                     ix[idim] = (int)x[idim];
                     // Distance relative to cell
@@ -600,7 +622,7 @@ namespace FML {
                     }
 
                     // Add particle to grid
-                    density.add_real(icoord, w * norm_fac * mass);
+                    density.add_real(icoord, w * mass);
                     sumweights += w;
                 }
 
@@ -608,19 +630,99 @@ namespace FML {
                 // Check that the weights sum up to unity
                 assert_mpi(
                     std::fabs(sumweights - 1.0) < 1e-3,
-                    "[particles_to_grid] Possible problem with particles to grid: weights does not sum to unity!");
+                    "[add_particles_to_grid] Possible problem with particles to grid: weights does not sum to unity!");
 #endif
             }
+        }
+
+        template <int N, int ORDER, class T>
+        void particles_to_grid(const T * part, size_t NumPart, size_t NumPartTot, FFTWGrid<N> & density) {
+            FML_PROFILE_SCOPE("particles_to_grid");
+
+            const auto nextra = get_extra_slices_needed_by_order<ORDER>();
+            assert_mpi(density.get_n_extra_slices_left() >= nextra.first and
+                           density.get_n_extra_slices_right() >= nextra.second,
+                       "[particles_to_grid] Too few extra slices\n");
+
+            const int Nmesh = density.get_nmesh();
+
+            // Set whole grid (also extra slices) to -1.0
+            density.fill_real_grid(-1.0);
+
+            // Factor to normalize density to the mean density
+            double norm_fac = std::pow((double)Nmesh, N) / double(NumPartTot);
+
+            // Check if particles has a get_mass method and if so
+            // compute the mean mass
+            constexpr bool has_mass = FML::PARTICLE::has_get_mass<T>();
+            if constexpr (has_mass) {
+                double mean_mass = 0.0;
+                for (size_t i = 0; i < NumPart; i++) {
+                    mean_mass += FML::PARTICLE::GetMass(part[i]);
+                }
+                SumOverTasks(&mean_mass);
+                mean_mass /= double(NumPartTot);
+                norm_fac /= mean_mass;
+            }
+
+            // Fetch mass if this is availiable
+            auto weight_of_particle = [&]([[maybe_unused]] size_t i) -> double {
+                if constexpr (has_mass)
+                    return norm_fac * FML::PARTICLE::GetMass(part[i]);
+                return norm_fac;
+            };
+            add_particles_to_grid<N, ORDER>(part, NumPart, density, weight_of_particle, 0.0);
 
             add_contribution_from_extra_slices<N>(density);
         }
 
+        template <int N, class T>
+        void weighted_particles_to_grid(const T * part,
+                                        size_t NumPart,
+                                        const std::vector<double> & weights,
+                                        FFTWGrid<N> & density,
+                                        std::string density_assignment_method,
+                                        bool add_to_grid,
+                                        double shift) {
+            FML_PROFILE_SCOPE("weighted_particles_to_grid");
+            assert_mpi(weights.size() >= NumPart, "[weighted_particles_to_grid] Need one weight per particle\n");
+
+            // The extra slices must be zero before we start. They contain what we sent to the neighbor tasks the last
+            // time so we must also clear them when adding to an existing grid
+            if (add_to_grid) {
+                const auto num_cells_slice = density.get_ntot_real_slice_alloc();
+                FloatType * left = density.get_real_grid() - density.get_n_extra_slices_left() * num_cells_slice;
+                FloatType * right = density.get_real_grid_right();
+                std::fill(left, density.get_real_grid(), FloatType(0.0));
+                std::fill(right, right + density.get_n_extra_slices_right() * num_cells_slice, FloatType(0.0));
+            } else {
+                density.fill_real_grid(0.0);
+            }
+
+            // Assign weight * Nmesh^N so that the grid is the weighted number density (box volume is 1)
+            const double norm_fac = std::pow(double(density.get_nmesh()), N);
+            auto weight_of_particle = [&](size_t i) -> double { return norm_fac * weights[i]; };
+            if (density_assignment_method.compare("NGP") == 0)
+                add_particles_to_grid<N, 1>(part, NumPart, density, weight_of_particle, shift);
+            if (density_assignment_method.compare("CIC") == 0)
+                add_particles_to_grid<N, 2>(part, NumPart, density, weight_of_particle, shift);
+            if (density_assignment_method.compare("TSC") == 0)
+                add_particles_to_grid<N, 3>(part, NumPart, density, weight_of_particle, shift);
+            if (density_assignment_method.compare("PCS") == 0)
+                add_particles_to_grid<N, 4>(part, NumPart, density, weight_of_particle, shift);
+            if (density_assignment_method.compare("PQS") == 0)
+                add_particles_to_grid<N, 5>(part, NumPart, density, weight_of_particle, shift);
+
+            add_contribution_from_extra_slices<N>(density, 0.0);
+        }
+
         template <int N, int ORDER, class T>
         void
         interpolate_grid_vector_to_particle_positions(const std::array<FFTWGrid<N>, N> & grid_vec,
                                                       const T * part,
                                                       size_t NumPart,
                                                       std::array<std::vector<FloatType>, N> & interpolated_values_vec) {
+            FML_PROFILE_SCOPE("interpolate_grid_vector_to_particle_positions");
 
             auto nextra = get_extra_slices_needed_by_order<ORDER>();
             assert_mpi(grid_vec.size() > 0,
@@ -778,6 +880,7 @@ namespace FML {
                                                     const T * part,
                                                     size_t NumPart,
                                                     std::vector<FloatType> & interpolated_values) {
+            FML_PROFILE_SCOPE("interpolate_grid_to_particle_positions");
 
             auto nextra = get_extra_slices_needed_by_order<ORDER>();
             assert_mpi(grid.get_nmesh() > 0,
@@ -908,7 +1011,8 @@ namespace FML {
         // on neighbor tasks
         //=======================================================================
         template <int N>
-        void add_contribution_from_extra_slices(FFTWGrid<N> & density) {
+        void add_contribution_from_extra_slices(FFTWGrid<N> & density, FloatType background) {
+            FML_PROFILE_SCOPE("add_contribution_from_extra_slices");
 
             auto Local_nx = density.get_local_nx();
             auto num_cells_slice = density.get_ntot_real_slice_alloc();
@@ -948,7 +1052,7 @@ namespace FML {
 
                 // Copy over data from temp
                 for (int j = 0; j < num_cells_slice; j++) {
-                    slice_left[j] += (temp[j] + 1.0);
+                    slice_left[j] += (temp[j] - background);
                 }
             }
 
@@ -982,7 +1086,7 @@ namespace FML {
 
                 // Copy over data from temp
                 for (int j = 0; j < num_cells_slice; j++) {
-                    slice_right[j] += (temp[j] + 1.0);
+                    slice_right[j] += (temp[j] - background);
                 }
             }
         }
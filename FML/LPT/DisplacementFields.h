@@ -35,12 +35,29 @@ namespace FML {
                                                            std::array<FFTWGrid<N>, N> & psi_real,
                                                            double DoverDini = 1.0);
 
+            template <int N>
+            void from_LPT_potential_to_displacement_component(const FFTWGrid<N> & phi_fourier,
+                                                              FFTWGrid<N> & psi_component_real,
+                                                              int idim,
+                                                              double DoverDini = 1.0);
+
             template <int N>
             void compute_1LPT_potential_fourier(const FFTWGrid<N> & delta_fourier, FFTWGrid<N> & phi_1LPT_fourier);
 
             template <int N>
             void compute_2LPT_potential_fourier(const FFTWGrid<N> & delta_fourier, FFTWGrid<N> & phi_2LPT_fourier);
 
+            // Computes all the LPT potentials up to LPT_order with the minimal number of FFTs
+            template <int N>
+            void compute_LPT_potentials_fourier(const FFTWGrid<N> & delta_fourier,
+                                                int LPT_order,
+                                                FFTWGrid<N> & phi_1LPT_fourier,
+                                                FFTWGrid<N> & phi_2LPT_fourier,
+                                                FFTWGrid<N> & phi_3LPT_a_fourier,
+                                                FFTWGrid<N> & phi_3LPT_b_fourier,
+                                                std::array<FFTWGrid<N>, N> & phi_3LPT_Avec_fourier,
+                                                bool ignore_curl_term);
+
             // Slightly different syntax here as we have to compute phi_1LPT and phi_2LPT to compute 3LPT so do it all
             template <int N>
             void compute_3LPT_potential_fourier(const FFTWGrid<N> & delta_fourier,
@@ -118,7 +135,6 @@ namespace FML {
                 auto nleft = phi.get_n_extra_slices_left();
                 auto nright = phi.get_n_extra_slices_right();
                 auto Nmesh = phi.get_nmesh();
-                auto Local_nx = phi.get_local_nx();
                 auto Local_x_start = phi.get_local_x_start();
 
                 // Create the output grids if they don't exist already
@@ -135,28 +151,20 @@ namespace FML {
                 // Make a spline of the function (faster) if we have GSL otherwise this is
                 // just a copy of the function itself
                 auto DoverDini_of_k_spline = phi.make_fourier_spline(DoverDini_of_k, "D(k)/Dini(k)");
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    std::complex<FML::GRID::FloatType> I(0, 1);
-                    for (auto && fourier_index : phi.get_fourier_range(islice, islice + 1)) {
-                        if (Local_x_start == 0 and fourier_index == 0)
-                            continue; // DC mode (k=0)
-
-                        // Get wavevector and magnitude
-                        phi.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
+                const std::complex<FML::GRID::FloatType> I(0, 1);
+                phi.for_each_fourier([&](IndexIntType fourier_index, const std::array<double, N> & kvec, double kmag2) {
+                    if (kmag2 == 0.0)
+                        return; // DC mode (k=0)
 
-                        // Psi_vec = D Phi => F[Psi_vec] = ik_vec F[Phi]
-                        auto value = phi.get_fourier_from_index(fourier_index) * I * FML::GRID::FloatType(DoverDini_of_k_spline(kmag));
+                    // Psi_vec = D Phi => F[Psi_vec] = ik_vec F[Phi]
+                    const double kmag = std::sqrt(kmag2);
+                    auto value = phi.get_fourier_from_index(fourier_index) * I *
+                                 FML::GRID::FloatType(DoverDini_of_k_spline(kmag));
 
-                        for (int idim = 0; idim < N; idim++) {
-                            psi[idim].set_fourier_from_index(fourier_index, value * FML::GRID::FloatType(kvec[idim]));
-                        }
+                    for (int idim = 0; idim < N; idim++) {
+                        psi[idim].set_fourier_from_index(fourier_index, value * FML::GRID::FloatType(kvec[idim]));
                     }
-                }
+                });
 
                 // Deal with DC mode
                 if (Local_x_start == 0)
@@ -201,7 +209,6 @@ namespace FML {
                 auto nleft = phi.get_n_extra_slices_left();
                 auto nright = phi.get_n_extra_slices_right();
                 auto Nmesh = phi.get_nmesh();
-                auto Local_nx = phi.get_local_nx();
                 auto Local_x_start = phi.get_local_x_start();
 
                 // Create the output grids if they don't exist already
@@ -214,27 +221,17 @@ namespace FML {
                     }
                 }
 
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    std::complex<FML::GRID::FloatType> I(0, 1);
-                    for (auto && fourier_index : psi[0].get_fourier_range(islice, islice + 1)) {
-                        if (Local_x_start == 0 and fourier_index == 0)
-                            continue; // DC mode (k=0)
-
-                        // Get wavevector and magnitude
-                        phi.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
+                const std::complex<FML::GRID::FloatType> I(0, 1);
+                phi.for_each_fourier([&](IndexIntType fourier_index, const std::array<double, N> & kvec, double kmag2) {
+                    if (kmag2 == 0.0)
+                        return; // DC mode (k=0)
 
-                        // Psi_vec = D Phi => F[Psi_vec] = ik_vec F[Phi]
-                        auto value = phi.get_fourier_from_index(fourier_index) * FML::GRID::FloatType(DoverDini);
-                        for (int idim = 0; idim < N; idim++) {
-                            psi[idim].set_fourier_from_index(fourier_index, I * value * FML::GRID::FloatType(kvec[idim]));
-                        }
+                    // Psi_vec = D Phi => F[Psi_vec] = ik_vec F[Phi]
+                    auto value = phi.get_fourier_from_index(fourier_index) * FML::GRID::FloatType(DoverDini);
+                    for (int idim = 0; idim < N; idim++) {
+                        psi[idim].set_fourier_from_index(fourier_index, I * value * FML::GRID::FloatType(kvec[idim]));
                     }
-                }
+                });
 
                 // Deal with DC mode
                 if (Local_x_start == 0)
@@ -251,6 +248,57 @@ namespace FML {
                 }
             }
 
+            //=================================================================================
+            /// Generate a single component \f$ \Psi_i = \partial_i \phi \f$ of the displacement field from the LPT
+            /// potential \f$ \phi \f$. Useful when we only want to hold one component in memory at the time.
+            ///
+            /// @tparam N The dimension of the grid
+            ///
+            /// @param[in] phi The LPT potential in fourier space
+            /// @param[out] psi_component The idim component of the displacement vector in real space
+            /// @param[in] idim The component we want
+            /// @param[in] DoverDini The growth factor at the time you want the displacement field to the growth factor
+            /// at which phi is at
+            ///
+            //=================================================================================
+            template <int N>
+            void from_LPT_potential_to_displacement_component(const FFTWGrid<N> & phi,
+                                                              FFTWGrid<N> & psi_component,
+                                                              int idim,
+                                                              double DoverDini) {
+
+                assert_mpi(phi.get_nmesh() > 0,
+                           "[from_LPT_potential_to_displacement_component] Grid has to be already allocated!");
+                assert_mpi(idim >= 0 and idim < N, "[from_LPT_potential_to_displacement_component] Invalid idim");
+
+                auto Local_x_start = phi.get_local_x_start();
+
+                // Create the output grid if it does not exist already
+                if (psi_component.get_nmesh() == 0) {
+                    psi_component =
+                        FFTWGrid<N>(phi.get_nmesh(), phi.get_n_extra_slices_left(), phi.get_n_extra_slices_right());
+                    psi_component.add_memory_label(
+                        "FFTWGrid::from_LPT_potential_to_displacement_component::Psi_component");
+                }
+                psi_component.set_grid_status_real(false);
+
+                const std::complex<FML::GRID::FloatType> I(0, 1);
+                phi.for_each_fourier([&](IndexIntType fourier_index, const std::array<double, N> & kvec, double kmag2) {
+                    if (kmag2 == 0.0)
+                        return; // DC mode (k=0)
+
+                    // Psi_i = D_i Phi => F[Psi_i] = ik_i F[Phi]
+                    auto value = phi.get_fourier_from_index(fourier_index) * FML::GRID::FloatType(DoverDini);
+                    psi_component.set_fourier_from_index(fourier_index, I * value * FML::GRID::FloatType(kvec[idim]));
+                });
+
+                // Deal with DC mode
+                if (Local_x_start == 0)
+                    psi_component.set_fourier_from_index(0, 0.0);
+
+                psi_component.fftw_c2r();
+            }
+
             //=================================================================================
             /// Generate the 1LPT potential defined as \f$ \Psi^{\rm 1LPT} = \nabla \phi^{\rm 1LPT} \f$ and \f$
             /// \nabla^2 \phi^{\rm 1LPT} = -\delta \f$. Returns it in Fourier space.
@@ -278,7 +326,6 @@ namespace FML {
                 auto nleft = delta_fourier.get_n_extra_slices_left();
                 auto nright = delta_fourier.get_n_extra_slices_right();
                 auto Nmesh = delta_fourier.get_nmesh();
-                auto Local_nx = delta_fourier.get_local_nx();
                 auto Local_x_start = delta_fourier.get_local_x_start();
 
                 // Create 1LPT grid
@@ -289,267 +336,369 @@ namespace FML {
                 }
 
                 // Divide grid by k^2. Assuming delta was created in fourier-space so no FFTW normalization needed
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag2;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    for (auto && fourier_index : phi_1LPT_fourier.get_fourier_range(islice, islice + 1)) {
-                        if (Local_x_start == 0 and fourier_index == 0)
-                            continue; // DC mode (k=0)
-
-                        // Get wavevector and magnitude
-                        phi_1LPT_fourier.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
+                phi_1LPT_fourier.for_each_fourier(
+                    [&](IndexIntType fourier_index, [[maybe_unused]] const std::array<double, N> & kvec, double kmag2) {
+                        if (kmag2 == 0.0)
+                            return; // DC mode (k=0)
 
                         // D^2 Phi_1LPT = -delta => F[Phi_1LPT] = F[delta] / k^2
                         auto value = delta_fourier.get_fourier_from_index(fourier_index) / FML::GRID::FloatType(kmag2);
                         phi_1LPT_fourier.set_fourier_from_index(fourier_index, value);
-                    }
-                }
+                    });
 
                 // Deal with DC mode
                 if (Local_x_start == 0)
                     phi_1LPT_fourier.set_fourier_from_index(0, 0.0);
             }
 
-            //=================================================================================
-            /// Generate the 2LPT potential defined as \f$ \Psi^{\rm 2LPT} = \nabla \phi^{\rm 2LPT} \f$ and \f$
-            /// \nabla^2 \phi^{\rm 2LPT} = \ldots \f$. Returns the grid in Fourier space.
+            //===========================================================================================
+            /// Compute the 1LPT, 2LPT and 3LPT potentials (up to the order we ask for) in one go. This is the
+            /// LPT engine that the other compute_nLPT_potential_fourier methods use.
             ///
-            /// @tparam N The dimension of the grid
+            /// Every second derivative phi_ij of the 1LPT and 2LPT potentials is computed exactly once from
+            /// the Fourier space potential and the sources are built up by streaming over these components.
+            /// All the source terms are linear in the phi_2LPT_ij (and in the components of phi_1LPT_ij for the
+            /// 2LPT source when we use that the laplacian of phi_1LPT is delta) so a component can be freed as
+            /// soon as it has been added in. The only exception is phi_1LPT_ij for 3LPT which we need all of
+            /// at the same time. Each grid is freed directly after its last use.
             ///
-            /// @param[in] delta The density contrast in fourier space
-            /// @param[out] phi_2LPT The LPT potential in fourier space
+            /// Number of FFTs and peak number of grids allocated in this method (in addition to delta_fourier and
+            /// with M = N(N+1)/2 the number of independent phi_ij, i.e. M = 6 for N = 3):
             ///
-            //=================================================================================
+            ///   LPT_order = 1 : 0 FFTs, 1 grid (the output)
+            ///
+            ///   LPT_order = 2 : M + 2 FFTs, 2 grids (source + one component). For N = 3 this is 8 FFTs and 2 grids.
+            ///
+            ///   LPT_order = 3 : 2M + 3 (+N for the curl) FFTs. Peak is M + 4 (+N for the curl) grids.
+            ///                   For N = 3 this is 15 FFTs and 10 grids without the curl term (18 FFTs and 13 grids
+            ///                   with it) compared to 19 grids with the old implementation.
+            ///
+            /// The potentials we output are normalized such that we can get the displacement field as
+            /// Psi = D phi_1LPT + D phi_2LPT + D phi_3LPT_a + D phi_3PT_b + D x A_3LPT
+            /// The 1LPT potential is \f$ \delta(k) / k^2 \f$ as in compute_1LPT_potential_fourier.
+            ///
+            /// @tparam N Dimensions we are working in (3LPT only for 2 or 3)
+            ///
+            /// @param[in] delta_fourier A realisation of the density field.
+            /// @param[in] LPT_order The highest order we want (1, 2 or 3). Grids for orders above this are not touched.
+            /// @param[out] phi_1LPT_fourier The 1LPT displacement potential
+            /// @param[out] phi_2LPT_fourier The 2LPT displacement potential
+            /// @param[out] phi_3LPT_a_fourier The A 3LPT displacement potential
+            /// @param[out] phi_3LPT_b_fourier The B 3LPT displacement potential
+            /// @param[out] phi_3LPT_Avec_fourier The 3LPT displacement vector potential (for N=2 we only use the first
+            /// component)
+            /// @param[in] ignore_curl_term Don't compute the vector potential
+            ///
+            //===========================================================================================
             template <int N>
-            void compute_2LPT_potential_fourier(const FFTWGrid<N> & delta, FFTWGrid<N> & phi_2LPT) {
+            void compute_LPT_potentials_fourier(const FFTWGrid<N> & delta_fourier,
+                                                int LPT_order,
+                                                FFTWGrid<N> & phi_1LPT_fourier,
+                                                FFTWGrid<N> & phi_2LPT_fourier,
+                                                FFTWGrid<N> & phi_3LPT_a_fourier,
+                                                FFTWGrid<N> & phi_3LPT_b_fourier,
+                                                std::array<FFTWGrid<N>, N> & phi_3LPT_Avec_fourier,
+                                                bool ignore_curl_term) {
 
-                // We require delta to exist and if phi_2LPT is allocated it must have the same size as delta
-                assert_mpi(delta.get_nmesh() > 0,
-                           "[compute_2LPT_potential_fourier] delta grid has to be already allocated!");
+                assert_mpi(delta_fourier.get_nmesh() > 0,
+                           "[compute_LPT_potentials_fourier] delta grid has to be already allocated!");
+                assert_mpi(LPT_order >= 1 and LPT_order <= 3,
+                           "[compute_LPT_potentials_fourier] LPT_order must be 1, 2 or 3");
+                assert_mpi(LPT_order < 3 or N == 2 or N == 3,
+                           "[compute_LPT_potentials_fourier] 3LPT is only implemented for N = 2 and N = 3");
 
-                // This is the -3/7 factor coming from D2 = -3/7 D1^2 for the growing mode in Einstein-deSitter
-                constexpr double prefactor_2LPT = -3.0 / 7.0;
+                // Factor to scale displacement potentials such that Psi = Dphi_1LPT + Dphi_2LPT + ... + D x Avec_3LPT
+                constexpr FML::GRID::FloatType prefactor_2LPT = -3.0 / 7.0;
+                constexpr FML::GRID::FloatType prefactor_3LPT_a = 1.0 / 3.0;
+                constexpr FML::GRID::FloatType prefactor_3LPT_b = -10.0 / 21.0;
+                constexpr FML::GRID::FloatType prefactor_3LPT_Avec = 1.0 / 7.0;
 
-#ifdef DEBUG_LPT
-                if (FML::ThisTask == 0)
-                    std::cout << "Compute 2LPT potential (require N(N-1)/2 = 3 for N = 3 temporary grids)\n";
-#endif
+                auto nleft = delta_fourier.get_n_extra_slices_left();
+                auto nright = delta_fourier.get_n_extra_slices_right();
+                auto Nmesh = delta_fourier.get_nmesh();
+                auto Local_nx = delta_fourier.get_local_nx();
+                auto Local_x_start = delta_fourier.get_local_x_start();
 
-                auto nleft = delta.get_n_extra_slices_left();
-                auto nright = delta.get_n_extra_slices_right();
-                auto Nmesh = delta.get_nmesh();
-                auto Local_nx = delta.get_local_nx();
-                auto Local_x_start = delta.get_local_x_start();
-
-                // Create grids
-                FFTWGrid<N> phi_1LPT_ii[N];
-                for (int i = 0; i < N; i++) {
-                    phi_1LPT_ii[i] = FFTWGrid<N>(Nmesh, nleft, nright);
-                    phi_1LPT_ii[i].add_memory_label("FFTWGrid::compute_2LPT_potential_fourier::phi_1LPT_ii_" +
-                                                    std::to_string(i));
-                    phi_1LPT_ii[i].set_grid_status_real(false);
-                }
-#ifdef DEBUG_LPT
-                if (FML::ThisTask == 0) {
-                    std::cout << "Compute [DiDi phi_1LPT] in fourier space\n";
-                }
-#endif
+                // The independent components ij with i <= j in the order (xx,xy,xz,yy,yz,zz) for N = 3
+                constexpr int num_pairs = (N * (N + 1)) / 2;
+                std::vector<std::pair<int, int>> pairs;
+                for (int idim1 = 0; idim1 < N; idim1++)
+                    for (int idim2 = idim1; idim2 < N; idim2++)
+                        pairs.push_back({idim1, idim2});
+
+                auto new_grid = [&](std::string label) {
+                    FFTWGrid<N> grid(Nmesh, nleft, nright);
+                    grid.add_memory_label("FFTWGrid::compute_LPT_potentials_fourier::" + label);
+                    return grid;
+                };
 
-                // Compute phi_xx, phi_yy, ...
+                // Set grid = F^-1[ source(k) k_i k_j / k^2 ] (for source = delta this is phi_1LPT_ij)
+                auto compute_phi_ij = [&](const FFTWGrid<N> & source_fourier, int pair, FFTWGrid<N> & grid) {
+                    const int i = pairs[pair].first;
+                    const int j = pairs[pair].second;
 #ifdef USE_OMP
 #pragma omp parallel for
 #endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag2;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    for (auto && fourier_index : phi_1LPT_ii[0].get_fourier_range(islice, islice + 1)) {
-                        if (Local_x_start == 0 and fourier_index == 0)
-                            continue; // DC mode (k=0)
-
-                        // Get wavevector and magnitude
-                        delta.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
-
-                        // D^2Phi = -delta => F[DiDj Phi] = F[delta] kikj/k^2
-                        auto value = delta.get_fourier_from_index(fourier_index) / FML::GRID::FloatType(kmag2);
-
-                        for (int idim = 0; idim < N; idim++) {
-                            phi_1LPT_ii[idim].set_fourier_from_index(fourier_index, value * FML::GRID::FloatType(kvec[idim] * kvec[idim]));
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        [[maybe_unused]] double kmag2;
+                        [[maybe_unused]] std::array<double, N> kvec;
+                        for (auto && fourier_index : grid.get_fourier_range(islice, islice + 1)) {
+                            if (Local_x_start == 0 and fourier_index == 0)
+                                continue; // DC mode (k=0)
+                            source_fourier.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
+                            auto value = source_fourier.get_fourier_from_index(fourier_index);
+                            grid.set_fourier_from_index(
+                                fourier_index, value * FML::GRID::FloatType(kvec[i] * kvec[j] / kmag2));
                         }
                     }
-                }
-
-                // Deal with DC mode
-                if (Local_x_start == 0)
-                    for (int idim = 0; idim < N; idim++)
-                        phi_1LPT_ii[idim].set_fourier_from_index(0, 0.0);
-
-                // Fourier transform
-                for (int idim = 0; idim < N; idim++) {
-#ifdef DEBUG_LPT
-                    if (FML::ThisTask == 0)
-                        std::cout << "Fourier transform [DiDi phi_1LPT] to real space: " << idim + 1 << " / " << N
-                                  << "\n";
-#endif
-                    phi_1LPT_ii[idim].fftw_c2r();
-                }
-
-                // Crete output grid
-                phi_2LPT = FFTWGrid<N>(Nmesh, nleft, nright);
-                phi_2LPT.add_memory_label("FFTWGrid::compute_2LPT_potential_fourier::phi_2LPT_fourier");
-                phi_2LPT.set_grid_status_real(true);
-
-                // Copy over source
-#ifdef DEBUG_LPT
-                if (FML::ThisTask == 0)
-                    std::cout << "Add 0.5[(D^2 phi_1LPT)^2 - DiDi phi_1LPT^2] to real space grid containing "
-                                 "(D^2phi_2LPT) \n";
-#endif
+                    if (Local_x_start == 0)
+                        grid.set_fourier_from_index(0, 0.0);
+                    grid.set_grid_status_real(false);
+                    grid.fftw_c2r();
+                };
 
+                // Multiply a grid by factor * (-1/k^2) and set the DC mode to zero
+                auto divide_by_minus_k2 = [&](FFTWGrid<N> & grid, FML::GRID::FloatType factor) {
 #ifdef USE_OMP
 #pragma omp parallel for
 #endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    for (auto && real_index : phi_2LPT.get_real_range(islice, islice + 1)) {
-                        auto laplacian = 0.0, sum_squared = 0.0;
-                        for (int idim = 0; idim < N; idim++) {
-                            auto curpsi = phi_1LPT_ii[idim].get_real_from_index(real_index);
-                            laplacian += curpsi;
-                            sum_squared += curpsi * curpsi;
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        [[maybe_unused]] double kmag2;
+                        [[maybe_unused]] std::array<double, N> kvec;
+                        for (auto && fourier_index : grid.get_fourier_range(islice, islice + 1)) {
+                            if (Local_x_start == 0 and fourier_index == 0)
+                                continue; // DC mode (k=0)
+                            grid.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
+                            auto value = grid.get_fourier_from_index(fourier_index);
+                            grid.set_fourier_from_index(fourier_index, value * FML::GRID::FloatType(-factor / kmag2));
                         }
-                        auto value = 0.5 * (laplacian * laplacian - sum_squared);
-                        phi_2LPT.set_real_from_index(real_index, value);
                     }
-                }
-
-                // Free memory
-                for (int idim = 0; idim < N; idim++)
-                    phi_1LPT_ii[idim].free();
-
-                // Create grids
-                const int num_pairs = (N * (N - 1)) / 2;
-                FFTWGrid<N> phi_1LPT_ij[num_pairs];
-                for (int i = 0; i < num_pairs; i++) {
-                    phi_1LPT_ij[i] = FFTWGrid<N>(Nmesh, nleft, nright);
-                    phi_1LPT_ij[i].add_memory_label("FFTWGrid::compute_2LPT_potential_fourier::phi_1LPT_ij_" +
-                                                    std::to_string(i));
-                    phi_1LPT_ij[i].set_grid_status_real(false);
-                }
+                    if (Local_x_start == 0)
+                        grid.set_fourier_from_index(0, 0.0);
+                };
 
-                // Compute phi_xixj for all pairs of i,j
-#ifdef DEBUG_LPT
-                if (FML::ThisTask == 0)
-                    std::cout << "Compute [DiDj phi_1LPT] in fourier space\n";
+                if (LPT_order == 2) {
+
+                    //=================================================================================
+                    // The 2LPT source 0.5 * [ (D^2phi_1LPT)^2 - Sum_ij phi_1LPT_ij^2 ] where the laplacian
+                    // is just delta so we can stream the components through one scratch grid
+                    //=================================================================================
+                    phi_2LPT_fourier = delta_fourier;
+                    phi_2LPT_fourier.add_memory_label("FFTWGrid::compute_LPT_potentials_fourier::phi_2LPT_fourier");
+                    if (Local_x_start == 0)
+                        phi_2LPT_fourier.set_fourier_from_index(0, 0.0);
+                    phi_2LPT_fourier.set_grid_status_real(false);
+                    phi_2LPT_fourier.fftw_c2r();
+#ifdef USE_OMP
+#pragma omp parallel for
 #endif
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        for (auto && real_index : phi_2LPT_fourier.get_real_range(islice, islice + 1)) {
+                            auto laplacian = phi_2LPT_fourier.get_real_from_index(real_index);
+                            phi_2LPT_fourier.set_real_from_index(real_index, 0.5 * laplacian * laplacian);
+                        }
+                    }
 
+                    if (FML::ThisTask == 0)
+                        std::cout << "Computing phi_2LPT streaming over phi_1LPT_ij...\n";
+                    FFTWGrid<N> phi_1LPT_ij = new_grid("phi_1LPT_ij");
+                    for (int pair = 0; pair < num_pairs; pair++) {
+                        compute_phi_ij(delta_fourier, pair, phi_1LPT_ij);
+                        const double factor = pairs[pair].first == pairs[pair].second ? 0.5 : 1.0;
 #ifdef USE_OMP
 #pragma omp parallel for
 #endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag2;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    for (auto && fourier_index : phi_1LPT_ij[0].get_fourier_range(islice, islice + 1)) {
-                        if (Local_x_start == 0 and fourier_index == 0)
-                            continue; // DC mode (k=0)
-
-                        // Get wavevector and magnitude
-                        delta.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
-
-                        auto value = delta.get_fourier_from_index(fourier_index) / FML::GRID::FloatType(kmag2);
-
-                        int pair = 0;
-                        for (int idim1 = 0; idim1 < N; idim1++) {
-                            for (int idim2 = idim1 + 1; idim2 < N; idim2++) {
-                                phi_1LPT_ij[pair++].set_fourier_from_index(fourier_index,
-                                                                           FML::GRID::FloatType(kvec[idim1] * kvec[idim2]) * value);
+                        for (int islice = 0; islice < Local_nx; islice++) {
+                            for (auto && real_index : phi_2LPT_fourier.get_real_range(islice, islice + 1)) {
+                                auto phi_ij = phi_1LPT_ij.get_real_from_index(real_index);
+                                auto value = phi_2LPT_fourier.get_real_from_index(real_index);
+                                phi_2LPT_fourier.set_real_from_index(real_index, value - factor * phi_ij * phi_ij);
                             }
                         }
                     }
+                    phi_1LPT_ij.free();
+
+                    // Back to fourier space: We now have -k^2 phi_2LPT / prefactor_2LPT in this grid
+                    phi_2LPT_fourier.fftw_r2c();
+                    divide_by_minus_k2(phi_2LPT_fourier, prefactor_2LPT);
                 }
 
-                // Deal with DC mode
-                if (Local_x_start == 0)
-                    for (auto & g : phi_1LPT_ij)
-                        g.set_fourier_from_index(0, 0.0);
+                if (LPT_order == 3) {
 
-                // Fourier transform
-                for (int pair = 0; pair < num_pairs; pair++) {
-#ifdef DEBUG_LPT
+                    //=================================================================================
+                    // All the components phi_1LPT_ij are needed at the same time for the 3LPT terms
+                    //=================================================================================
                     if (FML::ThisTask == 0)
-                        std::cout << "Fourier transform [DiDj phi_1LPT] to real space: " << pair + 1 << " / "
-                                  << num_pairs << "\n";
-#endif
-                    phi_1LPT_ij[pair].fftw_c2r();
-                }
-
-                // Copy over source
-#ifdef DEBUG_LPT
-                if (FML::ThisTask == 0)
-                    std::cout << "Add [-DiDjphi_1LPT^2] to real space grid containing (D^2phi_2LPT) \n";
-#endif
+                        std::cout << "Computing phi_1LPT_ij for all i,j...\n";
+                    std::vector<FFTWGrid<N>> phi_1LPT_ij(num_pairs);
+                    for (int pair = 0; pair < num_pairs; pair++) {
+                        phi_1LPT_ij[pair] = new_grid("phi_1LPT_ij_" + std::to_string(pair));
+                        compute_phi_ij(delta_fourier, pair, phi_1LPT_ij[pair]);
+                    }
 
+                    // The 2LPT source and the 3LPT_a source (the determinant of phi_1LPT_ij)
+                    if (FML::ThisTask == 0)
+                        std::cout << "Computing phi_2LPT and phi_3LPT_a...\n";
+                    phi_2LPT_fourier = new_grid("phi_2LPT_fourier");
+                    phi_3LPT_a_fourier = new_grid("phi_3LPT_a_fourier");
 #ifdef USE_OMP
 #pragma omp parallel for
 #endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    for (auto && real_index : phi_2LPT.get_real_range(islice, islice + 1)) {
-                        auto sum_squared = 0.0;
-                        for (int pair = 0; pair < num_pairs; pair++) {
-                            auto curpsi = phi_1LPT_ij[pair].get_real_from_index(real_index);
-                            sum_squared += curpsi * curpsi;
-                        }
-                        auto value = (phi_2LPT.get_real_from_index(real_index) - sum_squared);
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        std::array<double, num_pairs> psi1;
+                        for (auto && real_index : phi_2LPT_fourier.get_real_range(islice, islice + 1)) {
+                            for (int pair = 0; pair < num_pairs; pair++)
+                                psi1[pair] = phi_1LPT_ij[pair].get_real_from_index(real_index);
+
+                            double laplacian = 0.0;
+                            double sum_squared = 0.0;
+                            for (int pair = 0; pair < num_pairs; pair++) {
+                                const bool diagonal = pairs[pair].first == pairs[pair].second;
+                                laplacian += diagonal ? psi1[pair] : 0.0;
+                                sum_squared += (diagonal ? 1.0 : 2.0) * psi1[pair] * psi1[pair];
+                            }
+                            phi_2LPT_fourier.set_real_from_index(real_index,
+                                                                 0.5 * (laplacian * laplacian - sum_squared));
 
-                        phi_2LPT.set_real_from_index(real_index, value);
+                            double value_a = 0.0;
+                            if constexpr (N == 2) {
+                                // xx, xy, yy
+                                value_a = psi1[0] * psi1[2] - psi1[1] * psi1[1];
+                            } else if constexpr (N == 3) {
+                                // xx, xy, zx, yy, yz, zz
+                                value_a = psi1[0] * psi1[3] * psi1[5];
+                                value_a += 2.0 * psi1[1] * psi1[4] * psi1[2];
+                                value_a += -psi1[0] * psi1[4] * psi1[4];
+                                value_a += -psi1[3] * psi1[2] * psi1[2];
+                                value_a += -psi1[5] * psi1[1] * psi1[1];
+                            }
+                            phi_3LPT_a_fourier.set_real_from_index(real_index, value_a);
+                        }
                     }
-                }
-
-                // Free memory
-                for (int pair = 0; pair < num_pairs; pair++) {
-                    phi_1LPT_ij[pair].free();
-                }
-
-                // Fourier transform source
-#ifdef DEBUG_LPT
-                if (FML::ThisTask == 0)
-                    std::cout << "Fourier transform [D^2phi_2LPT] to fourier space\n";
-#endif
-                phi_2LPT.fftw_r2c();
 
-                // Divide by -k^2 and normalize
-#ifdef DEBUG_LPT
-                if (FML::ThisTask == 0)
-                    std::cout << "Computing phi_2LPT in fourier space\n";
-#endif
+                    // Back to fourier space: We now have -k^2 phi_2LPT / prefactor_2LPT and -k^2 phi_3LPT_a /
+                    // prefactor_3LPT_a in these grids. phi_2LPT is kept like this until we have the phi_2LPT_ij
+                    phi_2LPT_fourier.fftw_r2c();
+                    phi_3LPT_a_fourier.fftw_r2c();
+                    divide_by_minus_k2(phi_3LPT_a_fourier, prefactor_3LPT_a);
 
+                    //=================================================================================
+                    // The 3LPT_b source and the curl term are linear in phi_2LPT_ij so we stream over these
+                    // 3LPT_b = 0.5 Sum_{i!=j} phi1_ii phi2_jj - Sum_{i<j} phi1_ij phi2_ij
+                    //=================================================================================
+                    if (FML::ThisTask == 0)
+                        std::cout << "Computing phi_3LPT_b streaming over phi_2LPT_ij...\n";
+                    phi_3LPT_b_fourier = new_grid("phi_3LPT_b_fourier");
+                    const int num_curl = ignore_curl_term ? 0 : (N == 2 ? 1 : N);
+                    for (int idim = 0; idim < num_curl; idim++)
+                        phi_3LPT_Avec_fourier[idim] = new_grid("phi_3LPT_Avec_fourier" + std::to_string(idim));
+
+                    FFTWGrid<N> phi_2LPT_ij = new_grid("phi_2LPT_ij");
+                    for (int pair = 0; pair < num_pairs; pair++) {
+                        compute_phi_ij(phi_2LPT_fourier, pair, phi_2LPT_ij);
+                        const int i = pairs[pair].first;
+                        const int j = pairs[pair].second;
 #ifdef USE_OMP
 #pragma omp parallel for
 #endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag2;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    for (auto && fourier_index : phi_2LPT.get_fourier_range(islice, islice + 1)) {
-                        if (Local_x_start == 0 and fourier_index == 0)
-                            continue; // DC mode (k=0)
-
-                        // Get wavevector and magnitude
-                        phi_2LPT.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
-
-                        // Add in the -3/7 factor
-                        auto value = phi_2LPT.get_fourier_from_index(fourier_index);
-                        value *= -prefactor_2LPT / kmag2;
+                        for (int islice = 0; islice < Local_nx; islice++) {
+                            std::array<double, num_pairs> psi1;
+                            for (auto && real_index : phi_3LPT_b_fourier.get_real_range(islice, islice + 1)) {
+                                for (int p = 0; p < num_pairs; p++)
+                                    psi1[p] = phi_1LPT_ij[p].get_real_from_index(real_index);
+                                const double psi2 = phi_2LPT_ij.get_real_from_index(real_index);
+
+                                // Coefficient of phi2_ij in the 3LPT_b source
+                                double coeff_b = 0.0;
+                                if (i == j) {
+                                    for (int p = 0; p < num_pairs; p++)
+                                        if (pairs[p].first == pairs[p].second and p != pair)
+                                            coeff_b += 0.5 * psi1[p];
+                                } else {
+                                    coeff_b = -psi1[pair];
+                                }
+                                auto value_b = phi_3LPT_b_fourier.get_real_from_index(real_index);
+                                phi_3LPT_b_fourier.set_real_from_index(real_index, value_b + coeff_b * psi2);
+
+                                if (num_curl == 0)
+                                    continue;
+
+                                // Coefficients of phi2_ij in the curl term
+                                std::array<double, N> coeff_A{};
+                                if constexpr (N == 2) {
+                                    // Az = psi2_xy (psi1_yy - psi1_xx) - psi1_xy (psi2_yy - psi2_xx)
+                                    // in the order xx, xy, yy
+                                    if (pair == 0)
+                                        coeff_A[0] = psi1[1];
+                                    if (pair == 1)
+                                        coeff_A[0] = psi1[2] - psi1[0];
+                                    if (pair == 2)
+                                        coeff_A[0] = -psi1[1];
+                                } else if constexpr (N == 3) {
+                                    // Ax = psi1_zx psi2_xy - psi2_zx psi1_xy + psi1_yz(psi2_yy - psi2_zz) -
+                                    // psi2_yz(psi1_yy - psi1_zz) and cyclic permutations for Ay and Az
+                                    // in the order xx, xy, zx, yy, yz, zz
+                                    const double xx = psi1[0], xy = psi1[1], zx = psi1[2];
+                                    const double yy = psi1[3], yz = psi1[4], zz = psi1[5];
+                                    if (pair == 0)
+                                        coeff_A = {0.0, -zx, xy};
+                                    if (pair == 1)
+                                        coeff_A = {zx, -yz, yy - xx};
+                                    if (pair == 2)
+                                        coeff_A = {-xy, xx - zz, yz};
+                                    if (pair == 3)
+                                        coeff_A = {yz, 0.0, -xy};
+                                    if (pair == 4)
+                                        coeff_A = {zz - yy, xy, -zx};
+                                    if (pair == 5)
+                                        coeff_A = {-yz, zx, 0.0};
+                                }
+                                for (int idim = 0; idim < num_curl; idim++) {
+                                    auto value_A = phi_3LPT_Avec_fourier[idim].get_real_from_index(real_index);
+                                    phi_3LPT_Avec_fourier[idim].set_real_from_index(real_index,
+                                                                                    value_A + coeff_A[idim] * psi2);
+                                }
+                            }
+                        }
+                    }
+                    phi_2LPT_ij.free();
+                    for (auto & g : phi_1LPT_ij)
+                        g.free();
 
-                        phi_2LPT.set_fourier_from_index(fourier_index, value);
+                    // Fourier transform and voila we have -k^2phi_3LPT_b / prefactor_3LPT_b in the grid
+                    phi_3LPT_b_fourier.fftw_r2c();
+                    divide_by_minus_k2(phi_3LPT_b_fourier, prefactor_3LPT_b);
+                    for (int idim = 0; idim < num_curl; idim++) {
+                        phi_3LPT_Avec_fourier[idim].fftw_r2c();
+                        divide_by_minus_k2(phi_3LPT_Avec_fourier[idim], prefactor_3LPT_Avec);
                     }
+                    divide_by_minus_k2(phi_2LPT_fourier, prefactor_2LPT);
                 }
 
-                // Deal with DC mode
-                if (Local_x_start == 0)
-                    phi_2LPT.set_fourier_from_index(0, 0.0);
+                // The 1LPT potential does not need any FFTs so we make it last to keep it out of the peak memory
+                compute_1LPT_potential_fourier(delta_fourier, phi_1LPT_fourier);
             }
 
+            //=================================================================================
+            /// Generate the 2LPT potential defined as \f$ \Psi^{\rm 2LPT} = \nabla \phi^{\rm 2LPT} \f$ and \f$
+            /// \nabla^2 \phi^{\rm 2LPT} = \ldots \f$. Returns the grid in Fourier space.
+            /// See compute_LPT_potentials_fourier for the number of FFTs and grids we need.
+            ///
+            /// @tparam N The dimension of the grid
+            ///
+            /// @param[in] delta The density contrast in fourier space
+            /// @param[out] phi_2LPT The LPT potential in fourier space
+            ///
+            //=================================================================================
+            template <int N>
+            void compute_2LPT_potential_fourier(const FFTWGrid<N> & delta, FFTWGrid<N> & phi_2LPT) {
+                FFTWGrid<N> phi_1LPT;
+                FFTWGrid<N> phi_3LPT_a;
+                FFTWGrid<N> phi_3LPT_b;
+                std::array<FFTWGrid<N>, N> phi_3LPT_Avec;
+                compute_LPT_potentials_fourier<N>(
+                    delta, 2, phi_1LPT, phi_2LPT, phi_3LPT_a, phi_3LPT_b, phi_3LPT_Avec, true);
+            }
             //===========================================================================================
             /// In this method we have so far given completely up what we do in the other methods
             /// and try to be as memory efficient as possible. We can reduce the memory footprint of
@@ -719,10 +868,8 @@ namespace FML {
             }
 
             //===========================================================================================
-            /// In this method we have so far given completely up what we do in the other methods
-            /// and try to be as memory efficient as possible. We can reduce the memory footprint of
-            /// this method with some work. Right now we allocate ~15 grid at the same time. It is possible to
-            /// get that down to ~10. This method is not well tested!
+            /// Compute the 1LPT, 2LPT and 3LPT potentials. See compute_LPT_potentials_fourier for the details,
+            /// the number of FFTs and the number of grids we need.
             /// The potentials we output are normalized such that we can get the displacement field as
             /// Psi = D phi_1LPT + D phi_2LPT + D phi_3LPT_a + D phi_3PT_b + D x A_3LPT
             ///
@@ -749,297 +896,15 @@ namespace FML {
                 // Only works for N = 2 and N = 3
                 static_assert(N == 2 or N == 3);
 
-                // We require delta to exist
-                assert_mpi(delta_fourier.get_nmesh() > 0,
-                           "[compute_3LPT_displacement_field] delta grid has to be already allocated!");
-
-                // Factor to scale displacement potentials such that Psi = Dphi_1LPT + Dphi_2LPT + ... + D x Avec_3LPT
-                constexpr FML::GRID::FloatType prefactor_1LPT = -1.0;
-                constexpr FML::GRID::FloatType prefactor_2LPT = -3.0 / 7.0;
-                constexpr FML::GRID::FloatType prefactor_3LPT_a = 1.0 / 3.0;
-                constexpr FML::GRID::FloatType prefactor_3LPT_b = -10.0 / 21.0;
-                constexpr FML::GRID::FloatType prefactor_3LPT_Avec = 1.0 / 7.0;
-
-                auto nleft = delta_fourier.get_n_extra_slices_left();
-                auto nright = delta_fourier.get_n_extra_slices_right();
-                auto Nmesh = delta_fourier.get_nmesh();
-                auto Local_nx = delta_fourier.get_local_nx();
-                auto Local_x_start = delta_fourier.get_local_x_start();
-
-                // Store -k^2phi_1LPT
-                phi_1LPT_fourier = delta_fourier;
-                phi_1LPT_fourier.add_memory_label("FFTWGrid::compute_3LPT_potential_fourier::phi_1LPT_fourier");
-
-                // Compute all terms phi_1LPT_ij. These are absolutely needed
-                const int num_pairs = (N * (N + 1)) / 2;
-                FFTWGrid<N> phi_1LPT_ij[num_pairs];
-                for (int i = 0; i < num_pairs; i++) {
-                    phi_1LPT_ij[i] = FFTWGrid<N>(Nmesh, nleft, nright);
-                    phi_1LPT_ij[i].add_memory_label("FFTWGrid::compute_3LPT_potential_fourier::phi_1LPT_ij_" +
-                                                    std::to_string(i));
-                }
-
-                if (FML::ThisTask == 0)
-                    std::cout << "Computing phi_1LPT_ij for all i,j...\n";
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag2;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    for (auto && fourier_index : phi_1LPT_fourier.get_fourier_range(islice, islice + 1)) {
-                        if (Local_x_start == 0 and fourier_index == 0)
-                            continue; // DC mode (k=0)
-
-                        // Get wavevector and magnitude
-                        phi_1LPT_fourier.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
-
-                        // phi_1LPT_fourier is delta so transform to LPT potential D^2 phi_1LPT = -delta
-                        auto value = -phi_1LPT_fourier.get_fourier_from_index(fourier_index) / FML::GRID::FloatType(kmag2);
-
-                        int pair = 0;
-                        for (int idim1 = 0; idim1 < N; idim1++) {
-                            for (int idim2 = idim1; idim2 < N; idim2++) {
-                                phi_1LPT_ij[pair++].set_fourier_from_index(fourier_index,
-                                                                           -value * FML::GRID::FloatType(kvec[idim1] * kvec[idim2]));
-                            }
-                        }
-                    }
-                }
-
-                // Deal with DC mode
-                if (Local_x_start == 0)
-                    for (auto & g : phi_1LPT_ij)
-                        g.set_fourier_from_index(0, 0.0);
-
-                // Fourier transform it all to real-space
-                for (int i = 0; i < num_pairs; i++)
-                    phi_1LPT_ij[i].fftw_c2r();
-
-                // Compute 2LPT
-                phi_2LPT_fourier = FFTWGrid<N>(Nmesh, nleft, nright);
-                phi_2LPT_fourier.add_memory_label("FFTWGrid::compute_3LPT_potential_fourier::phi_2LPT_fourier");
-
-                if (FML::ThisTask == 0)
-                    std::cout << "Computing phi_2LPT...\n";
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    for (auto && real_index : phi_2LPT_fourier.get_real_range(islice, islice + 1)) {
-                        // Compute laplacian and sum of squares to get Sum_i,j Phi_iiPhi_jj Phi_ij^2
-                        double laplacian = 0.0;
-                        double sum_squared = 0.0;
-                        int pair = 0;
-                        for (int idim1 = 0; idim1 < N; idim1++) {
-                            auto phi_ij = phi_1LPT_ij[pair++].get_real_from_index(real_index);
-                            laplacian += phi_ij;
-                            sum_squared += phi_ij * phi_ij;
-                            for (int idim2 = idim1 + 1; idim2 < N; idim2++) {
-                                phi_ij = phi_1LPT_ij[pair++].get_real_from_index(real_index);
-                                sum_squared += 2.0 * phi_ij * phi_ij;
-                            }
-                        }
-                        phi_2LPT_fourier.set_real_from_index(real_index, 0.5 * (laplacian * laplacian - sum_squared));
-                    }
-                }
-
-                // Back to fourier space: We now have -k^2 phi_2LPT in this grid
-                phi_2LPT_fourier.fftw_r2c();
-
-                // Time to compute all the phi_2LPT_ij terms
-                FFTWGrid<N> phi_2LPT_ij[num_pairs];
-                for (int i = 0; i < num_pairs; i++) {
-                    phi_2LPT_ij[i] = FFTWGrid<N>(Nmesh, nleft, nright);
-                    phi_2LPT_ij[i].add_memory_label("FFTWGrid::compute_3LPT_potential_fourier::phi_2LPT_ij" +
-                                                    std::to_string(i));
-                }
-
-                if (FML::ThisTask == 0)
-                    std::cout << "Computing phi_2LPT_ij for all i,j...\n";
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag2;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    for (auto && fourier_index : phi_2LPT_fourier.get_fourier_range(islice, islice + 1)) {
-                        if (Local_x_start == 0 and fourier_index == 0)
-                            continue; // DC mode (k=0)
-
-                        // Get wavevector and magnitude
-                        phi_2LPT_fourier.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
-                        auto value = -phi_2LPT_fourier.get_fourier_from_index(fourier_index) / FML::GRID::FloatType(kmag2);
-
-                        int pair = 0;
-                        for (int idim1 = 0; idim1 < N; idim1++) {
-                            for (int idim2 = idim1; idim2 < N; idim2++) {
-                                phi_2LPT_ij[pair++].set_fourier_from_index(fourier_index,
-                                                                           -value * FML::GRID::FloatType(kvec[idim1] * kvec[idim2]));
-                            }
-                        }
-                    }
-                }
-
-                // Deal with DC mode
-                if (Local_x_start == 0)
-                    for (auto & g : phi_2LPT_ij)
-                        g.set_fourier_from_index(0, 0.0);
-
-                // Compute phi_3LPT_a
-                phi_3LPT_a_fourier = FFTWGrid<N>(Nmesh, nleft, nright);
-                phi_3LPT_a_fourier.add_memory_label("FFTWGrid::compute_3LPT_potential_fourier::phi_3LPT_a_fourier");
-                // Compute phi_3LPT_b
-                phi_3LPT_b_fourier = FFTWGrid<N>(Nmesh, nleft, nright);
-                phi_3LPT_b_fourier.add_memory_label("FFTWGrid::compute_3LPT_potential_fourier::phi_3LPT_b_fourier");
-                // And then finally the A-terms (for N=2 we only have 1 component)
-                if (not ignore_curl_term)
-                    for (int idim = 0; idim < N; idim++) {
-                        phi_3LPT_Avec_fourier[idim] = FFTWGrid<N>(Nmesh, nleft, nright);
-                        phi_3LPT_Avec_fourier[idim].add_memory_label(
-                            "FFTWGrid::compute_3LPT_potential_fourier::phi_3LPT_Avec_fourier" + std::to_string(idim));
-                        if constexpr (N == 2)
-                            break;
-                    }
-
-                if (FML::ThisTask == 0)
-                    std::cout << "Computing phi_3LPT...\n";
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    for (auto && real_index : phi_2LPT_fourier.get_real_range(islice, islice + 1)) {
-
-                        if constexpr (N == 2) {
-                            auto psi1_xx = phi_1LPT_ij[0].get_real_from_index(real_index);
-                            auto psi1_xy = phi_1LPT_ij[1].get_real_from_index(real_index);
-                            auto psi1_yy = phi_1LPT_ij[2].get_real_from_index(real_index);
-                            auto psi2_xx = phi_2LPT_ij[0].get_real_from_index(real_index);
-                            auto psi2_xy = phi_2LPT_ij[1].get_real_from_index(real_index);
-                            auto psi2_yy = phi_2LPT_ij[2].get_real_from_index(real_index);
-
-                            auto value_a = psi1_xx * psi1_yy - psi1_xy * psi1_xy;
-                            auto value_b = psi1_xx * psi2_yy - psi1_xy * psi2_xy;
-
-                            phi_3LPT_a_fourier.set_real_from_index(real_index, value_a);
-                            phi_3LPT_b_fourier.set_real_from_index(real_index, value_b);
-                            if (not ignore_curl_term) {
-                                // Curl is a scalar in 2D (only the 'z' component is nonzero)
-                                auto Az = psi2_xy * (psi1_yy - psi1_xx) - psi1_xy * (psi2_yy - psi2_xx);
-                                phi_3LPT_Avec_fourier[0].set_real_from_index(real_index, Az);
-                            }
-                        }
-                        if constexpr (N == 3) {
-                            auto psi1_xx = phi_1LPT_ij[0].get_real_from_index(real_index);
-                            auto psi1_xy = phi_1LPT_ij[1].get_real_from_index(real_index);
-                            auto psi1_zx = phi_1LPT_ij[2].get_real_from_index(real_index);
-                            auto psi1_yy = phi_1LPT_ij[3].get_real_from_index(real_index);
-                            auto psi1_yz = phi_1LPT_ij[4].get_real_from_index(real_index);
-                            auto psi1_zz = phi_1LPT_ij[5].get_real_from_index(real_index);
-
-                            auto psi2_xx = phi_2LPT_ij[0].get_real_from_index(real_index);
-                            auto psi2_xy = phi_2LPT_ij[1].get_real_from_index(real_index);
-                            auto psi2_zx = phi_2LPT_ij[2].get_real_from_index(real_index);
-                            auto psi2_yy = phi_2LPT_ij[3].get_real_from_index(real_index);
-                            auto psi2_yz = phi_2LPT_ij[4].get_real_from_index(real_index);
-                            auto psi2_zz = phi_2LPT_ij[5].get_real_from_index(real_index);
-
-                            auto value_a = psi1_xx * psi1_yy * psi1_zz;
-                            value_a += 2.0 * psi1_xy * psi1_yz * psi1_zx;
-                            value_a += -psi1_xx * psi1_yz * psi1_yz;
-                            value_a += -psi1_yy * psi1_zx * psi1_zx;
-                            value_a += -psi1_zz * psi1_xy * psi1_xy;
-
-                            auto value_b = 0.5 * psi1_xx * (psi2_yy + psi2_zz);
-                            value_b += 0.5 * psi1_yy * (psi2_zz + psi2_xx);
-                            value_b += 0.5 * psi1_zz * (psi2_xx + psi2_yy);
-                            value_b += -psi1_xy * psi2_xy - psi1_yz * psi2_yz - psi1_zx * psi2_zx;
-
-                            phi_3LPT_a_fourier.set_real_from_index(real_index, value_a);
-                            phi_3LPT_b_fourier.set_real_from_index(real_index, value_b);
-                            if (not ignore_curl_term) {
-                                auto value_Avec_x = psi1_zx * psi2_xy - psi2_zx * psi1_xy;
-                                value_Avec_x += psi1_yz * (psi2_yy - psi2_zz) - psi2_yz * (psi1_yy - psi1_zz);
-                                auto value_Avec_y = psi1_xy * psi2_yz - psi2_xy * psi1_yz;
-                                value_Avec_y += psi1_zx * (psi2_zz - psi2_xx) - psi2_zx * (psi1_zz - psi1_xx);
-                                auto value_Avec_z = psi1_yz * psi2_zx - psi2_yz * psi1_zx;
-                                value_Avec_z += psi1_xy * (psi2_xx - psi2_yy) - psi2_xy * (psi1_xx - psi1_yy);
-                                phi_3LPT_Avec_fourier[0].set_real_from_index(real_index, value_Avec_x);
-                                phi_3LPT_Avec_fourier[1].set_real_from_index(real_index, value_Avec_y);
-                                phi_3LPT_Avec_fourier[2].set_real_from_index(real_index, value_Avec_z);
-                            }
-                        }
-                    }
-                }
-
-                // Free up memory
-                for (int i = 0; i < num_pairs; i++) {
-                    phi_1LPT_ij[i].free();
-                    phi_2LPT_ij[i].free();
-                }
-
-                // Fourier transform and voila we have -k^2phi_3LPT_a stored in phi_3LPT_a
-                phi_3LPT_a_fourier.fftw_r2c();
-
-                // Fourier transform and voila we have -k^2phi_3LPT_b stored in phi_3LPT_b
-                phi_3LPT_b_fourier.fftw_r2c();
-
-                // Fourier transform and voila we have -k^2phi_3LPT_Avec stored in phi_3LPT_Avec
-                if (not ignore_curl_term) {
-                    for (int idim = 0; idim < N; idim++)
-                        phi_3LPT_Avec_fourier[idim].fftw_r2c();
-                }
-
-                // Divide by -1/k^2 and multiply by factor to make Psi = Dphi^1LPT + Dphi^2LPT + Dphi^3LPT + D x
-                // Avec^3LPT
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag2;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    for (auto && fourier_index : phi_1LPT_fourier.get_fourier_range(islice, islice + 1)) {
-                        if (Local_x_start == 0 and fourier_index == 0)
-                            continue; // DC mode (k=0)
-
-                        // Get wavevector and magnitude
-                        phi_1LPT_fourier.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
-                        const FML::GRID::FloatType fac = -1.0 / kmag2;
-
-                        // Fetch and rescale
-                        auto value_1LPT = phi_1LPT_fourier.get_fourier_from_index(fourier_index);
-                        auto value_2LPT = phi_2LPT_fourier.get_fourier_from_index(fourier_index);
-                        auto value_3LPT_a = phi_3LPT_a_fourier.get_fourier_from_index(fourier_index);
-                        auto value_3LPT_b = phi_3LPT_b_fourier.get_fourier_from_index(fourier_index);
-                        phi_1LPT_fourier.set_fourier_from_index(fourier_index, prefactor_1LPT * value_1LPT * fac);
-                        phi_2LPT_fourier.set_fourier_from_index(fourier_index, prefactor_2LPT * value_2LPT * fac);
-                        phi_3LPT_a_fourier.set_fourier_from_index(fourier_index, prefactor_3LPT_a * value_3LPT_a * fac);
-                        phi_3LPT_b_fourier.set_fourier_from_index(fourier_index, prefactor_3LPT_b * value_3LPT_b * fac);
-
-                        // The vector potential A
-                        if (not ignore_curl_term) {
-                            if constexpr (N == 2) {
-                                // For N=2 the curl is a scalar and we only store the "z" component
-                                auto value_Az = phi_3LPT_Avec_fourier[0].get_fourier_from_index(fourier_index);
-                                phi_3LPT_Avec_fourier[0].set_fourier_from_index(fourier_index,
-                                                                                prefactor_3LPT_Avec * value_Az * fac);
-                            }
-                            if constexpr (N == 3) {
-                                auto value_Ax = phi_3LPT_Avec_fourier[0].get_fourier_from_index(fourier_index);
-                                auto value_Ay = phi_3LPT_Avec_fourier[1].get_fourier_from_index(fourier_index);
-                                auto value_Az = phi_3LPT_Avec_fourier[2].get_fourier_from_index(fourier_index);
-                                phi_3LPT_Avec_fourier[0].set_fourier_from_index(fourier_index,
-                                                                                prefactor_3LPT_Avec * value_Ax * fac);
-                                phi_3LPT_Avec_fourier[1].set_fourier_from_index(fourier_index,
-                                                                                prefactor_3LPT_Avec * value_Ay * fac);
-                                phi_3LPT_Avec_fourier[2].set_fourier_from_index(fourier_index,
-                                                                                prefactor_3LPT_Avec * value_Az * fac);
-                            }
-                        }
-                    }
-                }
+                compute_LPT_potentials_fourier<N>(delta_fourier,
+                                               3,
+                                               phi_1LPT_fourier,
+                                               phi_2LPT_fourier,
+                                               phi_3LPT_a_fourier,
+                                               phi_3LPT_b_fourier,
+                                               phi_3LPT_Avec_fourier,
+                                               ignore_curl_term);
             }
-
             //=================================================================================
             /// Take in an initial density field (generated at a redshift zini) and the corresponding ratio of growth
             /// factors D(z)/D(zini) produces the approximate spherical collapse potential defined via D^2 phi_SC = 3(
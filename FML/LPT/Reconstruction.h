@@ -7,13 +7,17 @@
 #include <cstdio>
 #include <functional>
 #include <numeric>
+#include <string>
 #include <vector>
 
 #include <FML/FFTWGrid/FFTWGrid.h>
 #include <FML/Global/Global.h>
 #include <FML/Interpolation/ParticleGridInterpolation.h>
 #include <FML/LPT/DisplacementFields.h>
+#include <FML/MPIGrid/MPIGrid.h>
+#include <FML/MPIGrid/MPIMultiGrid.h>
 #include <FML/MPIParticles/MPIParticles.h>
+#include <FML/MultigridSolver/MultiGridSolver.h>
 #include <FML/Smoothing/SmoothingFourier.h>
 
 namespace FML {
@@ -80,7 +84,7 @@ namespace FML {
 
                 size_t NumPart = part.get_npart();
 
-                const bool periodic_box = true;
+                const bool periodic_box = not survey_data;
 
                 // Normalize the los_direction to a unit vector
                 assert_mpi(los_direction.size() == N,
@@ -178,10 +182,10 @@ namespace FML {
                         std::array<FloatType, N> Psi_rsd;
                         FloatType Psidotr = 0.0;
                         for (int idim = 0; idim < N; idim++) {
-                            Psidotr += los_direction[idim] * Psi_particle_positions[idim][i];
+                            Psidotr += r[idim] * Psi_particle_positions[idim][i];
                         }
                         for (int idim = 0; idim < N; idim++) {
-                            Psi_rsd[idim] = Psidotr * los_direction[idim] / (1.0 + beta);
+                            Psi_rsd[idim] = Psidotr * r[idim] / (1.0 + beta);
 
 #ifdef USE_OMP
 #pragma omp critical
@@ -222,6 +226,598 @@ namespace FML {
                     }
                 }
             }
+
+            //============================================================================
+            ///
+            /// Iterative reconstruction (BAO or RSD removal) for periodic boxes and surveys.
+            ///
+            /// We solve the linear LPT equation for the displacement field \f$ b\Psi = \nabla\phi \f$
+            ///  \f$ \nabla\cdot(b\Psi) + \beta \nabla\cdot((b\Psi\cdot\hat{r})\hat{r}) = -\delta_{\rm tracer} \f$
+            /// either with a fixed line of sight or with a local line of sight
+            /// \f$ \hat{r} = (x - x_{\rm obs}) / |x - x_{\rm obs}| \f$ as seen from an observer.
+            /// The particles are assigned to the grid once, the density field is kept for the whole solve
+            /// and all the grids used in the iterations are allocated once and reused.
+            ///
+            /// If randoms are provided (survey data) the density field is
+            /// \f$ \delta = n_g / (\alpha n_r) - 1 \f$ with \f$ \alpha = N_g / N_r \f$ where both fields are
+            /// smoothed before taking the ratio and we set \f$ \delta = 0 \f$ in cells where the smoothed random
+            /// density is below 1% of the mean density in the box (i.e. outside the survey mask).
+            /// For survey data the box must be big enough that no particle is shifted out of it.
+            ///
+            /// The solver_method options are:
+            ///  - "fourier": preconditioned Richardson iteration \f$ \phi \to \phi + P(\delta - A\phi) \f$
+            ///  - "cg": preconditioned conjugate gradient
+            ///  - "multigrid": solve the PDE for \f$ \phi \f$ with finite differences using MultiGridSolver
+            ///
+            /// For the first two the operator \f$ A\phi = -\nabla\cdot((I + \beta\hat{r}\hat{r}^T)\nabla\phi) \f$
+            /// is applied with FFTs and the preconditioner \f$ P = 1/(k^2 + \beta(k\cdot\hat{n})^2) \f$ is the
+            /// exact inverse for a fixed line of sight \f$ \hat{n} \f$ (for a local line of sight we use the
+            /// direction from the observer to the center of the box). For a fixed line of sight both methods
+            /// therefore converge in a single step to within the Nyquist modes (the operator sets the derivative
+            /// to zero at the Nyquist frequency while the preconditioner uses the full k).
+            /// The multigrid solver discretizes the same operator with finite differences in flux form (the
+            /// line of sight is evaluated on the faces between cells) so its solution agrees with the two
+            /// others up to the finite difference discretization error.
+            ///
+            /// After solving we interpolate the displacement field to the particles and shift them:
+            ///  - "RSD": galaxies are shifted by \f$ -\beta(b\Psi\cdot\hat{r})\hat{r} \f$
+            ///  - "BAO": galaxies are shifted by \f$ -(b\Psi/b + \beta(b\Psi\cdot\hat{r})\hat{r}) \f$ and the
+            ///    randoms by \f$ -b\Psi/b \f$
+            ///
+            /// @tparam N The dimension of the grid
+            /// @tparam T The galaxy particle class
+            /// @tparam U The random particle class
+            ///
+            /// @param[out] galaxies MPIParticles. Particles gets updated.
+            /// @param[out] randoms Pointer to the randoms. Gets updated for BAO reconstruction. Use the overload
+            /// without randoms for a periodic box.
+            /// @param[in] density_assignment_method The density assignment method (NGP, CIC, TSC, PCS, PQS)
+            /// @param[in] Nmesh The size of the grid we use
+            /// @param[in] reconstruction_type "RSD" (remove RSD only) or "BAO" (full reconstruction)
+            /// @param[in] line_of_sight "fixed" or "local"
+            /// @param[in] los_vector The fixed line of sight direction, e.g. (0,0,1), or the observer position
+            /// (in units of the boxsize) if line_of_sight is local
+            /// @param[in] beta This is beta = f/b the growth-rate over the bias
+            /// @param[in] bias The galaxy bias (only used for BAO reconstruction)
+            /// @param[in] smoothing_options The smoothing filter (gaussian, tophat, sharpk) and the smothing scale (in
+            /// units of the boxsize)
+            /// @param[in] solver_method The solver: "fourier", "cg" or "multigrid"
+            /// @param[in] max_iterations Maximum number of iterations (V-cycles for multigrid)
+            /// @param[in] epsilon Convergence criterion. Residual relative to the source for fourier and cg and
+            /// the rms residual for multigrid.
+            ///
+            //============================================================================
+
+            template <int N, class T, class U>
+            void ReconstructionIterativeSolver(MPIParticles<T> & galaxies,
+                                               MPIParticles<U> * randoms,
+                                               std::string density_assignment_method,
+                                               int Nmesh,
+                                               std::string reconstruction_type,
+                                               std::string line_of_sight,
+                                               std::vector<double> los_vector,
+                                               double beta,
+                                               double bias,
+                                               std::pair<std::string, double> smoothing_options,
+                                               std::string solver_method,
+                                               int max_iterations,
+                                               double epsilon) {
+
+                static_assert(FML::PARTICLE::has_get_pos<T>(),
+                              "[ReconstructionIterativeSolver] Particle must have a get_pos method");
+                static_assert(FML::PARTICLE::has_get_pos<U>(),
+                              "[ReconstructionIterativeSolver] Randoms must have a get_pos method");
+
+                assert_mpi(los_vector.size() == N,
+                           "[ReconstructionIterativeSolver] Line of sight vector has wrong dimension\n");
+                assert_mpi(reconstruction_type == "RSD" or reconstruction_type == "BAO",
+                           "[ReconstructionIterativeSolver] Unknown reconstruction_type (RSD or BAO)\n");
+                assert_mpi(line_of_sight == "fixed" or line_of_sight == "local",
+                           "[ReconstructionIterativeSolver] Unknown line_of_sight (fixed or local)\n");
+                assert_mpi(solver_method == "fourier" or solver_method == "cg" or solver_method == "multigrid",
+                           "[ReconstructionIterativeSolver] Unknown solver_method (fourier, cg or multigrid)\n");
+                assert_mpi(bias > 0.0 or reconstruction_type == "RSD",
+                           "[ReconstructionIterativeSolver] The bias must be positive\n");
+
+                // Use N-linear interpolation of the displacement field
+                const std::string interpolation_method = "CIC";
+
+                // Cells with a smoothed random density below this (in units of the mean) are outside the mask
+                const double random_density_threshold = 0.01;
+
+                const bool local_los = line_of_sight == "local";
+                const bool periodic_box = randoms == nullptr;
+                const bool BAO_reconstruction = reconstruction_type == "BAO";
+
+                // The observer position or the fixed line of sight as a unit vector
+                std::array<double, N> los_or_observer;
+                for (int idim = 0; idim < N; idim++)
+                    los_or_observer[idim] = los_vector[idim];
+                if (not local_los) {
+                    double norm = 0.0;
+                    for (int idim = 0; idim < N; idim++)
+                        norm += los_or_observer[idim] * los_or_observer[idim];
+                    assert_mpi(norm > 0.0,
+                               "[ReconstructionIterativeSolver] Line of sight vector cannot be the zero vector\n");
+                    for (int idim = 0; idim < N; idim++)
+                        los_or_observer[idim] /= std::sqrt(norm);
+                }
+
+                // The line of sight direction at a given position and the distance to the observer
+                auto get_los = [&](const auto * x, std::array<double, N> & r) -> double {
+                    if (not local_los) {
+                        r = los_or_observer;
+                        return 0.0;
+                    }
+                    double dist = 0.0;
+                    for (int idim = 0; idim < N; idim++) {
+                        r[idim] = x[idim] - los_or_observer[idim];
+                        dist += r[idim] * r[idim];
+                    }
+                    dist = std::sqrt(dist);
+                    for (int idim = 0; idim < N; idim++)
+                        r[idim] = dist > 0.0 ? r[idim] / dist : 0.0;
+                    return dist;
+                };
+
+                // The line of sight used in the preconditioner
+                std::array<double, N> los_mean;
+                if (local_los) {
+                    std::array<double, N> center;
+                    center.fill(0.5);
+                    get_los(center.data(), los_mean);
+                } else {
+                    los_mean = los_or_observer;
+                }
+
+                //=================================================================================
+                // Assign the particles to the grid once and form the smoothed density field
+                //=================================================================================
+                auto nleftright =
+                    FML::INTERPOLATION::get_extra_slices_needed_for_density_assignment(density_assignment_method);
+                auto nleftright_interpolation =
+                    FML::INTERPOLATION::get_extra_slices_needed_for_density_assignment(interpolation_method);
+                nleftright.first = std::max(nleftright.first, nleftright_interpolation.first);
+                nleftright.second = std::max(nleftright.second, nleftright_interpolation.second);
+
+                FFTWGrid<N> delta(Nmesh, nleftright.first, nleftright.second);
+                delta.add_memory_label("FFTWGrid::ReconstructionIterativeSolver::delta");
+                delta.set_grid_status_real(true);
+                FML::INTERPOLATION::particles_to_grid(galaxies.get_particles_ptr(),
+                                                      galaxies.get_npart(),
+                                                      galaxies.get_npart_total(),
+                                                      delta,
+                                                      density_assignment_method);
+                delta.fftw_r2c();
+                FML::GRID::smoothing_filter_fourier_space(delta, smoothing_options.second, smoothing_options.first);
+
+                const auto Local_nx = delta.get_local_nx();
+                const auto Local_x_start = delta.get_local_x_start();
+
+                if (randoms) {
+                    FFTWGrid<N> density_randoms(Nmesh, nleftright.first, nleftright.second);
+                    density_randoms.add_memory_label("FFTWGrid::ReconstructionIterativeSolver::density_randoms");
+                    density_randoms.set_grid_status_real(true);
+                    FML::INTERPOLATION::particles_to_grid(randoms->get_particles_ptr(),
+                                                          randoms->get_npart(),
+                                                          randoms->get_npart_total(),
+                                                          density_randoms,
+                                                          density_assignment_method);
+                    density_randoms.fftw_r2c();
+                    FML::GRID::smoothing_filter_fourier_space(
+                        density_randoms, smoothing_options.second, smoothing_options.first);
+                    density_randoms.fftw_c2r();
+                    delta.fftw_c2r();
+
+                    // delta = n_g / (alpha n_r) - 1 inside the mask and 0 outside
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        for (auto && real_index : delta.get_real_range(islice, islice + 1)) {
+                            const double nr = 1.0 + density_randoms.get_real_from_index(real_index);
+                            const double ng = 1.0 + delta.get_real_from_index(real_index);
+                            const double value = nr > random_density_threshold ? ng / nr - 1.0 : 0.0;
+                            delta.set_real_from_index(real_index, value);
+                        }
+                    }
+                    delta.fftw_r2c();
+                }
+                if (Local_x_start == 0)
+                    delta.set_fourier_from_index(0, 0.0);
+
+                //=================================================================================
+                // Solve for the potential phi (in real space)
+                //=================================================================================
+                FFTWGrid<N> phi(Nmesh, nleftright.first, nleftright.second);
+                phi.add_memory_label("FFTWGrid::ReconstructionIterativeSolver::phi");
+                phi.fill_real_grid(0.0);
+
+                if (solver_method == "multigrid") {
+                    using namespace FML::SOLVERS::MULTIGRIDSOLVER;
+
+                    // The source on all levels
+                    FFTWGrid<N> delta_real = delta;
+                    delta_real.fftw_c2r();
+                    MPIMultiGrid<N, double> delta_multigrid(Nmesh);
+                    auto & grid = delta_multigrid.get_grid();
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        for (auto && real_index : delta_real.get_real_range(islice, islice + 1)) {
+                            auto coord = delta_real.get_coord_from_index(real_index);
+                            grid.set_y(grid.index_from_coord(coord), delta_real.get_real_from_index(real_index));
+                        }
+                    }
+                    delta_real.free();
+                    delta_multigrid.restrict_down_all();
+
+                    MultiGridSolver<N, double> g(Nmesh, -1, FML::ThisTask == 0, true, 1, 1);
+                    g.set_epsilon(epsilon);
+                    g.set_maxsteps(max_iterations);
+                    g.set_initial_guess(0.0);
+                    MultiGridConvCrit ConvergenceCriterion =
+                        [&](double rms_residual, double rms_residual_ini, int step_number) {
+                            return g.ConvergenceCriterionResidual(rms_residual, rms_residual_ini, step_number);
+                        };
+
+                    // Offset to the neighbor along each axis in the list from get_cube_gridindex
+                    constexpr int ncube = FML::power(3, N);
+                    constexpr int center = (ncube - 1) / 2;
+                    std::array<int, N> offset;
+                    for (int idim = 0, pow3 = 1; idim < N; idim++, pow3 *= 3)
+                        offset[idim] = pow3;
+
+                    // D * [(I + beta r r^T) D phi] + delta = 0 in flux form: the flux F = (I + beta r r^T) D phi is
+                    // evaluated on the faces between the cells with r at the face. Both cells sharing a face use the
+                    // same flux so the sum of the operator over the box vanishes (as for the source). This keeps the
+                    // discrete problem solvable also where a local r jumps across the periodic boundary
+                    MultiGridFunction<N, double> Equation = [&](MultiGridSolver<N, double> * sol,
+                                                                int level,
+                                                                IndexInt index) {
+                        const double h = sol->get_Gridspacing(level);
+                        const auto cube = sol->get_cube_gridindex(level, index);
+                        const auto x = sol->get_Coordinate(level, index);
+                        auto field = [&](int cube_offset) { return sol->get_Field(level, cube[center + cube_offset]); };
+                        const double f0 = field(0);
+
+                        double divergence = 0.0;
+                        double dL = 0.0;
+                        std::array<double, N> xface, r, grad;
+                        for (int i = 0; i < N; i++) {
+                            for (int sign = -1; sign <= 1; sign += 2) {
+                                // The face at x + sign * h/2 e_i (wrapped into the box)
+                                xface = x;
+                                xface[i] += sign * 0.5 * h;
+                                xface[i] -= std::floor(xface[i]);
+                                get_los(xface.data(), r);
+
+                                // The gradient at the face. Transverse components are averaged over the two cells
+                                for (int j = 0; j < N; j++) {
+                                    if (j == i) {
+                                        grad[j] = sign * (field(sign * offset[i]) - f0) / h;
+                                    } else {
+                                        grad[j] = (field(offset[j]) - field(-offset[j]) +
+                                                   field(sign * offset[i] + offset[j]) -
+                                                   field(sign * offset[i] - offset[j])) /
+                                                  (4.0 * h);
+                                    }
+                                }
+                                double gdotr = 0.0;
+                                for (int j = 0; j < N; j++)
+                                    gdotr += grad[j] * r[j];
+                                divergence += sign * (grad[i] + beta * gdotr * r[i]) / h;
+                                dL -= (1.0 + beta * r[i] * r[i]) / (h * h);
+                            }
+                        }
+
+                        const double L = divergence + delta_multigrid.get_y(level, index);
+                        return std::pair<double, double>{L, dL};
+                    };
+
+                    g.solve(Equation, ConvergenceCriterion);
+
+                    // Copy over the solution
+                    auto & solution = g.get_grid(0);
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        for (auto && real_index : phi.get_real_range(islice, islice + 1)) {
+                            auto coord = phi.get_coord_from_index(real_index);
+                            phi.set_real_from_index(real_index, solution.get_y(solution.index_from_coord(coord)));
+                        }
+                    }
+
+                } else {
+
+                    // Scratch grids reused in every iteration
+                    FFTWGrid<N> residual(Nmesh, nleftright.first, nleftright.second);
+                    FFTWGrid<N> direction(Nmesh, nleftright.first, nleftright.second);
+                    FFTWGrid<N> preconditioned(Nmesh, nleftright.first, nleftright.second);
+                    FFTWGrid<N> Adirection(Nmesh, nleftright.first, nleftright.second);
+                    std::array<FFTWGrid<N>, N> gradient;
+                    for (int idim = 0; idim < N; idim++) {
+                        gradient[idim] = FFTWGrid<N>(Nmesh, nleftright.first, nleftright.second);
+                        gradient[idim].add_memory_label("FFTWGrid::ReconstructionIterativeSolver::gradient_" +
+                                                        std::to_string(idim));
+                    }
+                    residual.add_memory_label("FFTWGrid::ReconstructionIterativeSolver::residual");
+                    direction.add_memory_label("FFTWGrid::ReconstructionIterativeSolver::direction");
+                    preconditioned.add_memory_label("FFTWGrid::ReconstructionIterativeSolver::preconditioned");
+                    Adirection.add_memory_label("FFTWGrid::ReconstructionIterativeSolver::Adirection");
+
+                    // Sum over all cells of a * b
+                    auto dot_product = [&](const FFTWGrid<N> & a, const FFTWGrid<N> & b) {
+                        double sum = 0.0;
+#ifdef USE_OMP
+#pragma omp parallel for reduction(+ : sum)
+#endif
+                        for (int islice = 0; islice < Local_nx; islice++) {
+                            for (auto && real_index : a.get_real_range(islice, islice + 1)) {
+                                sum += a.get_real_from_index(real_index) * b.get_real_from_index(real_index);
+                            }
+                        }
+                        FML::SumOverTasks(&sum);
+                        return sum;
+                    };
+
+                    // out = P in with P = 1/(k^2 + beta (k*n)^2)
+                    auto apply_preconditioner = [&](const FFTWGrid<N> & in, FFTWGrid<N> & out) {
+                        out = in;
+                        out.fftw_r2c();
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                        for (int islice = 0; islice < Local_nx; islice++) {
+                            [[maybe_unused]] double kmag2;
+                            [[maybe_unused]] std::array<double, N> kvec;
+                            for (auto && fourier_index : out.get_fourier_range(islice, islice + 1)) {
+                                if (Local_x_start == 0 and fourier_index == 0)
+                                    continue; // DC mode (k=0)
+                                out.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
+                                double kdotn = 0.0;
+                                for (int idim = 0; idim < N; idim++)
+                                    kdotn += kvec[idim] * los_mean[idim];
+                                auto value = out.get_fourier_from_index(fourier_index);
+                                out.set_fourier_from_index(fourier_index,
+                                                           value / FloatType(kmag2 + beta * kdotn * kdotn));
+                            }
+                        }
+                        if (Local_x_start == 0)
+                            out.set_fourier_from_index(0, 0.0);
+                        out.fftw_c2r();
+                    };
+
+                    // The derivative ik has no real counterpart at the Nyquist frequency so we set it to zero
+                    // there. This keeps the discrete operator below symmetric (required for CG)
+                    const double knyquist = M_PI * Nmesh;
+                    auto derivative_wavenumber = [&](double k) { return std::abs(k) < 0.999 * knyquist ? k : 0.0; };
+
+                    // out = A in with A = -D * [(I + beta r r^T) D]
+                    auto apply_operator = [&](const FFTWGrid<N> & in, FFTWGrid<N> & out) {
+                        out = in;
+                        out.fftw_r2c();
+                        for (int idim = 0; idim < N; idim++) {
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                            for (int islice = 0; islice < Local_nx; islice++) {
+                                [[maybe_unused]] double kmag2;
+                                [[maybe_unused]] std::array<double, N> kvec;
+                                std::complex<FloatType> I(0, 1);
+                                for (auto && fourier_index : out.get_fourier_range(islice, islice + 1)) {
+                                    out.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
+                                    auto value = out.get_fourier_from_index(fourier_index);
+                                    gradient[idim].set_fourier_from_index(
+                                        fourier_index, value * I * FloatType(derivative_wavenumber(kvec[idim])));
+                                }
+                            }
+                            gradient[idim].set_grid_status_real(false);
+                            gradient[idim].fftw_c2r();
+                        }
+
+                        // g -> g + beta (g*r)r
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                        for (int islice = 0; islice < Local_nx; islice++) {
+                            std::array<double, N> r;
+                            for (auto && real_index : out.get_real_range(islice, islice + 1)) {
+                                const auto x = out.get_real_position(out.get_coord_from_index(real_index));
+                                get_los(x.data(), r);
+                                double gdotr = 0.0;
+                                for (int idim = 0; idim < N; idim++)
+                                    gdotr += gradient[idim].get_real_from_index(real_index) * r[idim];
+                                for (int idim = 0; idim < N; idim++) {
+                                    auto value = gradient[idim].get_real_from_index(real_index);
+                                    gradient[idim].set_real_from_index(real_index, value + beta * gdotr * r[idim]);
+                                }
+                            }
+                        }
+
+                        // Minus the divergence
+                        for (int idim = 0; idim < N; idim++) {
+                            gradient[idim].fftw_r2c();
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                            for (int islice = 0; islice < Local_nx; islice++) {
+                                [[maybe_unused]] double kmag2;
+                                [[maybe_unused]] std::array<double, N> kvec;
+                                std::complex<FloatType> I(0, 1);
+                                for (auto && fourier_index : out.get_fourier_range(islice, islice + 1)) {
+                                    out.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
+                                    auto value =
+                                        -gradient[idim].get_fourier_from_index(fourier_index) * I *
+                                        FloatType(derivative_wavenumber(kvec[idim]));
+                                    if (idim > 0)
+                                        value += out.get_fourier_from_index(fourier_index);
+                                    out.set_fourier_from_index(fourier_index, value);
+                                }
+                            }
+                        }
+                        out.fftw_c2r();
+                    };
+
+                    // The initial residual is just the source
+                    residual = delta;
+                    residual.fftw_c2r();
+                    const double source_norm = std::sqrt(dot_product(residual, residual));
+                    apply_preconditioner(residual, preconditioned);
+                    direction = preconditioned;
+                    double rz = dot_product(residual, preconditioned);
+
+                    // The update phi += alpha * direction, residual -= alpha * A direction
+                    auto update = [&](double alpha) {
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                        for (int islice = 0; islice < Local_nx; islice++) {
+                            for (auto && real_index : phi.get_real_range(islice, islice + 1)) {
+                                auto value = phi.get_real_from_index(real_index);
+                                phi.set_real_from_index(
+                                    real_index, value + alpha * direction.get_real_from_index(real_index));
+                                value = residual.get_real_from_index(real_index);
+                                residual.set_real_from_index(
+                                    real_index, value - alpha * Adirection.get_real_from_index(real_index));
+                            }
+                        }
+                    };
+
+                    for (int iteration = 0; iteration < max_iterations; iteration++) {
+                        apply_operator(direction, Adirection);
+                        if (solver_method == "fourier") {
+                            update(1.0);
+                        } else {
+                            update(rz / dot_product(direction, Adirection));
+                        }
+
+                        const double relative_residual =
+                            source_norm > 0.0 ? std::sqrt(dot_product(residual, residual)) / source_norm : 0.0;
+                        if (FML::ThisTask == 0)
+                            std::cout << "[ReconstructionIterativeSolver] Iteration: " << iteration + 1
+                                      << " Residual: " << relative_residual << "\n";
+                        if (relative_residual < epsilon)
+                            break;
+
+                        apply_preconditioner(residual, preconditioned);
+                        if (solver_method == "fourier") {
+                            direction = preconditioned;
+                        } else {
+                            const double rz_new = dot_product(residual, preconditioned);
+                            const double ratio = rz_new / rz;
+                            rz = rz_new;
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                            for (int islice = 0; islice < Local_nx; islice++) {
+                                for (auto && real_index : direction.get_real_range(islice, islice + 1)) {
+                                    auto value = direction.get_real_from_index(real_index);
+                                    direction.set_real_from_index(
+                                        real_index, preconditioned.get_real_from_index(real_index) + ratio * value);
+                                }
+                            }
+                        }
+                    }
+                }
+                delta.free();
+
+                //=================================================================================
+                // The displacement field bPsi = Dphi and interpolate it to the particles
+                //=================================================================================
+                phi.fftw_r2c();
+                std::array<FFTWGrid<N>, N> Psi;
+                from_LPT_potential_to_displacement_vector<N>(phi, Psi);
+                phi.free();
+                for (int idim = 0; idim < N; idim++) {
+                    Psi[idim].communicate_boundaries();
+                }
+
+                // Shift the particles by - (a bPsi + c (bPsi*r)r)
+                auto shift_particles = [&](auto & part, double a, double c) {
+                    std::array<std::vector<FloatType>, N> Psi_particle_positions;
+                    FML::INTERPOLATION::interpolate_grid_vector_to_particle_positions<N>(
+                        Psi, part.get_particles_ptr(), part.get_npart(), Psi_particle_positions, interpolation_method);
+                    double max_shift = 0.0;
+                    auto * p = part.get_particles_ptr();
+                    const size_t NumPart = part.get_npart();
+#ifdef USE_OMP
+#pragma omp parallel for reduction(max : max_shift)
+#endif
+                    for (size_t i = 0; i < NumPart; i++) {
+                        auto * pos = FML::PARTICLE::GetPos(p[i]);
+                        std::array<double, N> r;
+                        get_los(pos, r);
+
+                        double Psidotr = 0.0;
+                        for (int idim = 0; idim < N; idim++)
+                            Psidotr += Psi_particle_positions[idim][i] * r[idim];
+
+                        double shift2 = 0.0;
+                        for (int idim = 0; idim < N; idim++) {
+                            const double shift = a * Psi_particle_positions[idim][i] + c * Psidotr * r[idim];
+                            shift2 += shift * shift;
+                            pos[idim] -= shift;
+                            if (periodic_box) {
+                                if (pos[idim] < 0.0)
+                                    pos[idim] += 1.0;
+                                if (pos[idim] >= 1.0)
+                                    pos[idim] -= 1.0;
+                            } else {
+                                if (pos[idim] < 0.0 or pos[idim] >= 1.0)
+                                    assert_mpi(false,
+                                               "[ReconstructionIterativeSolver] The particles are outside the box "
+                                               "and we are set not to periodically wrap");
+                            }
+                        }
+                        max_shift = std::max(max_shift, std::sqrt(shift2));
+                    }
+                    part.communicate_particles();
+
+                    FML::MaxOverTasks(&max_shift);
+                    if (FML::ThisTask == 0)
+                        std::cout << "[ReconstructionIterativeSolver] Maximum shift: " << max_shift << "\n";
+                };
+
+                if (BAO_reconstruction) {
+                    shift_particles(galaxies, 1.0 / bias, beta);
+                    if (randoms)
+                        shift_particles(*randoms, 1.0 / bias, 0.0);
+                } else {
+                    shift_particles(galaxies, 0.0, beta);
+                }
+            }
+
+            /// Reconstruction in a periodic box (no randoms). See the method above.
+            template <int N, class T>
+            void ReconstructionIterativeSolver(MPIParticles<T> & galaxies,
+                                               std::string density_assignment_method,
+                                               int Nmesh,
+                                               std::string reconstruction_type,
+                                               std::string line_of_sight,
+                                               std::vector<double> los_vector,
+                                               double beta,
+                                               double bias,
+                                               std::pair<std::string, double> smoothing_options,
+                                               std::string solver_method,
+                                               int max_iterations,
+                                               double epsilon) {
+                ReconstructionIterativeSolver<N, T, T>(galaxies,
+                                                       static_cast<MPIParticles<T> *>(nullptr),
+                                                       density_assignment_method,
+                                                       Nmesh,
+                                                       reconstruction_type,
+                                                       line_of_sight,
+                                                       los_vector,
+                                                       beta,
+                                                       bias,
+                                                       smoothing_options,
+                                                       solver_method,
+                                                       max_iterations,
+                                                       epsilon);
+            }
         } // namespace LPT
 
         // NAMESPACE FML::COSMOLOGY
@@ -329,6 +329,7 @@ namespace FML {
             }
 
             // Allocate memory
+            FML_MEMORY_DEFAULT_TAG_SCOPE(Grids);
             _y.resize(_NtotLocalAlloc);
             add_memory_label("MPIGrid");
 
@@ -1,12 +1,14 @@
 #ifndef MPIPARTICLES_HEADER
 #define MPIPARTICLES_HEADER
 
+#include <array>
 #include <cassert>
 #include <cstdio>
 #include <fstream>
 #include <functional>
 #include <ios>
 #include <iostream>
+#include <numeric>
 #include <vector>
 
 #ifdef USE_MPI
@@ -95,7 +97,7 @@ namespace FML {
             size_t get_particle_byte_size(size_t ipart);
 
             // For communication
-            void copy_over_recieved_data(std::vector<char> & recv_buffer, size_t Npart_recieved);
+            void copy_over_recieved_data(Vector<char> & recv_buffer, size_t Npart_recieved);
 
           public:
             /// Iterator for looping through all the active particles i.e. allow for(auto &&p: mpiparticles)
@@ -217,19 +219,19 @@ namespace FML {
             for (auto & part : p)
                 memory_in_mb += FML::PARTICLE::GetSize(part);
             memory_in_mb /= 1e6;
-            double max_memory_in_mb = memory_in_mb;
-            double min_memory_in_mb = memory_in_mb;
-            double mean_memory_in_mb = memory_in_mb / double(FML::NTasks);
-            FML::MaxOverTasks(&max_memory_in_mb);
-            FML::MinOverTasks(&min_memory_in_mb);
-            FML::SumOverTasks(&mean_memory_in_mb);
             double fraction_filled = double(NpartLocal_in_use) / double(p.size()) * 100;
-            double max_fraction_filled = fraction_filled;
-            double min_fraction_filled = fraction_filled;
-            double mean_fraction_filled = fraction_filled / double(FML::NTasks);
-            FML::MaxOverTasks(&max_fraction_filled);
-            FML::MinOverTasks(&min_fraction_filled);
-            FML::SumOverTasks(&mean_fraction_filled);
+
+            // Max, min and mean over tasks of (memory, fraction filled). One communication for each
+            std::array<double, 2> max_values{memory_in_mb, fraction_filled};
+            std::array<double, 2> min_values{memory_in_mb, fraction_filled};
+            std::array<double, 2> mean_values{memory_in_mb / double(FML::NTasks),
+                                              fraction_filled / double(FML::NTasks)};
+            FML::MaxArrayOverTasks(max_values.data(), 2);
+            FML::MinArrayOverTasks(min_values.data(), 2);
+            FML::SumArrayOverTasks(mean_values.data(), 2);
+            const auto [max_memory_in_mb, max_fraction_filled] = max_values;
+            const auto [min_memory_in_mb, min_fraction_filled] = min_values;
+            const auto [mean_memory_in_mb, mean_fraction_filled] = mean_values;
 
             if (FML::ThisTask == 0) {
                 std::cout << "\n";
@@ -283,6 +285,9 @@ namespace FML {
             FML::SumOverTasks(&NpartTotal);
             // Resize to capacity - we keep size in NpartLocal_in_use
             p.resize(p.capacity());
+#ifdef MEMORY_LOGGING
+            FML::MemoryLog::get()->set_tag(p.data(), FML::MemoryTag::Particles);
+#endif
         }
 
         // Create from a vector of particles with a given selection function
@@ -294,6 +299,7 @@ namespace FML {
             x_min_per_task = FML::GatherFromTasks(&FML::xmin_domain);
             x_max_per_task = FML::GatherFromTasks(&FML::xmax_domain);
             p.clear();
+            FML_MEMORY_DEFAULT_TAG_SCOPE(Particles);
             p.reserve(nallocate + 1);
 
             size_t count = 0;
@@ -338,6 +344,7 @@ namespace FML {
 #endif
 
             // Allocate memory
+            FML_MEMORY_DEFAULT_TAG_SCOPE(Particles);
             p.resize(nallocate);
             add_memory_label("MPIPartices::create");
 
@@ -540,6 +547,7 @@ namespace FML {
             size_t NpartToAllocate =
                 buffer_factor <= 1.0 ? NpartLocal_in_use : size_t(double(NpartLocal_in_use) * buffer_factor);
             assert(NpartToAllocate >= NpartLocal_in_use);
+            FML_MEMORY_DEFAULT_TAG_SCOPE(Particles);
             p.resize(NpartToAllocate);
             add_memory_label("MPIPartices::create_particle_grid");
 
@@ -587,7 +595,7 @@ namespace FML {
         }
 
         template <class T>
-        void MPIParticles<T>::copy_over_recieved_data(std::vector<char> & recv_buffer, size_t Npart_recv) {
+        void MPIParticles<T>::copy_over_recieved_data(Vector<char> & recv_buffer, size_t Npart_recv) {
             assert_mpi(NpartLocal_in_use + Npart_recv <= p.size(),
                        "[MPIParticles::copy_over_recieved_data] Too many particles recieved! Increase buffer\n");
 
@@ -610,6 +618,7 @@ namespace FML {
             if (FML::NTasks == 1)
                 return;
 #ifdef USE_MPI
+            FML_PROFILE_SCOPE("communicate_particles");
 
             // The number of particles we start with
             size_t NpartLocal_in_use_pre_comm = NpartLocal_in_use;
@@ -671,6 +680,8 @@ namespace FML {
                 }
             }
 
+            FML_PROFILE_ADD_BYTES(std::accumulate(nbytes_to_send.begin(), nbytes_to_send.end(), 0LL));
+
             // Communicate to get how many to recieve from each task
             for (int i = 1; i < NTasks; i++) {
                 int send_request_to = (ThisTask + i) % NTasks;
@@ -735,8 +746,9 @@ namespace FML {
                       "[MPIParticles::communicate_particles] Number to particles to communicate does not match\n");
 
             // Allocate send buffer
-            std::vector<char> send_buffer(ntot_bytes_to_send);
-            std::vector<char> recv_buffer(ntot_bytes_to_recv);
+            FML_MEMORY_DEFAULT_TAG_SCOPE(Communication);
+            Vector<char> send_buffer(ntot_bytes_to_send);
+            Vector<char> recv_buffer(ntot_bytes_to_recv);
 
             // Pointers to each send-recv place in the send-recv buffer
             std::vector<size_t> offset_in_send_buffer(NTasks, 0);
@@ -919,6 +931,7 @@ namespace FML {
             myfile.read((char *)x_max_per_task.data(), sizeof(double) * FML::NTasks);
 
             // Allocate memory
+            FML_MEMORY_DEFAULT_TAG_SCOPE(Particles);
             p.resize(NpartLocalAllocated);
             if (NpartLocal_in_use == 0)
                 return;
@@ -0,0 +1,151 @@
+%module(threads="1") fml
+%{
+  #define SWIG_FILE_WITH_INIT
+  #include "Wrapper.h"
+%}
+
+//=====================================================================
+//
+// Python bindings for FML (see Wrapper.h for the C++ side)
+//
+// threads="1" makes SWIG release the GIL while the C++ code runs
+// (the NumPy conversions are done before/after with the GIL held)
+// so other Python threads can run while we compute.
+//
+//=====================================================================
+
+%include "std_string.i"
+%include "typemaps.i"
+%include "exception.i"
+%include "../numpy.i"
+%init %{
+import_array();
+%}
+
+// C++ exceptions become Python RuntimeErrors
+%exception {
+  try {
+    $action
+  } catch (const std::exception & e) {
+    SWIG_exception(SWIG_RuntimeError, e.what());
+  }
+}
+
+//=====================================================================
+// Positions and velocities are (npart, 3) float64 arrays. They are always
+// copied into particles on the C++ side (the input is never modified).
+//=====================================================================
+%apply (double * IN_ARRAY2, int DIM1, int DIM2) {
+  (double * pos, int npart, int ndim),
+  (double * vel, int npart_vel, int ndim_vel),
+  (double * pos1, int npart1, int ndim1),
+  (double * pos2, int npart2, int ndim2)
+};
+
+// View of the memory of a grid (no copy, no ownership)
+%apply (double ** ARGOUTVIEW_ARRAY3, int * DIM1, int * DIM2, int * DIM3) {
+  (double ** buffer, int * n1, int * n2, int * n3)
+};
+
+// Results: arrays allocated in C++ and owned by NumPy
+%apply (double ** ARGOUTVIEWM_ARRAY1, int * DIM1) {
+  (double ** k, int * nk),
+  (double ** pofk, int * npofk),
+  (double ** r, int * nr),
+  (double ** paircount, int * npaircount)
+};
+%apply (double ** ARGOUTVIEWM_ARRAY2, int * DIM1, int * DIM2) {
+  (double ** pell, int * nell, int * nbins_pell),
+  (double ** halo_pos, int * nhalos, int * ndim_halo)
+};
+%apply (double ** ARGOUTVIEWM_ARRAY3, int * DIM1, int * DIM2, int * DIM3) {
+  (double ** bofk, int * n1, int * n2, int * n3)
+};
+%apply (int ** ARGOUTVIEWM_ARRAY1, int * DIM1) {(int ** halo_npart, int * nhalos_npart)};
+%apply int * OUTPUT {int * nleft, int * nright};
+
+// The raw functions are wrapped below with keyword arguments and defaults
+%rename("_%s") FML::PYTHON::particles_to_grid;
+%rename("_%s") FML::PYTHON::compute_power_spectrum;
+%rename("_%s") FML::PYTHON::compute_power_spectrum_multipoles;
+%rename("_%s") FML::PYTHON::compute_bispectrum;
+%rename("_%s") FML::PYTHON::friends_of_friends;
+%rename("_%s") FML::PYTHON::auto_pair_count;
+%rename("_%s") FML::PYTHON::cross_pair_count;
+%ignore FML::PYTHON::Grid::get_grid;
+
+%include "Wrapper.h"
+
+%extend FML::PYTHON::Grid {
+%pythoncode %{
+    def _view(self):
+        v = self.raw_buffer().view(_GridView)
+        v._owner = self
+        return v
+
+    def real(self):
+        """The real grid as a (local_nx, Nmesh, Nmesh) view of the grid memory (padding removed, no copy)"""
+        nmesh = self.get_nmesh()
+        nleft = self.get_n_extra_slices_left()
+        return self._view()[nleft:nleft + self.get_local_nx(), :, :nmesh]
+
+    def fourier(self):
+        """The fourier grid as a (local_nx, Nmesh, Nmesh//2+1) complex view of the grid memory (no copy)"""
+        nleft = self.get_n_extra_slices_left()
+        return self._view()[nleft:nleft + self.get_local_nx()].view(_numpy.complex128)
+%}
+}
+
+%pythoncode %{
+import numpy as _numpy
+
+class _GridView(_numpy.ndarray):
+    """A view of the memory of a Grid that keeps the Grid alive"""
+    def __array_finalize__(self, obj):
+        self._owner = getattr(obj, "_owner", None)
+
+def _kmax_default(Ngrid):
+    return 2.0 * _numpy.pi * (Ngrid // 2)
+
+def particles_to_grid(pos, grid, method="CIC"):
+    """Assign particles with positions in [0,1) to a Grid (made with the extra slices the method needs)"""
+    _particles_to_grid(pos, grid, method)
+
+def make_density_grid(pos, Nmesh, method="CIC"):
+    """Make a Grid with the extra slices needed and assign the particles to it"""
+    nleft, nright = extra_slices_needed_for_density_assignment(method)
+    grid = Grid(Nmesh, nleft, nright)
+    _particles_to_grid(pos, grid, method)
+    return grid
+
+def compute_power_spectrum(pos, Ngrid, nbins=None, kmin=0.0, kmax=None, method="CIC", interlacing=True, boxsize=1.0):
+    """Returns k, P(k)"""
+    nbins = Ngrid // 2 if nbins is None else nbins
+    kmax = _kmax_default(Ngrid) if kmax is None else kmax
+    return _compute_power_spectrum(pos, Ngrid, nbins, kmin, kmax, method, interlacing, boxsize)
+
+def compute_power_spectrum_multipoles(pos, vel, velocity_to_displacement, Ngrid, ellmax=4, nbins=None, kmin=0.0,
+                                      kmax=None, method="CIC", interlacing=True, boxsize=1.0):
+    """Returns k, P_ell(k) with shape (ellmax + 1, nbins). The particles are copied"""
+    nbins = Ngrid // 2 if nbins is None else nbins
+    kmax = _kmax_default(Ngrid) if kmax is None else kmax
+    return _compute_power_spectrum_multipoles(pos, vel, velocity_to_displacement, ellmax, Ngrid, nbins, kmin, kmax,
+                                              method, interlacing, boxsize)
+
+def compute_bispectrum(pos, Ngrid, nbins=8, kmin=0.0, kmax=None, method="CIC", interlacing=True, boxsize=1.0):
+    """Returns k, B(k1,k2,k3) with shape (nbins, nbins, nbins)"""
+    kmax = _kmax_default(Ngrid) if kmax is None else kmax
+    return _compute_bispectrum(pos, Ngrid, nbins, kmin, kmax, method, interlacing, boxsize)
+
+def friends_of_friends(pos, fof_distance, nmin=20, periodic=True):
+    """Returns the center of mass (nhalos, 3) and the number of particles of the halos"""
+    return _friends_of_friends(pos, fof_distance, nmin, periodic)
+
+def auto_pair_count(pos, nbins, rmax, periodic=True):
+    """Returns r, paircount"""
+    return _auto_pair_count(pos, nbins, rmax, periodic)
+
+def cross_pair_count(pos1, pos2, nbins, rmax, periodic=True):
+    """Returns r, paircount"""
+    return _cross_pair_count(pos1, pos2, nbins, rmax, periodic)
+%}
@@ -0,0 +1,320 @@
+#include "Wrapper.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include <FML/ComputePowerSpectra/ComputePowerSpectrum.h>
+#include <FML/FriendsOfFriends/FoF.h>
+#include <FML/Interpolation/ParticleGridInterpolation.h>
+#include <FML/MPIParticles/MPIParticles.h>
+#include <FML/PairCounting/PairCount.h>
+
+namespace FML {
+    namespace PYTHON {
+
+        static_assert(std::is_same<FML::GRID::FloatType, double>::value,
+                      "The Python bindings require FFTWGrid to be in double precision");
+
+        /// A particle that has the same memory layout as a row in a (npart, 3) NumPy array of doubles
+        struct PythonParticle {
+            double Pos[3];
+            constexpr int get_ndim() { return 3; }
+            double * get_pos() { return Pos; }
+        };
+        static_assert(sizeof(PythonParticle) == 3 * sizeof(double) and std::is_standard_layout<PythonParticle>::value,
+                      "PythonParticle must have the same layout as double[3]");
+
+        using PowerSpectrumBinning = FML::CORRELATIONFUNCTIONS::PowerSpectrumBinning<3>;
+
+        /// Particles with velocities (for redshift space multipoles)
+        struct PythonParticleWithVel {
+            double Pos[3];
+            double Vel[3];
+            constexpr int get_ndim() { return 3; }
+            double * get_pos() { return Pos; }
+            double * get_vel() { return Vel; }
+        };
+
+        static void check_positions(int npart, int ndim) {
+            if (ndim != 3)
+                throw std::runtime_error("Positions must have shape (npart, 3)");
+            if (npart < 0)
+                throw std::runtime_error("Negative number of particles");
+        }
+
+        /// Copy the positions into particles. The NumPy array is read-only (and might be shared with
+        /// other threads as we release the GIL) while the algorithms might change the positions (interlacing)
+        static std::vector<PythonParticle> as_particles(const double * pos, int npart, int ndim) {
+            check_positions(npart, ndim);
+            const auto * part = reinterpret_cast<const PythonParticle *>(pos);
+            return std::vector<PythonParticle>(part, part + npart);
+        }
+
+        /// Copy to a malloc'ed array that NumPy takes ownership of
+        template <class T>
+        static void to_numpy(const std::vector<T> & v, T ** out, int * n) {
+            *n = int(v.size());
+            *out = static_cast<T *>(std::malloc(std::max(size_t(1), v.size()) * sizeof(T)));
+            if (*out == nullptr)
+                throw std::runtime_error("Failed to allocate memory for the result");
+            if (not v.empty())
+                std::memcpy(*out, v.data(), v.size() * sizeof(T));
+        }
+
+        void set_num_threads([[maybe_unused]] int nthreads) {
+#ifdef USE_OMP
+            if (nthreads > 0)
+                omp_set_num_threads(nthreads);
+#endif
+        }
+
+        int get_num_threads() {
+#ifdef USE_OMP
+            return omp_get_max_threads();
+#else
+            return 1;
+#endif
+        }
+
+        //=====================================================================
+        // Grid
+        //=====================================================================
+
+        Grid::Grid(int Nmesh, int nleft, int nright) {
+            if (Nmesh <= 0 or nleft < 0 or nright < 0)
+                throw std::runtime_error("Grid: invalid parameters");
+            grid = FML::GRID::FFTWGrid<3>(Nmesh, nleft, nright);
+        }
+        int Grid::get_nmesh() const { return grid.get_nmesh(); }
+        int Grid::get_local_nx() const { return int(grid.get_local_nx()); }
+        int Grid::get_local_x_start() const { return int(grid.get_local_x_start()); }
+        int Grid::get_n_extra_slices_left() const { return grid.get_n_extra_slices_left(); }
+        int Grid::get_n_extra_slices_right() const { return grid.get_n_extra_slices_right(); }
+        void Grid::fftw_r2c() { grid.fftw_r2c(); }
+        void Grid::fftw_c2r() { grid.fftw_c2r(); }
+        void Grid::fill_real_grid(double value) { grid.fill_real_grid(value); }
+        FML::GRID::FFTWGrid<3> & Grid::get_grid() { return grid; }
+
+        void Grid::raw_buffer(double ** buffer, int * n1, int * n2, int * n3) {
+            const int Nmesh = grid.get_nmesh();
+            *buffer = grid.get_real_grid_left();
+            *n1 = grid.get_n_extra_slices_left() + int(grid.get_local_nx()) + grid.get_n_extra_slices_right();
+            *n2 = Nmesh;
+            *n3 = 2 * (Nmesh / 2 + 1);
+        }
+
+        //=====================================================================
+        // Density assignment
+        //=====================================================================
+
+        void particles_to_grid(double * pos, int npart, int ndim, Grid & grid, std::string density_assignment_method) {
+            auto part = as_particles(pos, npart, ndim);
+            auto nleftright =
+                FML::INTERPOLATION::get_extra_slices_needed_for_density_assignment(density_assignment_method);
+            if (grid.get_n_extra_slices_left() < nleftright.first or
+                grid.get_n_extra_slices_right() < nleftright.second)
+                throw std::runtime_error("particles_to_grid: the grid does not have enough extra slices for " +
+                                         density_assignment_method);
+            FML::INTERPOLATION::particles_to_grid<3, PythonParticle>(
+                part.data(), part.size(), part.size(), grid.get_grid(), density_assignment_method);
+        }
+
+        void
+        extra_slices_needed_for_density_assignment(std::string density_assignment_method, int * nleft, int * nright) {
+            auto nleftright =
+                FML::INTERPOLATION::get_extra_slices_needed_for_density_assignment(density_assignment_method);
+            *nleft = nleftright.first;
+            *nright = nleftright.second;
+        }
+
+        //=====================================================================
+        // Power spectra
+        //=====================================================================
+
+        void compute_power_spectrum(double * pos,
+                                    int npart,
+                                    int ndim,
+                                    int Ngrid,
+                                    int nbins,
+                                    double kmin,
+                                    double kmax,
+                                    std::string density_assignment_method,
+                                    bool interlacing,
+                                    double boxsize,
+                                    double ** k,
+                                    int * nk,
+                                    double ** pofk,
+                                    int * npofk) {
+            auto part = as_particles(pos, npart, ndim);
+            PowerSpectrumBinning binning(kmin, kmax, nbins, PowerSpectrumBinning::LINEAR_SPACING);
+            FML::CORRELATIONFUNCTIONS::compute_power_spectrum<3>(
+                Ngrid, part.data(), part.size(), part.size(), binning, density_assignment_method, interlacing);
+            binning.scale(boxsize);
+            to_numpy(binning.kbin, k, nk);
+            to_numpy(binning.pofk, pofk, npofk);
+        }
+
+        void compute_power_spectrum_multipoles(double * pos,
+                                               int npart,
+                                               int ndim,
+                                               double * vel,
+                                               int npart_vel,
+                                               int ndim_vel,
+                                               double velocity_to_displacement,
+                                               int ellmax,
+                                               int Ngrid,
+                                               int nbins,
+                                               double kmin,
+                                               double kmax,
+                                               std::string density_assignment_method,
+                                               bool interlacing,
+                                               double boxsize,
+                                               double ** k,
+                                               int * nk,
+                                               double ** pell,
+                                               int * nell,
+                                               int * nbins_pell) {
+            check_positions(npart, ndim);
+            if (npart_vel != npart or ndim_vel != 3)
+                throw std::runtime_error("Velocities must have the same shape as the positions");
+            if (ellmax < 0)
+                throw std::runtime_error("ellmax must be >= 0");
+
+            std::vector<PythonParticleWithVel> p(npart);
+            for (int i = 0; i < npart; i++) {
+                for (int idim = 0; idim < 3; idim++) {
+                    p[i].Pos[idim] = pos[3 * i + idim];
+                    p[i].Vel[idim] = vel[3 * i + idim];
+                }
+            }
+            FML::PARTICLE::MPIParticles<PythonParticleWithVel> part;
+            part.create(p.data(), p.size(), p.size(), 0.0, 1.0, true);
+            std::vector<PythonParticleWithVel>().swap(p);
+
+            std::vector<PowerSpectrumBinning> Pell(
+                ellmax + 1, PowerSpectrumBinning(kmin, kmax, nbins, PowerSpectrumBinning::LINEAR_SPACING));
+            FML::CORRELATIONFUNCTIONS::compute_power_spectrum_multipoles<3>(
+                Ngrid, part, velocity_to_displacement, Pell, density_assignment_method, interlacing);
+
+            std::vector<double> result;
+            for (auto & P : Pell) {
+                P.scale(boxsize);
+                result.insert(result.end(), P.pofk.begin(), P.pofk.end());
+            }
+            to_numpy(Pell[0].kbin, k, nk);
+            int ntot;
+            to_numpy(result, pell, &ntot);
+            *nell = ellmax + 1;
+            *nbins_pell = nbins;
+        }
+
+        void compute_bispectrum(double * pos,
+                                int npart,
+                                int ndim,
+                                int Ngrid,
+                                int nbins,
+                                double kmin,
+                                double kmax,
+                                std::string density_assignment_method,
+                                bool interlacing,
+                                double boxsize,
+                                double ** k,
+                                int * nk,
+                                double ** bofk,
+                                int * n1,
+                                int * n2,
+                                int * n3) {
+            auto part = as_particles(pos, npart, ndim);
+            FML::CORRELATIONFUNCTIONS::BispectrumBinning<3> binning(kmin, kmax, nbins);
+            FML::CORRELATIONFUNCTIONS::compute_bispectrum<3>(
+                Ngrid, part.data(), part.size(), part.size(), binning, density_assignment_method, interlacing);
+            binning.scale(boxsize);
+            to_numpy(binning.kbin, k, nk);
+            int ntot;
+            to_numpy(binning.P123, bofk, &ntot);
+            *n1 = *n2 = *n3 = nbins;
+        }
+
+        //=====================================================================
+        // Friends of Friends
+        //=====================================================================
+
+        void friends_of_friends(double * pos,
+                                int npart,
+                                int ndim,
+                                double fof_distance,
+                                int nmin_FoF_group,
+                                bool periodic,
+                                double ** halo_pos,
+                                int * nhalos,
+                                int * ndim_halo,
+                                int ** halo_npart,
+                                int * nhalos_npart) {
+            auto p = as_particles(pos, npart, ndim);
+            std::vector<FML::FOF::FoFHalo<PythonParticle, 3>> halos;
+            FML::FOF::FriendsOfFriends<PythonParticle, 3>(
+                p.data(), p.size(), fof_distance, nmin_FoF_group, periodic, halos);
+
+            std::vector<double> positions;
+            std::vector<int> np;
+            positions.reserve(3 * halos.size());
+            np.reserve(halos.size());
+            for (auto & h : halos) {
+                positions.insert(positions.end(), h.pos.begin(), h.pos.end());
+                np.push_back(int(h.np));
+            }
+            int ntot;
+            to_numpy(positions, halo_pos, &ntot);
+            *nhalos = int(halos.size());
+            *ndim_halo = 3;
+            to_numpy(np, halo_npart, nhalos_npart);
+        }
+
+        //=====================================================================
+        // Pair counting
+        //=====================================================================
+
+        void auto_pair_count(double * pos,
+                             int npart,
+                             int ndim,
+                             int nbins,
+                             double rmax,
+                             bool periodic,
+                             double ** r,
+                             int * nr,
+                             double ** paircount,
+                             int * npaircount) {
+            auto p = as_particles(pos, npart, ndim);
+            auto result = FML::CORRELATIONFUNCTIONS::AutoPairCount(p, nbins, rmax, periodic, false);
+            to_numpy(result.r, r, nr);
+            to_numpy(result.paircount, paircount, npaircount);
+        }
+
+        void cross_pair_count(double * pos1,
+                              int npart1,
+                              int ndim1,
+                              double * pos2,
+                              int npart2,
+                              int ndim2,
+                              int nbins,
+                              double rmax,
+                              bool periodic,
+                              double ** r,
+                              int * nr,
+                              double ** paircount,
+                              int * npaircount) {
+            auto p1 = as_particles(pos1, npart1, ndim1);
+            auto p2 = as_particles(pos2, npart2, ndim2);
+            auto result = FML::CORRELATIONFUNCTIONS::CrossPairCount(p1, p2, nbins, rmax, periodic, false);
+            to_numpy(result.r, r, nr);
+            to_numpy(result.paircount, paircount, npaircount);
+        }
+
+    } // namespace PYTHON
+} // namespace FML
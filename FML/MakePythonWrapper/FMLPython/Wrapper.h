@@ -0,0 +1,177 @@
+#ifndef FMLPYTHONWRAPPER_HEADER
+#define FMLPYTHONWRAPPER_HEADER
+
+#include <string>
+#include <vector>
+
+#include <FML/FFTWGrid/FFTWGrid.h>
+
+//=====================================================================
+//
+// The C++ side of the Python bindings (see FMLPython.i). The functions
+// here are written with the argument conventions of numpy.i so that
+// SWIG can map them directly to NumPy arrays:
+//
+// * Positions come in as (npart, 3) arrays of doubles in [0,1). They are
+//   always copied into particles so the input array is never modified.
+// * Results are returned as new NumPy arrays that own their memory
+//   (malloc'ed here, freed by NumPy).
+// * The real and fourier buffers of a Grid are exposed as views of the
+//   memory of the FFTWGrid (no copy). See Grid.real() and Grid.fourier()
+//   in FMLPython.i for how the padding is removed.
+//
+// Everything is for NDIM = 3 and a serial (non-MPI) build. OpenMP threads
+// are used if compiled with USE_OMP (set with set_num_threads). All the
+// compute functions are called with the GIL released.
+//
+//=====================================================================
+
+namespace FML {
+    namespace PYTHON {
+
+        /// Set the number of OpenMP threads used by the library
+        void set_num_threads(int nthreads);
+        /// The number of OpenMP threads used by the library
+        int get_num_threads();
+
+        //=====================================================================
+        /// A 3D FFTWGrid. The memory layout is the one of FFTWGrid: the real
+        /// grid has shape (nleft + local_nx + nright, Nmesh, 2 * (Nmesh / 2 + 1))
+        /// where the last dimension is padded for the in-place transform and
+        /// the fourier grid (local_nx, Nmesh, Nmesh / 2 + 1) complex numbers
+        /// occupy the same memory as the main real grid.
+        //=====================================================================
+        class Grid {
+          private:
+            FML::GRID::FFTWGrid<3> grid;
+
+          public:
+            Grid(int Nmesh, int nleft = 0, int nright = 0);
+
+            int get_nmesh() const;
+            int get_local_nx() const;
+            int get_local_x_start() const;
+            int get_n_extra_slices_left() const;
+            int get_n_extra_slices_right() const;
+
+            void fftw_r2c();
+            void fftw_c2r();
+            void fill_real_grid(double value);
+
+            /// View of the full allocated real buffer including the extra slices and the padding
+            void raw_buffer(double ** buffer, int * n1, int * n2, int * n3);
+
+            FML::GRID::FFTWGrid<3> & get_grid();
+        };
+
+        /// Assign particles to a grid. The grid must have the extra slices needed by the method
+        /// (see extra_slices_needed_for_density_assignment)
+        void particles_to_grid(double * pos, int npart, int ndim, Grid & grid, std::string density_assignment_method);
+
+        /// How many extra slices to the left and right a grid needs for a given density assignment method
+        void
+        extra_slices_needed_for_density_assignment(std::string density_assignment_method, int * nleft, int * nright);
+
+        /// P(k) of particles. k is in units of 1/boxsize and P(k) in units of boxsize^3
+        void compute_power_spectrum(double * pos,
+                                    int npart,
+                                    int ndim,
+                                    int Ngrid,
+                                    int nbins,
+                                    double kmin,
+                                    double kmax,
+                                    std::string density_assignment_method,
+                                    bool interlacing,
+                                    double boxsize,
+                                    double ** k,
+                                    int * nk,
+                                    double ** pofk,
+                                    int * npofk);
+
+        /// Redshift space multipoles P_ell(k) for ell = 0,...,ellmax averaged over the three coordinate axes as
+        /// the line of sight. The particles are displaced by velocity_to_displacement * vel along the line of sight.
+        /// The particles are copied as the algorithm moves them. Pell has shape (ellmax + 1, nbins)
+        void compute_power_spectrum_multipoles(double * pos,
+                                               int npart,
+                                               int ndim,
+                                               double * vel,
+                                               int npart_vel,
+                                               int ndim_vel,
+                                               double velocity_to_displacement,
+                                               int ellmax,
+                                               int Ngrid,
+                                               int nbins,
+                                               double kmin,
+                                               double kmax,
+                                               std::string density_assignment_method,
+                                               bool interlacing,
+                                               double boxsize,
+                                               double ** k,
+                                               int * nk,
+                                               double ** pell,
+                                               int * nell,
+                                               int * nbins_pell);
+
+        /// Bispectrum B(k1,k2,k3) of particles. B has shape (nbins, nbins, nbins)
+        void compute_bispectrum(double * pos,
+                                int npart,
+                                int ndim,
+                                int Ngrid,
+                                int nbins,
+                                double kmin,
+                                double kmax,
+                                std::string density_assignment_method,
+                                bool interlacing,
+                                double boxsize,
+                                double ** k,
+                                int * nk,
+                                double ** bofk,
+                                int * n1,
+                                int * n2,
+                                int * n3);
+
+        /// Friends of Friends halos. The positions are copied as the algorithm sorts the particles.
+        /// Returns the center of mass (nhalos, 3) and the number of particles (nhalos) of the halos
+        void friends_of_friends(double * pos,
+                                int npart,
+                                int ndim,
+                                double fof_distance,
+                                int nmin_FoF_group,
+                                bool periodic,
+                                double ** halo_pos,
+                                int * nhalos,
+                                int * ndim_halo,
+                                int ** halo_npart,
+                                int * nhalos_npart);
+
+        /// Pair counts of particles in nbins linear bins in [0, rmax]
+        void auto_pair_count(double * pos,
+                             int npart,
+                             int ndim,
+                             int nbins,
+                             double rmax,
+                             bool periodic,
+                             double ** r,
+                             int * nr,
+                             double ** paircount,
+                             int * npaircount);
+
+        /// Cross pair counts of two sets of particles in nbins linear bins in [0, rmax]
+        void cross_pair_count(double * pos1,
+                              int npart1,
+                              int ndim1,
+                              double * pos2,
+                              int npart2,
+                              int ndim2,
+                              int nbins,
+                              double rmax,
+                              bool periodic,
+                              double ** r,
+                              int * nr,
+                              double ** paircount,
+                              int * npaircount);
+
+    } // namespace PYTHON
+} // namespace FML
+
+#endif
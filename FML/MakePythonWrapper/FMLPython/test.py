@@ -0,0 +1,35 @@
+import fml
+import numpy as np
+
+# Number of OpenMP threads used by the library (the GIL is released while computing)
+fml.set_num_threads(4)
+
+# Particles with positions in [0,1)
+npart = 64**3
+pos = np.random.rand(npart, 3)
+vel = 0.01 * np.random.randn(npart, 3)
+
+# Density field on a grid. real() and fourier() are views of the grid memory (no copies)
+grid = fml.make_density_grid(pos, 64, "CIC")
+delta = grid.real()
+print("Mean density contrast:", delta.mean())
+grid.fftw_r2c()
+delta_k = grid.fourier()
+print("Shape of fourier grid:", delta_k.shape, "delta(k=0) =", delta_k[0, 0, 0])
+
+# We can also fill the grid from numpy and transform back
+delta[:] = np.sin(2 * np.pi * np.arange(64) / 64.0)[:, None, None]
+grid.fftw_r2c()
+grid.fftw_c2r()
+
+# Power spectrum, multipoles and bispectrum (in units of a box of size 1000 Mpc/h)
+k, pofk = fml.compute_power_spectrum(pos, 64, method="PCS", interlacing=True, boxsize=1000.0)
+k, pell = fml.compute_power_spectrum_multipoles(pos, vel, 1.0, 64, ellmax=4, boxsize=1000.0)
+k123, bofk = fml.compute_bispectrum(pos, 64, nbins=8, boxsize=1000.0)
+print("P(k):", pofk[:4], "P2(k):", pell[2, :4], "B(k,k,k):", np.einsum("iii->i", bofk)[:4])
+
+# Halos and pair counts
+halo_pos, halo_npart = fml.friends_of_friends(pos, 0.2 / 64, nmin=20)
+r, dd = fml.auto_pair_count(pos[:10000], 20, 0.1)
+r, d1d2 = fml.cross_pair_count(pos[:10000], pos[10000:20000], 20, 0.1)
+print("Number of halos:", len(halo_npart), "DD:", dd[:4], "D1D2:", d1d2[:4])
@@ -1,11 +1,21 @@
 #ifndef MEMORYLOG_HEADER
 #define MEMORYLOG_HEADER
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <typeinfo>
 #include <vector>
 
@@ -22,10 +32,10 @@ namespace FML {
     //=======================================================
     // Do not log allocations smaller than a minimum size
     // The standard size is 0
-    // Set a limit to how many items we can have in the log
-    // at the same time to avoid it taking up too much memory
-    // If this limit is reached then we clear the memory associated
-    // with the logger and stop logging any more allocations
+    // Set a limit to how many points we store in the memory
+    // timeline per thread to avoid it taking up too much memory
+    // If this limit is reached we stop adding to the timeline,
+    // but we still keep track of the memory in use and the peaks
     //=======================================================
 #ifndef MIN_BYTES_TO_LOG
 #define MIN_BYTES_TO_LOG 0
@@ -34,54 +44,173 @@ namespace FML {
 #define MAX_ALLOCATIONS_IN_MEMORY 100000
 #endif
 
+    //=======================================================
+    // Attribute the allocations made in the current scope on
+    // this thread to a given subsystem. The DEFAULT version only
+    // sets the tag if no other subsystem has claimed the scope so
+    // e.g. grids allocated inside FoF counts as FoF memory
+    // (Global.h defines them as no-ops without MEMORY_LOGGING)
+    //=======================================================
+#ifdef MEMORY_LOGGING
+#define FML_MEMORY_CONCAT_INTERNAL(a, b) a##b
+#define FML_MEMORY_CONCAT(a, b) FML_MEMORY_CONCAT_INTERNAL(a, b)
+#define FML_MEMORY_TAG_SCOPE(tag)                                                                                      \
+    FML::MemoryTagScope FML_MEMORY_CONCAT(fml_memory_tag_scope_, __LINE__)(FML::MemoryTag::tag, true)
+#define FML_MEMORY_DEFAULT_TAG_SCOPE(tag)                                                                              \
+    FML::MemoryTagScope FML_MEMORY_CONCAT(fml_memory_tag_scope_, __LINE__)(FML::MemoryTag::tag, false)
+#endif
+
     class MemoryLog;
     using TimePoint = std::chrono::time_point<std::chrono::steady_clock>;
 
+    /// The subsystems we attribute memory to
+    enum class MemoryTag : int { Other, Grids, Particles, Communication, FoF, Polyspectrum, NTags };
+    constexpr int n_memory_tags = int(MemoryTag::NTags);
+    inline const char * memory_tag_name(int tag) {
+        constexpr std::array<const char *, n_memory_tags> names{
+            "Other", "Grids", "Particles", "Communication", "FoF", "Polyspectrum"};
+        return (tag >= 0 and tag < n_memory_tags) ? names[tag] : "Unknown";
+    }
+
+    //=======================================================
+    // Every allocation made by the LogAllocator is preceded by
+    // this header so that we can free it without having to look
+    // the pointer up. The size is rounded up to keep alignment
+    //=======================================================
+    struct AllocationHeader {
+        size_t size;
+        int tag;
+        int flags;
+    };
+    constexpr int allocation_is_logged = 1;
+    constexpr int allocation_has_label = 2;
+    constexpr size_t allocation_header_bytes =
+        (sizeof(AllocationHeader) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) *
+        alignof(std::max_align_t);
+    inline AllocationHeader * get_allocation_header(void * ptr) {
+        return reinterpret_cast<AllocationHeader *>(static_cast<char *>(ptr) - allocation_header_bytes);
+    }
+
     //=======================================================
     /// Logs all heap allocations in the code that are larger
     /// than min_bytes_to_log. Implemented as a singleton so only
     /// one instance of this object exists. Thread safe.
+    ///
+    /// The bookkeeping is done with atomic counters (total and
+    /// per subsystem tag) and per-thread buffers for the timeline
+    /// so the logger can be left on in production runs. Only
+    /// adding labels to allocations takes a lock.
+    ///
+    /// Call set_region (e.g. at the start of every time-step) to
+    /// be able to tell which region the peak memory was reached in.
+    /// The resident set size is sampled when a region starts.
     //=======================================================
     class MemoryLog {
       private:
         static MemoryLog * instance;
 
-        // Lock
+        struct MemoryEvent {
+            double time_sec;
+            long long int memory_in_use;
+            long long int tag_memory_in_use;
+            int tag;
+        };
+
+        struct ThreadLog {
+            std::vector<MemoryEvent> events{};
+            size_t events_dropped{0};
+        };
+
+        struct RegionStart {
+            double time_sec;
+            double rss;
+            std::string name;
+        };
+
+        // Lock for the things below that are not in the fast path
         std::mutex mymutex{};
+        std::vector<std::unique_ptr<ThreadLog>> thread_logs{};
+        std::map<void *, std::string> labels{};
+        std::vector<RegionStart> regions{};
 
         // The first allocation
         TimePoint time_start{};
 
-        // Containing all current allocations
-        std::map<void *, size_t> allocations{};
-
-        // For more info, after allocating we can (externally)
-        // call add with the pointer and store a label
-        std::map<void *, std::string> labels{};
-
-        // The total memory as function of time
-        std::map<TimePoint, size_t> memory_vs_time{};
+        // Total memory in use at any given time (in total and per tag)
+        std::atomic<long long int> memory_in_use{0};
+        std::atomic<long long int> peak_memory_use{0};
+        std::array<std::atomic<long long int>, n_memory_tags> memory_in_use_tag{};
+        std::array<std::atomic<long long int>, n_memory_tags> peak_memory_use_tag{};
 
-        // Total memory in use at any given time
-        size_t memory_in_use{0};
-        size_t peak_memory_use{0};
+        // The region we are in now and the one we were in when the peak was reached
+        std::atomic<int> current_region{-1};
+        std::atomic<int> peak_region{-1};
 
         // The minimum allocation size in bytes to log
         size_t min_bytes_to_log = MIN_BYTES_TO_LOG;
-        size_t max_allocations_to_log = MAX_ALLOCATIONS_IN_MEMORY;
-        size_t nallocation{0};
-        bool stop_logging{false};
+        size_t max_events_per_thread = MAX_ALLOCATIONS_IN_MEMORY;
 
         // Private constructor and destructor
         MemoryLog() {
             time_start = std::chrono::steady_clock::now();
-            memory_in_use = 0;
-            memory_vs_time[time_start] = 0;
-            nallocation = 0;
-            stop_logging = false;
+            for (int i = 0; i < n_memory_tags; i++) {
+                memory_in_use_tag[i] = 0;
+                peak_memory_use_tag[i] = 0;
+            }
         }
         ~MemoryLog() = default;
 
+        ThreadLog & get_thread_log() {
+            thread_local ThreadLog * log = nullptr;
+            if (log == nullptr) {
+                std::lock_guard<std::mutex> guard(mymutex);
+                thread_logs.push_back(std::make_unique<ThreadLog>());
+                log = thread_logs.back().get();
+            }
+            return *log;
+        }
+
+        static void atomic_max(std::atomic<long long int> & value, long long int candidate, bool * updated = nullptr) {
+            long long int current = value.load(std::memory_order_relaxed);
+            while (candidate > current) {
+                if (value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {
+                    if (updated)
+                        *updated = true;
+                    return;
+                }
+            }
+        }
+
+        double time_in_sec() const {
+            return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() -
+                                                                             time_start)
+                .count();
+        }
+
+        // Change the memory in use by delta bytes for a given tag
+        void update(long long int delta, int tag) {
+            const long long int total = memory_in_use.fetch_add(delta, std::memory_order_relaxed) + delta;
+            const long long int total_tag = memory_in_use_tag[tag].fetch_add(delta, std::memory_order_relaxed) + delta;
+            if (delta > 0) {
+                bool new_peak = false;
+                atomic_max(peak_memory_use, total, &new_peak);
+                if (new_peak)
+                    peak_region.store(current_region.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                atomic_max(peak_memory_use_tag[tag], total_tag);
+            }
+
+            auto & log = get_thread_log();
+            if (log.events.size() < max_events_per_thread)
+                log.events.push_back({time_in_sec(), total, total_tag, tag});
+            else
+                log.events_dropped++;
+        }
+
+        static int & current_tag() {
+            thread_local int tag = int(MemoryTag::Other);
+            return tag;
+        }
+
       public:
         static MemoryLog * get() {
             if (not instance)
@@ -94,83 +223,94 @@ namespace FML {
         MemoryLog & operator=(const MemoryLog & arg) = delete;
         MemoryLog & operator=(const MemoryLog && arg) = delete;
 
+        /// The subsystem new allocations on this thread are attributed to
+        static MemoryTag get_current_tag() { return MemoryTag(current_tag()); }
+        static void set_current_tag(MemoryTag tag) { current_tag() = int(tag); }
+
+        /// Start a new region (e.g. a time-step). Used to tell where the peak was reached
+        void set_region(std::string name) {
+            auto sysmem = get_system_memory_use();
+            std::lock_guard<std::mutex> guard(mymutex);
+            regions.push_back({time_in_sec(), sysmem.first, name});
+            current_region.store(int(regions.size()) - 1, std::memory_order_relaxed);
+        }
+
         // Add a new allocation label
         void add_label(void * ptr, std::string name) {
-            if (stop_logging)
+            if (ptr == nullptr)
                 return;
-            if (allocations.find(ptr) == allocations.end()) {
-                std::cout << "[MemoryLogging] Warning could not find pointer in allocation list to add label " + name +
-                                 " to\n";
+            auto * header = get_allocation_header(ptr);
+            if (not(header->flags & allocation_is_logged))
                 return;
-            }
             std::lock_guard<std::mutex> guard(mymutex);
+            header->flags |= allocation_has_label;
             labels[ptr] = name;
         }
         void add_label(void * ptr, size_t size, std::string name) {
-            if (stop_logging or size < min_bytes_to_log)
+            if (size < min_bytes_to_log)
                 return;
             add_label(ptr, name);
         }
 
-        void add(void * ptr, size_t size) {
-            if (stop_logging or size < min_bytes_to_log)
+        /// Attribute an (already logged) allocation to a different subsystem
+        void set_tag(void * ptr, MemoryTag tag) {
+            if (ptr == nullptr)
                 return;
-            std::lock_guard<std::mutex> guard(mymutex);
-            allocations[ptr] = size;
-
-            memory_in_use += size;
-            if (memory_in_use > peak_memory_use)
-                peak_memory_use = memory_in_use;
-
-            auto time = std::chrono::steady_clock::now();
-            memory_vs_time[time] = memory_in_use;
-            nallocation++;
+            auto * header = get_allocation_header(ptr);
+            if (not(header->flags & allocation_is_logged) or header->tag == int(tag))
+                return;
+            update(-(long long int)header->size, header->tag);
+            header->tag = int(tag);
+            update((long long int)header->size, header->tag);
+        }
 
-            // If we have saturated then stop logging
-            stop_logging = nallocation >= max_allocations_to_log;
+        /// Log an allocation. The pointer must come from the LogAllocator (it has an AllocationHeader)
+        void add(void * ptr, size_t size) {
+            auto * header = get_allocation_header(ptr);
+            header->size = size;
+            header->tag = current_tag();
+            header->flags = size < min_bytes_to_log ? 0 : allocation_is_logged;
+            if (header->flags & allocation_is_logged)
+                update((long long int)size, header->tag);
         }
 
+        /// Clear the timeline
         void clear() {
-            allocations.clear();
-            memory_vs_time.clear();
+            std::lock_guard<std::mutex> guard(mymutex);
+            for (auto & log : thread_logs) {
+                log->events.clear();
+                log->events.shrink_to_fit();
+            }
         }
 
         // Remove an allocation and log info
-        void remove(void * ptr, size_t size) {
-            if (stop_logging or size < min_bytes_to_log)
+        void remove(void * ptr, [[maybe_unused]] size_t size) {
+            auto * header = get_allocation_header(ptr);
+            if (not(header->flags & allocation_is_logged))
                 return;
 
+            if (header->flags & allocation_has_label) {
+                std::lock_guard<std::mutex> guard(mymutex);
 #ifdef DEBUG_MEMORYLOG
-            std::string name = labels[ptr];
-            if (ThisTask == 0)
-                std::cout << "===> MemoryLog::remove Freeing[" << name << "]" << std::endl;
+                if (ThisTask == 0)
+                    std::cout << "===> MemoryLog::remove Freeing[" << labels[ptr] << "]" << std::endl;
 #endif
-            std::lock_guard<std::mutex> guard(mymutex);
-            allocations.erase(ptr);
-            labels.erase(ptr);
-
-            memory_in_use -= size;
-
-            auto time = std::chrono::steady_clock::now();
-            memory_vs_time[time] = memory_in_use;
+                labels.erase(ptr);
+            }
+            update(-(long long int)header->size, header->tag);
         }
 
+        /// Memory currently in use on this task (in bytes)
+        long long int get_memory_in_use() const { return memory_in_use.load(); }
+        /// Memory currently in use by a subsystem on this task (in bytes)
+        long long int get_memory_in_use(MemoryTag tag) const { return memory_in_use_tag[int(tag)].load(); }
+        /// The peak memory use so far on this task (in bytes)
+        long long int get_peak_memory_use() const { return peak_memory_use.load(); }
+        /// The peak memory use so far of a subsystem on this task (in bytes)
+        long long int get_peak_memory_use(MemoryTag tag) const { return peak_memory_use_tag[int(tag)].load(); }
+
         // Print the total memory in use
         void print() {
-            // Check if any task has saturated the allocation limit
-            char ok = stop_logging ? 0 : 1;
-#ifdef USE_MPI
-            MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_CHAR, MPI_MIN, MPI_COMM_WORLD);
-#endif
-            if (ok == 0) {
-                clear();
-                stop_logging = true;
-
-                if (ThisTask == 0)
-                    std::cout << "Warning: The memory log has stopped working "
-                              << " due to max number of allocation having been reached\n";
-                return;
-            }
 
             // Fetch system memory usage
             auto sysmem = get_system_memory_use();
@@ -232,45 +372,192 @@ namespace FML {
                 std::cout << "Peak memory use (Task 0): " << std::setw(15) << double(peak_memory_use) / 1.0e6
                           << " MB\n";
                 std::cout << "Max over tasks:           " << std::setw(15) << double(peak_memory) / 1.0e6 << " MB\n";
+                std::cout << "Untracked at peak RSS:    " << std::setw(15)
+                          << (sysmem.second - double(peak_memory_use)) / 1.0e6 << " MB (Task 0)\n";
                 std::cout << "\n";
             }
-            if (not allocations.empty()) {
+
+            // Which region the task with the largest peak was in when it reached it
+            std::string peak_region_name = "";
+            {
+                std::lock_guard<std::mutex> guard(mymutex);
+                int index = peak_region.load();
+                if (index >= 0 and index < int(regions.size()))
+                    peak_region_name = regions[index].name;
+            }
+#ifdef USE_MPI
+            struct {
+                double value;
+                int task;
+            } peak_and_task{double(peak_memory_use), ThisTask};
+            MPI_Allreduce(MPI_IN_PLACE, &peak_and_task, 1, MPI_DOUBLE_INT, MPI_MAXLOC, MPI_COMM_WORLD);
+            int nchar = int(peak_region_name.size());
+            MPI_Bcast(&nchar, 1, MPI_INT, peak_and_task.task, MPI_COMM_WORLD);
+            peak_region_name.resize(nchar);
+            MPI_Bcast(peak_region_name.data(), nchar, MPI_CHAR, peak_and_task.task, MPI_COMM_WORLD);
+            const int peak_task = peak_and_task.task;
+#else
+            const int peak_task = 0;
+#endif
+            if (ThisTask == 0 and peak_region_name.size() > 0)
+                std::cout << "Largest peak was on task " << peak_task << " in region [" << peak_region_name << "]\n\n";
+
+            // Memory per subsystem
+            std::array<double, n_memory_tags> min_tag, mean_tag, max_tag, peak_min_tag, peak_max_tag;
+            for (int i = 0; i < n_memory_tags; i++) {
+                min_tag[i] = mean_tag[i] = max_tag[i] = double(memory_in_use_tag[i]);
+                peak_min_tag[i] = peak_max_tag[i] = double(peak_memory_use_tag[i]);
+            }
+#ifdef USE_MPI
+            MPI_Allreduce(MPI_IN_PLACE, min_tag.data(), n_memory_tags, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+            MPI_Allreduce(MPI_IN_PLACE, mean_tag.data(), n_memory_tags, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+            MPI_Allreduce(MPI_IN_PLACE, max_tag.data(), n_memory_tags, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+            MPI_Allreduce(MPI_IN_PLACE, peak_min_tag.data(), n_memory_tags, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+            MPI_Allreduce(MPI_IN_PLACE, peak_max_tag.data(), n_memory_tags, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+#endif
+            if (ThisTask == 0) {
+                std::cout << "Memory per subsystem (MB):\n";
+                std::cout << std::left << std::setw(15) << "Subsystem" << std::right << std::setw(12) << "Min now"
+                          << std::setw(12) << "Mean now" << std::setw(12) << "Max now" << std::setw(12) << "Min peak"
+                          << std::setw(12) << "Max peak"
+                          << "\n";
+                for (int i = 0; i < n_memory_tags; i++) {
+                    if (peak_max_tag[i] == 0.0)
+                        continue;
+                    std::cout << std::left << std::setw(15) << memory_tag_name(i) << std::right << std::setw(12)
+                              << min_tag[i] / 1e6 << std::setw(12) << mean_tag[i] / NTasks / 1e6 << std::setw(12)
+                              << max_tag[i] / 1e6 << std::setw(12) << peak_min_tag[i] / 1e6 << std::setw(12)
+                              << peak_max_tag[i] / 1e6 << "\n";
+                }
+                std::cout << "\n";
+            }
+
+            std::lock_guard<std::mutex> guard(mymutex);
+            if (not labels.empty()) {
                 if (ThisTask == 0) {
-                    std::cout << "\nWe have the following things allocated on task 0: \n";
+                    std::cout << "\nWe have the following labeled things allocated on task 0: \n";
                 }
-                for (auto && a : allocations) {
+                for (auto && a : labels) {
                     if (ThisTask == 0) {
-                        std::string name = "";
-                        if (labels.find(a.first) != labels.end())
-                            name = labels[a.first];
+                        auto * header = get_allocation_header(a.first);
                         std::string bytelabel = " (MB)";
                         double factor = 1e6;
-                        std::cout << "Address: " << a.first << " Size: " << double(a.second) / factor << bytelabel
-                                  << " Label: " << name << "\n";
+                        std::cout << "Address: " << a.first << " Size: " << double(header->size) / factor
+                                  << bytelabel << " Subsystem: " << memory_tag_name(header->tag)
+                                  << " Label: " << a.second << "\n";
                     }
                 }
                 if (ThisTask == 0)
                     std::cout << "\n";
             }
-            if (not memory_vs_time.empty()) {
-                if (ThisTask == 0)
-                    std::cout << "Total memory as function of time:\n";
-                for (auto && m : memory_vs_time) {
-                    double time_in_sec =
-                        std::chrono::duration_cast<std::chrono::duration<double>>(m.first - time_start).count();
-                    if (ThisTask == 0) {
-                        std::cout << " Time (sec): " << std::setw(13) << time_in_sec;
-                        std::string bytelabel = " (MB)";
-                        double factor = 1e6;
-                        std::cout << " Memory: " << std::setw(13) << double(m.second) / factor << bytelabel << "\n";
-                    }
-                }
-            }
+            size_t events_dropped = 0;
+            for (auto & log : thread_logs)
+                events_dropped += log->events_dropped;
+            if (events_dropped > 0)
+                std::cout << "Warning: [MemoryLog] Task " << ThisTask << " dropped " << events_dropped
+                          << " points in the timeline. Increase MAX_ALLOCATIONS_IN_MEMORY\n";
             if (ThisTask == 0) {
+                std::cout << "Use write_timeline to output the memory as function of time\n";
                 std::cout << "\n#=====================================================\n";
                 std::cout << std::flush;
             }
         }
+
+        /// Write the memory in use (in total and per subsystem) as function of time for all tasks to file
+        /// together with the region starts and the resident set size sampled then. Collective call.
+        void write_timeline(std::string filename) {
+
+            // Merge the timelines of all threads
+            std::vector<MemoryEvent> events;
+            std::vector<RegionStart> region_starts;
+            {
+                std::lock_guard<std::mutex> guard(mymutex);
+                for (auto & log : thread_logs)
+                    events.insert(events.end(), log->events.begin(), log->events.end());
+                region_starts = regions;
+            }
+            std::sort(events.begin(), events.end(), [](const MemoryEvent & a, const MemoryEvent & b) {
+                return a.time_sec < b.time_sec;
+            });
+
+            // Make the lines for this task
+            std::string lines;
+            char buffer[64];
+            std::array<long long int, n_memory_tags> tag_memory{};
+            size_t iregion = 0;
+            double rss = 0.0;
+            for (auto & e : events) {
+                for (; iregion < region_starts.size() and region_starts[iregion].time_sec <= e.time_sec; iregion++) {
+                    rss = region_starts[iregion].rss;
+                    lines += "# Task " + std::to_string(ThisTask) + " region [" + region_starts[iregion].name +
+                             "] starts at t = " + std::to_string(region_starts[iregion].time_sec) + "\n";
+                }
+                tag_memory[e.tag] = e.tag_memory_in_use;
+                std::snprintf(buffer, sizeof(buffer), "%d %.6f %.6f", ThisTask, e.time_sec, e.memory_in_use / 1e6);
+                lines += buffer;
+                for (int i = 0; i < n_memory_tags; i++) {
+                    std::snprintf(buffer, sizeof(buffer), " %.6f", tag_memory[i] / 1e6);
+                    lines += buffer;
+                }
+                std::snprintf(buffer, sizeof(buffer), " %.6f\n", rss / 1e6);
+                lines += buffer;
+            }
+
+            // Gather on task 0
+            int nbytes = int(lines.size());
+            std::vector<int> nbytes_tasks(NTasks, nbytes);
+            std::vector<int> offset(NTasks, 0);
+            std::string all_lines = lines;
+#ifdef USE_MPI
+            MPI_Gather(&nbytes, 1, MPI_INT, nbytes_tasks.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+            for (int i = 1; i < NTasks; i++)
+                offset[i] = offset[i - 1] + nbytes_tasks[i - 1];
+            if (ThisTask == 0)
+                all_lines = std::string(offset[NTasks - 1] + nbytes_tasks[NTasks - 1], ' ');
+            MPI_Gatherv(lines.data(),
+                        nbytes,
+                        MPI_CHAR,
+                        all_lines.data(),
+                        nbytes_tasks.data(),
+                        offset.data(),
+                        MPI_CHAR,
+                        0,
+                        MPI_COMM_WORLD);
+#endif
+
+            if (ThisTask > 0)
+                return;
+            std::ofstream fp(filename.c_str());
+            if (not fp.is_open()) {
+                std::cout << "Warning: [MemoryLog::write_timeline] Failed to open " << filename << "\n";
+                return;
+            }
+            fp << "# Task  Time (sec)  Total (MB)";
+            for (int i = 0; i < n_memory_tags; i++)
+                fp << "  " << memory_tag_name(i) << " (MB)";
+            fp << "  RSS at region start (MB)\n";
+            fp << all_lines;
+        }
+    };
+
+    //=======================================================
+    /// Attribute all allocations on this thread to a subsystem
+    /// until the object goes out of scope. If override_tag is
+    /// false we only set it if the current tag is Other
+    //=======================================================
+    class MemoryTagScope {
+      private:
+        MemoryTag previous_tag;
+
+      public:
+        MemoryTagScope(MemoryTag tag, bool override_tag = true) {
+            previous_tag = MemoryLog::get_current_tag();
+            if (override_tag or previous_tag == MemoryTag::Other)
+                MemoryLog::set_current_tag(tag);
+        }
+        ~MemoryTagScope() { MemoryLog::set_current_tag(previous_tag); }
+        MemoryTagScope(const MemoryTagScope &) = delete;
+        MemoryTagScope & operator=(const MemoryTagScope &) = delete;
     };
 
     /// Custom allocator that logs allocations
@@ -283,8 +570,9 @@ namespace FML {
         LogAllocator(const LogAllocator<U> &) {}
 
         T * allocate(std::size_t size) {
-            if (size <= std::numeric_limits<std::size_t>::max() / sizeof(T)) {
-                if (auto ptr = std::malloc(size * sizeof(T))) {
+            if (size <= (std::numeric_limits<std::size_t>::max() - allocation_header_bytes) / sizeof(T)) {
+                if (auto raw = std::malloc(allocation_header_bytes + size * sizeof(T))) {
+                    void * ptr = static_cast<char *>(raw) + allocation_header_bytes;
                     MemoryLog::get()->add(ptr, size * sizeof(T));
                     return static_cast<T *>(ptr);
                 }
@@ -295,7 +583,7 @@ namespace FML {
         }
         void deallocate(T * ptr, std::size_t size) {
             MemoryLog::get()->remove(ptr, size * sizeof(T));
-            std::free(ptr);
+            std::free(static_cast<void *>(get_allocation_header(ptr)));
         }
     };
 
@@ -28,6 +28,16 @@ int main() {
     mem->add_label(a.data(), "[This is A]");
     mem->add_label(b.data(), "[This is B]");
 
+    // Regions are used to tell where the peak memory was reached
+    // and allocations in a tag scope are attributed to that subsystem
+    mem->set_region("Making grids");
+    {
+        FML_MEMORY_TAG_SCOPE(Grids);
+        MyVector d(2000000);
+        std::cout << "Grids in use: " << mem->get_memory_in_use(FML::MemoryTag::Grids) / 1e6 << " MB\n";
+    }
+    mem->set_region("After grids");
+
     mem->print();
 
     // Free the memory
@@ -35,7 +45,8 @@ int main() {
     // b.clear(); b.shrink_to_fit();
     // c.clear(); c.shrink_to_fit();
 
-    // Print the info about the memory and the history
-    // of allocations
+    // Print the info about the memory and output the
+    // memory as function of time
     FML::MemoryLog::get()->print();
+    FML::MemoryLog::get()->write_timeline("memory_timeline.txt");
 }
@@ -177,6 +177,7 @@ namespace FML {
 
                 // The method that does all the work. Solve the PDE
                 void solve(MultiGridFunction<NDIM, T> & Equation, MultiGridConvCrit & ConvergenceCriterion) {
+                    FML_PROFILE_SCOPE("MultiGridSolver::solve");
                     _Equation = Equation;
                     _ConvergenceCriterion = ConvergenceCriterion;
                     run_solver();
@@ -976,6 +977,7 @@ namespace FML {
 
             template <int NDIM, class T>
             void MultiGridSolver<NDIM, T>::solve_current_level(int level) {
+                FML_PROFILE_SCOPE("GaussSeidelSweeps");
                 if (_verbose)
                     std::cout << "    Performing Newton-Gauss-Seidel sweeps at level " << level << std::endl;
 
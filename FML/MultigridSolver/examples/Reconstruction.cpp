@@ -246,6 +246,22 @@ void ReconSolver() {
     FML::COSMOLOGY::LPT::RSDReconstructionFourierMethod<NDIM, Particle>(
         p2, "CIC", std::vector<double>{0.0, 0.0, 1.0}, N, 5, beta, {"gaussian", smoothing_scale}, false);
 
+    // Or with the general solver that does all of the above (and also supports a local line of sight
+    // and randoms for survey data). Solver options are "fourier", "cg" and "multigrid"
+    FML::PARTICLE::MPIParticles<Particle> p3 = p; // Take a copy
+    FML::COSMOLOGY::LPT::ReconstructionIterativeSolver<NDIM, Particle>(p3,
+                                                                       "CIC",
+                                                                       N,
+                                                                       "RSD",
+                                                                       "fixed",
+                                                                       std::vector<double>{0.0, 0.0, 1.0},
+                                                                       beta,
+                                                                       b,
+                                                                       {"gaussian", smoothing_scale},
+                                                                       "cg",
+                                                                       20,
+                                                                       epsilon);
+
     double max_shift = 0.0;
     double avg_shift = 0.0;
     std::ofstream fp("out.txt");
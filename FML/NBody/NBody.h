@@ -228,7 +228,7 @@ namespace FML {
             density_grid_fourier.add_memory_label("FFTWGrid::compute_force_from_density_real::density_grid_fourier");
             density_grid_fourier.set_grid_status_real(true);
             density_grid_fourier.fftw_r2c();
-            compute_force_from_density_fourier(
+            compute_force_from_density_fourier<N>(
                 density_grid_fourier, force_real, density_assignment_method_used, norm_poisson_equation);
         }
 
@@ -273,7 +273,6 @@ namespace FML {
             constexpr int kernel_choice = CONTINUOUS_GREENS_FUNCTION;
 
             auto Nmesh = density_grid_fourier.get_nmesh();
-            auto Local_nx = density_grid_fourier.get_local_nx();
             auto Local_x_start = density_grid_fourier.get_local_x_start();
 
             // This is needed in case kernel_choice != CONTINUOUS_GREENS_FUNCTION
@@ -303,71 +302,63 @@ namespace FML {
             }
 
             // Loop over all local fourier grid cells
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-            for (int islice = 0; islice < Local_nx; islice++) {
-                [[maybe_unused]] double kmag2;
-                [[maybe_unused]] std::array<double, N> kvec;
-                std::complex<FML::GRID::FloatType> I(0, 1);
-                for (auto && fourier_index : force_real[0].get_fourier_range(islice, islice + 1)) {
-                    if (Local_x_start == 0 and fourier_index == 0)
-                        continue; // DC mode (k=0)
-
-                    force_real[0].get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
-                    auto value = force_real[0].get_fourier_from_index(fourier_index);
-
-                    // Divide by k^2 (different kernel choices here, fiducial is just 1/k^2)
-                    if constexpr (kernel_choice == CONTINUOUS_GREENS_FUNCTION) {
-                        value /= kmag2;
-                    } else if constexpr (kernel_choice == CONTINUOUS_GREENS_FUNCTION_DECONVOLVE) {
-                        double W = window_function(kvec);
-                        value /= (kmag2 * W * W);
-                    } else if constexpr (kernel_choice == DISCRETE_GREENS_FUNCTION_HOCKNEYEASTWOOD) {
-                        double sum = 0.0;
-                        for (int idim = 0; idim < N; idim++) {
-                            double s = std::sin(kvec[idim] / (2.0 * double(Nmesh)));
-                            sum += s * s;
-                        }
-                        sum *= 4.0 * double(Nmesh * Nmesh);
-                        value /= sum;
-                    } else if constexpr (kernel_choice == DISCRETE_GREENS_FUNCTION_HOCKNEYEASTWOOD_DECONVOLVE) {
-                        double W = window_function(kvec);
-                        double sum = 0.0;
-                        for (int idim = 0; idim < N; idim++) {
-                            double s = std::sin(kvec[idim] / (2.0 * double(Nmesh)));
-                            sum += s * s;
-                        }
-                        sum *= 4.0 * double(Nmesh * Nmesh) * W * W;
-                        value /= sum;
-                    } else if constexpr (kernel_choice == DISCRETE_GREENS_FUNCTION_HAMMING) {
-                        value *= 1.0 / kmag2;
-                    } else if constexpr (kernel_choice == DISCRETE_GREENS_FUNCTION_HAMMING_DECONVOLVE) {
-                        double W = window_function(kvec);
-                        value *= 1.0 / (kmag2 * W * W);
-                    } else {
-                        FML::assert_mpi(
-                            false,
-                            "Unknown kernel_choice in compute_force_from_density_fourier. Method set at the "
-                            "head of this function");
+            const std::complex<FML::GRID::FloatType> I(0, 1);
+            force_real[0].for_each_fourier([&](IndexIntType fourier_index, std::array<double, N> kvec, double kmag2) {
+                if (kmag2 == 0.0)
+                    return; // DC mode (k=0)
+
+                auto value = force_real[0].get_fourier_from_index(fourier_index);
+
+                // Divide by k^2 (different kernel choices here, fiducial is just 1/k^2)
+                if constexpr (kernel_choice == CONTINUOUS_GREENS_FUNCTION) {
+                    value /= kmag2;
+                } else if constexpr (kernel_choice == CONTINUOUS_GREENS_FUNCTION_DECONVOLVE) {
+                    double W = window_function(kvec);
+                    value /= (kmag2 * W * W);
+                } else if constexpr (kernel_choice == DISCRETE_GREENS_FUNCTION_HOCKNEYEASTWOOD) {
+                    double sum = 0.0;
+                    for (int idim = 0; idim < N; idim++) {
+                        double s = std::sin(kvec[idim] / (2.0 * double(Nmesh)));
+                        sum += s * s;
                     }
-
-                    // Modify F[D] = kvec -> (8*sin(ki dx) - sin(2 ki dx))/6dx
-                    if constexpr (kernel_choice == DISCRETE_GREENS_FUNCTION_HAMMING or
-                                  kernel_choice == DISCRETE_GREENS_FUNCTION_HAMMING_DECONVOLVE) {
-                        for (int idim = 0; idim < N; idim++) {
-                            kvec[idim] = (8.0 * std::sin(kvec[idim] / double(Nmesh)) - std::sin(2 * double(Nmesh))) /
-                                         6.0 * double(Nmesh);
-                        }
+                    sum *= 4.0 * double(Nmesh * Nmesh);
+                    value /= sum;
+                } else if constexpr (kernel_choice == DISCRETE_GREENS_FUNCTION_HOCKNEYEASTWOOD_DECONVOLVE) {
+                    double W = window_function(kvec);
+                    double sum = 0.0;
+                    for (int idim = 0; idim < N; idim++) {
+                        double s = std::sin(kvec[idim] / (2.0 * double(Nmesh)));
+                        sum += s * s;
                     }
+                    sum *= 4.0 * double(Nmesh * Nmesh) * W * W;
+                    value /= sum;
+                } else if constexpr (kernel_choice == DISCRETE_GREENS_FUNCTION_HAMMING) {
+                    value *= 1.0 / kmag2;
+                } else if constexpr (kernel_choice == DISCRETE_GREENS_FUNCTION_HAMMING_DECONVOLVE) {
+                    double W = window_function(kvec);
+                    value *= 1.0 / (kmag2 * W * W);
+                } else {
+                    FML::assert_mpi(
+                        false,
+                        "Unknown kernel_choice in compute_force_from_density_fourier. Method set at the "
+                        "head of this function");
+                }
 
-                    // Compute force -ik/k^2 delta(k)
+                // Modify F[D] = kvec -> (8*sin(ki dx) - sin(2 ki dx))/6dx
+                if constexpr (kernel_choice == DISCRETE_GREENS_FUNCTION_HAMMING or
+                              kernel_choice == DISCRETE_GREENS_FUNCTION_HAMMING_DECONVOLVE) {
                     for (int idim = 0; idim < N; idim++) {
-                        force_real[idim].set_fourier_from_index(fourier_index,
-                                                                -I * value * FML::GRID::FloatType(kvec[idim] * norm_poisson_equation));
+                        kvec[idim] = (8.0 * std::sin(kvec[idim] / double(Nmesh)) - std::sin(2 * double(Nmesh))) /
+                                     6.0 * double(Nmesh);
                     }
                 }
-            }
+
+                // Compute force -ik/k^2 delta(k)
+                for (int idim = 0; idim < N; idim++) {
+                    force_real[idim].set_fourier_from_index(
+                        fourier_index, -I * value * FML::GRID::FloatType(kvec[idim] * norm_poisson_equation));
+                }
+            });
 
             // Deal with DC mode
             if (Local_x_start == 0)
@@ -690,6 +681,10 @@ namespace FML {
         /// get peculiar velocities in km/s and \f$ f_i(z_{\rm ini}) H(z_{\rm ini})/H_0 \cdot a_{\rm ini}^2 \f$ to get
         /// the velocities we use as the fiducial choice in N-body.
         ///
+        /// If Npart_1D equals the size of the grid then the particles sit on the grid nodes and we read the
+        /// displacements directly from the grid (no interpolation) one component at the time. This saves several
+        /// full grids of memory compared to the general case.
+        ///
         //=====================================================================
         template <int N, class T>
         void NBodyInitialConditions(MPIParticles<T> & part,
@@ -784,26 +779,20 @@ namespace FML {
             FFTWGrid<N> phi_2LPT;
             FFTWGrid<N> phi_3LPTa;
             FFTWGrid<N> phi_3LPTb;
-            if (LPT_order == 1) {
-                // Generate the 1LPT potential phi_1LPT = delta(k)/k^2
-                FML::COSMOLOGY::LPT::compute_1LPT_potential_fourier(delta_fourier, phi_1LPT);
-            } else if (LPT_order == 2) {
-                // Generate the 1LPT potential phi_1LPT = delta(k)/k^2
-                FML::COSMOLOGY::LPT::compute_1LPT_potential_fourier(delta_fourier, phi_1LPT);
-                // Generate the 2LPT potential phi_2LPT = -1/2k^2 F[phi_ii phi_jj - phi_ij^2]
-                FML::COSMOLOGY::LPT::compute_2LPT_potential_fourier(delta_fourier, phi_2LPT);
-            } else if (LPT_order == 3) {
-                // Generate the 3LPT potentials phi_3LPTa, phi_3LPTb plus 3LPT curl term
-                // We ignore the curl term in this implementation for simplicity
+            {
+                // Generate the LPT potentials up to the order we want in one go (phi_1LPT = delta(k)/k^2,
+                // phi_2LPT = -1/2k^2 F[phi_ii phi_jj - phi_ij^2] and the 3LPT potentials phi_3LPTa, phi_3LPTb)
+                // We ignore the 3LPT curl term in this implementation for simplicity
                 const bool ignore_3LPT_curl_term = true;
                 std::array<FFTWGrid<N>, N> phi_3LPT_Avec_fourier;
-                FML::COSMOLOGY::LPT::compute_3LPT_potential_fourier<N>(delta_fourier,
-                                                                       phi_1LPT,
-                                                                       phi_2LPT,
-                                                                       phi_3LPTa,
-                                                                       phi_3LPTb,
-                                                                       phi_3LPT_Avec_fourier,
-                                                                       ignore_3LPT_curl_term);
+                FML::COSMOLOGY::LPT::compute_LPT_potentials_fourier<N>(delta_fourier,
+                                                                      LPT_order,
+                                                                      phi_1LPT,
+                                                                      phi_2LPT,
+                                                                      phi_3LPTa,
+                                                                      phi_3LPTb,
+                                                                      phi_3LPT_Avec_fourier,
+                                                                      ignore_3LPT_curl_term);
             }
 
             //================================================================
@@ -979,6 +968,113 @@ namespace FML {
                 }
             }
 
+            //================================================================
+            // If the particles sit exactly on the grid nodes and the particle slabs coincide with the grid
+            // slabs then we don't need any interpolation: the displacement of a particle is just the value
+            // in the cell it sits in. We then compute one component of Psi at the time, add it to the particles
+            // in the same sweep over the grid slices and free the grid directly after. This way we never
+            // hold more than one displacement grid (plus the potentials not yet used) in memory
+            //================================================================
+            const auto Local_nx = delta_fourier.get_local_nx();
+            int Local_p_start = 0;
+            while (Local_p_start / double(Npart_1D) < FML::xmin_domain)
+                Local_p_start++;
+            const size_t npart_per_slice = FML::power(Npart_1D, N - 1);
+            int stream_from_grid = Npart_1D == Nmesh and Local_p_start == delta_fourier.get_local_x_start() and
+                                   part.get_npart() == size_t(Local_nx) * npart_per_slice;
+            FML::MinOverTasks(&stream_from_grid);
+
+            auto stream_displacement =
+                [&]([[maybe_unused]] int nLPT, char type, FFTWGrid<N> & phi_nLPT, double vfac_nLPT) -> void {
+                double max_disp_nLPT = 0.0;
+                double max_vel_nLPT = 0.0;
+                auto * part_ptr = part.get_particles_ptr();
+                if (FML::ThisTask == 0)
+                    std::cout << "Adding " << std::to_string(nLPT) << "LPT" << (type == 0 ? "" : std::string(1, type))
+                              << " displacement to particles directly from the grid\n";
+
+                FFTWGrid<N> Psi_nLPT;
+                for (int idim = 0; idim < N; idim++) {
+                    FML::COSMOLOGY::LPT::from_LPT_potential_to_displacement_component<N>(phi_nLPT, Psi_nLPT, idim);
+                    if (idim == N - 1)
+                        phi_nLPT.free();
+
+#ifdef USE_OMP
+#pragma omp parallel for reduction(max : max_disp_nLPT, max_vel_nLPT)
+#endif
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        // The real range skips the padding so cells come in the same order as the particles
+                        size_t ind = size_t(islice) * npart_per_slice;
+                        for (auto && real_index : Psi_nLPT.get_real_range(islice, islice + 1)) {
+                            auto & p = part_ptr[ind++];
+                            const double disp = Psi_nLPT.get_real_from_index(real_index);
+
+                            // Add to position (particle must have position)
+                            auto * pos = FML::PARTICLE::GetPos(p);
+                            pos[idim] += disp;
+                            if (pos[idim] >= 1.0)
+                                pos[idim] -= 1.0;
+                            if (pos[idim] < 0.0)
+                                pos[idim] += 1.0;
+                            max_disp_nLPT = std::max(max_disp_nLPT, std::fabs(disp));
+
+                            // Add to velocity (if it exists)
+                            if constexpr (FML::PARTICLE::has_get_vel<T>()) {
+                                FML::PARTICLE::GetVel(p)[idim] += vfac_nLPT * disp;
+                                max_vel_nLPT = std::max(max_vel_nLPT, std::fabs(vfac_nLPT * disp));
+                            }
+
+                            // Store displacement fields at particle (if it exists)
+                            if constexpr (FML::PARTICLE::has_get_D_1LPT<T>())
+                                if (nLPT == 1)
+                                    FML::PARTICLE::GetD_1LPT(p)[idim] = disp;
+                            if constexpr (FML::PARTICLE::has_get_D_2LPT<T>())
+                                if (nLPT == 2)
+                                    FML::PARTICLE::GetD_2LPT(p)[idim] = disp;
+                            if constexpr (FML::PARTICLE::has_get_D_3LPTa<T>())
+                                if (nLPT == 3 and type == 'a')
+                                    FML::PARTICLE::GetD_3LPTa(p)[idim] = disp;
+                            if constexpr (FML::PARTICLE::has_get_D_3LPTb<T>())
+                                if (nLPT == 3 and type == 'b')
+                                    FML::PARTICLE::GetD_3LPTb(p)[idim] = disp;
+                        }
+                    }
+                }
+                Psi_nLPT.free();
+
+                // Output the maximum displacment and velocity
+                FML::MaxOverTasks(&max_disp_nLPT);
+                FML::MaxOverTasks(&max_vel_nLPT);
+                if (FML::ThisTask == 0)
+                    std::cout << "Maximum " << std::to_string(nLPT) << "LPT displacements: " << max_disp_nLPT * box
+                              << " Mpc/h\n";
+                if (FML::ThisTask == 0)
+                    std::cout << "Maximum " << std::to_string(nLPT)
+                              << "LPT velocity: " << max_vel_nLPT * 100.0 * box / aini << " km/s peculiar\n";
+            };
+
+            if (stream_from_grid) {
+                // Store potentials if asked for
+                if (LPT_order >= 2 and phi_nLPT_potentials.size() > 0)
+                    phi_nLPT_potentials[0] = phi_2LPT;
+                if (LPT_order >= 3 and phi_nLPT_potentials.size() > 1)
+                    phi_nLPT_potentials[1] = phi_3LPTa;
+                if (LPT_order >= 3 and phi_nLPT_potentials.size() > 2)
+                    phi_nLPT_potentials[2] = phi_3LPTb;
+
+                stream_displacement(1, 0, phi_1LPT, velocity_norms[0]);
+                if (LPT_order >= 2)
+                    stream_displacement(2, 0, phi_2LPT, velocity_norms[1]);
+                if (LPT_order >= 3) {
+                    stream_displacement(3, 'a', phi_3LPTa, velocity_norms[2]);
+                    stream_displacement(3, 'b', phi_3LPTb, velocity_norms[3]);
+                }
+
+                // Communicate particles (they might have left the current task)
+                part.communicate_particles();
+                return;
+            }
+
             // Compute and add displacements
             // NB: we must do this in one go as add_displacement changes the position of the particles
             std::array<std::vector<FML::GRID::FloatType>, N> displacements_1LPT;
@@ -14,6 +14,8 @@
 #include <mpi.h>
 #endif
 
+#include <FML/Global/ThreadHistogram.h>
+
 //==============================================================
 // This is needed to speed up the calculation
 // The particles are binned to a grid and we do the correlation
@@ -46,11 +48,11 @@
 // double get_weight() (just return 1.0 if no weight)
 //
 // Cells must have the methods:
-// auto& get_cells()
+// auto get_cell(size_t index)
 // int get_ngrid()
 // size_t get_npart()
 // int get_np()
-// vecto<Particle> &get_part()
+// Particle &get_part(int i)
 //
 // Fiducial results is the number of pairs in each bin
 //
@@ -448,7 +450,6 @@ namespace FML {
             assert(ndim <= 3);
 
             // Fetch data from grid
-            auto & cells = grid.get_cells();
             const int ngrid = grid.get_ngrid();
             int max_ix = ngrid - 1;
             int max_iy = ngrid - 1;
@@ -474,7 +475,7 @@ namespace FML {
                             if (ndim == 3) {
                                 index = (ix * ngrid + iy) * ngrid + iz;
                             }
-                            bool nonempty = cells[index].get_np() > 0;
+                            bool nonempty = grid.get_cell(index).get_np() > 0;
                             if (nonempty) {
                                 max_ix = std::max(ix, max_ix);
                                 max_iy = std::max(iy, max_iy);
@@ -547,7 +548,7 @@ namespace FML {
                             index = (ix0 * ngrid + iy0) * ngrid + iz0;
 
                         // Current cell
-                        FML::PARTICLE::Cell<T> & curcell = cells[index];
+                        auto curcell = grid.get_cell(index);
 
                         // Number of particles in current cell
                         int np_cell = curcell.get_np();
@@ -635,7 +636,7 @@ namespace FML {
                                             index_neighbor_cell = (ix * ngrid + iy) * ngrid + iz;
 
                                         // Pointer to neighboring cell
-                                        FML::PARTICLE::Cell<T> & neighborcell = cells[index_neighbor_cell];
+                                        auto neighborcell = grid.get_cell(index_neighbor_cell);
 
                                         // Number of galaxies in neighboring cell
                                         const int npart_neighbor_cell = neighborcell.get_np();
@@ -742,14 +743,12 @@ namespace FML {
             assert(ndim == FML::PARTICLE::GetNDIM(utemp));
 
             // Fetch data from the grid
-            auto & cells = grid.get_cells();
             const int ngrid = grid.get_ngrid();
             int max_ix = ngrid - 1;
             int max_iy = ngrid - 1;
             int max_iz = ngrid - 1;
 
             // Fetch data from the grid2
-            auto & cells2 = grid2.get_cells();
             const int ngrid2 = grid2.get_ngrid();
             int max_ix2 = ngrid2 - 1;
             int max_iy2 = ngrid2 - 1;
@@ -775,7 +774,7 @@ namespace FML {
                             if (ndim == 3) {
                                 index = (ix * ngrid + iy) * ngrid + iz;
                             }
-                            bool nonempty = cells[index].get_np() > 0;
+                            bool nonempty = grid.get_cell(index).get_np() > 0;
                             if (nonempty) {
                                 max_ix = std::max(ix, max_ix);
                                 max_iy = std::max(iy, max_iy);
@@ -800,7 +799,7 @@ namespace FML {
                             if (ndim == 3) {
                                 index = (ix * ngrid2 + iy) * ngrid2 + iz;
                             }
-                            bool nonempty = cells2[index].get_np() > 0;
+                            bool nonempty = grid2.get_cell(index).get_np() > 0;
                             if (nonempty) {
                                 max_ix2 = std::max(ix, max_ix2);
                                 max_iy2 = std::max(iy, max_iy2);
@@ -872,7 +871,7 @@ namespace FML {
                             index = (ix0 * ngrid + iy0) * ngrid + iz0;
 
                         // Pointer to current cell
-                        FML::PARTICLE::Cell<T> & curcell = cells[index];
+                        auto curcell = grid.get_cell(index);
 
                         // Number of galaxies in current cell
                         int np_cell = curcell.get_np();
@@ -951,7 +950,7 @@ namespace FML {
                                             index_neighbor_cell = (ix2 * ngrid2 + iy2) * ngrid2 + iz2;
 
                                         // Pointer to neighboring cell
-                                        FML::PARTICLE::Cell<U> & neighborcell = cells2[index_neighbor_cell];
+                                        auto neighborcell = grid2.get_cell(index_neighbor_cell);
 
                                         // Number of galaxies in neighboring cell
                                         int npart_neighbor_cell = neighborcell.get_np();
@@ -1033,7 +1032,7 @@ namespace FML {
 #endif
 
             // How many pairs in each bin
-            std::vector<std::vector<double>> count_threads(nthreads, std::vector<double>(nbins, 0.0));
+            ThreadHistogram<1> count_threads(nbins, nthreads);
 
             //========================================
             // Define the binning function
@@ -1058,8 +1057,8 @@ namespace FML {
                     return;
 
                 // Compute bin index and add to bin
-                const int ibin = int(sqrt(dist2 / rmax2) * nbins);
-                count_threads[thread_id][ibin] += weight1 * weight2;
+                const int ibin = get_bin_index_linear(std::sqrt(dist2), 0.0, nbins / rmax, 0.0, nbins);
+                count_threads.add(thread_id, ibin, weight1 * weight2);
 
                 // ...add other things to bin here...
             };
@@ -1080,14 +1079,12 @@ namespace FML {
             // Do the pair counts
             AutoPairCountGridMethod<T>(grid, binning, rmax, periodic, verbose);
 
-            // Sum up over threads
+            // Sum up over threads and tasks (the tasks count different cells)
             std::vector<double> count(nbins, 0.0);
             std::vector<double> r(nbins, 0.0);
             std::vector<double> r_edge(nbins + 1, 0.0);
+            count_threads.reduce({count.data()});
             for (int j = 0; j < nbins; j++) {
-                for (int i = 0; i < nthreads; i++) {
-                    count[j] += count_threads[i][j];
-                }
                 r[j] = rmax * (j + 0.5) / double(nbins);
                 r_edge[j] = rmax * j / double(nbins);
             }
@@ -1096,39 +1093,14 @@ namespace FML {
             // Compute sum of weights
             double sum_weights = 0.0;
             double sum_weights_squared = 0.0;
-            auto & cells = grid.get_cells();
-            for (auto & cell : cells) {
-                for (auto & p : cell.get_part()) {
-                    double w = 1.0;
-                    if constexpr (FML::PARTICLE::has_get_weight<T>())
-                        w = FML::PARTICLE::GetWeight(p);
-                    sum_weights += w;
-                    sum_weights_squared += w * w;
-                }
+            for (auto & p : grid.get_particles()) {
+                double w = 1.0;
+                if constexpr (FML::PARTICLE::has_get_weight<T>())
+                    w = FML::PARTICLE::GetWeight(p);
+                sum_weights += w;
+                sum_weights_squared += w * w;
             }
 
-#ifdef USE_MPI
-            // Gather data from all CPUs
-            int mpi_rank = 0, mpi_size = 1;
-            MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
-            MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
-
-            // General method to reduce a single grid over all processes
-            auto reduce_grid_MPI = [&](std::vector<double> & grid) {
-                size_t nsize = grid.size();
-                std::vector<double> recv(mpi_size * nsize);
-                MPI_Allgather(grid.data(), nsize, MPI_DOUBLE, recv.data(), nsize, MPI_DOUBLE, MPI_COMM_WORLD);
-                std::vector<double> reduced_grid(nsize, 0.0);
-                for (int task = 0; task < mpi_size; task++)
-                    for (size_t i = 0; i < nsize; i++)
-                        reduced_grid[i] += recv[task * nsize + i];
-                return reduced_grid;
-            };
-
-            // Reduce all grids
-            count = reduce_grid_MPI(count);
-#endif
-
             AutoPairCountData result;
             result.r = r;
             result.r_edge = r_edge;
@@ -1170,7 +1142,7 @@ namespace FML {
 #endif
 
             // How many pairs in each bin
-            std::vector<std::vector<double>> count_threads(nthreads, std::vector<double>(nbins, 0.0));
+            ThreadHistogram<1> count_threads(nbins, nthreads);
 
             //========================================
             // Define the binning function
@@ -1193,8 +1165,8 @@ namespace FML {
                     return;
 
                 // Compute bin index and add to bin
-                const int ibin = int(sqrt(dist2 / rmax2) * nbins);
-                count_threads[thread_id][ibin] += weight1 * weight2;
+                const int ibin = get_bin_index_linear(std::sqrt(dist2), 0.0, nbins / rmax, 0.0, nbins);
+                count_threads.add(thread_id, ibin, weight1 * weight2);
 
                 // ...add other things to bin here...
             };
@@ -1219,14 +1191,12 @@ namespace FML {
             // Do the pair counts
             CrossPairCountGridMethod<T, U>(grid1, grid2, binning, rmax, periodic, verbose);
 
-            // Sum up over threads...
+            // Sum up over threads and tasks (the tasks count different cells)
             std::vector<double> count(nbins, 0.0);
             std::vector<double> r(nbins, 0.0);
             std::vector<double> r_edge(nbins + 1, 0.0);
+            count_threads.reduce({count.data()});
             for (int j = 0; j < nbins; j++) {
-                for (int i = 0; i < nthreads; i++) {
-                    count[j] += count_threads[i][j];
-                }
                 r[j] = rmax * (j + 0.5) / double(nbins);
                 r_edge[j] = rmax * j / double(nbins);
             }
@@ -1236,51 +1206,23 @@ namespace FML {
             // as we assume all tasks have all the particles
             double sum_weights = 0.0;
             double sum_weights_squared = 0.0;
-            auto & cells1 = grid1.get_cells();
-            for (auto & cell : cells1) {
-                for (auto & p : cell.get_part()) {
-                    double w = 1.0;
-                    if constexpr (FML::PARTICLE::has_get_weight<T>())
-                        w = FML::PARTICLE::GetWeight(p);
-                    sum_weights += w;
-                    sum_weights_squared += w * w;
-                }
+            for (auto & p : grid1.get_particles()) {
+                double w = 1.0;
+                if constexpr (FML::PARTICLE::has_get_weight<T>())
+                    w = FML::PARTICLE::GetWeight(p);
+                sum_weights += w;
+                sum_weights_squared += w * w;
             }
             double sum2_weights = 0.0;
             double sum2_weights_squared = 0.0;
-            auto & cells2 = grid2.get_cells();
-            for (auto & cell : cells2) {
-                for (auto & p : cell.get_part()) {
-                    double w = 1.0;
-                    if constexpr (FML::PARTICLE::has_get_weight<T>())
-                        w = FML::PARTICLE::GetWeight(p);
-                    sum2_weights += w;
-                    sum2_weights_squared += w * w;
-                }
+            for (auto & p : grid2.get_particles()) {
+                double w = 1.0;
+                if constexpr (FML::PARTICLE::has_get_weight<U>())
+                    w = FML::PARTICLE::GetWeight(p);
+                sum2_weights += w;
+                sum2_weights_squared += w * w;
             }
 
-#ifdef USE_MPI
-            // Gather data from all CPUs
-            int mpi_rank = 0, mpi_size = 1;
-            MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
-            MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
-
-            // General method to reduce a single grid over all processes
-            auto reduce_grid_MPI = [&](std::vector<double> & grid) {
-                size_t nsize = grid.size();
-                std::vector<double> recv(mpi_size * nsize);
-                MPI_Allgather(grid.data(), nsize, MPI_DOUBLE, recv.data(), nsize, MPI_DOUBLE, MPI_COMM_WORLD);
-                std::vector<double> reduced_grid(nsize, 0.0);
-                for (int task = 0; task < mpi_size; task++)
-                    for (size_t i = 0; i < nsize; i++)
-                        reduced_grid[i] += recv[task * nsize + i];
-                return reduced_grid;
-            };
-
-            // Reduce all grids...
-            count = reduce_grid_MPI(count);
-#endif
-
             CrossPairCountData result;
             result.r = r;
             result.r_edge = r_edge;
@@ -1,41 +1,65 @@
 #ifndef PARTICLEGRID_HEADER
 #define PARTICLEGRID_HEADER
 
+#include <FML/Global/Global.h>
 #include <FML/ParticleTypes/ReflectOnParticleMethods.h>
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
 namespace FML {
     namespace PARTICLE {
 
+        /// The type of the position of a particle T (i.e. the type get_pos points to)
+        template <class T>
+        using PositionType =
+            std::remove_const_t<std::remove_pointer_t<decltype(FML::PARTICLE::GetPos(std::declval<T &>()))>>;
+
+        /// What we store in the cells: copies of the full particles or just their positions
+        enum class CellStorage { Particles, Positions };
+
         //======================================================================
-        /// Class for binning objects into cells. Useful for speeding up algorithms.
+        /// A view into one cell of a ParticlesInBoxes grid. This does not own
+        /// any memory: the particles (or positions) of all cells live in one
+        /// contiguous array in the grid and a cell is just a range in it.
+        /// For every element we also have the index it had in the input array.
+        /// With CellStorage::Particles we can iterate over the particles
+        /// with a range-based for loop.
         //======================================================================
         template <class T>
         struct Cell {
-            size_t np{0};
-            std::vector<T> ps{};
+            using PosType = PositionType<T>;
 
-            // Increase np by 1. For counting particles
-            void operator++();
+            size_t np{0};
+            T * ps{nullptr};
+            const PosType * pos{nullptr};
+            const size_t * index{nullptr};
+            int ndim{0};
 
-            // Get the raw data
-            std::vector<T> & get_part();
-            T & get_part(int i);
+            /// Number of particles in the cell
             size_t get_np() const;
 
-            // Initialize cell. np = 0 and clear ps if its not already empty
-            void init();
+            /// Get a particle. Only available with CellStorage::Particles
+            T & get_part(size_t i);
 
-            // Reserve memory for n partices
-            void allocate(int n);
+            /// Get the position of a particle (works with both storage types)
+            const PosType * get_pos(size_t i) const;
 
-            // Add a particle to its corresponding cell in the grid
-            void add(T & p);
+            /// The index the particle had in the array the grid was created from
+            size_t get_index(size_t i) const;
 
-            // Free up memory
-            void clear();
+            /// For looping over the particles. Only available with CellStorage::Particles
+            T * begin();
+            T * end();
         };
 
         //======================================================================
@@ -45,30 +69,72 @@ namespace FML {
         /// auto *get_pos() : Pointer to first element in position
         /// int *get_ndim() : Number of dimensions in position
         ///
-        /// NB: This is not parallelized in any way!
+        /// The grid is a compressed cell list: we compute the cell of every particle,
+        /// make a histogram, do a prefix sum over the cells to get where each cell starts
+        /// and then scatter the particles into one contiguous array. The histogram and the
+        /// scatter are OpenMP parallelized over chunks of particles and the sort is stable so
+        /// the order of the particles within a cell is the same as in the input.
+        /// By default the cells are laid out in memory in Morton (Z-curve) order so that
+        /// neighboring cells are close in memory.
+        ///
+        /// We can either store copies of the particles (CellStorage::Particles, the default)
+        /// or only their positions (CellStorage::Positions) in which case the particles are
+        /// accessed through the stored index into the original array.
         ///
         /// Its mainly used for paircounting and for that the way we parallelize it is
         /// that all tasks make their own grid and does work only on their parts of the grid
-        /// This can be improved
+        /// It is also used in Friend of Friend where the grid only covers the local slab
+        /// [xmin, xmin + nx/ngrid) in the x-direction (see set_local_x_domain).
         ///
         /// The index of a cell is [iz + iy * N + ix*N^2 + ...], i.e. last coord varies first
-        /// We use a variant of this in Friend of Friend which should really be merged with this
         ///
         //======================================================================
 
         template <class T>
         class ParticlesInBoxes {
+          public:
+            using PosType = PositionType<T>;
+
           private:
-            std::vector<Cell<T>> cells{};
+            std::vector<T> sorted_particles{};
+            std::vector<PosType> sorted_positions{};
+            std::vector<size_t> sorted_index{};
+            std::vector<size_t> cell_start{};
+            std::vector<size_t> cell_count{};
+            CellStorage storage{CellStorage::Particles};
+            bool morton_order{true};
             int Ngrid{0};
             int Ndim{0};
+            int Nx{0};
+            double Xmin{0.0};
             size_t Npart{0};
+            size_t Ncells{0};
+
+            template <class Function>
+            void morton_traverse(std::vector<int> & corner, int size, Function & f) const;
 
           public:
-            // Get the raw data
-            std::vector<Cell<T>> & get_cells();
+            // Settings. Must be set before create is called
+            void set_storage(CellStorage storage);
+            void set_morton_order(bool morton_order);
+            void set_local_x_domain(double xmin, int nx);
+
+            // Get the cell with a given (row-major) index
+            Cell<T> get_cell(size_t index);
+            size_t get_ncells() const;
+
+            // The particles (or positions) of all cells and the index they had in the input
+            std::vector<T> & get_particles();
+            std::vector<PosType> & get_positions();
+            std::vector<size_t> & get_particle_index();
+
             size_t get_npart() const;
             int get_ngrid() const;
+            int get_nx() const;
+
+            // Loop over all cells in the order they are laid out in memory
+            template <class Function>
+            void for_each_cell_in_memory_order(Function && f) const;
 
             // Output some useful info about the grid
             void info() const;
@@ -85,56 +151,94 @@ namespace FML {
         // Cell methods
         //======================================================================
 
-        template <class T>
-        void Cell<T>::operator++() {
-            ++np;
-        }
-
         template <class T>
         size_t Cell<T>::get_np() const {
             return np;
         }
 
         template <class T>
-        T & Cell<T>::get_part(int i) {
+        T & Cell<T>::get_part(size_t i) {
+            assert(ps != nullptr);
             return ps[i];
         }
 
         template <class T>
-        std::vector<T> & Cell<T>::get_part() {
+        auto Cell<T>::get_pos(size_t i) const -> const PosType * {
+            if (ps)
+                return FML::PARTICLE::GetPos(ps[i]);
+            return pos + i * ndim;
+        }
+
+        template <class T>
+        size_t Cell<T>::get_index(size_t i) const {
+            return index[i];
+        }
+
+        template <class T>
+        T * Cell<T>::begin() {
+            assert(ps != nullptr or np == 0);
             return ps;
         }
 
         template <class T>
-        void Cell<T>::init() {
-            ps.clear();
-            np = 0;
+        T * Cell<T>::end() {
+            return ps + np;
         }
 
+        //======================================================================
+        // ParticlesInBoxes methods
+        //======================================================================
+
         template <class T>
-        void Cell<T>::allocate(int n) {
-            ps.reserve(n);
+        void ParticlesInBoxes<T>::set_storage(CellStorage _storage) {
+            storage = _storage;
         }
 
         template <class T>
-        void Cell<T>::add(T & p) {
-            ps.push_back(p);
+        void ParticlesInBoxes<T>::set_morton_order(bool _morton_order) {
+            morton_order = _morton_order;
         }
 
         template <class T>
-        void Cell<T>::clear() {
-            ps.clear();
-            ps.shrink_to_fit();
+        void ParticlesInBoxes<T>::set_local_x_domain(double xmin, int nx) {
+            Xmin = xmin;
+            Nx = nx;
         }
 
         template <class T>
-        std::vector<Cell<T>> & ParticlesInBoxes<T>::get_cells() {
-            return cells;
+        Cell<T> ParticlesInBoxes<T>::get_cell(size_t index) {
+            assert(index < Ncells);
+            const size_t start = cell_start[index];
+            Cell<T> cell;
+            cell.np = cell_count[index];
+            cell.index = sorted_index.data() + start;
+            cell.ndim = Ndim;
+            if (storage == CellStorage::Particles)
+                cell.ps = sorted_particles.data() + start;
+            else
+                cell.pos = sorted_positions.data() + start * Ndim;
+            return cell;
         }
 
-        //======================================================================
-        // ParticlesInBoxes methods
-        //======================================================================
+        template <class T>
+        size_t ParticlesInBoxes<T>::get_ncells() const {
+            return Ncells;
+        }
+
+        template <class T>
+        std::vector<T> & ParticlesInBoxes<T>::get_particles() {
+            return sorted_particles;
+        }
+
+        template <class T>
+        auto ParticlesInBoxes<T>::get_positions() -> std::vector<PosType> & {
+            return sorted_positions;
+        }
+
+        template <class T>
+        std::vector<size_t> & ParticlesInBoxes<T>::get_particle_index() {
+            return sorted_index;
+        }
 
         template <class T>
         size_t ParticlesInBoxes<T>::get_npart() const {
@@ -146,17 +250,68 @@ namespace FML {
             return Ngrid;
         }
 
+        template <class T>
+        int ParticlesInBoxes<T>::get_nx() const {
+            return Nx > 0 ? Nx : Ngrid;
+        }
+
+        template <class T>
+        template <class Function>
+        void ParticlesInBoxes<T>::morton_traverse(std::vector<int> & corner, int size, Function & f) const {
+            // Prune blocks that lie fully outside the grid
+            if (corner[0] >= get_nx())
+                return;
+            for (int idim = 1; idim < Ndim; idim++)
+                if (corner[idim] >= Ngrid)
+                    return;
+
+            if (size == 1) {
+                size_t index = 0;
+                for (int idim = 0; idim < Ndim; idim++)
+                    index = index * Ngrid + corner[idim];
+                f(index);
+                return;
+            }
+
+            // Visit the 2^Ndim children. The last coordinate has the lowest bit
+            const int half = size / 2;
+            for (int child = 0; child < (1 << Ndim); child++) {
+                for (int idim = 0; idim < Ndim; idim++)
+                    corner[idim] += ((child >> (Ndim - 1 - idim)) & 1) * half;
+                morton_traverse(corner, half, f);
+                for (int idim = 0; idim < Ndim; idim++)
+                    corner[idim] -= ((child >> (Ndim - 1 - idim)) & 1) * half;
+            }
+        }
+
+        template <class T>
+        template <class Function>
+        void ParticlesInBoxes<T>::for_each_cell_in_memory_order(Function && f) const {
+            if (Ncells == 0)
+                return;
+            if (not morton_order) {
+                for (size_t index = 0; index < Ncells; index++)
+                    f(index);
+                return;
+            }
+            int size = 1;
+            while (size < std::max(get_nx(), Ngrid))
+                size *= 2;
+            std::vector<int> corner(Ndim, 0);
+            morton_traverse(corner, size, f);
+        }
+
         template <class T>
         void ParticlesInBoxes<T>::info() const {
             size_t nempty = 0;
             size_t ntot = 0;
-            for (auto & cell : cells) {
-                if (cell.np == 0)
+            for (auto & np : cell_count) {
+                if (np == 0)
                     nempty++;
-                ntot += cell.np;
+                ntot += np;
             }
-            double fraction_empty = nempty / double(ntot);
-            
+            double fraction_empty = Ncells > 0 ? nempty / double(Ncells) : 0.0;
+
             if (FML::ThisTask == 0) {
                 std::cout << "ParticlesInBoxes Ngrid:     " << Ngrid << " Ndim: " << Ndim << "\n";
                 std::cout << "Total elements in grid: " << ntot << "\n";
@@ -171,68 +326,128 @@ namespace FML {
 
         template <class T>
         void ParticlesInBoxes<T>::create(T * particles, size_t nparticles, int ngrid) {
-            if (nparticles == 0)
-                return;
-
             assert_mpi(FML::PARTICLE::has_get_pos<T>(),
                        "[ParticlesInBoxes] Particle class must have positions via a get_pos method");
 
             // Set class data
+            T tmp{};
             Ngrid = ngrid;
-            Ndim = particles[0].get_ndim();
+            Ndim = FML::PARTICLE::GetNDIM(tmp);
             Npart = nparticles;
-
-            // Allocate cells
-            size_t ncells = 1;
-            for (int i = 0; i < Ndim; i++)
-                ncells *= ngrid;
-            cells.resize(ncells);
-            for (auto & cell : cells)
-                cell.init();
-
-            // Count number of particles in each cell
+            const int nx = get_nx();
+            Ncells = size_t(nx) * FML::power(Ngrid, Ndim - 1);
+
+            // Index of the cell a particle belongs to. Returns false if it is outside the grid
+            auto get_cell_index = [&](const T & p, size_t & index) -> bool {
+                const auto * pos = FML::PARTICLE::GetPos(const_cast<T &>(p));
+                const int ix = int((pos[0] - Xmin) * Ngrid);
+                bool inside = ix >= 0 and ix < nx;
+                index = ix;
+                for (int idim = 1; idim < Ndim; idim++) {
+                    const int icoord = int(pos[idim] * Ngrid);
+                    inside = inside and icoord >= 0 and icoord < Ngrid;
+                    index = index * Ngrid + icoord;
+                }
+                return inside;
+            };
+
+            // Compute the cell index of all the particles
+            std::vector<size_t> particle_cell(nparticles);
+            bool all_inside = true;
+#ifdef USE_OMP
+#pragma omp parallel for reduction(and : all_inside)
+#endif
             for (size_t i = 0; i < nparticles; i++) {
-                auto * Pos = FML::PARTICLE::GetPos(particles[i]);
-
-                // Index of cell particle belong to
-                size_t index = 0;
-                for (int j = 0; j < Ndim; j++) {
-                    int ix = (int)(Pos[j] * ngrid);
-                    index = index * ngrid + ix;
-                    if (ix >= ngrid)
-                        throw std::runtime_error(
-                            "ParticlesInBoxes positions has to be in [0,1). pos = " + std::to_string(Pos[j]) + "\n");
+                all_inside = get_cell_index(particles[i], particle_cell[i]) and all_inside;
+            }
+            if (not all_inside) {
+                for (size_t i = 0; i < nparticles; i++) {
+                    if (not get_cell_index(particles[i], particle_cell[i])) {
+                        const auto * pos = FML::PARTICLE::GetPos(particles[i]);
+                        std::string error = "ParticlesInBoxes positions has to be in the grid. pos = ";
+                        for (int idim = 0; idim < Ndim; idim++)
+                            error += std::to_string(pos[idim]) + " ";
+                        throw std::runtime_error(error + "\n");
+                    }
                 }
-                assert(index < ncells);
-
-                // Increase count in cell
-                ++cells[index];
             }
 
-            // Allocate memory
-            for (auto & cell : cells)
-                cell.allocate(cell.np);
-
-            // Add particles to cell
-            for (size_t i = 0; i < nparticles; i++) {
-                auto * Pos = FML::PARTICLE::GetPos(particles[i]);
+            // Each chunk of particles gets its own histogram. We limit the number of chunks
+            // so that the histograms don't use much more memory than the particle index
+            int nthreads = 1;
+#ifdef USE_OMP
+            nthreads = omp_get_max_threads();
+#endif
+            const int nchunks =
+                int(std::max(size_t(1), std::min(size_t(nthreads), 2 * nparticles / std::max(Ncells, size_t(1)))));
+            std::vector<size_t> chunk_count(nchunks * Ncells, 0);
+#ifdef USE_OMP
+#pragma omp parallel for schedule(static, 1)
+#endif
+            for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+                size_t * count = chunk_count.data() + ichunk * Ncells;
+                const size_t istart = nparticles * ichunk / nchunks;
+                const size_t iend = nparticles * (ichunk + 1) / nchunks;
+                for (size_t i = istart; i < iend; i++)
+                    count[particle_cell[i]]++;
+            }
 
-                // Index of cell particle belong to
-                size_t index = 0;
-                for (int j = 0; j < Ndim; j++) {
-                    int ix = (int)(Pos[j] * ngrid);
-                    index = index * ngrid + ix;
+            // Prefix sum over the cells in memory order. After this chunk_count holds
+            // the position where the next particle of a given chunk in a given cell goes
+            cell_start.assign(Ncells, 0);
+            cell_count.assign(Ncells, 0);
+            size_t offset = 0;
+            for_each_cell_in_memory_order([&](size_t index) {
+                cell_start[index] = offset;
+                for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+                    size_t & count = chunk_count[ichunk * Ncells + index];
+                    const size_t n = count;
+                    count = offset;
+                    offset += n;
+                }
+                cell_count[index] = offset - cell_start[index];
+            });
+            assert(offset == nparticles);
+
+            // Scatter the particles (or the positions) to the cells
+            sorted_index.resize(nparticles);
+            if (storage == CellStorage::Particles) {
+                sorted_particles.resize(nparticles);
+                sorted_positions.clear();
+            } else {
+                sorted_positions.resize(nparticles * Ndim);
+                sorted_particles.clear();
+            }
+#ifdef USE_OMP
+#pragma omp parallel for schedule(static, 1)
+#endif
+            for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+                size_t * next = chunk_count.data() + ichunk * Ncells;
+                const size_t istart = nparticles * ichunk / nchunks;
+                const size_t iend = nparticles * (ichunk + 1) / nchunks;
+                for (size_t i = istart; i < iend; i++) {
+                    const size_t j = next[particle_cell[i]]++;
+                    sorted_index[j] = i;
+                    if (storage == CellStorage::Particles) {
+                        sorted_particles[j] = particles[i];
+                    } else {
+                        const auto * pos = FML::PARTICLE::GetPos(particles[i]);
+                        for (int idim = 0; idim < Ndim; idim++)
+                            sorted_positions[j * Ndim + idim] = pos[idim];
+                    }
                 }
-
-                // Add particles
-                cells[index].add(particles[i]);
             }
         }
 
         template <class T>
         void ParticlesInBoxes<T>::clear() {
-            cells.clear();
-            cells.shrink_to_fit();
+            std::vector<T>().swap(sorted_particles);
+            std::vector<PosType>().swap(sorted_positions);
+            std::vector<size_t>().swap(sorted_index);
+            std::vector<size_t>().swap(cell_start);
+            std::vector<size_t>().swap(cell_count);
+            Npart = 0;
+            Ncells = 0;
         }
     } // namespace PARTICLE
 } // namespace FML
@@ -35,6 +35,202 @@ namespace FML {
             template <int N>
             using FFTWGrid = FML::GRID::FFTWGrid<N>;
 
+            //=================================================================================
+            /// Counter-based version of generate_white_noise_field_real. The value in a cell
+            /// is a pure function of (seed, global cell index) so the result is the same for
+            /// any number of tasks and threads. Only cells inside the (global) region
+            /// [region_begin, region_end) are generated; the rest of the grid is left untouched
+            /// which allows us to make a zoom region without generating the full box.
+            ///
+            /// @tparam N The dimension we are it
+            ///
+            /// @param[out] grid The real grid we generate.
+            /// @param[in] rng The counter-based random generator (only the seed is used).
+            /// @param[in] region_begin The first global cell-coordinate in the region
+            /// @param[in] region_end One past the last global cell-coordinate in the region
+            ///
+            //=================================================================================
+            template <int N>
+            void generate_white_noise_field_real_counter_based(FFTWGrid<N> & grid,
+                                                               const PhiloxRandomGenerator & rng,
+                                                               const std::vector<int> & region_begin,
+                                                               const std::vector<int> & region_end) {
+                static_assert(N >= 2, "[generate_white_noise_field_real_counter_based] Only implemented for N >= 2");
+
+                const int Nmesh = grid.get_nmesh();
+                const auto Local_nx = grid.get_local_nx();
+                const auto Local_x_start = grid.get_local_x_start();
+
+                assert_mpi(region_begin.size() == N and region_end.size() == N,
+                           "[generate_white_noise_field_real_counter_based] Region must have N components\n");
+                for (int idim = 0; idim < N; idim++) {
+                    assert_mpi(0 <= region_begin[idim] and region_begin[idim] <= region_end[idim] and
+                                   region_end[idim] <= Nmesh,
+                               "[generate_white_noise_field_real_counter_based] Region is not inside the box\n");
+                }
+
+                // The norm is to get unit power-spectrum
+                const double norm = std::pow(Nmesh, N / 2.0);
+
+                // The part of the region that is on the current task
+                const int ixmin = std::max(int(Local_x_start), region_begin[0]) - int(Local_x_start);
+                const int ixmax = std::min(int(Local_x_start + Local_nx), region_end[0]) - int(Local_x_start);
+                const int nlast = region_end[N - 1] - region_begin[N - 1];
+                if (ixmin >= ixmax or nlast == 0)
+                    return;
+
+                // Number of rows (cells in dim 1,...,N-2) per slice
+                IndexIntType nrows_per_slice = 1;
+                for (int idim = 1; idim < N - 1; idim++)
+                    nrows_per_slice *= Nmesh;
+
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                for (int islice = ixmin; islice < ixmax; islice++) {
+                    std::vector<double> row(nlast);
+                    std::array<int, N> coord;
+                    coord[0] = islice;
+                    for (IndexIntType irow = 0; irow < nrows_per_slice; irow++) {
+
+                        // Row coordinates and check that we are inside the region
+                        bool inside = true;
+                        IndexIntType rest = irow;
+                        for (int idim = N - 2; idim >= 1; idim--) {
+                            coord[idim] = int(rest % Nmesh);
+                            rest /= Nmesh;
+                            inside = inside and region_begin[idim] <= coord[idim] and coord[idim] < region_end[idim];
+                        }
+                        if (not inside)
+                            continue;
+
+                        // Global index of the first cell in the row we want
+                        uint64_t global_index = uint64_t(Local_x_start + islice);
+                        for (int idim = 1; idim < N - 1; idim++)
+                            global_index = global_index * Nmesh + coord[idim];
+                        global_index = global_index * Nmesh + region_begin[N - 1];
+
+                        // Generate the whole row in one go
+                        rng.fill_normal(global_index, row.data(), nlast);
+
+                        coord[N - 1] = region_begin[N - 1];
+                        auto * realgrid = grid.get_real_grid() + grid.get_index_real(coord);
+                        for (int i = 0; i < nlast; i++)
+                            realgrid[i] = FML::GRID::FloatType(row[i] * norm);
+                    }
+                }
+            }
+
+            /// Counter-based white noise in the full box. See the method above.
+            template <int N>
+            void generate_white_noise_field_real_counter_based(FFTWGrid<N> & grid, const PhiloxRandomGenerator & rng) {
+                std::vector<int> region_begin(N, 0);
+                std::vector<int> region_end(N, grid.get_nmesh());
+                generate_white_noise_field_real_counter_based(grid, rng, region_begin, region_end);
+            }
+
+            //=================================================================================
+            /// Counter-based version of generate_gaussian_random_field_fourier. The random
+            /// numbers for a mode is a pure function of (seed, global mode index) so the field
+            /// is the same for any number of tasks and threads and we only loop over the local
+            /// modes. For the modes in the kN = 0 plane that are related by symmetry we draw the
+            /// numbers for the one with the smallest global index and the other is the complex
+            /// conjugate. The DC mode and the Nyquist modes are set to zero.
+            ///
+            /// @tparam N The dimension we are it
+            ///
+            /// @param[out] grid The fourier grid we generate.
+            /// @param[in] rng The counter-based random generator (only the seed is used).
+            /// @param[in] Pofk_of_kBox_over_volume This is \f$ P(kB) / V \f$ where \f$ kB \f$ is the dimesnionless
+            /// wavenumber where \f$ B \f$ is the boxsize and \f$ V = B^{\rm N} \f$ is the volume of the box.
+            /// @param[in] fix_amplitude If true then we only draw phases and set \f$ |\delta(k)| \f$ directly from the
+            /// input power-spectrum.
+            ///
+            //=================================================================================
+            template <int N>
+            void generate_gaussian_random_field_fourier_counter_based(
+                FFTWGrid<N> & grid,
+                const PhiloxRandomGenerator & rng,
+                std::function<double(double)> Pofk_of_kBox_over_volume,
+                bool fix_amplitude) {
+                static_assert(N >= 2, "[generate_gaussian_random_field_fourier_counter_based] Only implemented for N >= 2");
+
+                // We require an allocated grid and a power-spectrum to run
+                assert_mpi(grid.get_nmesh() > 0,
+                           "[generate_gaussian_random_field_fourier_counter_based] Grid is not allocated. Nmesh is zero\n");
+                assert_mpi(Pofk_of_kBox_over_volume.operator bool(),
+                           "[generate_gaussian_random_field_fourier_counter_based] PowerSpectrum function not callable\n");
+
+                // Use a different stream than for the white noise
+                const uint32_t stream = 1;
+
+                const int Nmesh = grid.get_nmesh();
+                const auto Local_nx = grid.get_local_nx();
+                const auto Local_x_start = grid.get_local_x_start();
+
+                // The global index of a mode. This is what we use as the counter
+                auto global_index = [&](const std::array<int, N> & c) {
+                    uint64_t index = c[0];
+                    for (int idim = 1; idim < N - 1; idim++)
+                        index = index * Nmesh + c[idim];
+                    return index * (Nmesh / 2 + 1) + c[N - 1];
+                };
+
+                // If we use GSL make a spline (std::function can be slow) otherwise this is just a copy
+                // of the function itself
+                auto Pofk_of_kBox_over_volume_spline = grid.make_fourier_spline(Pofk_of_kBox_over_volume, "P(k)/V");
+
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                for (int islice = 0; islice < Local_nx; islice++) {
+                    std::array<double, N> kvec;
+                    double kmag;
+                    for (auto && fourier_index : grid.get_fourier_range(islice, islice + 1)) {
+                        auto coord = grid.get_fourier_coord_from_index(fourier_index);
+                        coord[0] += int(Local_x_start);
+
+                        // The DC mode and the Nyquist modes are set to zero
+                        bool is_zero = true;
+                        bool is_nyquist = false;
+                        for (int idim = 0; idim < N; idim++) {
+                            is_zero = is_zero and coord[idim] == 0;
+                            is_nyquist = is_nyquist or coord[idim] == Nmesh / 2;
+                        }
+                        if (is_zero or is_nyquist) {
+                            grid.set_fourier_from_index(fourier_index, 0.0);
+                            continue;
+                        }
+
+                        // In the kN = 0 plane delta(k) = delta(-k)^* so we use the random numbers
+                        // of the mode with the smallest global index for both of them
+                        auto coord_rng = coord;
+                        bool conjugate = false;
+                        if (coord[N - 1] == 0) {
+                            std::array<int, N> mirrorcoord;
+                            for (int idim = 0; idim < N; idim++)
+                                mirrorcoord[idim] = coord[idim] == 0 ? 0 : Nmesh - coord[idim];
+                            if (global_index(mirrorcoord) < global_index(coord)) {
+                                coord_rng = mirrorcoord;
+                                conjugate = true;
+                            }
+                        }
+
+                        const auto u = rng.uniform_pair(global_index(coord_rng), stream);
+                        const double phase = 2.0 * M_PI * u[0];
+                        const double norm = fix_amplitude ? 1.0 : -std::log(u[1]);
+
+                        // Assign the field. Note kmag is dimensionless here. Units taken care of in Powerspectrum
+                        grid.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
+                        const double delta_norm = std::sqrt(norm * Pofk_of_kBox_over_volume_spline(kmag));
+                        std::complex<double> delta = delta_norm * std::exp(std::complex<double>(0, 1) * phase);
+                        if (conjugate)
+                            delta = std::conj(delta);
+                        grid.set_fourier_from_index(fourier_index, delta);
+                    }
+                }
+            }
+
             //=================================================================================
             /// This generates gaussian white noise in real-space. It is normalized such that
             /// the power-spectrum of the field is unity, so the amplitude in real-space is
@@ -49,6 +245,14 @@ namespace FML {
             template <int N>
             void generate_white_noise_field_real(FFTWGrid<N> & grid, RandomGenerator * rng) {
 
+                // With a counter-based generator we don't need a seedtable (N = 1 uses the sequential path below)
+                if constexpr (N >= 2) {
+                    if (auto * philox = dynamic_cast<PhiloxRandomGenerator *>(rng)) {
+                        generate_white_noise_field_real_counter_based(grid, *philox);
+                        return;
+                    }
+                }
+
                 auto Nmesh = grid.get_nmesh();
                 auto Local_nx = grid.get_local_nx();
                 auto Local_x_start = grid.get_local_x_start();
@@ -82,12 +286,15 @@ namespace FML {
                     auto _rng = rngs[slice];
                     _rng->set_seed(seedtable[slice + Local_x_start]);
 
-                    // Loop over cells
+                    // Loop over cells. The numbers are generated one row at a time
+                    std::vector<double> row(N > 1 ? Nmesh : 1);
+                    size_t irow = row.size();
                     for (auto & real_index : grid.get_real_range(slice, slice + 1)) {
-                        auto value = _rng->generate_normal() * norm;
-                        grid.set_real_from_index(real_index, value);
-                        if (slice + Local_x_start == 0)
-                            std::cout << value << "\n";
+                        if (irow == row.size()) {
+                            _rng->fill_normal(row.data(), row.size());
+                            irow = 0;
+                        }
+                        grid.set_real_from_index(real_index, row[irow++] * norm);
                     }
                 }
             }
@@ -150,6 +357,16 @@ namespace FML {
 
                 using IndexIntType = long long int;
 
+                // With a counter-based generator every mode is generated independently
+                // (N = 1 uses the sequential path below)
+                if constexpr (N >= 2) {
+                    if (auto * philox = dynamic_cast<PhiloxRandomGenerator *>(rng)) {
+                        generate_gaussian_random_field_fourier_counter_based(
+                            grid, *philox, Pofk_of_kBox_over_volume, fix_amplitude);
+                        return;
+                    }
+                }
+
                 // We require an allocated grid, a random number generator and a power-spectrum to run
                 assert_mpi(grid.get_nmesh() > 0,
                            "[generate_gaussian_random_field_fourier] Grid is not allocated. Nmesh is zero\n");
@@ -298,6 +515,14 @@ namespace FML {
                                                         std::function<double(double)> Pofk_of_kBox_over_volume,
                                                         bool fix_amplitude) {
 
+                // With a counter-based generator every mode is generated independently so there is
+                // no N-GenIC seedtable ordering to follow
+                if (auto * philox = dynamic_cast<PhiloxRandomGenerator *>(rng)) {
+                    generate_gaussian_random_field_fourier_counter_based(
+                        grid, *philox, Pofk_of_kBox_over_volume, fix_amplitude);
+                    return;
+                }
+
                 // We require an allocated grid, a random number generator and a power-spectrum to run
                 assert_mpi(grid.get_nmesh() > 0,
                            "[generate_gaussian_random_field_fourier<3>] Grid is not allocated. Nmesh is zero\n");
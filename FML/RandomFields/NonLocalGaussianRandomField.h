@@ -39,8 +39,13 @@ namespace FML {
             /// gaussian},\phi_{\rm gaussian}) \f$ where the kernel is some quadratic form which in its simples form
             /// (local) is just \f$ \phi_{\rm gaussian}^2 \f$.
             ///
-            /// This requires in general 6 grids to be allocated at the same time
-            /// and up to 8 fourier transforms
+            /// We only allocate the fields needed for the kernel terms that are non-zero and all the work is
+            /// done in place in phi_fourier. Every field is made in one sweep over the grid so the number of
+            /// grids (including phi_fourier) and fourier transforms we need is:
+            ///   gaussian: 1 grid and 0 FFTs
+            ///   local: 1 grid and 2 FFTs
+            ///   equilateral and orthogonal with u = 0: 3 grids and 6 FFTs
+            ///   equilateral and orthogonal with u != 0 (and generic): 4 grids and 8 FFTs
             ///
             /// NB: for generating IC for cosmological simulations see the related method
             /// and see 1108.5512 for more info about the algorithmm.
@@ -68,11 +73,6 @@ namespace FML {
                                                                  double u = 0.0,
                                                                  std::vector<double> kernel_values = {}) {
 
-                // Ensure that <phi> = 0 in the end (this costs 2 extra FT)
-                // This is not really needed as all terms apart from phi^2 mean to zero
-                // and we take care of phi^2 seperately. Also it is not observable anyway
-                const double subtract_mean = false;
-
                 // Set up the kernel values:
                 // 0 is coefficient of (phi^2 - <phi^2>), 1 is P13[ phi Pm13 ]
                 // 2 is P23[ phi Pm23 - Pm13^2 ], 3 is P1 [ phi Pm1 - Pm23 Pm13 ]
@@ -106,8 +106,7 @@ namespace FML {
 
                 const auto Nmesh = phi_fourier.get_nmesh();
                 const auto Local_nx = phi_fourier.get_local_nx();
-                const auto nleft = phi_fourier.get_n_extra_slices_left();
-                const auto nright = phi_fourier.get_n_extra_slices_right();
+                const auto Local_x_start = phi_fourier.get_local_x_start();
                 assert_mpi(Nmesh > 0,
                            "[generate_nonlocal_gaussian_random_field_fourier] Grid must already be allocated");
 
@@ -116,160 +115,106 @@ namespace FML {
                     phi_fourier, rng, Pofk_of_kBox_over_volume, fix_amplitude);
 
                 // Set DC mode to zero (this should be the case, but just to be sure)
-                if (FML::ThisTask == 0)
+                if (Local_x_start == 0)
                     phi_fourier.set_fourier_from_index(0, 0.0);
 
                 // If fNL = 0 no point to continue
                 if (fNL == 0.0)
                     return;
 
-                // Get phi in real space
-                FFTWGrid<N> phi_real = phi_fourier;
-                phi_real.add_memory_label("FFTWGrid::generate_nonlocal_gaussian_random_field_fourier::phi_real");
-                phi_real.set_grid_status_real(false);
-                phi_real.fftw_c2r();
-
-                // Compute phi^2 - <phi>^2 in real space and store in source
-                FFTWGrid<N> source(Nmesh, nleft, nright);
-                source.add_memory_label("FFTWGrid::generate_nonlocal_gaussian_random_field_fourier::source");
-                double phi_squared_mean = 0.0;
-                double phi_mean = 0.0;
-                long long int ncells = 0;
-#ifdef USE_OMP
-#pragma omp parallel for reduction(+ : phi_squared_mean, phi_mean, ncells)
-#endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    for (auto && real_index : phi_real.get_real_range(islice, islice + 1)) {
-                        auto phi = phi_real.get_real_from_index(real_index);
-                        auto value = phi * phi;
-                        source.set_real_from_index(real_index, value);
-                        phi_squared_mean += value;
-                        phi_mean += phi;
-                        ncells += 1;
-                    }
-                }
-
-                FML::SumOverTasks(&phi_squared_mean);
-                FML::SumOverTasks(&phi_mean);
-                FML::SumOverTasks(&ncells);
-                assert_mpi(ncells == (long long int)(FML::power(Nmesh, N)),
-                           "[generate_nonlocal_gaussian_random_field_fourier] Number of cells we have summed over does "
-                           "not agree with how many cells are in the grid");
-                phi_squared_mean /= std::pow(Nmesh, N);
-                phi_mean /= std::pow(Nmesh, N);
-
-                if (FML::ThisTask == 0)
-                    std::cout << "[generate_nonlocal_gaussian_random_field_fourier] <Phi^2>: " << phi_squared_mean
-                              << " <Phi>: " << phi_mean << "\n";
-
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                // Subtract <phi^2>
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    for (auto && real_index : source.get_real_range(islice, islice + 1)) {
-                        auto phi2 = source.get_real_from_index(real_index);
-                        auto phi = phi_real.get_real_from_index(real_index);
-                        auto value =
-                            (phi - phi_mean) + FML::GRID::FloatType(kernel_values[0]) * (phi2 - phi_squared_mean);
-                        source.set_real_from_index(real_index, value);
-                    }
-                }
-
-                // Back to fourier space. We now have F[phi] + const * F[phi^2 - <phi^2>] in source
-                source.fftw_r2c();
-
-                // Set DC mode to zero
-                if (FML::ThisTask == 0)
-                    source.set_fourier_from_index(0, 0.0);
-
-                // If we only want standard local phi + fNL[phi^2 - <phi^2>] then we can return now
-                if (kernel_values[1] == 0.0 and kernel_values[2] == 0.0 and kernel_values[3] == 0.0) {
-                    phi_fourier = source;
-                    return;
-                }
+                // The number of fields phi * P^(-n/3) n = 1,2,3 we need to compute the non-zero kernel terms
+                // The term 3 needs Pm13, Pm23 and Pm33, term 2 needs Pm13 and Pm23 and term 1 needs Pm13
+                int nfields = 0;
+                for (int n = 1; n <= 3; n++)
+                    if (kernel_values[n] != 0.0)
+                        nfields = n;
 
                 // If we use GSL make a spline (std::function can be slow) otherwise this is just a copy
                 // of the function itself
                 auto Pofk_of_kBox_over_volume_spline =
                     phi_fourier.make_fourier_spline(Pofk_of_kBox_over_volume, "P(k)/V");
 
-                // Compute the kernel terms
-                FFTWGrid<N> phi_m13(Nmesh);
-                FFTWGrid<N> phi_m23(Nmesh);
-                FFTWGrid<N> phi_m33(Nmesh); // XXX Not needed when u=0
-                phi_m13.add_memory_label("FFTWGrid::generate_nonlocal_gaussian_random_field_fourier::phi_m13");
-                phi_m23.add_memory_label("FFTWGrid::generate_nonlocal_gaussian_random_field_fourier::phi_m23");
-                phi_m33.add_memory_label("FFTWGrid::generate_nonlocal_gaussian_random_field_fourier::phi_m33");
+                // Make phi * P^(-n/3) for the n we need in one sweep
+                std::array<FFTWGrid<N>, 3> phi_mn3;
+                for (int n = 0; n < nfields; n++) {
+                    phi_mn3[n] = FFTWGrid<N>(Nmesh);
+                    phi_mn3[n].add_memory_label("FFTWGrid::generate_nonlocal_gaussian_random_field_fourier::phi_m" +
+                                                std::to_string(n + 1) + "3");
+                    phi_mn3[n].set_grid_status_real(false);
+                }
+                if (nfields > 0) {
 #ifdef USE_OMP
 #pragma omp parallel for
 #endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    for (auto && fourier_index : phi_fourier.get_fourier_range(islice, islice + 1)) {
-                        phi_fourier.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
-
-                        FML::GRID::FloatType pofk_m13 = std::pow(Pofk_of_kBox_over_volume_spline(kmag), -1.0 / 3.0);
-                        FML::GRID::FloatType pofk_m23 = pofk_m13 * pofk_m13;
-                        FML::GRID::FloatType pofk_m33 = pofk_m23 * pofk_m13; // XXX Not needed when u=0
-
-                        auto phi = phi_fourier.get_fourier_from_index(fourier_index);
-                        auto value1 = phi * pofk_m13;
-                        auto value2 = phi * pofk_m23;
-                        auto value3 = phi * pofk_m33; // XXX Not needed when u=0
-
-                        phi_m13.set_fourier_from_index(fourier_index, value1);
-                        phi_m23.set_fourier_from_index(fourier_index, value2);
-                        phi_m33.set_fourier_from_index(fourier_index, value3); // XXX Not needed when u=0
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        [[maybe_unused]] double kmag;
+                        [[maybe_unused]] std::array<double, N> kvec;
+                        for (auto && fourier_index : phi_fourier.get_fourier_range(islice, islice + 1)) {
+                            if (Local_x_start == 0 and fourier_index == 0)
+                                continue; // DC mode (k=0)
+                            phi_fourier.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
+
+                            const FML::GRID::FloatType pofk_m13 =
+                                std::pow(Pofk_of_kBox_over_volume_spline(kmag), -1.0 / 3.0);
+                            auto value = phi_fourier.get_fourier_from_index(fourier_index);
+                            for (int n = 0; n < nfields; n++) {
+                                value *= pofk_m13;
+                                phi_mn3[n].set_fourier_from_index(fourier_index, value);
+                            }
+                        }
+                    }
+                    for (int n = 0; n < nfields; n++) {
+                        if (Local_x_start == 0)
+                            phi_mn3[n].set_fourier_from_index(0, 0.0);
+                        phi_mn3[n].fftw_c2r();
                     }
                 }
 
-                // Set DC mode to 0
-                if (FML::ThisTask == 0) {
-                    phi_m13.set_fourier_from_index(0, 0.0);
-                    phi_m23.set_fourier_from_index(0, 0.0);
-                    phi_m33.set_fourier_from_index(0, 0.0); // XXX Not needed when u=0
-                }
-                phi_m13.fftw_c2r();
-                phi_m23.fftw_c2r();
-                phi_m33.fftw_c2r(); // XXX Not needed when u=0
-
-                // We use the grids already allocated as temporary grids
-                // We must make sure we do things in the right order below
-                FFTWGrid<N> & temp1 = phi_m13;
-                FFTWGrid<N> & temp2 = phi_m23;
-                FFTWGrid<N> & temp3 = phi_m33;
+                // Get phi in real space. We don't need the gaussian phi(k) anymore so we do this in place
+                phi_fourier.fftw_c2r();
 
-                // Compute the square of some quantities in real space
+                // Compute all the source terms in real space in one sweep:
+                // phi -> phi + k0 (phi^2 - <phi^2>) and phi * Pm13, phi * Pm23 - Pm13^2, phi * Pm33 - Pm13 * Pm23
+                // We subtract the mean by setting the DC mode to zero below so <phi^2> is only computed for output
+                double phi_squared_mean = 0.0;
+                const FML::GRID::FloatType k0 = kernel_values[0];
 #ifdef USE_OMP
-#pragma omp parallel for
+#pragma omp parallel for reduction(+ : phi_squared_mean)
 #endif
                 for (int islice = 0; islice < Local_nx; islice++) {
-                    for (auto && real_index : temp1.get_real_range(islice, islice + 1)) {
-                        auto pm13 = phi_m13.get_real_from_index(real_index);
-                        auto pm23 = phi_m23.get_real_from_index(real_index);
-                        auto pm33 = phi_m33.get_real_from_index(real_index); // XXX Not needed when u=0
-                        auto phi = phi_real.get_real_from_index(real_index);
-
-                        auto value1 = phi * pm13;
-                        auto value2 = phi * pm23 - pm13 * pm13;
-                        auto value3 = phi * pm33 - pm13 * pm23; // XXX Not needed when u=0
-                        temp1.set_real_from_index(real_index, value1);
-                        temp2.set_real_from_index(real_index, value2);
-                        temp3.set_real_from_index(real_index, value3); // XXX Not needed when u=0
+                    std::array<FML::GRID::FloatType, 3> pmn3{};
+                    for (auto && real_index : phi_fourier.get_real_range(islice, islice + 1)) {
+                        auto phi = phi_fourier.get_real_from_index(real_index);
+                        phi_squared_mean += phi * phi;
+                        phi_fourier.set_real_from_index(real_index, phi + k0 * phi * phi);
+
+                        for (int n = 0; n < nfields; n++)
+                            pmn3[n] = phi_mn3[n].get_real_from_index(real_index);
+                        if (nfields > 0)
+                            phi_mn3[0].set_real_from_index(real_index, phi * pmn3[0]);
+                        if (nfields > 1)
+                            phi_mn3[1].set_real_from_index(real_index, phi * pmn3[1] - pmn3[0] * pmn3[0]);
+                        if (nfields > 2)
+                            phi_mn3[2].set_real_from_index(real_index, phi * pmn3[2] - pmn3[0] * pmn3[1]);
                     }
                 }
+                FML::SumOverTasks(&phi_squared_mean);
+                phi_squared_mean /= std::pow(Nmesh, N);
+                if (FML::ThisTask == 0)
+                    std::cout << "[generate_nonlocal_gaussian_random_field_fourier] <Phi^2>: " << phi_squared_mean
+                              << "\n";
 
-                // Transform these back to fourier space
-                temp1.fftw_r2c();
-                temp2.fftw_r2c();
-                temp3.fftw_r2c(); // XXX Not needed when u=0
-                if (FML::ThisTask == 0) {
-                    temp1.set_fourier_from_index(0, 0.0);
-                    temp2.set_fourier_from_index(0, 0.0);
-                    temp3.set_fourier_from_index(0, 0.0); // XXX Not needed when u=0
-                }
+                // Back to fourier space. We now have F[phi] + const * F[phi^2 - <phi^2>] in phi_fourier
+                phi_fourier.fftw_r2c();
+                if (Local_x_start == 0)
+                    phi_fourier.set_fourier_from_index(0, 0.0);
+
+                // If we only want standard local phi + fNL[phi^2 - <phi^2>] then we are done
+                if (nfields == 0)
+                    return;
+
+                for (int n = 0; n < nfields; n++)
+                    phi_mn3[n].fftw_r2c();
 
                 // Add up to get phi + fNL K(phi,phi) in fourier space
 #ifdef USE_OMP
@@ -278,66 +223,22 @@ namespace FML {
                 for (int islice = 0; islice < Local_nx; islice++) {
                     [[maybe_unused]] double kmag;
                     [[maybe_unused]] std::array<double, N> kvec;
-                    for (auto && fourier_index : source.get_fourier_range(islice, islice + 1)) {
-                        source.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
-
-                        FML::GRID::FloatType pofk_p13 = std::pow(Pofk_of_kBox_over_volume_spline(kmag), 1.0 / 3.0);
-                        FML::GRID::FloatType pofk_p23 = pofk_p13 * pofk_p13;
-                        FML::GRID::FloatType pofk_p33 = pofk_p23 * pofk_p13;
-
-                        auto term1 = temp1.get_fourier_from_index(fourier_index) * pofk_p13;
-                        auto term2 = temp2.get_fourier_from_index(fourier_index) * pofk_p23;
-                        auto term3 = temp3.get_fourier_from_index(fourier_index) * pofk_p33; // XXX Not needed when u=0
-
-                        auto s = source.get_fourier_from_index(fourier_index);
-                        s += term1 * FML::GRID::FloatType(kernel_values[1]) +
-                             term2 * FML::GRID::FloatType(kernel_values[2]) +
-                             term3 * FML::GRID::FloatType(kernel_values[3]);
-                        source.set_fourier_from_index(fourier_index, s);
-                    }
-                }
-
-                // Set DC mode to 0
-                if (FML::ThisTask == 0)
-                    source.set_fourier_from_index(0, 0.0);
-
-                // Copy over result
-                phi_fourier = source;
-
-                // Ensure that <phi> = 0
-                if (subtract_mean) {
-                    phi_fourier.fftw_c2r();
-
-                    double phi_mean = 0.0;
-#ifdef USE_OMP
-#pragma omp parallel for reduction(+ : phi_mean)
-#endif
-                    for (int islice = 0; islice < Local_nx; islice++) {
-                        for (auto && real_index : phi_fourier.get_real_range(islice, islice + 1)) {
-                            auto value = phi_fourier.get_real_from_index(real_index);
-                            phi_mean += value;
-                        }
-                    }
-                    FML::SumOverTasks(&phi_mean);
-                    phi_mean /= std::pow(Nmesh, N);
-
-                    if (FML::ThisTask == 0)
-                        std::cout << "Subtracting mean: " << phi_mean << "\n";
+                    for (auto && fourier_index : phi_fourier.get_fourier_range(islice, islice + 1)) {
+                        if (Local_x_start == 0 and fourier_index == 0)
+                            continue; // DC mode (k=0)
+                        phi_fourier.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
 
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                    for (int islice = 0; islice < Local_nx; islice++) {
-                        for (auto && real_index : phi_fourier.get_real_range(islice, islice + 1)) {
-                            auto phi = phi_fourier.get_real_from_index(real_index);
-                            phi_fourier.set_real_from_index(real_index, phi - phi_mean);
+                        const FML::GRID::FloatType pofk_p13 =
+                            std::pow(Pofk_of_kBox_over_volume_spline(kmag), 1.0 / 3.0);
+                        FML::GRID::FloatType pofk_pn3 = 1.0;
+                        auto s = phi_fourier.get_fourier_from_index(fourier_index);
+                        for (int n = 0; n < nfields; n++) {
+                            pofk_pn3 *= pofk_p13;
+                            s += phi_mn3[n].get_fourier_from_index(fourier_index) *
+                                 FML::GRID::FloatType(kernel_values[n + 1] * pofk_pn3);
                         }
+                        phi_fourier.set_fourier_from_index(fourier_index, s);
                     }
-                    phi_fourier.fftw_r2c();
-
-                    // Set DC mode to zero
-                    if (FML::ThisTask == 0)
-                        phi_fourier.set_fourier_from_index(0, 0.0);
                 }
             }
 
@@ -391,13 +292,21 @@ namespace FML {
 
                 const auto Local_nx = phi_fourier.get_local_nx();
 
+                // If we use GSL make a spline (std::function can be slow) otherwise this is just a copy
+                // of the function itself
+                auto Pofk_of_kBox_over_Pofk_primordal_spline =
+                    phi_fourier.make_fourier_spline(Pofk_of_kBox_over_Pofk_primordal, "P(k)/Pprimordial(k)");
+
                 // Transform to delta by multiplying by sqrt(P(k) / Pprimodial(k))
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
                 for (int islice = 0; islice < Local_nx; islice++) {
                     [[maybe_unused]] double kmag;
                     [[maybe_unused]] std::array<double, N> kvec;
                     for (auto && fourier_index : phi_fourier.get_fourier_range(islice, islice + 1)) {
                         phi_fourier.get_fourier_wavevector_and_norm_by_index(fourier_index, kvec, kmag);
-                        auto rescaling_factor = std::sqrt(Pofk_of_kBox_over_Pofk_primordal(kmag));
+                        auto rescaling_factor = std::sqrt(Pofk_of_kBox_over_Pofk_primordal_spline(kmag));
                         auto value = phi_fourier.get_fourier_from_index(fourier_index);
                         phi_fourier.set_fourier_from_index(fourier_index,
                                                            value * FML::GRID::FloatType(rescaling_factor));
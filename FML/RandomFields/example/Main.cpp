@@ -66,6 +66,40 @@ void generate_mean_over_realisations(int Nreal, int Nmesh, std::function<double(
                       << pofk_total.pofk[j] / (Powspec(pofk_total.kbin[j] * box) * std::pow(box, N)) << "\n";
 }
 
+//=========================================================================
+// Benchmark the time and memory it takes to generate the different types
+// of non-local non-gaussianity. The peak RSS can only grow so we do the types
+// in order of increasing memory use and report the peak after each one
+//=========================================================================
+template <int N>
+void benchmark_nonlocal_gaussian_random_field(int Nmesh, std::function<double(double)> Powspec) {
+    std::shared_ptr<FML::RANDOM::RandomGenerator> rng = std::make_shared<FML::RANDOM::RandomGenerator>();
+    const double fNL = 100.0;
+    const bool fix_amplitude = true;
+
+    FML::UTILS::Timings timer;
+    const double peak_rss_start = FML::get_system_memory_use().second;
+    const std::vector<std::pair<std::string, double>> types = {
+        {"gaussian", 0.0}, {"local", 0.0}, {"equilateral", 0.0}, {"orthogonal", 0.0}, {"orthogonal", 0.5}};
+    for (auto & type : types) {
+        const std::string label = type.first + " u = " + std::to_string(type.second);
+        FFTWGrid<N> grid(Nmesh);
+        timer.StartTiming(label);
+        FML::RANDOM::NONGAUSSIAN::generate_nonlocal_gaussian_random_field_fourier(
+            grid, rng.get(), Powspec, fix_amplitude, fNL, type.first, type.second);
+        const double time = timer.EndTiming(label);
+
+        // Memory used relative to the start and in units of the size of one grid
+        double memory = FML::get_system_memory_use().second - peak_rss_start;
+        FML::MaxOverTasks(&memory);
+        const double grid_bytes = double(grid.get_ntot_fourier_alloc()) * sizeof(FML::GRID::ComplexType);
+        if (FML::ThisTask == 0)
+            std::cout << "Benchmark Nmesh = " << Nmesh << " fNL type = " << std::setw(25) << label
+                      << " Time: " << std::setw(10) << time << " sec  Peak RSS: " << std::setw(10) << memory / 1e6
+                      << " MB (" << memory / grid_bytes << " grids)\n";
+    }
+}
+
 int main() {
 
     //=========================================================================
@@ -116,6 +150,10 @@ int main() {
     // generate_mean_over_realisations<Ndim>(100, Nmesh, Powspec);
     // exit(1);
 
+    // Benchmark time and memory for the different types of fNL
+    // benchmark_nonlocal_gaussian_random_field<Ndim>(512, Powspec);
+    // exit(1);
+
     //=========================================================================
     // Generate nreal realisation
     //=========================================================================
@@ -1,12 +1,16 @@
 #ifndef RANDOMGENERATOR_HEADER
 #define RANDOMGENERATOR_HEADER
 
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <memory>
 #include <numeric>
 #include <random>
+#include <typeinfo>
 #include <vector>
 #ifdef USE_GSL
 #include <gsl/gsl_randist.h>
@@ -32,6 +36,9 @@ namespace FML {
         /// This is a class for having a unified interface for random numbers in the library.
         /// If you want to use a different RNG other than c++ random (fiducial: mt19937) or GSL then make a class
         /// that inherits from this class and implement the 3-4 methods it has.
+        /// When many numbers are needed use fill_uniform / fill_normal: this gives the same numbers as calling
+        /// generate_uniform / generate_normal repeatedly, but with one virtual call per block instead of per number.
+        /// Override these as well if the generator can do better than one number at a time.
         class RandomGenerator {
           protected:
             std::vector<unsigned int> Seed;
@@ -53,7 +60,10 @@ namespace FML {
             RandomGenerator(std::vector<unsigned int> seed) : RandomGenerator() { set_seed(seed); }
 
             /// Set the standard deviation sigma used when generating a normal distributed random number
-            void set_normal_sigma(double sigma) { normal_dist = std::normal_distribution<double>{0.0, sigma}; }
+            void set_normal_sigma(double _sigma) {
+                sigma = _sigma;
+                normal_dist = std::normal_distribution<double>{0.0, sigma};
+            }
 
             /// Make a clone of the state of the random number generator
             virtual std::unique_ptr<RandomGenerator> clone() const { return std::make_unique<RandomGenerator>(*this); }
@@ -74,6 +84,288 @@ namespace FML {
 
             /// Generate a random number with a normal distribution N(0,sigma) where sigma by default is 1.
             virtual double generate_normal() { return normal_dist(generator); }
+
+            /// Fill out[0..n) with random numbers uniformly distributed in [0,1)
+            virtual void fill_uniform(double * out, size_t n) {
+                // Skip the virtual call per number if generate_uniform is ours (i.e. not a subclass)
+                if (typeid(*this) == typeid(RandomGenerator)) {
+                    for (size_t i = 0; i < n; i++)
+                        out[i] = uniform_dist(generator);
+                    return;
+                }
+                for (size_t i = 0; i < n; i++)
+                    out[i] = this->generate_uniform();
+            }
+
+            /// Fill out[0..n) with random numbers with a normal distribution N(0,sigma)
+            virtual void fill_normal(double * out, size_t n) {
+                if (typeid(*this) == typeid(RandomGenerator)) {
+                    for (size_t i = 0; i < n; i++)
+                        out[i] = normal_dist(generator);
+                    return;
+                }
+                for (size_t i = 0; i < n; i++)
+                    out[i] = this->generate_normal();
+            }
+
+            /// Fill a vector with random numbers uniformly distributed in [0,1)
+            void fill_uniform(std::vector<double> & out) { fill_uniform(out.data(), out.size()); }
+
+            /// Fill a vector with random numbers with a normal distribution N(0,sigma)
+            void fill_normal(std::vector<double> & out) { fill_normal(out.data(), out.size()); }
+        };
+
+        //=======================================================================
+        //=======================================================================
+
+        /// Counter-based random number generator (Philox4x32-10, Salmon et al. 2011).
+        ///
+        /// The random numbers are a pure function of (seed, index, stream) so they can be generated in any order, by
+        /// any number of threads and tasks, and only for the indices that are needed. This is what we use to
+        /// make random fields that are independent of the domain decomposition (see GaussianRandomField.h).
+        ///
+        /// Every index gives us 2 uniform doubles (53 bits of randomness each) or, with Box-Muller, 2 normal
+        /// distributed numbers. The stream number is used to make independent sequences for different purposes
+        /// with the same seed.
+        ///
+        /// It can also be used as a normal sequential RandomGenerator. In that case we simply increase the index
+        /// every time we have used up the two numbers it gives.
+        ///
+        /// The block methods generate block_size consecutive counters at a time with the rounds written lane
+        /// by lane (structure of arrays) so that the compiler can vectorize them. We use Box-Muller and not
+        /// a rejection method (Ziggurat) for the normal numbers as every index must use a fixed number of draws.
+        class PhiloxRandomGenerator : public RandomGenerator {
+          public:
+            using counter_type = std::array<uint32_t, 4>;
+            using key_type = std::array<uint32_t, 2>;
+
+            /// The stream used when calling generate_uniform and generate_normal
+            static const uint32_t sequential_stream = 0xFFFFFFFF;
+
+            /// Number of counters we generate at once in the block methods
+            static const int block_size = 32;
+
+          private:
+            key_type key{0, 0};
+
+            // For the sequential interface
+            uint64_t sequential_index{0};
+            std::array<double, 2> uniform_buffer{};
+            std::array<double, 2> normal_buffer{};
+            int n_uniform_buffer{0};
+            int n_normal_buffer{0};
+
+            // Philox4x32 constants
+            static const uint32_t PHILOX_M0 = 0xD2511F53;
+            static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+            static const uint32_t PHILOX_W0 = 0x9E3779B9;
+            static const uint32_t PHILOX_W1 = 0xBB67AE85;
+
+            void set_seed_philox(uint64_t seed) {
+                Seed = std::vector<unsigned int>(1, (unsigned int)(seed));
+                key = {uint32_t(seed), uint32_t(seed >> 32)};
+                sequential_index = 0;
+                n_uniform_buffer = 0;
+                n_normal_buffer = 0;
+            }
+
+            // The uniform pairs (u0[l], u1[l]) = uniform_pair(index + l, stream) for l = 0, ..., block_size-1
+            void uniform_pairs_block(uint64_t index, uint32_t stream, double * u0, double * u1) const {
+                uint32_t c0[block_size], c1[block_size], c2[block_size], c3[block_size];
+                for (int l = 0; l < block_size; l++) {
+                    c0[l] = uint32_t(index + l);
+                    c1[l] = uint32_t((index + l) >> 32);
+                    c2[l] = stream;
+                    c3[l] = 0;
+                }
+                uint32_t k0 = key[0], k1 = key[1];
+                for (int round = 0; round < 10; round++) {
+                    for (int l = 0; l < block_size; l++) {
+                        const uint64_t prod0 = uint64_t(PHILOX_M0) * c0[l];
+                        const uint64_t prod1 = uint64_t(PHILOX_M1) * c2[l];
+                        c0[l] = uint32_t(prod1 >> 32) ^ c1[l] ^ k0;
+                        c1[l] = uint32_t(prod1);
+                        c2[l] = uint32_t(prod0 >> 32) ^ c3[l] ^ k1;
+                        c3[l] = uint32_t(prod0);
+                    }
+                    k0 += PHILOX_W0;
+                    k1 += PHILOX_W1;
+                }
+                const double twopowm53 = 1.0 / 9007199254740992.0;
+                for (int l = 0; l < block_size; l++) {
+                    const uint64_t a = (uint64_t(c0[l]) << 32 | c1[l]) >> 11;
+                    const uint64_t b = (uint64_t(c2[l]) << 32 | c3[l]) >> 11;
+                    u0[l] = (double(a) + 0.5) * twopowm53;
+                    u1[l] = (double(b) + 0.5) * twopowm53;
+                }
+            }
+
+            // The normal pairs (g0[l], g1[l]) = normal_pair(index + l, stream) for l = 0, ..., block_size-1
+            void normal_pairs_block(uint64_t index, uint32_t stream, double * g0, double * g1) const {
+                double u0[block_size], u1[block_size];
+                uniform_pairs_block(index, stream, u0, u1);
+                for (int l = 0; l < block_size; l++) {
+                    const double r = std::sqrt(-2.0 * std::log(u0[l]));
+                    const double theta = 2.0 * M_PI * u1[l];
+                    g0[l] = r * std::cos(theta);
+                    g1[l] = r * std::sin(theta);
+                }
+            }
+
+            // The pairs for the counters index, ..., index + block_size - 1
+            template <bool normal>
+            void pairs_block(uint64_t index, uint32_t stream, double * p0, double * p1) const {
+                if constexpr (normal)
+                    normal_pairs_block(index, stream, p0, p1);
+                else
+                    uniform_pairs_block(index, stream, p0, p1);
+            }
+
+            // Draws [first_draw, first_draw + n) where draw d is component d % 2 of the pair with index d / 2
+            template <bool normal>
+            void fill_draws(uint64_t first_draw, double * out, size_t n, uint32_t stream) const {
+                double p0[block_size], p1[block_size];
+                size_t i = 0;
+
+                // An odd first draw is the second number of a pair
+                if (n > 0 and first_draw % 2 == 1) {
+                    pairs_block<normal>(first_draw / 2, stream, p0, p1);
+                    out[i++] = p1[0];
+                }
+
+                // Whole blocks
+                uint64_t index = (first_draw + i) / 2;
+                for (; i + 2 * block_size <= n; i += 2 * block_size, index += block_size) {
+                    pairs_block<normal>(index, stream, p0, p1);
+                    for (int l = 0; l < block_size; l++) {
+                        out[i + 2 * l] = p0[l];
+                        out[i + 2 * l + 1] = p1[l];
+                    }
+                }
+
+                // What is left
+                if (i < n) {
+                    pairs_block<normal>(index, stream, p0, p1);
+                    for (int l = 0; i < n; l++) {
+                        out[i++] = p0[l];
+                        if (i < n)
+                            out[i++] = p1[l];
+                    }
+                }
+            }
+
+            // The same numbers as n calls to generate_uniform (or generate_normal)
+            template <bool normal>
+            void fill_sequential(double * out, size_t n) {
+                auto & buffer = normal ? normal_buffer : uniform_buffer;
+                auto & nbuffer = normal ? n_normal_buffer : n_uniform_buffer;
+                const double scale = normal ? sigma : 1.0;
+
+                // Use up what is left from the last pair
+                size_t i = 0;
+                while (i < n and nbuffer > 0)
+                    out[i++] = scale * buffer[--nbuffer];
+
+                // The sequential interface gives the second number of a pair first
+                double p0[block_size], p1[block_size];
+                while (i < n) {
+                    pairs_block<normal>(sequential_index, sequential_stream, p0, p1);
+                    for (int l = 0; l < block_size and i < n; l++) {
+                        sequential_index++;
+                        out[i++] = scale * p1[l];
+                        if (i < n) {
+                            out[i++] = scale * p0[l];
+                        } else {
+                            buffer = {p0[l], p1[l]};
+                            nbuffer = 1;
+                        }
+                    }
+                }
+            }
+
+          public:
+            PhiloxRandomGenerator() : RandomGenerator() { name = "philox4x32_10"; }
+
+            PhiloxRandomGenerator(uint64_t seed) : PhiloxRandomGenerator() { set_seed_philox(seed); }
+
+            virtual std::unique_ptr<RandomGenerator> clone() const override {
+                return std::make_unique<PhiloxRandomGenerator>(*this);
+            }
+
+            virtual void set_seed(unsigned int seed) override { set_seed_philox(seed); }
+
+            virtual void set_seed(std::vector<unsigned int> seed) override {
+                assert(seed.size() > 0);
+                set_seed_philox(seed.size() > 1 ? (uint64_t(seed[1]) << 32) | seed[0] : uint64_t(seed[0]));
+            }
+
+            /// The raw Philox4x32-10 bijection
+            static counter_type philox4x32(counter_type ctr, key_type k) {
+                for (int round = 0; round < 10; round++) {
+                    const uint64_t prod0 = uint64_t(PHILOX_M0) * ctr[0];
+                    const uint64_t prod1 = uint64_t(PHILOX_M1) * ctr[2];
+                    ctr = {uint32_t(prod1 >> 32) ^ ctr[1] ^ k[0],
+                           uint32_t(prod1),
+                           uint32_t(prod0 >> 32) ^ ctr[3] ^ k[1],
+                           uint32_t(prod0)};
+                    k[0] += PHILOX_W0;
+                    k[1] += PHILOX_W1;
+                }
+                return ctr;
+            }
+
+            /// Two uniform random numbers in (0,1) that only depend on (seed, index, stream)
+            std::array<double, 2> uniform_pair(uint64_t index, uint32_t stream = 0) const {
+                const counter_type ctr{uint32_t(index), uint32_t(index >> 32), stream, 0};
+                const counter_type r = philox4x32(ctr, key);
+                const double twopowm53 = 1.0 / 9007199254740992.0;
+                const uint64_t a = (uint64_t(r[0]) << 32 | r[1]) >> 11;
+                const uint64_t b = (uint64_t(r[2]) << 32 | r[3]) >> 11;
+                return {(double(a) + 0.5) * twopowm53, (double(b) + 0.5) * twopowm53};
+            }
+
+            /// Two N(0,1) random numbers that only depend on (seed, index, stream) (Box-Muller)
+            std::array<double, 2> normal_pair(uint64_t index, uint32_t stream = 0) const {
+                const auto u = uniform_pair(index, stream);
+                const double r = std::sqrt(-2.0 * std::log(u[0]));
+                const double theta = 2.0 * M_PI * u[1];
+                return {r * std::cos(theta), r * std::sin(theta)};
+            }
+
+            /// Fill out[0..n) with uniform random numbers. Number i is draw number first_draw + i where draw d
+            /// is component d % 2 of uniform_pair(d / 2, stream), so any sub-range of draws can be made on its own
+            void fill_uniform(uint64_t first_draw, double * out, size_t n, uint32_t stream = 0) const {
+                fill_draws<false>(first_draw, out, n, stream);
+            }
+
+            /// Fill out[0..n) with N(0,1) random numbers. Same indexing as for fill_uniform
+            void fill_normal(uint64_t first_draw, double * out, size_t n, uint32_t stream = 0) const {
+                fill_draws<true>(first_draw, out, n, stream);
+            }
+
+            // The sequential block methods of RandomGenerator
+            using RandomGenerator::fill_normal;
+            using RandomGenerator::fill_uniform;
+
+            virtual void fill_uniform(double * out, size_t n) override { fill_sequential<false>(out, n); }
+
+            virtual void fill_normal(double * out, size_t n) override { fill_sequential<true>(out, n); }
+
+            virtual double generate_uniform() override {
+                if (n_uniform_buffer == 0) {
+                    uniform_buffer = uniform_pair(sequential_index++, sequential_stream);
+                    n_uniform_buffer = 2;
+                }
+                return uniform_buffer[--n_uniform_buffer];
+            }
+
+            virtual double generate_normal() override {
+                if (n_normal_buffer == 0) {
+                    normal_buffer = normal_pair(sequential_index++, sequential_stream);
+                    n_normal_buffer = 2;
+                }
+                return sigma * normal_buffer[--n_normal_buffer];
+            }
         };
 
         //=======================================================================
@@ -136,6 +428,18 @@ namespace FML {
             virtual double generate_uniform() override { return gsl_rng_uniform(rng.get()); }
 
             virtual double generate_normal() override { return gsl_ran_gaussian(rng.get(), sigma); }
+
+            virtual void fill_uniform(double * out, size_t n) override {
+                gsl_rng * r = rng.get();
+                for (size_t i = 0; i < n; i++)
+                    out[i] = gsl_rng_uniform(r);
+            }
+
+            virtual void fill_normal(double * out, size_t n) override {
+                gsl_rng * r = rng.get();
+                for (size_t i = 0; i < n; i++)
+                    out[i] = gsl_ran_gaussian(r, sigma);
+            }
         };
 
 #endif
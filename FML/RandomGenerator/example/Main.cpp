@@ -1,4 +1,6 @@
 #include <FML/RandomGenerator/RandomGenerator.h>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <memory>
 
@@ -32,6 +34,60 @@ int main() {
     }
     std::cout << "\n";
     
+    //=========================================
+    // Counter-based generator: the numbers are
+    // a function of (seed, index) so any range
+    // can be generated on its own
+    //=========================================
+    FML::RANDOM::PhiloxRandomGenerator philox(seed);
+    std::vector<double> block(10), subblock(4);
+    philox.fill_normal(0, block.data(), block.size());
+    philox.fill_normal(3, subblock.data(), subblock.size());
+    for(size_t i = 0; i < subblock.size(); i++){
+      std::cout << block[i + 3] << " " << subblock[i] << "\n";
+      assert( block[i + 3] == subblock[i] );
+    }
+    std::cout << "\n";
+
+    //=========================================
+    // Block generation: fill_uniform / fill_normal
+    // give the same numbers as calling generate_*
+    // repeatedly, but with one virtual call per block
+    //=========================================
+    std::shared_ptr<FML::RANDOM::RandomGenerator> rng = std::make_shared<FML::RANDOM::PhiloxRandomGenerator>(seed);
+    auto rngclone = rng->clone();
+    std::vector<double> u(7), g(13);
+    rng->fill_uniform(u);
+    rng->fill_normal(g);
+    for(auto & num : u)
+      assert( num == rngclone->generate_uniform() );
+    for(auto & num : g)
+      assert( num == rngclone->generate_normal() );
+
+    // Check the statistics of a large block: mean, variance and
+    // the Kolmogorov-Smirnov distance to the normal CDF
+    const size_t nsample = 1000000;
+    std::vector<double> sample(nsample);
+    rng->fill_normal(sample);
+    double mean = 0.0, var = 0.0;
+    for(auto & x : sample){
+      mean += x;
+      var += x * x;
+    }
+    mean /= nsample;
+    var = var / nsample - mean * mean;
+    std::sort(sample.begin(), sample.end());
+    double ks = 0.0;
+    for(size_t i = 0; i < nsample; i++){
+      const double cdf = 0.5 * std::erfc(-sample[i] / std::sqrt(2.0));
+      ks = std::max(ks, std::max(std::fabs(cdf - double(i) / nsample), std::fabs(cdf - double(i + 1) / nsample)));
+    }
+    std::cout << "Normal block: mean " << mean << " variance " << var << " KS distance " << ks << "\n";
+    assert( std::fabs(mean) < 5.0 / std::sqrt(double(nsample)) );
+    assert( std::fabs(var - 1.0) < 10.0 / std::sqrt(double(nsample)) );
+    assert( ks * std::sqrt(double(nsample)) < 2.0 );
+    std::cout << "\n";
+
 #ifdef USE_GSL
     // If you want to use GSL
     std::shared_ptr<FML::RANDOM::RandomGenerator> r1 = std::make_shared<FML::RANDOM::GSLRandomGenerator>(seed);
@@ -10,7 +10,9 @@
 #endif
 
 #include <FML/FFTWGrid/FFTWGrid.h>
+#include <FML/FFTWGrid/OutOfCoreGrid.h>
 #include <FML/Global/Global.h>
+#include <FML/Global/ThreadHistogram.h>
 
 namespace FML {
     namespace GRID {
@@ -42,19 +44,17 @@ namespace FML {
         }
 
         //===================================================================================
-        /// Low-pass filters (tophat, gaussian, sharpk)
+        /// The low-pass filters (tophat, gaussian, sharpk) as function of \f$ k^2 \f$
         ///
         /// @tparam N The dimension of the grid
         ///
-        /// @param[out] fourier_grid The fourier grid we do the smoothing of
         /// @param[in] smoothing_scale The smoothing radius of the filter (in units of the boxsize)
         /// @param[in] smoothing_method The smoothing filter (tophat, gaussian, sharpk)
         ///
         //===================================================================================
         template <int N>
-        void smoothing_filter_fourier_space(FFTWGrid<N> & fourier_grid,
-                                            double smoothing_scale,
-                                            std::string smoothing_method) {
+        std::function<double(double)> get_smoothing_filter_fourier_space(double smoothing_scale,
+                                                                          std::string smoothing_method) {
 
             // Sharp cut off kR = 1
             std::function<double(double)> filter_sharpk = [=](double k2) -> double {
@@ -85,37 +85,69 @@ namespace FML {
             };
 
             // Select the filter
-            std::function<double(double)> filter;
-            if (smoothing_method == "sharpk") {
-                filter = filter_sharpk;
-            } else if (smoothing_method == "gaussian") {
-                filter = filter_gaussian;
-            } else if (smoothing_method == "tophat") {
+            if (smoothing_method == "sharpk")
+                return filter_sharpk;
+            if (smoothing_method == "gaussian")
+                return filter_gaussian;
+            if (smoothing_method == "tophat") {
                 assert_mpi(N == 2 or N == 3,
                            "[smoothing_filter_fourier_space] Tophat filter only implemented in 2D and 3D");
-                if (N == 2)
-                    filter = filter_tophat_2D;
-                if (N == 3)
-                    filter = filter_tophat_3D;
-            } else {
-                throw std::runtime_error("Unknown filter " + smoothing_method + " Options: sharpk, gaussian, tophat");
+                return N == 2 ? filter_tophat_2D : filter_tophat_3D;
             }
+            throw std::runtime_error("Unknown filter " + smoothing_method + " Options: sharpk, gaussian, tophat");
+        }
+
+        //===================================================================================
+        /// Low-pass filters (tophat, gaussian, sharpk)
+        ///
+        /// @tparam N The dimension of the grid
+        ///
+        /// @param[out] fourier_grid The fourier grid we do the smoothing of
+        /// @param[in] smoothing_scale The smoothing radius of the filter (in units of the boxsize)
+        /// @param[in] smoothing_method The smoothing filter (tophat, gaussian, sharpk)
+        ///
+        //===================================================================================
+        template <int N>
+        void smoothing_filter_fourier_space(FFTWGrid<N> & fourier_grid,
+                                            double smoothing_scale,
+                                            std::string smoothing_method) {
+
+            std::function<double(double)> filter =
+                get_smoothing_filter_fourier_space<N>(smoothing_scale, smoothing_method);
 
             // Do the smoothing
-            auto Local_nx = fourier_grid.get_local_nx();
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-            for (int islice = 0; islice < Local_nx; islice++) {
-                [[maybe_unused]] double kmag2;
-                [[maybe_unused]] std::array<double, N> kvec;
-                for (auto && fourier_index : fourier_grid.get_fourier_range(islice, islice + 1)) {
-                    fourier_grid.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
+            fourier_grid.for_each_fourier(
+                [&](IndexIntType fourier_index, [[maybe_unused]] const std::array<double, N> & kvec, double kmag2) {
                     auto value = fourier_grid.get_fourier_from_index(fourier_index);
                     value *= filter(kmag2);
                     fourier_grid.set_fourier_from_index(fourier_index, value);
-                }
-            }
+                });
+        }
+
+        //===================================================================================
+        /// Low-pass filters (tophat, gaussian, sharpk) of an out-of-core grid. The grid is
+        /// streamed from disk and the filtered slabs are written back.
+        ///
+        /// @tparam N The dimension of the grid
+        ///
+        /// @param[out] fourier_grid The fourier grid we do the smoothing of
+        /// @param[in] smoothing_scale The smoothing radius of the filter (in units of the boxsize)
+        /// @param[in] smoothing_method The smoothing filter (tophat, gaussian, sharpk)
+        ///
+        //===================================================================================
+        template <int N>
+        void smoothing_filter_fourier_space(OutOfCoreGrid<N> & fourier_grid,
+                                            double smoothing_scale,
+                                            std::string smoothing_method) {
+
+            std::function<double(double)> filter =
+                get_smoothing_filter_fourier_space<N>(smoothing_scale, smoothing_method);
+
+            fourier_grid.for_each_fourier(
+                [&](ComplexType & value, [[maybe_unused]] const std::array<double, N> & kvec, double kmag2, int) {
+                    value *= filter(kmag2);
+                },
+                true);
         }
 
         //===================================================================================
@@ -271,7 +303,8 @@ namespace FML {
             }
 
             // For binning over threads
-            std::vector<std::vector<double>> pdfthreads(FML::NThreads, std::vector<double>(nbins, 0.0));
+            ThreadHistogram<1> pdfthreads(nbins);
+            const double inv_dx = nbins / (grid_max - grid_min);
 
 #ifdef USE_OMP
 #pragma omp parallel for
@@ -283,23 +316,12 @@ namespace FML {
 #endif
                 for (auto && real_index : real_grid.get_real_range(islice, islice + 1)) {
                     auto value = real_grid.get_real_from_index(real_index);
-                    int ibin = int((value - grid_min) / (grid_max - grid_min) * nbins);
-                    if (ibin >= 0 and ibin < nbins)
-                        pdfthreads[id][ibin] += 1;
-                }
-            }
-
-            // Sum up over threads
-            for (int i = 0; i < FML::NThreads; i++) {
-                for (int j = 0; j < nbins; j++) {
-                    pdf[j] += pdfthreads[i][j];
+                    pdfthreads.add(id, get_bin_index_linear(value, grid_min, inv_dx, 0.0, nbins), 1.0);
                 }
             }
 
-            // Sum over tasks
-#ifdef USE_MPI
-            MPI_Allreduce(MPI_IN_PLACE, pdf.data(), nbins, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-#endif
+            // Sum up over threads and tasks
+            pdfthreads.reduce({pdf.data()});
 
             // Normalize so that the PDF integrates to unity
             const double dx = (grid_max - grid_min) / double(nbins);
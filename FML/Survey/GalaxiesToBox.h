@@ -1,6 +1,8 @@
 #ifndef GALAXIES_TO_BOX_HEADER
 #define GALAXIES_TO_BOX_HEADER
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <functional>
 #include <iostream>
@@ -14,11 +16,10 @@
 #include <mpi.h>
 #endif
 
-// We need these for the r(z) spline
+// We need the ODE solver for the r(z) table
 #include <FML/Global/Global.h>
 #include <FML/ODESolver/ODESolver.h>
 #include <FML/ParticleTypes/ReflectOnParticleMethods.h>
-#include <FML/Spline/Spline.h>
 
 //==============================================================================
 //
@@ -48,7 +49,13 @@
 //
 // The boxsize contains the maximum distance over all the coordinates in Mpc/h
 //
-// OpenMP parallelized and safe to run with MPI
+// The comoving distance r(z) is tabulated once on a uniform grid in z (ComovingDistanceTable)
+// so the lookup per galaxy is O(1). The conversion is done in blocks of contiguous arrays
+// so that the compiler can vectorize it (including the trig functions if a vector math
+// library is availiable, e.g. glibc's libmvec with -O3 -ffast-math)
+//
+// OpenMP parallelized and safe to run with MPI: each task converts its own rows of the catalog
+// and the shift and boxsize are the same on all tasks
 //
 //==============================================================================
 
@@ -58,12 +65,117 @@ namespace FML {
     /// equitorial to cartesian coordinates.
     namespace SURVEY {
 
+        //==============================================================================
+        /// The comoving distance r(z) tabulated on a uniform grid in z. We store r and dr/dz = 1/(H/c)
+        /// at the nodes and evaluate with a cubic Hermite interpolation, i.e. O(1) per lookup
+        /// with an error O(dz^4). Valid for 0 <= z <= z_max.
+        //==============================================================================
+        class ComovingDistanceTable {
+          private:
+            double z_max{0.0};
+            double dz{1.0};
+            double inv_dz{1.0};
+            std::vector<double> r_of_z{};
+            std::vector<double> drdz_of_z{};
+
+          public:
+            ComovingDistanceTable() = default;
+            ComovingDistanceTable(std::function<double(double)> & hubble_over_c_of_z, double z_max, int nz = 10000) {
+                create(hubble_over_c_of_z, z_max, nz);
+            }
+
+            /// Tabulate r(z) from 0 to z_max using nz points
+            void create(std::function<double(double)> & hubble_over_c_of_z, double _z_max, int nz = 10000) {
+                assert_mpi(nz >= 2, "[ComovingDistanceTable::create] Need at least 2 points\n");
+                z_max = _z_max > 0.0 ? _z_max : 1.0;
+                dz = z_max / double(nz - 1);
+                inv_dz = 1.0 / dz;
+
+                std::vector<double> z_arr(nz);
+                for (int i = 0; i < nz; i++)
+                    z_arr[i] = i * dz;
+
+                // Solve the ODE for the co-moving distance
+                using ODESolver = FML::SOLVERS::ODESOLVER::ODESolver;
+                using ODEFunction = FML::SOLVERS::ODESOLVER::ODEFunction;
+                using DVector = FML::SOLVERS::ODESOLVER::DVector;
+                ODEFunction deriv = [&](double z, [[maybe_unused]] const double * y, double * dydx) {
+                    dydx[0] = 1.0 / hubble_over_c_of_z(z);
+                    return GSL_SUCCESS;
+                };
+                DVector r_ini{0.0};
+                ODESolver r_ode(1e-3, 1e-10, 1e-10);
+                r_ode.solve(deriv, z_arr, r_ini);
+                r_of_z = r_ode.get_data_by_component(0);
+
+                drdz_of_z.resize(nz);
+                for (int i = 0; i < nz; i++)
+                    drdz_of_z[i] = 1.0 / hubble_over_c_of_z(z_arr[i]);
+            }
+
+            /// The comoving distance at redshift z
+            double operator()(double z) const {
+                const int nz = int(r_of_z.size());
+                double x = std::max(z, 0.0) * inv_dz;
+                int i = std::min(int(x), nz - 2);
+                const double t = x - i;
+                const double t2 = t * t;
+                const double t3 = t2 * t;
+                return (2.0 * t3 - 3.0 * t2 + 1.0) * r_of_z[i] + (t3 - 2.0 * t2 + t) * dz * drdz_of_z[i] +
+                       (-2.0 * t3 + 3.0 * t2) * r_of_z[i + 1] + (t3 - t2) * dz * drdz_of_z[i + 1];
+            }
+
+            double get_z_max() const { return z_max; }
+        };
+
+        //==============================================================================
+        /// The maximum redshift of a set of galaxies over all tasks
+        //==============================================================================
+        template <class T>
+        double get_max_redshift(const T * galaxies_ra_dec_z, size_t ngalaxies) {
+            double z_max = 0.0;
+#ifdef USE_OMP
+#pragma omp parallel for reduction(max : z_max)
+#endif
+            for (size_t i = 0; i < ngalaxies; i++) {
+                const double z = FML::PARTICLE::GetRedshift(galaxies_ra_dec_z[i]);
+                z_max = std::max(z, z_max);
+            }
+            FML::MaxOverTasks(&z_max);
+            return z_max;
+        }
+
+        //==============================================================================
+        /// Convert n points with (RA, DEC) in degrees and comoving distance r to cartesian
+        /// coordinates. The arrays are contiguous so the loop vectorizes.
+        //==============================================================================
+        inline void equitorial_to_cartesian_batch(const double * RA,
+                                                  const double * DEC,
+                                                  const double * r,
+                                                  size_t n,
+                                                  double * x,
+                                                  double * y,
+                                                  double * z) {
+            const double degrees_to_radial = 2.0 * M_PI / 360.0;
+#ifdef USE_OMP
+#pragma omp simd
+#endif
+            for (size_t i = 0; i < n; i++) {
+                const double ra = RA[i] * degrees_to_radial;
+                const double dec = DEC[i] * degrees_to_radial;
+                const double rcosdec = r[i] * std::cos(dec);
+                x[i] = rcosdec * std::cos(ra);
+                y[i] = rcosdec * std::sin(ra);
+                z[i] = r[i] * std::sin(dec);
+            }
+        }
+
         //==============================================================================
         /// Take a set of galaxies galaxies_ra_dec_z with (RA,DEC,z) and convert them to
         /// cartesian coordinates (x,y,z) stored in particles_xyz
         ///
-        /// The positions will be in the same units as the 1.0/hubble_over_c_of_z
-        /// Gives back the min/max of the positions (useful for boxing the catalog)
+        /// The positions will be in the same units as r_of_z
+        /// Gives back the min/max of the positions over all tasks (useful for boxing the catalog)
         ///
         /// @tparam T Particle class for the galaxies
         /// @tparam U Particle class for the particles we make from the galaxies
@@ -71,19 +183,17 @@ namespace FML {
         /// @param[in] galaxies_ra_dec_z Particles with RA, DEC and Z.
         /// @param[in] ngalaxies Number of galaxies
         /// @param[out] particles_xyz Vector with galaxies as particles with cartesian coordinates.
-        /// @param[in] hubble_over_c_of_z This is the function \f$ H(z)/c \f$ used to compute the redshift-comobing
-        /// distance relationship. Postions units is the same as those of \f$ c/H(z) \f$ (so e.g. if you want Mpc/h then
-        /// we need H0 = 100, if you want kpc/s then use H0 = 10^5 and so on.
+        /// @param[in] r_of_z The comoving distance table. Must cover the redshifts of the galaxies.
         /// @param[out] min_max_x The min/max values of x-postions
         /// @param[out] min_max_y The min/max values of x-postions
         /// @param[out] min_max_z The min/max values of x-postions
         ///
         //==============================================================================
         template <class T, class U>
-        void EquitorialToCartesianCoordinates(T * galaxies_ra_dec_z,
+        void EquitorialToCartesianCoordinates(const T * galaxies_ra_dec_z,
                                               size_t ngalaxies,
                                               std::vector<U> & particles_xyz,
-                                              std::function<double(double)> & hubble_over_c_of_z,
+                                              const ComovingDistanceTable & r_of_z,
                                               std::pair<double, double> & min_max_x,
                                               std::pair<double, double> & min_max_y,
                                               std::pair<double, double> & min_max_z) {
@@ -93,41 +203,6 @@ namespace FML {
             static_assert(FML::PARTICLE::has_get_DEC<T>());
             static_assert(FML::PARTICLE::has_get_z<T>());
 
-            // Find maximum redshift
-            double z_max = 0.0;
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-            for (size_t i = 0; i < ngalaxies; i++) {
-                const double z = FML::PARTICLE::GetRedshift(galaxies_ra_dec_z[i]);
-                z_max = std::max(z, z_max);
-            }
-
-            // Make a z-array
-            const int nz = 10000;
-            std::vector<double> z_arr(nz);
-            std::vector<double> r_arr(nz);
-            for (int i = 0; i < nz; i++) {
-                z_arr[i] = 1.1 * z_max * i / double(nz - 1);
-            }
-
-            // Solve the ODE for the co-moving distance
-            using ODESolver = FML::SOLVERS::ODESOLVER::ODESolver;
-            using ODEFunction = FML::SOLVERS::ODESOLVER::ODEFunction;
-            using DVector = FML::SOLVERS::ODESOLVER::DVector;
-            ODEFunction deriv = [&](double z, [[maybe_unused]] const double * y, double * dydx) {
-                dydx[0] = 1.0 / hubble_over_c_of_z(z);
-                return GSL_SUCCESS;
-            };
-
-            DVector r_ini{0.0};
-            ODESolver r_ode(1e-3, 1e-10, 1e-10);
-            r_ode.solve(deriv, z_arr, r_ini);
-            r_arr = r_ode.get_data_by_component(0);
-
-            // Make a spline of r(z)
-            FML::INTERPOLATION::SPLINE::Spline r_of_z_spline(z_arr, r_arr, "r_of_z_spline");
-
             // Fetch ndim from particles and check that we have the right dimensions
             U utemp;
             assert_mpi(FML::PARTICLE::GetNDIM(utemp) == 3,
@@ -142,44 +217,89 @@ namespace FML {
             double min_y = +1e100;
             double min_z = +1e100;
 
-            const double degrees_to_radial = 2.0 * M_PI / 360.0;
+            // We do the conversion in blocks of contiguous arrays
+            constexpr size_t block_size = 512;
+            const size_t nblocks = (ngalaxies + block_size - 1) / block_size;
 #ifdef USE_OMP
 #pragma omp parallel for reduction(max : max_x, max_y, max_z) reduction(min : min_x, min_y, min_z)
 #endif
-            for (size_t i = 0; i < ngalaxies; i++) {
-                auto * Pos = FML::PARTICLE::GetPos(particles_xyz[i]);
-                const double RA = FML::PARTICLE::GetRA(galaxies_ra_dec_z[i]);
-                const double DEC = FML::PARTICLE::GetDEC(galaxies_ra_dec_z[i]);
-                const double redshift = FML::PARTICLE::GetRedshift(galaxies_ra_dec_z[i]);
-                const double r = r_of_z_spline(redshift);
-
-                const double cosTheta = std::cos((90.0 - RA) * degrees_to_radial);
-                const double sinTheta = std::sqrt(1.0 - cosTheta * cosTheta);
-                const double phi = DEC * degrees_to_radial;
-
-                const double x = r * sinTheta * std::cos(phi);
-                const double y = r * sinTheta * std::sin(phi);
-                const double z = r * cosTheta;
-
-                // Compute max/min
-                max_x = std::max(x, max_x);
-                max_y = std::max(y, max_y);
-                max_z = std::max(z, max_z);
-                min_x = std::min(x, min_x);
-                min_y = std::min(y, min_y);
-                min_z = std::min(z, min_z);
-
-                // Assign positions
-                Pos[0] = x;
-                Pos[1] = y;
-                Pos[2] = z;
+            for (size_t iblock = 0; iblock < nblocks; iblock++) {
+                const size_t istart = iblock * block_size;
+                const size_t n = std::min(block_size, ngalaxies - istart);
+
+                std::array<double, block_size> RA, DEC, r, x, y, z;
+                for (size_t i = 0; i < n; i++) {
+                    const auto & galaxy = galaxies_ra_dec_z[istart + i];
+                    RA[i] = FML::PARTICLE::GetRA(galaxy);
+                    DEC[i] = FML::PARTICLE::GetDEC(galaxy);
+                    r[i] = r_of_z(FML::PARTICLE::GetRedshift(galaxy));
+                }
+
+                equitorial_to_cartesian_batch(RA.data(), DEC.data(), r.data(), n, x.data(), y.data(), z.data());
+
+                for (size_t i = 0; i < n; i++) {
+                    // Compute max/min
+                    max_x = std::max(x[i], max_x);
+                    max_y = std::max(y[i], max_y);
+                    max_z = std::max(z[i], max_z);
+                    min_x = std::min(x[i], min_x);
+                    min_y = std::min(y[i], min_y);
+                    min_z = std::min(z[i], min_z);
+
+                    // Assign positions
+                    auto * Pos = FML::PARTICLE::GetPos(particles_xyz[istart + i]);
+                    Pos[0] = x[i];
+                    Pos[1] = y[i];
+                    Pos[2] = z[i];
+                }
             }
 
+            FML::MaxOverTasks(&max_x);
+            FML::MaxOverTasks(&max_y);
+            FML::MaxOverTasks(&max_z);
+            FML::MinOverTasks(&min_x);
+            FML::MinOverTasks(&min_y);
+            FML::MinOverTasks(&min_z);
+
             min_max_x = {min_x, max_x};
             min_max_y = {min_y, max_y};
             min_max_z = {min_z, max_z};
         }
 
+        //==============================================================================
+        /// Take a set of galaxies galaxies_ra_dec_z with (RA,DEC,z) and convert them to
+        /// cartesian coordinates (x,y,z) stored in particles_xyz
+        ///
+        /// The positions will be in the same units as the 1.0/hubble_over_c_of_z
+        /// Gives back the min/max of the positions over all tasks (useful for boxing the catalog)
+        ///
+        /// @tparam T Particle class for the galaxies
+        /// @tparam U Particle class for the particles we make from the galaxies
+        ///
+        /// @param[in] galaxies_ra_dec_z Particles with RA, DEC and Z.
+        /// @param[in] ngalaxies Number of galaxies
+        /// @param[out] particles_xyz Vector with galaxies as particles with cartesian coordinates.
+        /// @param[in] hubble_over_c_of_z This is the function \f$ H(z)/c \f$ used to compute the redshift-comobing
+        /// distance relationship. Postions units is the same as those of \f$ c/H(z) \f$ (so e.g. if you want Mpc/h then
+        /// we need H0 = 100, if you want kpc/s then use H0 = 10^5 and so on.
+        /// @param[out] min_max_x The min/max values of x-postions
+        /// @param[out] min_max_y The min/max values of x-postions
+        /// @param[out] min_max_z The min/max values of x-postions
+        ///
+        //==============================================================================
+        template <class T, class U>
+        void EquitorialToCartesianCoordinates(const T * galaxies_ra_dec_z,
+                                              size_t ngalaxies,
+                                              std::vector<U> & particles_xyz,
+                                              std::function<double(double)> & hubble_over_c_of_z,
+                                              std::pair<double, double> & min_max_x,
+                                              std::pair<double, double> & min_max_y,
+                                              std::pair<double, double> & min_max_z) {
+            ComovingDistanceTable r_of_z(hubble_over_c_of_z, 1.1 * get_max_redshift(galaxies_ra_dec_z, ngalaxies));
+            EquitorialToCartesianCoordinates(
+                galaxies_ra_dec_z, ngalaxies, particles_xyz, r_of_z, min_max_x, min_max_y, min_max_z);
+        }
+
         //==============================================================================
         /// @brief Transform galaxies with positions defined by RA,DEC,Z and transform these to
         /// cartesian positions in [0,1).
@@ -311,76 +431,59 @@ namespace FML {
 
             verbose = verbose and FML::ThisTask == 0;
 
-            double boxsize1, boxsize2;
-
-            GalaxiesToBox(
-                galaxies_ra_dec_z, ngalaxies, galaxies_xyz, hubble_over_c_of_z, boxsize1, false, false, verbose);
+            // If we are to scale the positions then they must be shifted so they lie in [0,1)
+            if (scalePositions)
+                assert(shiftPositions);
 
-            GalaxiesToBox(randoms_ra_dec_z, nrandoms, randoms_xyz, hubble_over_c_of_z, boxsize2, false, false, verbose);
+            // Tabulate r(z) once for both catalogs
+            const double z_max = std::max(get_max_redshift(galaxies_ra_dec_z, ngalaxies),
+                                          get_max_redshift(randoms_ra_dec_z, nrandoms));
+            ComovingDistanceTable r_of_z(hubble_over_c_of_z, 1.1 * z_max);
 
-            double max_x = -1e100, max_y = -1e100, max_z = -1e100;
-            double min_x = +1e100, min_y = +1e100, min_z = +1e100;
-#ifdef USE_OMP
-#pragma omp parallel for reduction(max : max_x, max_y, max_z) reduction(min : min_x, min_y, min_z)
-#endif
-            for (size_t i = 0; i < galaxies_xyz.size(); i++) {
-                auto * Pos = FML::PARTICLE::GetPos(galaxies_xyz[i]);
-                max_x = std::max(Pos[0], max_x);
-                max_y = std::max(Pos[1], max_y);
-                max_z = std::max(Pos[2], max_z);
-                min_x = std::min(Pos[0], min_x);
-                min_y = std::min(Pos[1], min_y);
-                min_z = std::min(Pos[2], min_z);
-            }
-#ifdef USE_OMP
-#pragma omp parallel for reduction(max : max_x, max_y, max_z) reduction(min : min_x, min_y, min_z)
-#endif
-            for (size_t i = 0; i < randoms_xyz.size(); i++) {
-                auto * Pos = FML::PARTICLE::GetPos(randoms_xyz[i]);
-                max_x = std::max(Pos[0], max_x);
-                max_y = std::max(Pos[1], max_y);
-                max_z = std::max(Pos[2], max_z);
-                min_x = std::min(Pos[0], min_x);
-                min_y = std::min(Pos[1], min_y);
-                min_z = std::min(Pos[2], min_z);
-            }
-
-            max_x -= min_x;
-            max_y -= min_y;
-            max_z -= min_z;
+            // To cartesian coordinates
+            std::pair<double, double> min_max_x, min_max_y, min_max_z;
+            std::pair<double, double> min_max_x_randoms, min_max_y_randoms, min_max_z_randoms;
+            EquitorialToCartesianCoordinates(
+                galaxies_ra_dec_z, ngalaxies, galaxies_xyz, r_of_z, min_max_x, min_max_y, min_max_z);
+            EquitorialToCartesianCoordinates(randoms_ra_dec_z,
+                                             nrandoms,
+                                             randoms_xyz,
+                                             r_of_z,
+                                             min_max_x_randoms,
+                                             min_max_y_randoms,
+                                             min_max_z_randoms);
+
+            const double min_x = std::min(min_max_x.first, min_max_x_randoms.first);
+            const double min_y = std::min(min_max_y.first, min_max_y_randoms.first);
+            const double min_z = std::min(min_max_z.first, min_max_z_randoms.first);
+            const double max_x = std::max(min_max_x.second, min_max_x_randoms.second) - min_x;
+            const double max_y = std::max(min_max_y.second, min_max_y_randoms.second) - min_y;
+            const double max_z = std::max(min_max_z.second, min_max_z_randoms.second) - min_z;
 
             // The boxsize we use is the maximum of the two
             boxsize = 1.1 * std::max(std::max(max_x, max_y), max_z);
 
-            if (shiftPositions) {
-                for (auto & p : galaxies_xyz) {
-                    auto * Pos = FML::PARTICLE::GetPos(p);
-                    Pos[0] += min_x;
-                    Pos[1] += min_y;
-                    Pos[2] += min_z;
-                }
-                for (auto & p : randoms_xyz) {
-                    auto * Pos = FML::PARTICLE::GetPos(p);
-                    Pos[0] += min_x;
-                    Pos[1] += min_y;
-                    Pos[2] += min_z;
-                }
-            }
-
-            if (scalePositions) {
-                for (auto & p : galaxies_xyz) {
-                    auto * Pos = FML::PARTICLE::GetPos(p);
-                    Pos[0] /= boxsize;
-                    Pos[1] /= boxsize;
-                    Pos[2] /= boxsize;
-                }
-                for (auto & p : randoms_xyz) {
-                    auto * Pos = FML::PARTICLE::GetPos(p);
-                    Pos[0] /= boxsize;
-                    Pos[1] /= boxsize;
-                    Pos[2] /= boxsize;
+            // Shift positions and possily scale them so they are in [0,1)
+            auto shift_and_scale = [&](std::vector<U> & particles) {
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                for (size_t i = 0; i < particles.size(); i++) {
+                    auto * Pos = FML::PARTICLE::GetPos(particles[i]);
+                    if (shiftPositions) {
+                        Pos[0] -= min_x;
+                        Pos[1] -= min_y;
+                        Pos[2] -= min_z;
+                    }
+                    if (scalePositions) {
+                        Pos[0] /= boxsize;
+                        Pos[1] /= boxsize;
+                        Pos[2] /= boxsize;
+                    }
                 }
-            }
+            };
+            shift_and_scale(galaxies_xyz);
+            shift_and_scale(randoms_xyz);
 
             if (verbose) {
                 std::cout << "Boxsize for boxing galaxies and randoms: " << boxsize << "\n";
@@ -1,6 +1,9 @@
 #ifndef HESSIAN_HEADER
 #define HESSIAN_HEADER
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <vector>
 
 #include <gsl/gsl_eigen.h>
@@ -15,6 +18,12 @@ namespace FML {
 
         template <int N>
         using FFTWGrid = FML::GRID::FFTWGrid<N>;
+        using FloatType = FML::GRID::FloatType;
+        using ComplexType = FML::GRID::ComplexType;
+
+        /// The classes of the cosmic web in 3D. The class of a cell is the number of eigenvalues of the
+        /// tidal (T-web) or velocity shear (V-web) tensor that are above the threshold.
+        enum CosmicWebType { Void = 0, Sheet = 1, Filament = 2, Knot = 3 };
 
         //=================================================================================
         /// Computes the Hessian matrix of a grid [norm * f] via Fourier transforms.
@@ -25,6 +34,9 @@ namespace FML {
         /// In 2D: [fxx fxy fyy]
         /// In 3D: [fxx fxy fxz fyy fyz fzz]
         ///
+        /// The last component is computed in the grid we Fourier transform f in so this allocates
+        /// \f$ N(N+1)/2 \f$ grids in total.
+        ///
         /// @tparam N The dimension we are working in
         ///
         /// @param[in] f_real The grid we are to compute the hessian of
@@ -48,64 +60,431 @@ namespace FML {
                     std::cout << "[ComputeHessianWithFT::ComputeSecondDerivative] Computing phi_" << i1 << "," << i2
                               << "\n";
 
-                auto Local_nx = grid.get_local_nx();
-                auto Local_x_start = grid.get_local_x_start();
-#ifdef USE_OMP
-#pragma omp parallel for
-#endif
-                for (int islice = 0; islice < Local_nx; islice++) {
-                    [[maybe_unused]] double kmag2;
-                    [[maybe_unused]] std::array<double, N> kvec;
-                    for (auto && fourier_index : grid.get_fourier_range(islice, islice + 1)) {
-                        if(Local_x_start == 0 and fourier_index == 0)
-                          continue; // DC mode (k=0)
-
-                        grid.get_fourier_wavevector_and_norm2_by_index(fourier_index, kvec, kmag2);
-
-                        // From f(k) -> -ika ikb f(k) / k^2 = (ka kb / k^2) f(k)
-                        auto value = grid.get_fourier_from_index(fourier_index);
-                        double factor = -norm * kvec[i1] * kvec[i2];
-                        if (hessian_of_potential_of_f)
-                            factor *= -1.0 / kmag2;
-                        value *= factor;
-
-                        grid.set_fourier_from_index(fourier_index, value);
+                auto kernel = [&](IndexIntType fourier_index, const std::array<double, N> & kvec, double kmag2) {
+                    // DC mode (k=0)
+                    if (kmag2 == 0.0) {
+                        grid.set_fourier_from_index(fourier_index, 0.0);
+                        return;
                     }
-                }
 
-                // Deal with the DC mode
-                if (FML::ThisTask == 0)
-                    grid.set_fourier_from_index(0, 0.0);
+                    // From f(k) -> -ika ikb f(k) / k^2 = (ka kb / k^2) f(k)
+                    auto value = grid.get_fourier_from_index(fourier_index);
+                    double factor = -norm * kvec[i1] * kvec[i2];
+                    if (hessian_of_potential_of_f)
+                        factor *= -1.0 / kmag2;
+                    value *= factor;
+
+                    grid.set_fourier_from_index(fourier_index, value);
+                };
+                grid.for_each_fourier(kernel);
 
                 // Back to real space
                 grid.fftw_c2r();
             };
 
-            // Take a copy and Fourier transform it
-            FFTWGrid<N> f_fourier = f_real;
-            f_fourier.fftw_r2c();
-
             // Allocate grids
-            hessian_real.resize(N * (N - 1));
+            const int ncomponents = N * (N + 1) / 2;
+            hessian_real.resize(ncomponents);
+
+            // Take a copy and Fourier transform it. We keep it in the last component
+            FFTWGrid<N> & f_fourier = hessian_real[ncomponents - 1];
+            f_fourier = f_real;
+            f_fourier.fftw_r2c();
 
             // Compute hessian matrix
             int count = 0;
             for (int idim = 0; idim < N; idim++) {
                 for (int idim2 = idim; idim2 < N; idim2++) {
-                    hessian_real[count] = f_fourier;
+                    if (count < ncomponents - 1)
+                        hessian_real[count] = f_fourier;
                     ComputeSecondDerivative(hessian_real[count], idim, idim2);
                     count++;
                 }
             }
         }
 
+        //=================================================================================
+        /// Computes the (symmetrized) velocity shear tensor
+        /// \f$ \Sigma_{ij} = -\frac{norm}{2} (\partial_i v_j + \partial_j v_i) \f$ of a velocity field via
+        /// Fourier transforms. The derivatives are with respect to the box coordinates x in [0,1) so for
+        /// the usual V-web normalization take norm = 1 / (H0 Boxsize) with v in km/s and Boxsize in Mpc/h (H0 = 100).
+        /// The components are stored in the same order as for the Hessian, i.e. [vxx vxy vxz vyy vyz vzz] in 3D.
+        ///
+        /// The velocity components are transformed in the grid of the last component they are needed for, so
+        /// this allocates \f$ N(N+1)/2 \f$ grids in total.
+        ///
+        /// @tparam N The dimension we are working in
+        ///
+        /// @param[in] velocity_real The N components of the velocity field
+        /// @param[out] shear_real The velocity shear tensor
+        /// @param[in] norm A number to scale the tensor by (default is 1.0)
+        ///
+        //=================================================================================
+        template <int N>
+        void ComputeVelocityShearWithFT(const std::vector<FFTWGrid<N>> & velocity_real,
+                                        std::vector<FFTWGrid<N>> & shear_real,
+                                        double norm = 1.0) {
+
+            assert_mpi(velocity_real.size() == N, "[ComputeVelocityShearWithFT] Need N velocity components\n");
+            for (int idim = 0; idim < N; idim++)
+                assert_mpi(velocity_real[idim].get_nmesh() > 0,
+                           "[ComputeVelocityShearWithFT] velocity_real grid is not allocated\n");
+
+            // Index of the component ij (j >= i) in the list of components
+            auto component = [](int i, int j) { return i * N - (i * (i - 1)) / 2 + (j - i); };
+
+            // v_i(k) is stored in component (i, N-1). This is the last component that needs v_i
+            // so there we can compute the result in place
+            shear_real.resize(N * (N + 1) / 2);
+            for (int idim = 0; idim < N; idim++) {
+                shear_real[component(idim, N - 1)] = velocity_real[idim];
+                shear_real[component(idim, N - 1)].fftw_r2c();
+            }
+
+            for (int idim = 0; idim < N; idim++) {
+                for (int idim2 = idim; idim2 < N; idim2++) {
+                    if (FML::ThisTask == 0)
+                        std::cout << "[ComputeVelocityShearWithFT] Computing sigma_" << idim << "," << idim2 << "\n";
+
+                    const FFTWGrid<N> & vi = shear_real[component(idim, N - 1)];
+                    const FFTWGrid<N> & vj = shear_real[component(idim2, N - 1)];
+                    FFTWGrid<N> & grid = shear_real[component(idim, idim2)];
+                    if (idim2 < N - 1)
+                        grid = vi;
+
+                    // From v(k) -> -norm/2 (ika vb + ikb va)
+                    const ComplexType I(0, 1);
+                    vi.for_each_fourier([&](IndexIntType fourier_index, const std::array<double, N> & kvec, double) {
+                        const auto vik = vi.get_fourier_from_index(fourier_index);
+                        const auto vjk = vj.get_fourier_from_index(fourier_index);
+                        const ComplexType value =
+                            FloatType(-0.5 * norm) * I * (FloatType(kvec[idim]) * vjk + FloatType(kvec[idim2]) * vik);
+                        grid.set_fourier_from_index(fourier_index, value);
+                    });
+
+                    // Back to real space
+                    grid.fftw_c2r();
+                }
+            }
+        }
+
+        //=================================================================================
+        /// Eigenvalues of a symmetric 2x2 matrix given by its upper triangle [a00 a01 a11].
+        /// The eigenvalues are ordered in descending order.
+        //=================================================================================
+        inline void SymmetricEigenvalues2x2(const double * a, double * eval) {
+            const double mean = 0.5 * (a[0] + a[2]);
+            const double radius = std::hypot(0.5 * (a[0] - a[2]), a[1]);
+            eval[0] = mean + radius;
+            eval[1] = mean - radius;
+        }
+
+        //=================================================================================
+        /// Eigenvalues of a symmetric 3x3 matrix given by its upper triangle [a00 a01 a02 a11 a12 a22].
+        /// Closed form trigonometric solution of the characteristic polynomial (Smith 1961).
+        /// The eigenvalues are ordered in descending order. Branch-free so that it can be vectorized over cells.
+        /// Near exactly degenerate eigenvalues the precision drops to ~1e-8 relative to the largest
+        /// eigenvalue which is more than enough for single precision grids.
+        //=================================================================================
+        inline void SymmetricEigenvalues3x3(const double * a, double * eval) {
+            // Shift by the mean eigenvalue q and scale by p: B = (A - qI) / p
+            const double q = (a[0] + a[3] + a[5]) / 3.0;
+            const double b00 = a[0] - q;
+            const double b11 = a[3] - q;
+            const double b22 = a[5] - q;
+            const double offdiag2 = a[1] * a[1] + a[2] * a[2] + a[4] * a[4];
+            const double p = std::sqrt((b00 * b00 + b11 * b11 + b22 * b22 + 2.0 * offdiag2) / 6.0);
+            const double pinv = p > 0.0 ? 1.0 / p : 0.0;
+            const double B00 = b00 * pinv, B11 = b11 * pinv, B22 = b22 * pinv;
+            const double B01 = a[1] * pinv, B02 = a[2] * pinv, B12 = a[4] * pinv;
+
+            // The eigenvalues of B are 2cos(phi + 2pi n/3) with cos(3phi) = det(B)/2
+            const double detB =
+                B00 * (B11 * B22 - B12 * B12) - B01 * (B01 * B22 - B12 * B02) + B02 * (B01 * B12 - B11 * B02);
+            const double r = std::clamp(0.5 * detB, -1.0, 1.0);
+            const double phi = std::acos(r) / 3.0;
+
+            eval[0] = q + 2.0 * p * std::cos(phi);
+            eval[2] = q + 2.0 * p * std::cos(phi + 2.0 * M_PI / 3.0);
+            eval[1] = 3.0 * q - eval[0] - eval[2];
+        }
+
+        //=================================================================================
+        /// Eigenvalues and eigenvectors of a symmetric 2x2 matrix given by its upper triangle [a00 a01 a11].
+        /// The eigenvalues are ordered in descending order and evec[i * 2 + j] is the i'th component of
+        /// the j'th eigenvector (the same row major order as GSL). The sign of the eigenvectors is arbitrary.
+        //=================================================================================
+        inline void SymmetricEigensystem2x2(const double * a, double * eval, double * evec) {
+            SymmetricEigenvalues2x2(a, eval);
+
+            // The eigenvector of eval[0] from the largest of the two rows of (A - eval[0] I) rotated by 90 degrees
+            double v0x = a[1], v0y = eval[0] - a[0];
+            const double u0x = eval[0] - a[2], u0y = a[1];
+            if (u0x * u0x + u0y * u0y > v0x * v0x + v0y * v0y) {
+                v0x = u0x;
+                v0y = u0y;
+            }
+            const double norm = std::hypot(v0x, v0y);
+            if (norm > 0.0) {
+                v0x /= norm;
+                v0y /= norm;
+            } else {
+                v0x = 1.0;
+                v0y = 0.0;
+            }
+
+            evec[0] = v0x;
+            evec[2] = v0y;
+            evec[1] = -v0y;
+            evec[3] = v0x;
+        }
+
+        //=================================================================================
+        /// Eigenvalues and eigenvectors of a symmetric 3x3 matrix given by its upper triangle
+        /// [a00 a01 a02 a11 a12 a22]. The eigenvector of the most separated eigenvalue is the largest cross
+        /// product of two rows of (A - lambda I), the second one is found the same way and orthogonalized to
+        /// the first and the third is their cross product. Degenerate cases give an arbitrary orthonormal basis
+        /// of the degenerate subspace. The eigenvalues are ordered in descending order and evec[i * 3 + j] is the
+        /// i'th component of the j'th eigenvector (the same row major order as GSL). The sign of the eigenvectors
+        /// is arbitrary.
+        //=================================================================================
+        inline void SymmetricEigensystem3x3(const double * a, double * eval, double * evec) {
+            SymmetricEigenvalues3x3(a, eval);
+
+            // Work with the traceless part scaled to unit norm, (A - qI) / scale. This has the same eigenvectors,
+            // avoids under/overflow in the cross products and keeps the precision when the eigenvalues are close
+            const double q = (a[0] + a[3] + a[5]) / 3.0;
+            const double scale = std::sqrt((a[0] - q) * (a[0] - q) + (a[3] - q) * (a[3] - q) + (a[5] - q) * (a[5] - q) +
+                                           2.0 * (a[1] * a[1] + a[2] * a[2] + a[4] * a[4]));
+            const double scaleinv = scale > 0.0 ? 1.0 / scale : 0.0;
+            const double as[6] = {(a[0] - q) * scaleinv,
+                                  a[1] * scaleinv,
+                                  a[2] * scaleinv,
+                                  (a[3] - q) * scaleinv,
+                                  a[4] * scaleinv,
+                                  (a[5] - q) * scaleinv};
+            const double tolerance = 1e-20;
+
+            auto cross = [](const double * x, const double * y, double * z) {
+                z[0] = x[1] * y[2] - x[2] * y[1];
+                z[1] = x[2] * y[0] - x[0] * y[2];
+                z[2] = x[0] * y[1] - x[1] * y[0];
+            };
+
+            // Eigenvector of lambda from the largest cross product of two rows of (A - lambda I)
+            auto eigenvector = [&](double lambda, double * v) -> bool {
+                lambda = (lambda - q) * scaleinv;
+                const double r0[3] = {as[0] - lambda, as[1], as[2]};
+                const double r1[3] = {as[1], as[3] - lambda, as[4]};
+                const double r2[3] = {as[2], as[4], as[5] - lambda};
+                double c[3][3];
+                cross(r0, r1, c[0]);
+                cross(r0, r2, c[1]);
+                cross(r1, r2, c[2]);
+                int imax = 0;
+                double norm2max = 0.0;
+                for (int i = 0; i < 3; i++) {
+                    const double norm2 = c[i][0] * c[i][0] + c[i][1] * c[i][1] + c[i][2] * c[i][2];
+                    if (norm2 > norm2max) {
+                        norm2max = norm2;
+                        imax = i;
+                    }
+                }
+                if (not(norm2max > tolerance))
+                    return false;
+                const double norm = std::sqrt(norm2max);
+                for (int i = 0; i < 3; i++)
+                    v[i] = c[imax][i] / norm;
+                return true;
+            };
+
+            // Start with the eigenvalue that is furthest away from the middle one
+            const bool first_is_isolated = eval[0] - eval[1] >= eval[1] - eval[2];
+            const int iisolated = first_is_isolated ? 0 : 2;
+            const int iother = first_is_isolated ? 2 : 0;
+            double v[3][3];
+            if (not eigenvector(eval[iisolated], v[iisolated])) {
+                // All eigenvalues are equal
+                for (int i = 0; i < 9; i++)
+                    evec[i] = (i % 4 == 0) ? 1.0 : 0.0;
+                return;
+            }
+
+            // Second eigenvector. Orthogonalize to the first and if the remaining two eigenvalues are degenerate
+            // pick any vector orthogonal to the first
+            const double * u = v[iisolated];
+            double * w = v[iother];
+            bool found = eigenvector(eval[iother], w);
+            if (found) {
+                const double dot = w[0] * u[0] + w[1] * u[1] + w[2] * u[2];
+                for (int i = 0; i < 3; i++)
+                    w[i] -= dot * u[i];
+                const double norm = std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+                found = norm > 1e-6;
+                for (int i = 0; i < 3; i++)
+                    w[i] /= norm;
+            }
+            if (not found) {
+                int imin = 0;
+                for (int i = 1; i < 3; i++)
+                    if (std::abs(u[i]) < std::abs(u[imin]))
+                        imin = i;
+                for (int i = 0; i < 3; i++)
+                    w[i] = (i == imin ? 1.0 : 0.0) - u[imin] * u[i];
+                const double norm = std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+                for (int i = 0; i < 3; i++)
+                    w[i] /= norm;
+            }
+
+            // The middle one completes the basis
+            cross(v[2], v[0], v[1]);
+
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++)
+                    evec[i * 3 + j] = v[j][i];
+        }
+
+        //=================================================================================
+        /// Internal method: for each cell compute the eigenvalues (and eigenvectors if eigenvectors is not
+        /// a nullptr) of the tensor. The output grids must be allocated and eigenvalues is allowed to be the
+        /// first N grids of tensor_real (the result is then computed in place).
+        /// In 2D and 3D we use the closed form solution vectorized along the rows of the grid, otherwise GSL.
+        //=================================================================================
+        template <int N>
+        void ComputeEigensystemInCells(std::vector<FFTWGrid<N>> & tensor_real,
+                                       std::vector<FFTWGrid<N>> & eigenvalues,
+                                       std::vector<FFTWGrid<N>> * eigenvectors) {
+            constexpr int ncomponents = N * (N + 1) / 2;
+            const auto Local_nx = tensor_real[0].get_local_nx();
+
+            if constexpr (N == 2 or N == 3) {
+                // Loop over the rows of the grid (cells along the last dimension) which are contiguous in memory
+                const int Nmesh = tensor_real[0].get_nmesh();
+                const IndexIntType row_stride = 2 * (Nmesh / 2 + 1);
+                const IndexIntType nrows = IndexIntType(Local_nx) * FML::power(Nmesh, N - 2);
+
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+                for (IndexIntType irow = 0; irow < nrows; irow++) {
+                    const IndexIntType offset = irow * row_stride;
+                    std::array<const FloatType *, ncomponents> tensor_row;
+                    std::array<FloatType *, N> eigenvalues_row;
+                    std::array<FloatType *, N * N> eigenvectors_row;
+                    for (int i = 0; i < ncomponents; i++)
+                        tensor_row[i] = tensor_real[i].get_real_grid() + offset;
+                    for (int i = 0; i < N; i++)
+                        eigenvalues_row[i] = eigenvalues[i].get_real_grid() + offset;
+                    if (eigenvectors)
+                        for (int i = 0; i < N * N; i++)
+                            eigenvectors_row[i] = (*eigenvectors)[i].get_real_grid() + offset;
+
+                    if (eigenvectors) {
+                        for (int icell = 0; icell < Nmesh; icell++) {
+                            double tensor[ncomponents], eval[N], evec[N * N];
+                            for (int i = 0; i < ncomponents; i++)
+                                tensor[i] = tensor_row[i][icell];
+                            if constexpr (N == 2)
+                                SymmetricEigensystem2x2(tensor, eval, evec);
+                            else
+                                SymmetricEigensystem3x3(tensor, eval, evec);
+                            for (int i = 0; i < N; i++)
+                                eigenvalues_row[i][icell] = FloatType(eval[i]);
+                            for (int i = 0; i < N * N; i++)
+                                eigenvectors_row[i][icell] = FloatType(evec[i]);
+                        }
+                    } else {
+#ifdef USE_OMP
+#pragma omp simd
+#endif
+                        for (int icell = 0; icell < Nmesh; icell++) {
+                            double tensor[ncomponents], eval[N];
+                            for (int i = 0; i < ncomponents; i++)
+                                tensor[i] = tensor_row[i][icell];
+                            if constexpr (N == 2)
+                                SymmetricEigenvalues2x2(tensor, eval);
+                            else
+                                SymmetricEigenvalues3x3(tensor, eval);
+                            for (int i = 0; i < N; i++)
+                                eigenvalues_row[i][icell] = FloatType(eval[i]);
+                        }
+                    }
+                }
+
+            } else {
+
+#ifdef USE_OMP
+#pragma omp parallel
+#endif
+                {
+                    // Set up the GSL stuff we need (one per thread)
+                    gsl_matrix * matrix = gsl_matrix_alloc(N, N);
+                    gsl_matrix * evec = gsl_matrix_alloc(N, N);
+                    gsl_vector * eval = gsl_vector_alloc(N);
+                    gsl_eigen_symm_workspace * workspace = gsl_eigen_symm_alloc(N);
+                    gsl_eigen_symmv_workspace * workspacev = gsl_eigen_symmv_alloc(N);
+
+#ifdef USE_OMP
+#pragma omp for
+#endif
+                    for (int islice = 0; islice < Local_nx; islice++) {
+                        for (auto && real_index : tensor_real[0].get_real_range(islice, islice + 1)) {
+
+                            // Set the matrix
+                            int count = 0;
+                            for (int idim = 0; idim < N; idim++) {
+                                auto value = tensor_real[count].get_real_from_index(real_index);
+                                gsl_matrix_set(matrix, idim, idim, value);
+                                count++;
+                                for (int idim2 = idim + 1; idim2 < N; idim2++) {
+                                    value = tensor_real[count].get_real_from_index(real_index);
+                                    gsl_matrix_set(matrix, idim, idim2, value);
+                                    gsl_matrix_set(matrix, idim2, idim, value);
+                                    count++;
+                                }
+                            }
+
+                            // Compute eigenvectors+eigenvalues or just eigenvalues
+                            // In both cases the eigenvalues are sorted in descending order
+                            if (eigenvectors) {
+                                gsl_eigen_symmv(matrix, eval, evec, workspacev);
+                                gsl_eigen_symmv_sort(eval, evec, GSL_EIGEN_SORT_VAL_DESC);
+
+                                // Set eigenvectors
+                                for (int i = 0; i < N * N; i++) {
+                                    (*eigenvectors)[i].set_real_from_index(real_index, evec->data[i]);
+                                    // For column major order: gsl_matrix_get(evec, i / N, i % N);
+                                }
+
+                            } else {
+                                gsl_eigen_symm(matrix, eval, workspace);
+                                std::sort(eval->data, eval->data + N, std::greater<double>());
+                            }
+
+                            // Store the eigenvalues
+                            for (int idim = 0; idim < N; idim++)
+                                eigenvalues[idim].set_real_from_index(real_index, eval->data[idim]);
+                        }
+                    }
+
+                    // Free up GSL allocations
+                    gsl_matrix_free(matrix);
+                    gsl_matrix_free(evec);
+                    gsl_vector_free(eval);
+                    gsl_eigen_symm_free(workspace);
+                    gsl_eigen_symmv_free(workspacev);
+                }
+            }
+        }
+
         //=================================================================================
         /// For each point in the grid compute eigenvectors and eigenvalues of the tensor
-        /// \f$ H_{ij} \f$ where tensor_real contains the \f$ N(N-1)/2 \f$ grids [ 00,01,02,..,11,12,...,NN ]
+        /// \f$ H_{ij} \f$ where tensor_real contains the \f$ N(N+1)/2 \f$ grids [ 00,01,02,..,11,12,...,NN ]
         ///
         /// Eigenvalues are ordered in descending order
         ///
-        /// Eigenvectors are stored in row major order in the grid vector
+        /// Eigenvectors are stored in row major order in the grid vector (eigenvectors[i * N + j] is
+        /// the i'th component of the j'th eigenvector)
         ///
         /// This allocates N grids if compute_eigenvectors = false and N(N+1) grids otherwise
         ///
@@ -117,7 +496,8 @@ namespace FML {
                                         std::vector<FFTWGrid<N>> & eigenvectors,
                                         bool compute_eigenvectors = false) {
 
-            assert_mpi(tensor_real.size() > 0, "[SymmetricTensorEigensystem] tensor_real is not allocated\n");
+            assert_mpi(tensor_real.size() == N * (N + 1) / 2,
+                       "[SymmetricTensorEigensystem] tensor_real is not allocated\n");
             assert_mpi(tensor_real[0].get_nmesh() > 0,
                        "[SymmetricTensorEigensystem] tensor_real[0] is not allocated\n");
             for (size_t i = 1; i < tensor_real.size(); i++)
@@ -137,82 +517,126 @@ namespace FML {
                     eigenvectors[i] = tensor_real[0];
             }
 
-            // Set up the GSL stuff we need
-            gsl_matrix * matrix = gsl_matrix_alloc(N, N);
-            gsl_matrix * evec = gsl_matrix_alloc(N, N);
-            gsl_vector * eval = gsl_vector_alloc(N);
-            gsl_eigen_symm_workspace * workspace = gsl_eigen_symm_alloc(N);
-            gsl_eigen_symmv_workspace * workspacev = gsl_eigen_symmv_alloc(N);
-
-            // Solves the full eigensystem
-            auto SolveEigensystem = [&](gsl_matrix * _matrix,
-                                        gsl_vector * _eval,
-                                        gsl_matrix * _evec,
-                                        gsl_eigen_symmv_workspace * _workspace) {
-                // Compute eigenvalues and eigenvectors
-                gsl_eigen_symmv(_matrix, _eval, _evec, _workspace);
-                // Sort in descending order
-                gsl_eigen_symmv_sort(_eval, _evec, GSL_EIGEN_SORT_VAL_DESC);
-            };
+            ComputeEigensystemInCells<N>(tensor_real, eigenvalues, compute_eigenvectors ? &eigenvectors : nullptr);
+        }
 
-            // Solves just for eigenvalues
-            auto SolveEigenvalues =
-                [&](gsl_matrix * _matrix, gsl_vector * _eval, gsl_eigen_symm_workspace * _workspace) {
-                    // Compute eigenvalues and eigenvectors
-                    gsl_eigen_symm(_matrix, _eval, _workspace);
-                    // Order the eigenvalues in descending order
-                    std::sort(_eval->data, _eval->data + _matrix->size1, std::greater<double>());
-                };
+        //=================================================================================
+        /// Compute the eigenvalues (and optionally the eigenvectors) of the Hessian of a grid
+        /// (see ComputeHessianWithFT) without keeping the Hessian around. The eigenvalues are computed in place
+        /// in the Hessian grids so this allocates \f$ N(N+1)/2 \f$ grids (plus N^2 for the eigenvectors) instead
+        /// of the \f$ N(N+1)/2 + 1 \f$ for the Hessian plus N for the eigenvalues we need when calling
+        /// ComputeHessianWithFT and SymmetricTensorEigensystem.
+        ///
+        /// @tparam N The dimension we are working in
+        ///
+        /// @param[in] f_real The grid we are to compute the hessian of
+        /// @param[out] eigenvalues The N eigenvalues in descending order
+        /// @param[out] eigenvectors The eigenvectors (same order as in SymmetricTensorEigensystem)
+        /// @param[in] compute_eigenvectors Compute the eigenvectors
+        /// @param[in] norm A number to scale the grid by if needed (default is 1.0)
+        /// @param[in] hessian_of_potential_of_f Compute the hessian of the potential of the grid (default is false)
+        ///
+        //=================================================================================
+        template <int N>
+        void ComputeHessianEigensystemWithFT(const FFTWGrid<N> & f_real,
+                                             std::vector<FFTWGrid<N>> & eigenvalues,
+                                             std::vector<FFTWGrid<N>> & eigenvectors,
+                                             bool compute_eigenvectors = false,
+                                             double norm = 1.0,
+                                             bool hessian_of_potential_of_f = false) {
+            ComputeHessianWithFT(f_real, eigenvalues, norm, hessian_of_potential_of_f);
+            if (compute_eigenvectors) {
+                eigenvectors.resize(N * N);
+                for (int i = 0; i < N * N; i++)
+                    eigenvectors[i] = eigenvalues[0];
+            }
+            ComputeEigensystemInCells<N>(eigenvalues, eigenvalues, compute_eigenvectors ? &eigenvectors : nullptr);
+            eigenvalues.resize(N);
+        }
 
-            // Loop over all cells
-            auto Local_nx = tensor_real[0].get_local_nx();
+        //=================================================================================
+        /// Classify the cells by the number of eigenvalues above lambda_threshold. In 3D this is
+        /// the cosmic web classification void, sheet, filament and knot (0, 1, 2, 3, see CosmicWebType).
+        ///
+        /// @tparam N The dimension we are working in
+        ///
+        /// @param[in] eigenvalues The N eigenvalue grids
+        /// @param[out] web The number of eigenvalues above the threshold in each cell
+        /// @param[in] lambda_threshold The threshold
+        ///
+        //=================================================================================
+        template <int N>
+        void CosmicWebClassification(const std::vector<FFTWGrid<N>> & eigenvalues,
+                                     FFTWGrid<N> & web,
+                                     double lambda_threshold) {
+            assert_mpi(eigenvalues.size() == N, "[CosmicWebClassification] Need N eigenvalue grids\n");
+            web = eigenvalues[0];
+            web.fill_real_grid(0.0);
+
+            const auto Local_nx = web.get_local_nx();
 #ifdef USE_OMP
 #pragma omp parallel for
 #endif
             for (int islice = 0; islice < Local_nx; islice++) {
-                for (auto && real_index : tensor_real[0].get_real_range(islice,islice+1)) {
-
-                    // Set the matrix
-                    int count = 0;
-                    for (int idim = 0; idim < N; idim++) {
-                        auto value = tensor_real[count].get_real_from_index(real_index);
-                        gsl_matrix_set(matrix, idim, idim, value);
-                        count++;
-                        for (int idim2 = idim + 1; idim2 < N; idim2++) {
-                            value = tensor_real[count].get_real_from_index(real_index);
-                            gsl_matrix_set(matrix, idim, idim2, value);
-                            gsl_matrix_set(matrix, idim2, idim, value);
-                            count++;
-                        }
-                    }
-
-                    // Compute eigenvectors+eigenvalues or just eigenvalues
-                    // In the latter case we sort the eigenvalues
-                    if (compute_eigenvectors) {
-                        SolveEigensystem(matrix, eval, evec, workspacev);
-
-                        // Set eigenvectors
-                        for (int i = 0; i < N * N; i++) {
-                            eigenvectors[i].set_real_from_index(real_index, evec->data[i]);
-                            // For column major order: gsl_matrix_get(evec, i / N, i % N);
-                        }
-
-                    } else {
-                        SolveEigenvalues(matrix, eval, workspace);
-                    }
-
-                    // Store the eigenvalues
+                for (auto && real_index : web.get_real_range(islice, islice + 1)) {
+                    int nabove = 0;
                     for (int idim = 0; idim < N; idim++)
-                        eigenvalues[idim].set_real_from_index(real_index, eval->data[idim]);
+                        if (eigenvalues[idim].get_real_from_index(real_index) > lambda_threshold)
+                            nabove++;
+                    web.set_real_from_index(real_index, FloatType(nabove));
                 }
             }
+        }
+
+        //=================================================================================
+        /// The T-web: classify cells by the eigenvalues of the tidal tensor \f$ \phi_{ij} \f$
+        /// where \f$ \nabla^2 \phi = norm * \delta \f$ (Hahn et al. 2007, Forero-Romero et al. 2009).
+        /// Smooth the density field first if needed.
+        ///
+        /// @tparam N The dimension we are working in
+        ///
+        /// @param[in] delta_real The density contrast
+        /// @param[out] web The classification of each cell (see CosmicWebClassification)
+        /// @param[in] lambda_threshold The eigenvalue threshold
+        /// @param[in] norm The normalization of the potential (default is 1.0)
+        ///
+        //=================================================================================
+        template <int N>
+        void ComputeTWeb(const FFTWGrid<N> & delta_real,
+                         FFTWGrid<N> & web,
+                         double lambda_threshold,
+                         double norm = 1.0) {
+            std::vector<FFTWGrid<N>> eigenvalues;
+            std::vector<FFTWGrid<N>> eigenvectors;
+            const bool compute_eigenvectors = false;
+            const bool hessian_of_potential_of_f = true;
+            ComputeHessianEigensystemWithFT(
+                delta_real, eigenvalues, eigenvectors, compute_eigenvectors, norm, hessian_of_potential_of_f);
+            CosmicWebClassification(eigenvalues, web, lambda_threshold);
+        }
 
-            // Free up GSL allocations
-            gsl_matrix_free(matrix);
-            gsl_matrix_free(evec);
-            gsl_vector_free(eval);
-            gsl_eigen_symm_free(workspace);
-            gsl_eigen_symmv_free(workspacev);
+        //=================================================================================
+        /// The V-web: classify cells by the eigenvalues of the velocity shear tensor
+        /// (see ComputeVelocityShearWithFT) (Hoffman et al. 2012). Smooth the velocity field first if needed.
+        ///
+        /// @tparam N The dimension we are working in
+        ///
+        /// @param[in] velocity_real The N components of the velocity field
+        /// @param[out] web The classification of each cell (see CosmicWebClassification)
+        /// @param[in] lambda_threshold The eigenvalue threshold
+        /// @param[in] norm The normalization of the shear tensor (default is 1.0)
+        ///
+        //=================================================================================
+        template <int N>
+        void ComputeVWeb(const std::vector<FFTWGrid<N>> & velocity_real,
+                         FFTWGrid<N> & web,
+                         double lambda_threshold,
+                         double norm = 1.0) {
+            std::vector<FFTWGrid<N>> eigenvalues;
+            ComputeVelocityShearWithFT(velocity_real, eigenvalues, norm);
+            ComputeEigensystemInCells<N>(eigenvalues, eigenvalues, nullptr);
+            eigenvalues.resize(N);
+            CosmicWebClassification(eigenvalues, web, lambda_threshold);
         }
 
     } // namespace HESSIAN
@@ -1,3 +1,4 @@
+#include <array>
 #include <vector>
 
 #include <FML/FFTWGrid/FFTWGrid.h>
@@ -60,17 +61,29 @@ int main() {
     FML::INTERPOLATION::particles_to_grid<NDIM, Particle>(
         part.get_particles_ptr(), part.get_npart(), part.get_npart_total(), f_real, density_assignment_method);
 
-    // Compute the Hessian of the potential of f, i.e. D^-2 f_(ij)
+    // Compute the Hessian of the potential of f, i.e. D^-2 f_(ij) and its eigenvalues at each point in the grid
+    // If you need the Hessian itself use ComputeHessianWithFT followed by SymmetricTensorEigensystem
     const double norm = 1.0;
     const bool hessian_of_potential_of_f = true;
-    std::vector<FFTWGrid<NDIM>> hessian_real;
-    FML::HESSIAN::ComputeHessianWithFT(f_real, hessian_real, norm, hessian_of_potential_of_f);
-
-    // Compute eigenvalues of the Hessian above at each point in the grid
     std::vector<FFTWGrid<NDIM>> eigenvalues;
     std::vector<FFTWGrid<NDIM>> eigenvectors;
     const bool compute_eigenvectors = false;
-    FML::HESSIAN::SymmetricTensorEigensystem(hessian_real, eigenvalues, eigenvectors, compute_eigenvectors);
+    FML::HESSIAN::ComputeHessianEigensystemWithFT(
+        f_real, eigenvalues, eigenvectors, compute_eigenvectors, norm, hessian_of_potential_of_f);
+
+    // Classify the cells into voids, sheets, filaments and knots (the T-web)
+    const double lambda_threshold = 0.0;
+    FFTWGrid<NDIM> web;
+    FML::HESSIAN::CosmicWebClassification(eigenvalues, web, lambda_threshold);
+    std::array<double, NDIM + 1> web_fraction{};
+    for (auto real_index : web.get_real_range())
+        web_fraction[int(web.get_real_from_index(real_index))] += 1.0 / std::pow(Nmesh, NDIM);
+    FML::SumArrayOverTasks(web_fraction.data(), web_fraction.size());
+    if (FML::ThisTask == 0)
+        std::cout << "Volume fraction of voids: " << web_fraction[FML::HESSIAN::Void]
+                  << " sheets: " << web_fraction[FML::HESSIAN::Sheet]
+                  << " filaments: " << web_fraction[FML::HESSIAN::Filament]
+                  << " knots: " << web_fraction[FML::HESSIAN::Knot] << "\n";
 
     // Output the points in the grid on task 0 where all eigenvalues are positive
     if (FML::ThisTask == 0) {
@@ -0,0 +1,139 @@
+#ifndef HARDWARECOUNTERS_HEADER
+#define HARDWARECOUNTERS_HEADER
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(HARDWARE_COUNTERS) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define FML_HAS_PERF_EVENTS
+#endif
+
+//===========================================================================
+//
+// Compile time defines:
+// HARDWARE_COUNTERS : Read hardware counters (cycles, instructions, last level
+//                     cache misses) with the Linux perf_event_open interface in
+//                     all profiled regions (see Profiler.h). Implies PROFILING.
+//                     If the counters cannot be opened (not Linux, inside some
+//                     containers/VMs or /proc/sys/kernel/perf_event_paranoid > 2)
+//                     they are reported as not available and nothing else changes.
+//
+//===========================================================================
+
+namespace FML {
+    namespace UTILS {
+
+        /// The counters we read. The memory traffic is estimated as LLC misses times the cache line size
+        enum HardwareCounterType { HW_CYCLES, HW_INSTRUCTIONS, HW_LLC_MISSES, HW_NCOUNTERS };
+        using HardwareCounterValues = std::array<long long int, HW_NCOUNTERS>;
+        constexpr int hardware_cache_line_bytes = 64;
+
+        //=======================================================
+        /// Hardware counters for the calling thread. The counters
+        /// are opened as one group (so they are scheduled together)
+        /// counting user-space events only. If the kernel has to
+        /// multiplex the counters we scale the values by the fraction
+        /// of the time they were running.
+        ///
+        /// Open and read on the same thread. Not copyable.
+        //=======================================================
+        class HardwareCounters {
+          private:
+            std::array<int, HW_NCOUNTERS> fd{};
+            std::array<bool, HW_NCOUNTERS> counter_available{};
+            int nopen{0};
+
+#ifdef FML_HAS_PERF_EVENTS
+            static int open_counter(uint64_t config, int group_fd) {
+                struct perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.size = sizeof(attr);
+                attr.config = config;
+                attr.disabled = group_fd == -1 ? 1 : 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                return int(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+            }
+#endif
+
+          public:
+            HardwareCounters() {
+                fd.fill(-1);
+                counter_available.fill(false);
+            }
+            HardwareCounters(const HardwareCounters &) = delete;
+            HardwareCounters & operator=(const HardwareCounters &) = delete;
+            ~HardwareCounters() { close(); }
+
+            /// Try to open the counters. Returns true if at least the cycle counter is available
+            bool open() {
+#ifdef FML_HAS_PERF_EVENTS
+                if (nopen > 0)
+                    return true;
+                const std::array<uint64_t, HW_NCOUNTERS> config{
+                    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+                fd[HW_CYCLES] = open_counter(config[HW_CYCLES], -1);
+                if (fd[HW_CYCLES] < 0)
+                    return false;
+                for (int i = 0; i < HW_NCOUNTERS; i++) {
+                    if (i != HW_CYCLES)
+                        fd[i] = open_counter(config[i], fd[HW_CYCLES]);
+                    counter_available[i] = fd[i] >= 0;
+                    nopen += counter_available[i] ? 1 : 0;
+                }
+                ioctl(fd[HW_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(fd[HW_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+                return true;
+#else
+                return false;
+#endif
+            }
+
+            void close() {
+#ifdef FML_HAS_PERF_EVENTS
+                for (int i = HW_NCOUNTERS - 1; i >= 0; i--)
+                    if (fd[i] >= 0)
+                        ::close(fd[i]);
+#endif
+                fd.fill(-1);
+                counter_available.fill(false);
+                nopen = 0;
+            }
+
+            /// Are any counters open
+            bool available() const { return nopen > 0; }
+            /// Is a given counter open
+            bool available(int counter) const { return counter_available[counter]; }
+
+            /// Read the current values of the counters (-1 for counters that are not available)
+            bool read(HardwareCounterValues & values) const {
+                values.fill(-1);
+#ifdef FML_HAS_PERF_EVENTS
+                if (nopen == 0)
+                    return false;
+                // Layout with PERF_FORMAT_GROUP: nr, time_enabled, time_running, value[nr]
+                uint64_t buffer[3 + HW_NCOUNTERS];
+                if (::read(fd[HW_CYCLES], buffer, sizeof(buffer)) < ssize_t(3 * sizeof(uint64_t)))
+                    return false;
+                const double scale = buffer[2] > 0 ? double(buffer[1]) / double(buffer[2]) : 1.0;
+                int ivalue = 0;
+                for (int i = 0; i < HW_NCOUNTERS; i++)
+                    if (counter_available[i] and ivalue < int(buffer[0]))
+                        values[i] = (long long int)(double(buffer[3 + ivalue++]) * scale);
+                return true;
+#else
+                return false;
+#endif
+            }
+        };
+
+    } // namespace UTILS
+} // namespace FML
+#endif
@@ -0,0 +1,485 @@
+#ifndef PROFILER_HEADER
+#define PROFILER_HEADER
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include <FML/Timing/HardwareCounters.h>
+#include <FML/Timing/Timings.h>
+
+//===========================================================================
+//
+// Compile time defines:
+// PROFILING : Turn on the FML_PROFILE_SCOPE / FML_PROFILE_ADD_BYTES macros
+//             that are placed in the main routines of the library. Without it
+//             they expand to nothing. The Profiler itself can always be used.
+// HARDWARE_COUNTERS : Also read hardware counters in all regions (see HardwareCounters.h)
+//
+//===========================================================================
+
+#if defined(HARDWARE_COUNTERS) && !defined(PROFILING)
+#define PROFILING
+#endif
+
+#ifdef PROFILING
+#define FML_PROFILE_CONCAT_INTERNAL(a, b) a##b
+#define FML_PROFILE_CONCAT(a, b) FML_PROFILE_CONCAT_INTERNAL(a, b)
+#define FML_PROFILE_SCOPE(name) FML::UTILS::ProfileScope FML_PROFILE_CONCAT(fml_profile_scope_, __LINE__)(name)
+#define FML_PROFILE_ADD_BYTES(nbytes) FML::UTILS::Profiler::get().add_bytes(nbytes)
+#else
+#define FML_PROFILE_SCOPE(name)
+#define FML_PROFILE_ADD_BYTES(nbytes)
+#endif
+
+namespace FML {
+    namespace UTILS {
+
+        //=======================================================
+        /// Hierarchical region profiler. Regions are opened/closed with
+        /// enter/exit (or the RAII ProfileScope, or the FML_PROFILE_SCOPE macro)
+        /// and nested regions get the path parent/child. Each thread
+        /// accumulates into its own data so no locking is needed except the first
+        /// time a thread uses the profiler. Regions opened by OpenMP worker threads
+        /// are top-level regions for that thread and the time is summed over threads.
+        ///
+        /// print_summary gives the call count, min/mean/max time over tasks, the
+        /// load imbalance (max/mean - 1) and the bytes moved for each region (and
+        /// the hardware counters if compiled with HARDWARE_COUNTERS) and
+        /// write_chrome_trace writes all the events as Chrome trace JSON (open in
+        /// chrome://tracing or ui.perfetto.dev) with one process per task.
+        ///
+        /// Implemented as a singleton. Only query it outside of parallel regions.
+        //=======================================================
+        class Profiler {
+          public:
+            /// The accumulated data for a region
+            struct RegionData {
+                double time_sec{0.0};
+                long long int calls{0};
+                long long int bytes{0};
+                HardwareCounterValues counters{};
+            };
+
+          private:
+            struct TraceEvent {
+                std::string name;
+                double start_usec;
+                double duration_usec;
+            };
+
+            struct CountersStart {
+                bool all_threads;
+                HardwareCounterValues values;
+            };
+
+            struct ThreadData {
+                int thread_id{0};
+                std::vector<std::string> path_stack{};
+                std::vector<TimePoint> start_stack{};
+                HardwareCounters hardware_counters{};
+                std::vector<CountersStart> counters_start_stack{};
+                std::unordered_map<std::string, RegionData> regions{};
+                std::vector<TraceEvent> events{};
+                size_t events_dropped{0};
+            };
+
+            std::mutex registry_mutex{};
+            std::vector<std::unique_ptr<ThreadData>> thread_data{};
+            TimePoint time_start{std::chrono::steady_clock::now()};
+            size_t max_trace_events_per_thread{100000};
+            bool all_threads_registered{false};
+
+            Profiler() = default;
+
+            ThreadData & get_thread_data() {
+                thread_local ThreadData * data = nullptr;
+                if (data == nullptr) {
+                    std::lock_guard<std::mutex> guard(registry_mutex);
+                    thread_data.push_back(std::make_unique<ThreadData>());
+                    data = thread_data.back().get();
+                    data->thread_id = int(thread_data.size()) - 1;
+#ifdef HARDWARE_COUNTERS
+                    data->hardware_counters.open();
+#endif
+                }
+                return *data;
+            }
+
+            static bool in_parallel_region() {
+#ifdef USE_OMP
+                return omp_in_parallel();
+#else
+                return false;
+#endif
+            }
+
+            // Regions opened outside of OpenMP parallel regions count the events of all threads
+            // (the work is done by the threads it spawns) so the threads must have opened their counters
+            void read_counters(ThreadData & data, bool all_threads, HardwareCounterValues & values) {
+                if (not all_threads) {
+                    data.hardware_counters.read(values);
+                    return;
+                }
+#ifdef USE_OMP
+                if (not all_threads_registered) {
+#pragma omp parallel
+                    get_thread_data();
+                    all_threads_registered = true;
+                }
+#endif
+                values.fill(0);
+                for (auto & other : thread_data) {
+                    HardwareCounterValues other_values;
+                    if (not other->hardware_counters.read(other_values))
+                        continue;
+                    for (int i = 0; i < HW_NCOUNTERS; i++)
+                        values[i] = other_values[i] < 0 ? -1 : values[i] + other_values[i];
+                }
+            }
+
+            static double time_in_usec(const TimePoint & time_start, const TimePoint & time_end) {
+                return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(time_end - time_start)
+                    .count();
+            }
+
+            // Order regions as a tree: parent, then its children, then the next parent
+            static bool tree_order(const std::string & a, const std::string & b) {
+                return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+                    return (x == '/' ? '\0' : x) < (y == '/' ? '\0' : y);
+                });
+            }
+
+            static std::string json_escape(const std::string & in) {
+                std::string out;
+                for (char c : in) {
+                    if (c == '"' or c == '\\')
+                        out += '\\';
+                    out += c;
+                }
+                return out;
+            }
+
+          public:
+            Profiler(const Profiler &) = delete;
+            Profiler & operator=(const Profiler &) = delete;
+
+            /// Get the profiler
+            static Profiler & get() {
+                static Profiler profiler;
+                return profiler;
+            }
+
+            /// Open a region (nested in the currently open region on this thread)
+            void enter(const char * name) {
+                auto & data = get_thread_data();
+                if (data.path_stack.empty())
+                    data.path_stack.push_back(name);
+                else
+                    data.path_stack.push_back(data.path_stack.back() + "/" + name);
+                if (data.hardware_counters.available()) {
+                    data.counters_start_stack.push_back({not in_parallel_region(), {}});
+                    read_counters(data, data.counters_start_stack.back().all_threads,
+                                  data.counters_start_stack.back().values);
+                }
+                data.start_stack.push_back(std::chrono::steady_clock::now());
+            }
+
+            /// Close the innermost open region on this thread
+            void exit() {
+                auto time_end = std::chrono::steady_clock::now();
+                auto & data = get_thread_data();
+                if (data.path_stack.empty())
+                    return;
+                const auto & path = data.path_stack.back();
+                const auto & start = data.start_stack.back();
+                const double duration_usec = time_in_usec(start, time_end);
+
+                auto & region = data.regions[path];
+                region.time_sec += 1e-6 * duration_usec;
+                region.calls++;
+
+                if (data.hardware_counters.available()) {
+                    const auto & counters_start = data.counters_start_stack.back();
+                    HardwareCounterValues counters_end;
+                    read_counters(data, counters_start.all_threads, counters_end);
+                    for (int i = 0; i < HW_NCOUNTERS; i++)
+                        if (counters_end[i] >= 0 and counters_start.values[i] >= 0)
+                            region.counters[i] += counters_end[i] - counters_start.values[i];
+                    data.counters_start_stack.pop_back();
+                }
+
+                if (data.events.size() < max_trace_events_per_thread) {
+                    auto pos = path.rfind('/');
+                    data.events.push_back(
+                        {pos == std::string::npos ? path : path.substr(pos + 1), time_in_usec(time_start, start),
+                         duration_usec});
+                } else {
+                    data.events_dropped++;
+                }
+
+                data.path_stack.pop_back();
+                data.start_stack.pop_back();
+            }
+
+            /// Add to the bytes moved (communicated, transformed, ...) in the innermost open region on this thread
+            void add_bytes(long long int nbytes) {
+                auto & data = get_thread_data();
+                if (data.path_stack.empty())
+                    return;
+                data.regions[data.path_stack.back()].bytes += nbytes;
+            }
+
+            /// Set the maximum number of trace events we store per thread (after that we only accumulate)
+            void set_max_trace_events_per_thread(size_t n) { max_trace_events_per_thread = n; }
+
+            /// Clear all data and restart the clock. Collective call (synchronizes the clock between tasks).
+            void reset() {
+                for (auto & data : thread_data) {
+                    data->regions.clear();
+                    data->events.clear();
+                    data->events_dropped = 0;
+                }
+#ifdef USE_MPI
+                MPI_Barrier(MPI_COMM_WORLD);
+#endif
+                time_start = std::chrono::steady_clock::now();
+            }
+
+            /// The data for all regions on this task (summed over threads)
+            std::map<std::string, RegionData> get_regions() const {
+                std::map<std::string, RegionData> regions;
+                for (auto & data : thread_data) {
+                    for (auto & r : data->regions) {
+                        auto & region = regions[r.first];
+                        region.time_sec += r.second.time_sec;
+                        region.calls += r.second.calls;
+                        region.bytes += r.second.bytes;
+                        for (int i = 0; i < HW_NCOUNTERS; i++)
+                            region.counters[i] += r.second.counters[i];
+                    }
+                }
+                return regions;
+            }
+
+            /// Print the call count (mean over tasks), min/mean/max time over tasks, imbalance and bytes moved
+            /// (total over tasks) for all regions. Collective call.
+            void print_summary() {
+                int ThisTask = 0;
+                int NTasks = 1;
+#ifdef USE_MPI
+                MPI_Comm_rank(MPI_COMM_WORLD, &ThisTask);
+                MPI_Comm_size(MPI_COMM_WORLD, &NTasks);
+#endif
+                auto regions = get_regions();
+                std::vector<std::string> labels;
+                for (auto & r : regions)
+                    labels.push_back(r.first);
+                labels = union_of_labels_over_tasks(labels);
+                std::sort(labels.begin(), labels.end(), tree_order);
+
+                const size_t n = labels.size();
+                std::vector<double> time_sec(n, 0.0), calls(n, 0.0), bytes(n, 0.0);
+                for (size_t i = 0; i < n; i++) {
+                    auto it = regions.find(labels[i]);
+                    if (it != regions.end()) {
+                        time_sec[i] = it->second.time_sec;
+                        calls[i] = double(it->second.calls);
+                        bytes[i] = double(it->second.bytes);
+                    }
+                }
+                std::vector<double> min, mean, max, tmp1, tmp2, mean_calls, mean_bytes;
+                min_mean_max_over_tasks(time_sec, min, mean, max);
+                min_mean_max_over_tasks(calls, tmp1, mean_calls, tmp2);
+                min_mean_max_over_tasks(bytes, tmp1, mean_bytes, tmp2);
+
+                if (ThisTask == 0) {
+                    std::cout << "\n";
+                    std::cout << std::string(95, '=') << "\n";
+                    std::cout << "Profiler summary over " << NTasks << " tasks (time in sec)\n";
+                    std::cout << std::string(95, '=') << "\n";
+                    std::cout << std::left << std::setw(40) << "Region" << std::right << std::setw(10) << "Calls"
+                              << std::setw(11) << "Min" << std::setw(11) << "Mean" << std::setw(11) << "Max"
+                              << std::setw(11) << "Imbalance" << std::setw(11) << "MB moved"
+                              << "\n";
+                    for (size_t i = 0; i < n; i++) {
+                        const auto & path = labels[i];
+                        const int depth = int(std::count(path.begin(), path.end(), '/'));
+                        auto pos = path.rfind('/');
+                        std::string name = std::string(2 * depth, ' ');
+                        name += pos == std::string::npos ? path : path.substr(pos + 1);
+                        const double imbalance = mean[i] > 0.0 ? max[i] / mean[i] - 1.0 : 0.0;
+                        std::cout << std::left << std::setw(40) << name << std::right << std::setw(10)
+                                  << (long long int)(mean_calls[i] + 0.5) << std::setprecision(4) << std::setw(11)
+                                  << min[i] << std::setw(11) << mean[i] << std::setw(11) << max[i] << std::setw(10)
+                                  << 100.0 * imbalance << "%" << std::setw(11) << mean_bytes[i] * NTasks / 1e6
+                                  << std::setprecision(6) << "\n";
+                    }
+                    std::cout << std::string(95, '=') << "\n";
+                    std::cout << "\n";
+                }
+#ifdef HARDWARE_COUNTERS
+                print_hardware_counters(labels, regions, time_sec);
+#endif
+            }
+
+            /// Print the hardware counters for all regions: instructions per cycle, last level cache misses and
+            /// the memory bandwidth estimated from them (mean and max over tasks). Collective call.
+            void print_hardware_counters(const std::vector<std::string> & labels,
+                                         const std::map<std::string, RegionData> & regions,
+                                         const std::vector<double> & time_sec) {
+                int ThisTask = 0;
+#ifdef USE_MPI
+                MPI_Comm_rank(MPI_COMM_WORLD, &ThisTask);
+#endif
+                int available = get_thread_data().hardware_counters.available() ? 1 : 0;
+#ifdef USE_MPI
+                MPI_Allreduce(MPI_IN_PLACE, &available, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+#endif
+                if (available == 0) {
+                    if (ThisTask == 0)
+                        std::cout << "\nHardware counters are not available on all tasks (not Linux or "
+                                  << "/proc/sys/kernel/perf_event_paranoid is too high)\n";
+                    return;
+                }
+
+                const size_t n = labels.size();
+                std::vector<double> cycles(n, 0.0), instructions(n, 0.0), misses(n, 0.0), bandwidth(n, 0.0);
+                for (size_t i = 0; i < n; i++) {
+                    auto it = regions.find(labels[i]);
+                    if (it != regions.end()) {
+                        cycles[i] = double(it->second.counters[HW_CYCLES]);
+                        instructions[i] = double(it->second.counters[HW_INSTRUCTIONS]);
+                        misses[i] = double(it->second.counters[HW_LLC_MISSES]);
+                        if (time_sec[i] > 0.0)
+                            bandwidth[i] = misses[i] * hardware_cache_line_bytes / time_sec[i];
+                    }
+                }
+                std::vector<double> tmp1, tmp2, mean_cycles, mean_instructions, mean_misses, mean_bw, max_bw;
+                min_mean_max_over_tasks(cycles, tmp1, mean_cycles, tmp2);
+                min_mean_max_over_tasks(instructions, tmp1, mean_instructions, tmp2);
+                min_mean_max_over_tasks(misses, tmp1, mean_misses, tmp2);
+                min_mean_max_over_tasks(bandwidth, tmp1, mean_bw, max_bw);
+
+                if (ThisTask > 0)
+                    return;
+                std::cout << "\n";
+                std::cout << std::string(95, '=') << "\n";
+                std::cout << "Hardware counters (mean per task, memory traffic estimated as LLC misses x "
+                          << hardware_cache_line_bytes << " bytes)\n";
+                std::cout << std::string(95, '=') << "\n";
+                std::cout << std::left << std::setw(40) << "Region" << std::right << std::setw(11) << "Gcycles"
+                          << std::setw(11) << "IPC" << std::setw(11) << "LLCmiss(M)" << std::setw(11) << "GB/s"
+                          << std::setw(11) << "Max GB/s"
+                          << "\n";
+                for (size_t i = 0; i < n; i++) {
+                    const auto & path = labels[i];
+                    const int depth = int(std::count(path.begin(), path.end(), '/'));
+                    auto pos = path.rfind('/');
+                    std::string name = std::string(2 * depth, ' ');
+                    name += pos == std::string::npos ? path : path.substr(pos + 1);
+                    const double ipc = mean_cycles[i] > 0.0 ? mean_instructions[i] / mean_cycles[i] : 0.0;
+                    std::cout << std::left << std::setw(40) << name << std::right << std::setprecision(4)
+                              << std::setw(11) << mean_cycles[i] / 1e9 << std::setw(11) << ipc << std::setw(11)
+                              << mean_misses[i] / 1e6 << std::setw(11) << mean_bw[i] / 1e9 << std::setw(11)
+                              << max_bw[i] / 1e9 << std::setprecision(6) << "\n";
+                }
+                std::cout << std::string(95, '=') << "\n";
+            }
+
+            /// Write all the events from all tasks and threads to filename as Chrome trace JSON. Collective call.
+            void write_chrome_trace(std::string filename) {
+                int ThisTask = 0;
+                int NTasks = 1;
+#ifdef USE_MPI
+                MPI_Comm_rank(MPI_COMM_WORLD, &ThisTask);
+                MPI_Comm_size(MPI_COMM_WORLD, &NTasks);
+#endif
+
+                // Make the events for this task
+                std::string json;
+                char buffer[64];
+                size_t events_dropped = 0;
+                json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + std::to_string(ThisTask) +
+                        ",\"args\":{\"name\":\"Task " + std::to_string(ThisTask) + "\"}},\n";
+                for (auto & data : thread_data) {
+                    events_dropped += data->events_dropped;
+                    for (auto & e : data->events) {
+                        std::snprintf(
+                            buffer, sizeof(buffer), "\"ts\":%.3f,\"dur\":%.3f", e.start_usec, e.duration_usec);
+                        json += "{\"name\":\"" + json_escape(e.name) + "\",\"cat\":\"FML\",\"ph\":\"X\"," + buffer +
+                                ",\"pid\":" + std::to_string(ThisTask) + ",\"tid\":" + std::to_string(data->thread_id) +
+                                "},\n";
+                    }
+                }
+                if (events_dropped > 0)
+                    std::cout << "Warning: [Profiler::write_chrome_trace] Task " << ThisTask << " dropped "
+                              << events_dropped << " events. Increase max_trace_events_per_thread\n";
+
+                // Gather on task 0
+                int nbytes = int(json.size());
+                std::vector<int> nbytes_tasks(NTasks, nbytes);
+                std::vector<int> offset(NTasks, 0);
+                std::string all_json = json;
+#ifdef USE_MPI
+                MPI_Gather(&nbytes, 1, MPI_INT, nbytes_tasks.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+                for (int i = 1; i < NTasks; i++)
+                    offset[i] = offset[i - 1] + nbytes_tasks[i - 1];
+                if (ThisTask == 0)
+                    all_json = std::string(offset[NTasks - 1] + nbytes_tasks[NTasks - 1], ' ');
+                MPI_Gatherv(json.data(),
+                            nbytes,
+                            MPI_CHAR,
+                            all_json.data(),
+                            nbytes_tasks.data(),
+                            offset.data(),
+                            MPI_CHAR,
+                            0,
+                            MPI_COMM_WORLD);
+#endif
+
+                if (ThisTask > 0)
+                    return;
+                // Remove the last ,\n
+                all_json.resize(all_json.size() - 2);
+                std::ofstream fp(filename.c_str());
+                if (not fp.is_open()) {
+                    std::cout << "Warning: [Profiler::write_chrome_trace] Failed to open " << filename << "\n";
+                    return;
+                }
+                fp << "{\"traceEvents\":[\n" << all_json << "\n],\"displayTimeUnit\":\"ms\"}\n";
+            }
+        };
+
+        //=======================================================
+        /// Open a profiler region that is closed when the object
+        /// goes out of scope
+        //=======================================================
+        class ProfileScope {
+          public:
+            ProfileScope(const char * name) { Profiler::get().enter(name); }
+            ~ProfileScope() { Profiler::get().exit(); }
+            ProfileScope(const ProfileScope &) = delete;
+            ProfileScope & operator=(const ProfileScope &) = delete;
+        };
+
+    } // namespace UTILS
+} // namespace FML
+#endif
@@ -1,11 +1,15 @@
 #ifndef TIMINGS_HEADER
 #define TIMINGS_HEADER
 
+#include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <mutex>
+#include <set>
+#include <string>
+#include <vector>
 
 #ifdef USE_MPI
 #include <mpi.h>
@@ -18,6 +22,68 @@ namespace FML {
 
         using TimePoint = std::chrono::time_point<std::chrono::steady_clock>;
 
+        //==========================================================================
+        /// The union of a set of labels over all tasks (sorted). The labels
+        /// can differ between tasks. Must be called by all tasks.
+        //==========================================================================
+        inline std::vector<std::string> union_of_labels_over_tasks(const std::vector<std::string> & labels) {
+            std::set<std::string> all_labels(labels.begin(), labels.end());
+#ifdef USE_MPI
+            // Pack the labels into one buffer separated by \n
+            std::string buffer;
+            for (auto & label : labels)
+                buffer += label + "\n";
+            int ntasks = 1;
+            MPI_Comm_size(MPI_COMM_WORLD, &ntasks);
+            int nbuffer = int(buffer.size());
+            std::vector<int> nbuffer_tasks(ntasks);
+            MPI_Allgather(&nbuffer, 1, MPI_INT, nbuffer_tasks.data(), 1, MPI_INT, MPI_COMM_WORLD);
+            std::vector<int> offset(ntasks, 0);
+            for (int i = 1; i < ntasks; i++)
+                offset[i] = offset[i - 1] + nbuffer_tasks[i - 1];
+            std::string all_buffer(offset[ntasks - 1] + nbuffer_tasks[ntasks - 1], ' ');
+            MPI_Allgatherv(buffer.data(),
+                           nbuffer,
+                           MPI_CHAR,
+                           all_buffer.data(),
+                           nbuffer_tasks.data(),
+                           offset.data(),
+                           MPI_CHAR,
+                           MPI_COMM_WORLD);
+
+            // Unpack
+            size_t start = 0;
+            for (size_t i = 0; i < all_buffer.size(); i++) {
+                if (all_buffer[i] == '\n') {
+                    all_labels.insert(all_buffer.substr(start, i - start));
+                    start = i + 1;
+                }
+            }
+#endif
+            return std::vector<std::string>(all_labels.begin(), all_labels.end());
+        }
+
+        //==========================================================================
+        /// Compute the min, mean and max over tasks of values (one per label).
+        /// Must be called by all tasks with the same number of values.
+        //==========================================================================
+        inline void min_mean_max_over_tasks(const std::vector<double> & values,
+                                            std::vector<double> & min,
+                                            std::vector<double> & mean,
+                                            std::vector<double> & max) {
+            min = mean = max = values;
+#ifdef USE_MPI
+            int ntasks = 1;
+            MPI_Comm_size(MPI_COMM_WORLD, &ntasks);
+            const int n = int(values.size());
+            MPI_Allreduce(MPI_IN_PLACE, min.data(), n, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+            MPI_Allreduce(MPI_IN_PLACE, mean.data(), n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+            MPI_Allreduce(MPI_IN_PLACE, max.data(), n, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+            for (auto & m : mean)
+                m /= double(ntasks);
+#endif
+        }
+
         /// Class for performing timings of the code using std::chrono
         class Timings {
           private:
@@ -57,6 +123,45 @@ namespace FML {
                 std::cout << "\n";
             }
 
+            /// Output the min, mean and max over all tasks of all the recorded timings together with the load
+            /// imbalance max/mean - 1. Labels that only exist on some tasks count as 0 on the others.
+            /// This is a collective call and must be called by all tasks.
+            void PrintAllTimingsAllTasks() {
+                int ThisTask = 0;
+#ifdef USE_MPI
+                MPI_Comm_rank(MPI_COMM_WORLD, &ThisTask);
+#endif
+                std::vector<std::string> labels;
+                for (const auto & t : elapsed_time_sec)
+                    labels.push_back(t.first);
+                labels = union_of_labels_over_tasks(labels);
+
+                std::vector<double> time_sec(labels.size(), 0.0);
+                for (size_t i = 0; i < labels.size(); i++) {
+                    auto it = elapsed_time_sec.find(labels[i]);
+                    if (it != elapsed_time_sec.end())
+                        time_sec[i] = it->second;
+                }
+                std::vector<double> min, mean, max;
+                min_mean_max_over_tasks(time_sec, min, mean, max);
+
+                if (ThisTask > 0)
+                    return;
+                std::cout << "\n";
+                std::cout << "==================================================================================\n";
+                std::cout << "All the recorded timings (min / mean / max over tasks in sec):\n";
+                std::cout << "==================================================================================\n";
+                for (size_t i = 0; i < labels.size(); i++) {
+                    const double imbalance = mean[i] > 0.0 ? max[i] / mean[i] - 1.0 : 0.0;
+                    std::cout << "[" << std::setw(35) << labels[i] << "]: " << std::setw(10) << min[i] << " "
+                              << std::setw(10) << mean[i] << " " << std::setw(10) << max[i]
+                              << "  Imbalance: " << std::setw(6) << std::setprecision(3) << 100.0 * imbalance
+                              << "%" << std::setprecision(6) << "\n";
+                }
+                std::cout << "==================================================================================\n";
+                std::cout << "\n";
+            }
+
             /// Start timing
             /// @param[in] name The label to give to the timing
             ///
@@ -1,7 +1,10 @@
+#include <FML/Global/Global.h>
+#include <FML/Timing/Profiler.h>
 #include <FML/Timing/Timings.h>
 #include <cmath>
 
 using Timer = FML::UTILS::Timings;
+using Profiler = FML::UTILS::Profiler;
 
 int main() {
     Timer timer;
@@ -30,7 +33,31 @@ int main() {
         exp(i);
     timer.EndTiming("Label 1");
 
+    //==============================================
+    // Hierarchical profiling of regions
+    // A scope records the time (and optionally bytes) of the region it lives in
+    // and nested scopes show up as children in the summary. The FML_PROFILE_*
+    // macros compile to nothing unless PROFILING is defined
+    //==============================================
+    {
+        FML::UTILS::ProfileScope outer("Outer region");
+        for (int k = 0; k < 4; k++) {
+            FML::UTILS::ProfileScope inner("Inner region");
+            double sum = 0.0;
+            for (int i = 0; i < 100000 * (FML::ThisTask + 1); i++)
+                sum += exp(-i * 1e-5);
+            Profiler::get().add_bytes(100000 * sizeof(double));
+        }
+    }
+
     // Print all the timings we have in the code
+    // The first only shows task 0, the second is collective and shows min/mean/max over tasks
     timer.EndTiming("Whole Program");
-    timer.PrintAllTimings();
+    if (FML::ThisTask == 0)
+        timer.PrintAllTimings();
+    timer.PrintAllTimingsAllTasks();
+
+    // Print the profiler tree and write a trace that can be opened in chrome://tracing or ui.perfetto.dev
+    Profiler::get().print_summary();
+    Profiler::get().write_chrome_trace("trace.json");
 }
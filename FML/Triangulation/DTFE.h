@@ -0,0 +1,490 @@
+#ifndef DTFE_HEADER
+#define DTFE_HEADER
+
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <FML/FFTWGrid/FFTWGrid.h>
+#include <FML/Global/Global.h>
+#include <FML/ParticleTypes/ReflectOnParticleMethods.h>
+#include <FML/Triangulation/PeriodicDelaunay.h>
+
+namespace FML {
+    namespace TRIANGULATION {
+
+        template <int N>
+        using FFTWGrid = FML::GRID::FFTWGrid<N>;
+
+        /// The vertex base for the CGAL tesselation needed for the DTFE method
+        typedef struct {
+            double volume{0.0};
+            double density{0.0};
+            double vel[CGAL_NDIM]{};
+            char point_type{GUARD_POINT};
+        } VertexDataDTFE;
+
+        //==========================================================================================
+        /// Invert a small NxN matrix using Gauss-Jordan elimination with partial pivoting.
+        /// Returns the determinant (and Ainv is not set if it is zero)
+        //==========================================================================================
+        template <int N>
+        double invert_small_matrix(std::array<std::array<double, N>, N> A,
+                                   std::array<std::array<double, N>, N> & Ainv) {
+            for (int i = 0; i < N; i++)
+                for (int j = 0; j < N; j++)
+                    Ainv[i][j] = (i == j) ? 1.0 : 0.0;
+
+            double det = 1.0;
+            for (int col = 0; col < N; col++) {
+                int pivot = col;
+                for (int row = col + 1; row < N; row++)
+                    if (std::fabs(A[row][col]) > std::fabs(A[pivot][col]))
+                        pivot = row;
+                if (A[pivot][col] == 0.0)
+                    return 0.0;
+                if (pivot != col) {
+                    std::swap(A[pivot], A[col]);
+                    std::swap(Ainv[pivot], Ainv[col]);
+                    det = -det;
+                }
+                const double diag = A[col][col];
+                det *= diag;
+                for (int j = 0; j < N; j++) {
+                    A[col][j] /= diag;
+                    Ainv[col][j] /= diag;
+                }
+                for (int row = 0; row < N; row++) {
+                    if (row == col)
+                        continue;
+                    const double fac = A[row][col];
+                    for (int j = 0; j < N; j++) {
+                        A[row][j] -= fac * A[col][j];
+                        Ainv[row][j] -= fac * Ainv[col][j];
+                    }
+                }
+            }
+            return det;
+        }
+
+        //==========================================================================================
+        /// Rasterize a set of simplices (tetrahedra in 3D, triangles in 2D) with fields that are linear
+        /// inside each simplex onto the local slab of a grid with Nmesh cells per dimension.
+        ///
+        /// The fields are evaluated at the grid nodes (nsamples_per_cell = 1) or averaged over nsamples_per_cell
+        /// random points inside each cell (the same points in every cell). Samples that lie on the boundary
+        /// of several simplices gets the mean of them. Only samples inside the local slab
+        /// [Local_x_start, Local_x_start + Local_nx) are computed so the simplices must cover this.
+        /// The loop over simplices is parallelized with OpenMP.
+        ///
+        /// @tparam N The dimension
+        /// @tparam NFIELD The number of fields
+        /// @tparam SimplexFunction A function bool(size_t i, pos, values) that fills the N+1 vertex positions
+        /// (std::array<std::array<double,N>,N+1>; periodic offsets applied, i.e. not wrapped into the box) and the
+        /// fields at the vertices (std::array<std::array<double,NFIELD>,N+1>) for simplex i. Return false to skip it.
+        ///
+        /// @param[in] nsimplices Number of simplices.
+        /// @param[in] get_simplex The function giving us simplex i.
+        /// @param[in] Nmesh Gridcells per dimension.
+        /// @param[in] Local_nx Number of local slices.
+        /// @param[in] Local_x_start The first local slice.
+        /// @param[in] nsamples_per_cell Number of samples per cell.
+        /// @param[in] ivector If >= 0 we also compute the divergence of the vector field given by the fields
+        /// ivector,...,ivector+N-1 (the gradient is constant inside a simplex). Stored as the last field.
+        /// @param[out] fields The fields for each local cell (index (ix * Nmesh + iy) * Nmesh + iz).
+        /// The last entry is the divergence.
+        /// @param[out] nsamples_found The number of samples found inside a simplex for each local cell.
+        ///
+        //==========================================================================================
+        template <int N, int NFIELD, class SimplexFunction>
+        void rasterize_linear_simplices_to_grid(size_t nsimplices,
+                                                SimplexFunction && get_simplex,
+                                                int Nmesh,
+                                                int Local_nx,
+                                                int Local_x_start,
+                                                int nsamples_per_cell,
+                                                int ivector,
+                                                std::vector<std::array<double, NFIELD + 1>> & fields,
+                                                std::vector<int> & nsamples_found) {
+
+            assert_mpi(nsamples_per_cell >= 1, "[rasterize_linear_simplices_to_grid] Need at least one sample\n");
+            assert_mpi(ivector < 0 or ivector + N <= NFIELD,
+                       "[rasterize_linear_simplices_to_grid] The vector field is out of range\n");
+
+            const size_t ncells_local = size_t(Local_nx) * FML::power(size_t(Nmesh), N - 1);
+            fields.assign(ncells_local, std::array<double, NFIELD + 1>{});
+            nsamples_found.assign(ncells_local, 0);
+
+#ifdef CELLCENTERSHIFTED
+            const double shift = 0.5;
+#else
+            const double shift = 0.0;
+#endif
+
+            // The sample points relative to the grid node (in units of the cell size)
+            std::vector<std::array<double, N>> offsets(nsamples_per_cell);
+            if (nsamples_per_cell > 1) {
+                std::mt19937 rng(1234);
+                std::uniform_real_distribution<double> uniform(-0.5, 0.5);
+                for (auto & offset : offsets)
+                    for (int idim = 0; idim < N; idim++)
+                        offset[idim] = uniform(rng);
+            } else {
+                offsets[0].fill(0.0);
+            }
+
+            // Loop over all simplices
+#ifdef USE_OMP
+#pragma omp parallel for schedule(dynamic, 256)
+#endif
+            for (size_t i = 0; i < nsimplices; i++) {
+                std::array<std::array<double, N>, N + 1> pos;
+                std::array<std::array<double, NFIELD>, N + 1> values;
+                if (not get_simplex(i, pos, values))
+                    continue;
+
+                // The edge matrix M[idim][j] = pos[j+1][idim] - pos[0][idim] and its inverse
+                // The barycentric coordinates are then lambda = Minv (x - pos[0])
+                std::array<std::array<double, N>, N> M;
+                std::array<std::array<double, N>, N> Minv;
+                for (int idim = 0; idim < N; idim++)
+                    for (int j = 0; j < N; j++)
+                        M[idim][j] = pos[j + 1][idim] - pos[0][idim];
+                const double det = invert_small_matrix<N>(M, Minv);
+                if (det == 0.0)
+                    continue;
+
+                // The divergence of the vector field (constant inside the simplex)
+                double divergence = 0.0;
+                if (ivector >= 0) {
+                    for (int idim = 0; idim < N; idim++)
+                        for (int j = 0; j < N; j++)
+                            divergence +=
+                                Minv[j][idim] * (values[j + 1][ivector + idim] - values[0][ivector + idim]);
+                }
+
+                // The bounding box of the simplex
+                std::array<double, N> lo = pos[0];
+                std::array<double, N> hi = pos[0];
+                for (int j = 1; j <= N; j++) {
+                    for (int idim = 0; idim < N; idim++) {
+                        lo[idim] = std::min(lo[idim], pos[j][idim]);
+                        hi[idim] = std::max(hi[idim], pos[j][idim]);
+                    }
+                }
+
+                // Relative tolerance for a point being inside the simplex
+                const double eps = 1e-10;
+
+                for (auto & offset : offsets) {
+                    // The range of grid nodes (shifted by the offset) inside the bounding box
+                    std::array<int, N> imin, imax;
+                    for (int idim = 0; idim < N; idim++) {
+                        imin[idim] = int(std::ceil(lo[idim] * Nmesh - shift - offset[idim]));
+                        imax[idim] = int(std::floor(hi[idim] * Nmesh - shift - offset[idim]));
+                    }
+
+                    for (int ix = imin[0]; ix <= imax[0]; ix++) {
+                        // Only do the samples in the local slab
+                        const int ix_local = ((ix % Nmesh) + Nmesh) % Nmesh - Local_x_start;
+                        if (ix_local < 0 or ix_local >= Local_nx)
+                            continue;
+
+                        std::array<int, N> icoord = imin;
+                        icoord[0] = ix;
+                        while (true) {
+                            // Barycentric coordinates of the sample
+                            std::array<double, N> dx;
+                            for (int idim = 0; idim < N; idim++)
+                                dx[idim] = (icoord[idim] + shift + offset[idim]) / double(Nmesh) - pos[0][idim];
+                            std::array<double, N + 1> lambda;
+                            lambda[0] = 1.0;
+                            bool inside = true;
+                            for (int j = 0; j < N; j++) {
+                                lambda[j + 1] = 0.0;
+                                for (int idim = 0; idim < N; idim++)
+                                    lambda[j + 1] += Minv[j][idim] * dx[idim];
+                                lambda[0] -= lambda[j + 1];
+                                inside = inside and lambda[j + 1] >= -eps;
+                            }
+                            inside = inside and lambda[0] >= -eps;
+
+                            if (inside) {
+                                size_t index = ix_local;
+                                for (int idim = 1; idim < N; idim++)
+                                    index = index * Nmesh + ((icoord[idim] % Nmesh) + Nmesh) % Nmesh;
+
+                                std::array<double, NFIELD + 1> f{};
+                                for (int j = 0; j <= N; j++)
+                                    for (int k = 0; k < NFIELD; k++)
+                                        f[k] += lambda[j] * values[j][k];
+                                f[NFIELD] = divergence;
+
+                                for (int k = 0; k <= NFIELD; k++) {
+#ifdef USE_OMP
+#pragma omp atomic
+#endif
+                                    fields[index][k] += f[k];
+                                }
+#ifdef USE_OMP
+#pragma omp atomic
+#endif
+                                nsamples_found[index]++;
+                            }
+
+                            // Next node in the transverse directions
+                            int idim = N - 1;
+                            while (idim >= 1 and ++icoord[idim] > imax[idim]) {
+                                icoord[idim] = imin[idim];
+                                idim--;
+                            }
+                            if (idim < 1)
+                                break;
+                        }
+                    }
+                }
+            }
+
+            // Normalize
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+            for (size_t i = 0; i < ncells_local; i++) {
+                if (nsamples_found[i] > 0)
+                    for (auto & f : fields[i])
+                        f /= double(nsamples_found[i]);
+            }
+        }
+
+        //==========================================================================================
+        /// Compute the density field (and optionally the velocity field and its divergence) on a grid
+        /// using the Delaunay Tessellation Field Estimator (DTFE).
+        ///
+        /// We make a Delaunay tesselation of the particles, estimate the density at each particle as
+        /// (NDIM+1) times the mass divided by the total volume of the cells sharing the particle and
+        /// interpolate the density and velocity linearly inside each cell. The cells are then rasterized
+        /// onto the grid (see rasterize_linear_simplices_to_grid). Each task only computes the grid cells
+        /// in its own slab and the values at the boundary particles are taken from the task that owns them.
+        /// The result is an adaptive resolution density field without the shot-noise and smoothing of CIC and
+        /// with a well defined velocity field also where there are few particles.
+        ///
+        /// The velocity field is volume weighted and the divergence is in units of [vel] / Boxsize.
+        ///
+        /// @tparam N The dimension (must be equal to CGAL_NDIM)
+        /// @tparam T The particle class. Must have a get_pos method and a get_vel method if we ask for
+        /// velocities. If it has a get_mass method this is used as the particle mass.
+        ///
+        /// @param[in] p Pointer to the particles
+        /// @param[in] NumPart Number of local particles
+        /// @param[out] density The overdensity field delta. Must be allocated with the Nmesh we want.
+        /// @param[out] velocity_divergence Optional: the divergence of the velocity field (nullptr if not needed).
+        /// Allocated in the method with the same Nmesh as the density grid.
+        /// @param[out] velocity Optional: the velocity field (nullptr if not needed). Allocated in the method.
+        /// @param[in] nsamples_per_cell Optional: 1 means evaluate at the grid nodes otherwise we average over this
+        /// many random points inside each cell.
+        /// @param[in] buffer_fraction Optional: the maximum buffer used when making the tesselation.
+        /// @param[in] random_fraction Optional: the fraction of random guard points used when making the tesselation.
+        ///
+        //==========================================================================================
+        template <int N, class T>
+        void DTFEParticlesToGrid(T * p,
+                                 size_t NumPart,
+                                 FFTWGrid<N> & density,
+                                 FFTWGrid<N> * velocity_divergence = nullptr,
+                                 std::array<FFTWGrid<N>, N> * velocity = nullptr,
+                                 int nsamples_per_cell = 1,
+                                 double buffer_fraction = 0.30,
+                                 double random_fraction = 0.3) {
+
+            static_assert(N == CGAL_NDIM, "[DTFEParticlesToGrid] The grid dimension must be equal to CGAL_NDIM");
+            constexpr bool has_vel = FML::PARTICLE::has_get_vel<T>();
+            constexpr bool has_mass = FML::PARTICLE::has_get_mass<T>();
+            const bool do_velocity = (velocity_divergence != nullptr or velocity != nullptr);
+            assert_mpi(not do_velocity or has_vel,
+                       "[DTFEParticlesToGrid] To get the velocity field the particle must have a get_vel method\n");
+
+            const int Nmesh = density.get_nmesh();
+            const int Local_nx = int(density.get_local_nx());
+            const int Local_x_start = int(density.get_local_x_start());
+            assert_mpi(Nmesh > 0, "[DTFEParticlesToGrid] The density grid must be allocated\n");
+
+            // Create tesselation
+            if (FML::ThisTask == 0)
+                std::cout << "[DTFEParticlesToGrid] Computing tesselation\n";
+            MPIPeriodicDelaunay<T, VertexDataDTFE> D;
+            D.create(p, NumPart, buffer_fraction, random_fraction);
+            auto & dt = D.get_delaunay_triangulation();
+            auto & vs = D.get_vertex_handles_regular();
+            auto & vs_boundary = D.get_vertex_handles_boundary();
+            for (auto & v : vs)
+                v->info().point_type = REGULAR_POINT;
+            for (auto & v : vs_boundary)
+                v->info().point_type = BOUNDARY_POINT;
+
+            // Gather up the cells in the tesselation so that we can loop over them in parallel
+            using PeriodicDelaunay = std::remove_reference_t<decltype(dt)>;
+#if CGAL_NDIM == 3
+            using Cell_handle = typename PeriodicDelaunay::Cell_handle;
+            std::vector<Cell_handle> cells;
+            for (auto cit = dt.cells_begin(); cit != dt.cells_end(); ++cit)
+                cells.push_back(cit);
+#elif CGAL_NDIM == 2
+            using Cell_handle = typename PeriodicDelaunay::Face_handle;
+            std::vector<Cell_handle> cells;
+            for (auto cit = dt.faces_begin(); cit != dt.faces_end(); ++cit)
+                cells.push_back(cit);
+#endif
+
+            // The vertex positions of a cell (with the periodic offsets applied)
+            auto get_cell_positions = [&](const Cell_handle & c, std::array<std::array<double, N>, N + 1> & pos) {
+                for (int j = 0; j <= N; j++) {
+                    auto point = dt.point(dt.periodic_point(c, j));
+                    for (int idim = 0; idim < N; idim++)
+                        pos[j][idim] = CGAL::to_double(point[idim]);
+                }
+            };
+
+            // Compute the volume of the star of each vertex (the contiguous Voronoi cell)
+            if (FML::ThisTask == 0)
+                std::cout << "[DTFEParticlesToGrid] Computing densities\n";
+            const double factorial_N = N == 2 ? 2.0 : 6.0;
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
+            for (size_t i = 0; i < cells.size(); i++) {
+                std::array<std::array<double, N>, N + 1> pos;
+                get_cell_positions(cells[i], pos);
+                std::array<std::array<double, N>, N> M;
+                std::array<std::array<double, N>, N> Minv;
+                for (int idim = 0; idim < N; idim++)
+                    for (int j = 0; j < N; j++)
+                        M[idim][j] = pos[j + 1][idim] - pos[0][idim];
+                const double volume = std::fabs(invert_small_matrix<N>(M, Minv)) / factorial_N;
+                for (int j = 0; j <= N; j++) {
+                    auto & info = cells[i]->vertex(j)->info();
+#ifdef USE_OMP
+#pragma omp atomic
+#endif
+                    info.volume += volume;
+                }
+            }
+
+            // The mean density (the volume of the box is 1)
+            double mass_total = double(NumPart);
+            if constexpr (has_mass) {
+                mass_total = 0.0;
+                for (size_t i = 0; i < NumPart; i++)
+                    mass_total += FML::PARTICLE::GetMass(p[i]);
+            }
+            FML::SumOverTasks(&mass_total);
+
+            // The density (in units of the mean density) and velocity of the regular particles.
+            // These are sent to the tasks that have them as boundary particles
+            std::vector<std::array<double, N + 1>> data_regular(NumPart);
+            for (size_t i = 0; i < NumPart; i++) {
+                double mass = 1.0;
+                if constexpr (has_mass)
+                    mass = FML::PARTICLE::GetMass(p[i]);
+                data_regular[i][0] = (N + 1) * mass / (vs[i]->info().volume * mass_total);
+                if constexpr (has_vel) {
+                    auto * vel = FML::PARTICLE::GetVel(p[i]);
+                    for (int idim = 0; idim < N; idim++)
+                        data_regular[i][idim + 1] = vel[idim];
+                } else {
+                    for (int idim = 0; idim < N; idim++)
+                        data_regular[i][idim + 1] = 0.0;
+                }
+            }
+            std::vector<std::array<double, N + 1>> data_boundary;
+            D.communicate_boundary_data(data_regular, data_boundary);
+
+            auto assign_to_vertex = [&](VertexDataDTFE & info, const std::array<double, N + 1> & data) {
+                info.density = data[0];
+                for (int idim = 0; idim < N; idim++)
+                    info.vel[idim] = data[idim + 1];
+            };
+            for (size_t i = 0; i < NumPart; i++)
+                assign_to_vertex(vs[i]->info(), data_regular[i]);
+            for (size_t i = 0; i < vs_boundary.size(); i++)
+                assign_to_vertex(vs_boundary[i]->info(), data_boundary[i]);
+            data_regular.clear();
+            data_regular.shrink_to_fit();
+            data_boundary.clear();
+            data_boundary.shrink_to_fit();
+
+            // Rasterize all the cells not connected to the guard points. We only interpolate
+            // the velocity if we need it
+            if (FML::ThisTask == 0)
+                std::cout << "[DTFEParticlesToGrid] Interpolating to grid with Nmesh = " << Nmesh << " using "
+                          << nsamples_per_cell << " samples per cell\n";
+            const int nfields = do_velocity ? N + 1 : 1;
+            auto get_simplex = [&](size_t i,
+                                   std::array<std::array<double, N>, N + 1> & pos,
+                                   std::array<std::array<double, N + 1>, N + 1> & values) {
+                const auto & c = cells[i];
+                for (int j = 0; j <= N; j++) {
+                    const auto & info = c->vertex(j)->info();
+                    if (info.point_type == GUARD_POINT)
+                        return false;
+                    values[j][0] = info.density;
+                    for (int k = 1; k < nfields; k++)
+                        values[j][k] = info.vel[k - 1];
+                    for (int k = nfields; k < N + 1; k++)
+                        values[j][k] = 0.0;
+                }
+                get_cell_positions(c, pos);
+                return true;
+            };
+            std::vector<std::array<double, N + 2>> fields;
+            std::vector<int> nsamples_found;
+            rasterize_linear_simplices_to_grid<N, N + 1>(cells.size(),
+                                                         get_simplex,
+                                                         Nmesh,
+                                                         Local_nx,
+                                                         Local_x_start,
+                                                         nsamples_per_cell,
+                                                         do_velocity ? 1 : -1,
+                                                         fields,
+                                                         nsamples_found);
+            cells.clear();
+            cells.shrink_to_fit();
+            D.free();
+
+            // Cells where we found no samples inside the tesselation (only if something is wrong with the buffer)
+            long long int nmissing = 0;
+            for (auto & n : nsamples_found)
+                nmissing += (n == 0);
+            FML::SumOverTasks(&nmissing);
+            if (FML::ThisTask == 0 and nmissing > 0)
+                std::cout << "[DTFEParticlesToGrid] Warning: " << nmissing
+                          << " grid cells are not covered by the tesselation. Increase the buffer\n";
+
+            // Copy over to the grids
+            if (velocity_divergence)
+                *velocity_divergence = FFTWGrid<N>(Nmesh);
+            if (velocity)
+                for (int idim = 0; idim < N; idim++)
+                    (*velocity)[idim] = FFTWGrid<N>(Nmesh);
+            density.set_grid_status_real(true);
+            std::array<int, N> coord;
+            for (size_t i = 0; i < fields.size(); i++) {
+                size_t index = i;
+                for (int idim = N - 1; idim >= 0; idim--) {
+                    coord[idim] = int(index % Nmesh);
+                    index /= Nmesh;
+                }
+                density.set_real(coord, fields[i][0] - (nsamples_found[i] > 0 ? 1.0 : 0.0));
+                if (velocity_divergence)
+                    velocity_divergence->set_real(coord, fields[i][N + 1]);
+                if (velocity)
+                    for (int idim = 0; idim < N; idim++)
+                        (*velocity)[idim].set_real(coord, fields[i][idim + 1]);
+            }
+        }
+
+    } // namespace TRIANGULATION
+} // namespace FML
+
+#endif
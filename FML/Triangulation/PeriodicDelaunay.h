@@ -2,6 +2,12 @@
 #define MPIPERIODICDEANAY_HEADER
 
 #include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
 #include <random>
 #include <vector>
 
@@ -21,14 +27,18 @@
 #pragma GCC diagnostic ignored "-Wconversion"
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Kernel/global_functions.h>
+#include <CGAL/property_map.h>
+#include <CGAL/spatial_sort.h>
 #if CGAL_NDIM == 3
 #include <CGAL/Delaunay_triangulation_cell_base_with_circumcenter_3.h>
 #include <CGAL/Periodic_3_Delaunay_triangulation_3.h>
 #include <CGAL/Periodic_3_Delaunay_triangulation_traits_3.h>
+#include <CGAL/Spatial_sort_traits_adapter_3.h>
 #include <CGAL/Triangulation_vertex_base_with_info_3.h>
 #elif CGAL_NDIM == 2
 #include <CGAL/Periodic_2_Delaunay_triangulation_2.h>
 #include <CGAL/Periodic_2_Delaunay_triangulation_traits_2.h>
+#include <CGAL/Spatial_sort_traits_adapter_2.h>
 #include <CGAL/Triangulation_vertex_base_with_info_2.h>
 #else
 "Error CGAL_NDIM has to be 2 or 3"
@@ -96,15 +106,24 @@ namespace FML {
         /// random particles (is faster!). In the end we have the tesselation
         /// with a vertex handle to each of the regular particles
         ///
+        /// The buffer is adaptive (can be turned off with set_adaptive_buffer):
+        /// we split the left and right boundary into patches in the transverse
+        /// directions and start with a thin buffer. After tesselating we check
+        /// that the circumsphere of every cell with a regular vertex lies inside
+        /// the region we have all the particles in (then the cell is a true Delaunay cell)
+        /// and request more particles from the neighbor tasks only in the patches where
+        /// this is not the case. These are inserted into the existing tesselation.
+        /// The buffer never grows beyond buffer_fraction of the neighbor domain.
+        ///
+        /// The points are inserted in a (biased randomized) Hilbert order with
+        /// the previous vertex as the hint for the point location.
+        ///
         /// Templated on a vertex class and when creating the user can
         /// supply a function that assigns data to the vertices
         ///
         /// Only availiable in 2D and 3D. Use define CGAL_NDIM to choose this
         /// at compiletime
         ///
-        /// Probably much faster to do a regular tesselation and deal with the boundaries
-        /// ourselves, but this is much easier!
-        ///
         //====================================================================
 
         template <class T, class VD = VD_FIDUCIAL>
@@ -115,30 +134,67 @@ namespace FML {
             using Periodic_point = typename PeriodicDelaunay::Periodic_point;
             using Vertex_handle = typename PeriodicDelaunay::Vertex_handle;
             using Vertex_iterator = typename PeriodicDelaunay::Vertex_iterator;
+#if CGAL_NDIM == 3
+            using Location_hint = typename PeriodicDelaunay::Cell_handle;
+            using Spatial_sort_traits =
+                CGAL::Spatial_sort_traits_adapter_3<K, typename CGAL::Pointer_property_map<Point>::type>;
+#elif CGAL_NDIM == 2
+            using Location_hint = typename PeriodicDelaunay::Face_handle;
+            using Spatial_sort_traits =
+                CGAL::Spatial_sort_traits_adapter_2<K, typename CGAL::Pointer_property_map<Point>::type>;
+#endif
 
-            // Random shuffle the particles before tesselating (always a good idea)
-            const bool tesselation_random_shuffle{true};
+            // Sort the particles spatially (after a random shuffle) before tesselating (always a good idea)
+            const bool tesselation_spatial_sort{true};
 
             // The CGAL tesselation structure
             PeriodicDelaunay dt;
 
-            // The size of the buffer
+            // The (maximum) size of the buffer
             double dx_buffer{0.0};
 
+            // Adaptive buffer. The initial depth in units of the mean particle separation,
+            // the minimum size of a patch in the same units and the maximum number of rounds we grow it
+            bool adaptive_buffer{true};
+            const double initial_buffer_in_mean_separations{3.0};
+            const double patch_size_in_mean_separations{4.0};
+            const int max_patches_per_dim{64};
+            const int max_buffer_rounds{10};
+
+            // The buffer depth we have in each patch on the left and right
+            int npatch_per_dim{1};
+            std::vector<double> depth_left{};
+            std::vector<double> depth_right{};
+
             // Info about the tesselation
             std::vector<Vertex_handle> vs{};
             std::vector<Vertex_handle> vs_boundary{};
 
             // Info about boundary particles
             // where they are from and their index
-            // on the local task
+            // on the local task. The first nboundary_left came from the left task
             std::vector<T> p_boundary{};
+            size_t nboundary_left{0};
+
+            // The index of the local particles we have sent to the left and right task (in the order sent)
+            std::vector<size_t> index_sent_left{};
+            std::vector<size_t> index_sent_right{};
 
           public:
             std::vector<T> & get_boundary_particles() { return p_boundary; }
 
+            /// The first get_number_of_boundary_particles_from_left() boundary particles came from the left task
+            size_t get_number_of_boundary_particles_from_left() { return nboundary_left; }
+
+            /// The local particles we sent to the left and right task (the order they have on the receiving task)
+            std::vector<size_t> & get_index_of_particles_sent_left() { return index_sent_left; }
+            std::vector<size_t> & get_index_of_particles_sent_right() { return index_sent_right; }
+
             double get_dx_buffer() { return dx_buffer; }
 
+            /// Grow the buffer only where needed (true) or use a uniform buffer (false)
+            void set_adaptive_buffer(bool adaptive) { adaptive_buffer = adaptive; }
+
             /// Return the CGAL triangulation we have created
             PeriodicDelaunay & get_delaunay_triangulation() { return dt; }
 
@@ -156,61 +212,77 @@ namespace FML {
                 vs_boundary.shrink_to_fit();
                 p_boundary.clear();
                 p_boundary.shrink_to_fit();
+                index_sent_left.clear();
+                index_sent_left.shrink_to_fit();
+                index_sent_right.clear();
+                index_sent_right.shrink_to_fit();
+                depth_left.clear();
+                depth_right.clear();
+                nboundary_left = 0;
+            }
+
+            // The index of the patch (in the directions transverse to x) a position belongs to
+            template <class PosType>
+            int get_patch_index(const PosType & pos) const {
+                int index = 0;
+                for (int idim = 1; idim < CGAL_NDIM; idim++) {
+                    double x = pos[idim] - std::floor(pos[idim]);
+                    int ix = std::min(int(x * npatch_per_dim), npatch_per_dim - 1);
+                    index = index * npatch_per_dim + ix;
+                }
+                return index;
             }
 
-            // Communicate the full particle data
-            void communicate_boundary_particles(T * p, size_t NumPart, std::vector<T> & p_to_recv) {
+            // Communicate the full particle data. Local particle i is sent to the left if send_left(i) is
+            // true and to the right if send_right(i) is true. The indices sent are appended to
+            // index_sent_left and index_sent_right
+            void communicate_boundary_particles([[maybe_unused]] T * p,
+                                                [[maybe_unused]] size_t NumPart,
+                                                [[maybe_unused]] std::function<bool(size_t)> send_left,
+                                                [[maybe_unused]] std::function<bool(size_t)> send_right,
+                                                [[maybe_unused]] std::vector<T> & p_recv_left,
+                                                [[maybe_unused]] std::vector<T> & p_recv_right) {
 #ifdef USE_MPI
                 if (FML::NTasks == 1)
                     return;
-                assert(NumPart > 0);
-
-                if (FML::ThisTask == 0)
-                    std::cout << "[MPIPeriodicDelaunay::communicate_boundary_particles]\n";
 
                 int LeftTask = (FML::ThisTask - 1 + FML::NTasks) % FML::NTasks;
                 int RightTask = (FML::ThisTask + 1) % FML::NTasks;
 
-                // Count how many particles we have on the left and right
-                size_t count_left = 0;
-                size_t count_right = 0;
+                // Find the particles to send
+                const size_t nsent_left_before = index_sent_left.size();
+                const size_t nsent_right_before = index_sent_right.size();
                 size_t bytes_to_send_left = 0;
                 size_t bytes_to_send_right = 0;
                 for (size_t i = 0; i < NumPart; i++) {
-                    auto * pos = FML::PARTICLE::GetPos(p[i]);
-                    if (pos[0] < FML::xmin_domain + dx_buffer) {
-                        count_left++;
+                    if (send_left(i)) {
+                        index_sent_left.push_back(i);
                         bytes_to_send_left += FML::PARTICLE::GetSize(p[i]);
                     }
-                    if (pos[0] > FML::xmax_domain - dx_buffer) {
-                        count_right++;
+                    if (send_right(i)) {
+                        index_sent_right.push_back(i);
                         bytes_to_send_right += FML::PARTICLE::GetSize(p[i]);
                     }
                 }
+                size_t count_left = index_sent_left.size() - nsent_left_before;
+                size_t count_right = index_sent_right.size() - nsent_right_before;
 #ifdef DEBUG_TESSELATION
                 std::cout << "Task " << FML::ThisTask << " will send " << count_left << " + " << count_right
                           << " boundary particles\n";
 #endif
 
-                // Gather positions to send
+                // Gather particles to send
                 std::vector<char> p_to_send_left(bytes_to_send_left);
                 std::vector<char> p_to_send_right(bytes_to_send_right);
                 char * left_buffer = p_to_send_left.data();
                 char * right_buffer = p_to_send_right.data();
-                count_left = 0;
-                count_right = 0;
-                for (size_t i = 0; i < NumPart; i++) {
-                    auto * pos = FML::PARTICLE::GetPos(p[i]);
-                    if (pos[0] < FML::xmin_domain + dx_buffer) {
-                        FML::PARTICLE::AppendToBuffer(p[i], left_buffer);
-                        left_buffer += FML::PARTICLE::GetSize(p[i]);
-                        count_left++;
-                    }
-                    if (pos[0] > FML::xmax_domain - dx_buffer) {
-                        FML::PARTICLE::AppendToBuffer(p[i], right_buffer);
-                        right_buffer += FML::PARTICLE::GetSize(p[i]);
-                        count_right++;
-                    }
+                for (size_t i = nsent_left_before; i < index_sent_left.size(); i++) {
+                    FML::PARTICLE::AppendToBuffer(p[index_sent_left[i]], left_buffer);
+                    left_buffer += FML::PARTICLE::GetSize(p[index_sent_left[i]]);
+                }
+                for (size_t i = nsent_right_before; i < index_sent_right.size(); i++) {
+                    FML::PARTICLE::AppendToBuffer(p[index_sent_right[i]], right_buffer);
+                    right_buffer += FML::PARTICLE::GetSize(p[index_sent_right[i]]);
                 }
 
                 // Communicate how many to send
@@ -273,7 +345,6 @@ namespace FML {
 #endif
 
                 // Allocate buffers and communicate
-                size_t nboundary = recv_left + recv_right;
                 std::vector<char> p_to_recv_left(bytes_to_recv_left);
                 std::vector<char> p_to_recv_right(bytes_to_recv_right);
                 MPI_Sendrecv(p_to_send_left.data(),
@@ -308,21 +379,94 @@ namespace FML {
                 p_to_send_right.shrink_to_fit();
 
                 // Assign particles
-                p_to_recv.resize(nboundary);
+                p_recv_left.resize(recv_left);
                 left_buffer = p_to_recv_left.data();
                 for (size_t i = 0; i < recv_left; i++) {
-                    FML::PARTICLE::AssignFromBuffer(p_to_recv[i], left_buffer);
-                    left_buffer += FML::PARTICLE::GetSize(p_to_recv[i]);
+                    FML::PARTICLE::AssignFromBuffer(p_recv_left[i], left_buffer);
+                    left_buffer += FML::PARTICLE::GetSize(p_recv_left[i]);
                 }
+                p_recv_right.resize(recv_right);
                 right_buffer = p_to_recv_right.data();
                 for (size_t i = 0; i < recv_right; i++) {
-                    FML::PARTICLE::AssignFromBuffer(p_to_recv[i + recv_left], right_buffer);
-                    right_buffer += FML::PARTICLE::GetSize(p_to_recv[i + recv_left]);
-                    ;
+                    FML::PARTICLE::AssignFromBuffer(p_recv_right[i], right_buffer);
+                    right_buffer += FML::PARTICLE::GetSize(p_recv_right[i]);
                 }
 #endif
             }
 
+            // Request the particles that are between the current and the new buffer depth in each patch
+            // from the neighbor tasks (and send them the particles they request from us)
+            void request_boundary_particles([[maybe_unused]] T * p,
+                                            [[maybe_unused]] size_t NumPart,
+                                            [[maybe_unused]] const std::vector<double> & new_depth_left,
+                                            [[maybe_unused]] const std::vector<double> & new_depth_right,
+                                            [[maybe_unused]] std::vector<T> & p_recv_left,
+                                            [[maybe_unused]] std::vector<T> & p_recv_right) {
+#ifdef USE_MPI
+                if (FML::NTasks == 1)
+                    return;
+
+                int LeftTask = (FML::ThisTask - 1 + FML::NTasks) % FML::NTasks;
+                int RightTask = (FML::ThisTask + 1) % FML::NTasks;
+
+                // Send [old, new) depths. The left task needs our particles close to our left edge and
+                // what it has on its right boundary is what we need to know to send them
+                const size_t npatch = depth_left.size();
+                std::vector<double> request_left(2 * npatch);
+                std::vector<double> request_right(2 * npatch);
+                std::vector<double> requested_by_left(2 * npatch);
+                std::vector<double> requested_by_right(2 * npatch);
+                for (size_t i = 0; i < npatch; i++) {
+                    request_left[2 * i] = depth_left[i];
+                    request_left[2 * i + 1] = new_depth_left[i];
+                    request_right[2 * i] = depth_right[i];
+                    request_right[2 * i + 1] = new_depth_right[i];
+                }
+                MPI_Status status;
+                MPI_Sendrecv(request_right.data(),
+                             int(2 * npatch),
+                             MPI_DOUBLE,
+                             RightTask,
+                             0,
+                             requested_by_left.data(),
+                             int(2 * npatch),
+                             MPI_DOUBLE,
+                             LeftTask,
+                             0,
+                             MPI_COMM_WORLD,
+                             &status);
+                MPI_Sendrecv(request_left.data(),
+                             int(2 * npatch),
+                             MPI_DOUBLE,
+                             LeftTask,
+                             0,
+                             requested_by_right.data(),
+                             int(2 * npatch),
+                             MPI_DOUBLE,
+                             RightTask,
+                             0,
+                             MPI_COMM_WORLD,
+                             &status);
+
+                auto send_left = [&](size_t i) {
+                    auto * pos = FML::PARTICLE::GetPos(p[i]);
+                    const int ipatch = get_patch_index(pos);
+                    const double dist = pos[0] - FML::xmin_domain;
+                    return dist >= requested_by_left[2 * ipatch] and dist < requested_by_left[2 * ipatch + 1];
+                };
+                auto send_right = [&](size_t i) {
+                    auto * pos = FML::PARTICLE::GetPos(p[i]);
+                    const int ipatch = get_patch_index(pos);
+                    const double dist = FML::xmax_domain - pos[0];
+                    return dist > requested_by_right[2 * ipatch] and dist <= requested_by_right[2 * ipatch + 1];
+                };
+                communicate_boundary_particles(p, NumPart, send_left, send_right, p_recv_left, p_recv_right);
+
+                depth_left = new_depth_left;
+                depth_right = new_depth_right;
+#endif
+            }
+
             // Generate random (guard) positions outside of local domain plus buffer to help speed up
             // the tesselation
             void make_random_points_outside_domain(size_t nrandom, std::vector<float> & positions_random) {
@@ -417,10 +561,19 @@ namespace FML {
 #endif
             }
 
+            // Make a CGAL point from a position
+            template <class PosType>
+            static Point make_point(const PosType & pos) {
+#if CGAL_NDIM == 2
+                return Point(pos[0], pos[1]);
+#elif CGAL_NDIM == 3
+                return Point(pos[0], pos[1], pos[2]);
+#endif
+            }
+
             // Combines the normal points with the boundary points and the randoms
             // to create a total std::vector<Point> & points and an id
-            // and then does a random shuffle of the points to make it more
-            // random (faster to tesselate that!)
+            // (id >= 0: index of regular particle, id < 0: -index-1 of boundary particle, LLONG_MIN: random)
             void create_total_point_set(T * p,
                                         size_t NumPart,
                                         T * pboundary,
@@ -428,67 +581,152 @@ namespace FML {
                                         std::vector<float> & positions_random,
                                         std::vector<Point> & points,
                                         std::vector<long long int> & id) {
-                size_t nrandom = positions_random.size() / CGAL_NDIM;
-                size_t npoints = NumPart + nboundary + nrandom;
-                points.reserve(npoints);
+                const size_t nrandom = positions_random.size() / CGAL_NDIM;
+                const size_t npoints = NumPart + nboundary + nrandom;
+                points.resize(npoints);
+                id.resize(npoints);
 
-                // Regular points: index in parts, other: negative
-                id.reserve(npoints);
-
-                // Add random points
-                for (size_t i = 0; i < nrandom; i++) {
-#if CGAL_NDIM == 2
-                    Point pt(positions_random[CGAL_NDIM * i + 0], positions_random[CGAL_NDIM * i + 1]);
-#elif CGAL_NDIM == 3
-                    Point pt(positions_random[CGAL_NDIM * i + 0],
-                             positions_random[CGAL_NDIM * i + 1],
-                             positions_random[CGAL_NDIM * i + 2]);
+#ifdef USE_OMP
+#pragma omp parallel for
 #endif
-                    points.push_back(pt);
-                    id.push_back(LLONG_MIN);
+                for (size_t i = 0; i < nrandom; i++) {
+                    points[i] = make_point(&positions_random[CGAL_NDIM * i]);
+                    id[i] = LLONG_MIN;
                 }
-
-                // Add boundary points
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
                 for (size_t i = 0; i < nboundary; i++) {
-                    auto * pos = FML::PARTICLE::GetPos(pboundary[i]);
-#if CGAL_NDIM == 2
-                    Point pt(pos[0], pos[1]);
-#elif CGAL_NDIM == 3
-                    Point pt(pos[0], pos[1], pos[2]);
+                    points[nrandom + i] = make_point(FML::PARTICLE::GetPos(pboundary[i]));
+                    id[nrandom + i] = -static_cast<long long int>(i) - 1;
+                }
+#ifdef USE_OMP
+#pragma omp parallel for
 #endif
-                    points.push_back(pt);
-                    id.push_back(-i - 1);
+                for (size_t i = 0; i < NumPart; i++) {
+                    points[nrandom + nboundary + i] = make_point(FML::PARTICLE::GetPos(p[i]));
+                    id[nrandom + nboundary + i] = i;
                 }
+            }
 
-                // Add regular points
-                for (size_t i = 0; i < NumPart; i++) {
-                    auto * pos = FML::PARTICLE::GetPos(p[i]);
-#if CGAL_NDIM == 2
-                    Point pt(pos[0], pos[1]);
-#elif CGAL_NDIM == 3
-                    Point pt(pos[0], pos[1], pos[2]);
+            // Insert points into the tesselation. We do a random shuffle followed by a spatial sort
+            // (biased randomized insertion order along a Hilbert curve) and use the last vertex as the
+            // starting point for locating the next point. The callback is called with the vertex
+            // for each point inserted
+            void insert_points(std::vector<Point> & points,
+                               std::function<void(size_t, Vertex_handle)> inserted,
+                               bool show_progress) {
+                const size_t npoints = points.size();
+                std::vector<std::ptrdiff_t> order(npoints);
+                std::iota(order.begin(), order.end(), 0);
+                if (tesselation_spatial_sort) {
+                    std::mt19937 rng(1);
+                    std::shuffle(order.begin(), order.end(), rng);
+                    CGAL::spatial_sort(
+                        order.begin(), order.end(), Spatial_sort_traits(CGAL::make_property_map(points)));
+                }
+
+                Location_hint hint = Location_hint();
+                for (size_t i = 0; i < npoints; i++) {
+                    if (show_progress and FML::ThisTask == 0 and ((i * 10) / npoints != ((i + 1) * 10) / npoints))
+                        std::cout << int(10.0 * (10 * (i + 1)) / npoints) << "% " << std::flush;
+                    Vertex_handle v = dt.insert(points[order[i]], hint);
+#if CGAL_NDIM == 3
+                    hint = v->cell();
+#elif CGAL_NDIM == 2
+                    hint = v->face();
 #endif
-                    points.push_back(pt);
-                    id.push_back(i);
+                    inserted(order[i], v);
                 }
-                assert(points.size() == npoints);
-                assert(id.size() == npoints);
+            }
 
-                // Random shuffle of positions (to speed up tesselation)
-                if (tesselation_random_shuffle) {
-                    std::random_device rd;
-                    unsigned int seed = rd();
+            // Go through all cells with at least one regular vertex and check that their circumsphere lies
+            // inside the region where we have all the particles. Returns the number of cells where this
+            // is not the case and the buffer depth needed in each patch to the left and right
+            size_t compute_required_buffer(std::vector<double> & need_left, std::vector<double> & need_right) {
+                need_left.assign(depth_left.size(), 0.0);
+                need_right.assign(depth_right.size(), 0.0);
 
-                    if (FML::ThisTask == 0)
-                        std::cout << "[MPIPeriodicDelaunay::create_total_point_set] Random shuffle of points\n";
+                // Add the requirement to all patches the sphere overlaps with in the transverse directions
+                auto add_to_patches = [&](std::vector<double> & need, const Point & center, double radius, double val) {
+                    std::array<int, CGAL_NDIM> imin, imax;
+                    for (int idim = 1; idim < CGAL_NDIM; idim++) {
+                        if (2.0 * radius >= 1.0) {
+                            imin[idim] = 0;
+                            imax[idim] = npatch_per_dim - 1;
+                        } else {
+                            imin[idim] = int(std::floor((center[idim] - radius) * npatch_per_dim));
+                            imax[idim] = int(std::floor((center[idim] + radius) * npatch_per_dim));
+                        }
+                    }
+                    std::array<int, CGAL_NDIM> ipatch = imin;
+                    while (true) {
+                        int index = 0;
+                        for (int idim = 1; idim < CGAL_NDIM; idim++)
+                            index = index * npatch_per_dim + ((ipatch[idim] % npatch_per_dim) + npatch_per_dim) %
+                                                                 npatch_per_dim;
+                        need[index] = std::max(need[index], val);
+                        int idim = CGAL_NDIM - 1;
+                        while (idim >= 1 and ++ipatch[idim] > imax[idim]) {
+                            ipatch[idim] = imin[idim];
+                            idim--;
+                        }
+                        if (idim < 1)
+                            break;
+                    }
+                };
 
-                    std::mt19937 rng(seed);
-                    std::shuffle(points.begin(), points.end(), rng);
+                size_t nbadcells = 0;
+#if CGAL_NDIM == 2
+                typename PeriodicDelaunay::Periodic_triangle_iterator tit;
+                for (tit = dt.periodic_triangles_begin(); tit != dt.periodic_triangles_end(); ++tit)
+#elif CGAL_NDIM == 3
+                typename PeriodicDelaunay::Periodic_tetrahedron_iterator tit;
+                for (tit = dt.periodic_tetrahedra_begin(); tit != dt.periodic_tetrahedra_end(); ++tit)
+#endif
+                {
+                    // Find a regular vertex (the ones inside the domain)
+                    int iregular = -1;
+                    for (int i = 0; i <= CGAL_NDIM; i++) {
+                        const double x = tit->at(i).first[0];
+                        if (x >= FML::xmin_domain and x < FML::xmax_domain) {
+                            iregular = i;
+                            break;
+                        }
+                    }
+                    if (iregular < 0)
+                        continue;
 
-                    // Do exactly the same shuffle as above to preserve the point-id ordering
-                    rng = std::mt19937(seed);
-                    std::shuffle(id.begin(), id.end(), rng);
+                    // The vertices with the periodic offsets applied
+                    std::array<Point, CGAL_NDIM + 1> pts;
+                    for (int i = 0; i <= CGAL_NDIM; i++)
+                        pts[i] = dt.point(tit->at(i));
+#if CGAL_NDIM == 2
+                    Point center = CGAL::circumcenter(pts[0], pts[1], pts[2]);
+#elif CGAL_NDIM == 3
+                    Point center = CGAL::circumcenter(pts[0], pts[1], pts[2], pts[3]);
+#endif
+                    const double radius = std::sqrt(CGAL::to_double(CGAL::squared_distance(center, pts[0])));
+
+                    // Shift to the frame where the regular vertex is inside the domain
+                    const double xshift = tit->at(iregular).first[0] - pts[iregular][0];
+                    const double xlow = center[0] + xshift - radius;
+                    const double xhigh = center[0] + xshift + radius;
+
+                    bool bad = false;
+                    if (xlow < FML::xmin_domain) {
+                        const double need = FML::xmin_domain - xlow;
+                        add_to_patches(need_left, center, radius, need);
+                        bad = bad or need > depth_left[get_patch_index(center)];
+                    }
+                    if (xhigh > FML::xmax_domain) {
+                        const double need = xhigh - FML::xmax_domain;
+                        add_to_patches(need_right, center, radius, need);
+                        bad = bad or need > depth_right[get_patch_index(center)];
+                    }
+                    nbadcells += bad;
                 }
+                return nbadcells;
             }
 
             /// Create the tesselation and check that it is good
@@ -496,7 +734,7 @@ namespace FML {
             /// @param[in] p Pointer to the particles
             /// @param[in] NumPart Number of local particles
             /// @param[in] buffer_fraction Optional: what fraction of the neighboring domain(s) we include when making
-            /// the tesselation.
+            /// the tesselation. With the adaptive buffer this is the maximum we allow it to grow to.
             /// @param[in] random_fraction Optional: what fraction of random particles we use (just to speed up the
             /// calculation)
             /// @param[in] assignment_function Optional: function to tell what data to store at the vertices
@@ -535,30 +773,56 @@ namespace FML {
                     std::cout << "#         \\/     \\/          \\/     \\/     \\/\\/    \n";
                     std::cout << "#\n";
                     std::cout << "# Creating periodic Delaunay tesselation on " << NumPart << " parts\n";
-                    std::cout << "# Buffer fraction: " << buffer_fraction << "\n";
+                    std::cout << "# Buffer fraction: " << buffer_fraction << (adaptive_buffer ? " (max)" : "") << "\n";
                     std::cout << "# Random fraction: " << random_fraction << "\n";
                     std::cout << "#\n";
                     std::cout << "#=====================================================\n";
                     std::cout << "\n";
                 }
 
-                // The buffersize we communicate particles from neighbor tasks
+                // The (maximum) buffersize we communicate particles from neighbor tasks
                 dx_buffer = buffer_fraction * (FML::xmax_domain - FML::xmin_domain);
 
+                // The patches and the initial buffer depth
+                long long int NumPartTotal = NumPart;
+                FML::SumOverTasks(&NumPartTotal);
+                const double mean_separation = std::pow(1.0 / double(NumPartTotal), 1.0 / CGAL_NDIM);
+                double initial_depth = dx_buffer;
+                npatch_per_dim = 1;
+                if (adaptive_buffer) {
+                    initial_depth = std::min(dx_buffer, initial_buffer_in_mean_separations * mean_separation);
+                    npatch_per_dim = int(1.0 / (patch_size_in_mean_separations * mean_separation));
+                    npatch_per_dim = std::max(1, std::min(npatch_per_dim, max_patches_per_dim));
+                }
+                const int npatch = FML::power(npatch_per_dim, CGAL_NDIM - 1);
+                depth_left.assign(npatch, 0.0);
+                depth_right.assign(npatch, 0.0);
+                index_sent_left.clear();
+                index_sent_right.clear();
+
                 // Create random particles
                 std::vector<float> positions_random;
                 const size_t nrandom = size_t(NumPart * random_fraction);
                 make_random_points_outside_domain(nrandom, positions_random);
 
-                // Boundary particles
-                communicate_boundary_particles(p, NumPart, p_boundary);
-                const size_t nboundary = p_boundary.size();
-
-                // Create total point set and do a random shuffle
+                // Boundary particles (the initial buffer)
+                std::vector<T> p_boundary_left;
+                std::vector<T> p_boundary_right;
+                request_boundary_particles(p,
+                                           NumPart,
+                                           std::vector<double>(npatch, initial_depth),
+                                           std::vector<double>(npatch, initial_depth),
+                                           p_boundary_left,
+                                           p_boundary_right);
+                p_boundary = p_boundary_left;
+                p_boundary.insert(p_boundary.end(), p_boundary_right.begin(), p_boundary_right.end());
+                [[maybe_unused]] const size_t nboundary = p_boundary.size();
+
+                // Create total point set
                 std::vector<Point> points;
                 std::vector<long long int> id;
                 create_total_point_set(p, NumPart, p_boundary.data(), p_boundary.size(), positions_random, points, id);
-                const size_t npoints = points.size();
+                size_t npoints = points.size();
 
                 // Free up memory
                 positions_random.clear();
@@ -571,45 +835,124 @@ namespace FML {
 
                 // Create tesselation and store a vertex handle to all the regular points
                 // and boundary points (but not random points as they are there just to speed up
-                // the calculation)
+                // the calculation). We assign data to the boundary vertices in the end as
+                // p_boundary might grow
                 if (FML::ThisTask == 0)
                     std::cout << "[MPIPeriodicDelaunay::create] Tesselating: 0% " << std::flush;
                 vs.resize(NumPart);
-                vs_boundary.resize(nboundary);
+                std::vector<Vertex_handle> vs_boundary_left(p_boundary_left.size());
+                std::vector<Vertex_handle> vs_boundary_right(p_boundary_right.size());
+                insert_points(
+                    points,
+                    [&](size_t i, Vertex_handle v) {
+                        if (id[i] >= 0) {
+                            vs[id[i]] = v;
+                            assignment_function(&(v->info()), &p[id[i]]);
+                        } else if (id[i] > LLONG_MIN) {
+                            // We store -ind-1 in id so -id-1 gives back ind
+                            const size_t ind = -id[i] - 1;
+                            if (ind < p_boundary_left.size())
+                                vs_boundary_left[ind] = v;
+                            else
+                                vs_boundary_right[ind - p_boundary_left.size()] = v;
+                        } else {
+                            assignment_function(&(v->info()), nullptr);
+                        }
+                    },
+                    true);
+                if (FML::ThisTask == 0)
+                    std::cout << std::endl;
 
-                for (size_t i = 0; i < npoints; i++) {
-                    if (FML::ThisTask == 0 and ((i * 10) / npoints != ((i + 1) * 10) / npoints))
-                        std::cout << int(10.0 * (10 * (i + 1)) / npoints) << "% " << std::flush;
-                    Vertex_handle v = dt.insert(points[i]);
-                    if (id[i] >= 0) {
-                        vs[id[i]] = v;
-                        assignment_function(&(v->info()), &p[id[i]]);
-                    } else if (id[i] > LLONG_MIN) {
-                        // We store -ind-1 in id so -id-1 gives back ind
-                        vs_boundary[-id[i] - 1] = v;
-                        assignment_function(&(v->info()), &p_boundary[-id[i] - 1]);
-                    } else {
-                        assignment_function(&(v->info()), nullptr);
+                // Free up memory
+                points.clear();
+                points.shrink_to_fit();
+                id.clear();
+                id.shrink_to_fit();
+
+                // Grow the buffer where the cells are not verified to be Delaunay cells
+                size_t nbadcells = 0;
+                std::vector<double> need_left;
+                std::vector<double> need_right;
+                for (int round = 0; round <= max_buffer_rounds and FML::NTasks > 1; round++) {
+                    nbadcells = compute_required_buffer(need_left, need_right);
+                    if (not adaptive_buffer or round == max_buffer_rounds)
+                        break;
+
+                    // Grow with a small margin, but never beyond the maximum buffer
+                    long long int ngrow = 0;
+                    std::vector<double> new_depth_left = depth_left;
+                    std::vector<double> new_depth_right = depth_right;
+                    for (int i = 0; i < npatch; i++) {
+                        if (need_left[i] > depth_left[i] and depth_left[i] < dx_buffer) {
+                            new_depth_left[i] = std::min(dx_buffer, need_left[i] + mean_separation);
+                            ngrow++;
+                        }
+                        if (need_right[i] > depth_right[i] and depth_right[i] < dx_buffer) {
+                            new_depth_right[i] = std::min(dx_buffer, need_right[i] + mean_separation);
+                            ngrow++;
+                        }
                     }
+                    FML::SumOverTasks(&ngrow);
+                    if (ngrow == 0)
+                        break;
+
+                    std::vector<T> p_new_left;
+                    std::vector<T> p_new_right;
+                    request_boundary_particles(
+                        p, NumPart, new_depth_left, new_depth_right, p_new_left, p_new_right);
+                    if (FML::ThisTask == 0)
+                        std::cout << "[MPIPeriodicDelaunay::create] Growing the buffer in " << ngrow
+                                  << " patches (round " << round + 1 << ")\n";
+
+                    // Insert the new particles into the existing tesselation
+                    const size_t nleft_before = p_boundary_left.size();
+                    const size_t nright_before = p_boundary_right.size();
+                    p_boundary_left.insert(p_boundary_left.end(), p_new_left.begin(), p_new_left.end());
+                    p_boundary_right.insert(p_boundary_right.end(), p_new_right.begin(), p_new_right.end());
+                    vs_boundary_left.resize(p_boundary_left.size());
+                    vs_boundary_right.resize(p_boundary_right.size());
+                    std::vector<Point> new_points;
+                    new_points.reserve(p_new_left.size() + p_new_right.size());
+                    for (auto & part : p_new_left)
+                        new_points.push_back(make_point(FML::PARTICLE::GetPos(part)));
+                    for (auto & part : p_new_right)
+                        new_points.push_back(make_point(FML::PARTICLE::GetPos(part)));
+                    npoints += new_points.size();
+                    insert_points(
+                        new_points,
+                        [&](size_t i, Vertex_handle v) {
+                            if (i < p_new_left.size())
+                                vs_boundary_left[nleft_before + i] = v;
+                            else
+                                vs_boundary_right[nright_before + i - p_new_left.size()] = v;
+                        },
+                        false);
                 }
 
+                // Gather up the boundary particles: first all from the left and then all from the right
+                nboundary_left = p_boundary_left.size();
+                p_boundary = p_boundary_left;
+                p_boundary.insert(p_boundary.end(), p_boundary_right.begin(), p_boundary_right.end());
+                vs_boundary = vs_boundary_left;
+                vs_boundary.insert(vs_boundary.end(), vs_boundary_right.begin(), vs_boundary_right.end());
+                for (size_t i = 0; i < p_boundary.size(); i++)
+                    assignment_function(&(vs_boundary[i]->info()), &p_boundary[i]);
+
                 if (FML::ThisTask == 0)
-                    std::cout << " Waiting for other tasks to finish" << std::endl;
+                    std::cout << "[MPIPeriodicDelaunay::create] Waiting for other tasks to finish" << std::endl;
                 assert(dt.is_valid());
                 if (dt.number_of_vertices() != npoints)
                     std::cout << "[MPIPeriodicDelaunay::create] Warning task " << FML::ThisTask
                               << " has less nvertices: " << dt.number_of_vertices() << " than points " << npoints
                               << "\n";
-                int nbadcells = num_bad_cells();
                 if (nbadcells > 0)
                     std::cout << "[MPIPeriodicDelaunay::create] Warning task " << FML::ThisTask << " We have "
-                              << nbadcells << " tetrahedra that extends outside of buffer. Increase buffer\n";
+                              << nbadcells << " cells that extends outside of buffer. Increase buffer\n";
 
-                // Free up memory
-                points.clear();
-                points.shrink_to_fit();
-                id.clear();
-                id.shrink_to_fit();
+#ifdef DEBUG_TESSELATION
+                std::cout << "Task " << FML::ThisTask << " has " << nboundary << " -> " << p_boundary.size()
+                          << " boundary particles after growing the buffer\n";
+#endif
             }
 
             /// Computes the voronoi volumes for the regular points which we have stored vertex handles for
@@ -647,42 +990,70 @@ namespace FML {
                               << (totvol - 1) * 100 << " %\n";
             }
 
-            // Check that the tesselation is OK
-            int num_bad_cells() {
-                int nbadcells = 0;
+            /// Send data for the regular particles to the tasks that have them as boundary particles
+            /// and receive the data for our boundary particles
+            ///
+            /// @tparam Q The data type (must be trivially copyable)
+            ///
+            /// @param[in] data_regular One entry per regular particle (same order as used to create the tesselation)
+            /// @param[out] data_boundary One entry per boundary particle (same order as get_boundary_particles())
+            ///
+            template <class Q>
+            void communicate_boundary_data([[maybe_unused]] const std::vector<Q> & data_regular,
+                                           std::vector<Q> & data_boundary) {
+                data_boundary.resize(p_boundary.size());
+#ifdef USE_MPI
+                if (FML::NTasks == 1)
+                    return;
 
-#if CGAL_NDIM == 2
-                typename PeriodicDelaunay::Periodic_triangle_iterator tit;
-                for (tit = dt.periodic_triangles_begin(); tit != dt.periodic_triangles_end(); ++tit)
-#elif CGAL_NDIM == 3
-                typename PeriodicDelaunay::Periodic_tetrahedron_iterator tit;
-                for (tit = dt.periodic_tetrahedra_begin(); tit != dt.periodic_tetrahedra_end(); ++tit)
-#endif
-                {
-                    Point base = tit->at(0).first;
+                int LeftTask = (FML::ThisTask - 1 + FML::NTasks) % FML::NTasks;
+                int RightTask = (FML::ThisTask + 1) % FML::NTasks;
 
-                    // Only look at tetrahedra which has a base-point inside the domain
-                    if (base[0] < FML::xmin_domain or base[0] >= FML::xmax_domain)
-                        continue;
+                const size_t count_left = index_sent_left.size();
+                const size_t count_right = index_sent_right.size();
+                const size_t recv_left = nboundary_left;
+                const size_t recv_right = p_boundary.size() - nboundary_left;
+                std::vector<Q> data_to_send_left(count_left);
+                std::vector<Q> data_to_send_right(count_right);
+                for (size_t i = 0; i < count_left; i++)
+                    data_to_send_left[i] = data_regular[index_sent_left[i]];
+                for (size_t i = 0; i < count_right; i++)
+                    data_to_send_right[i] = data_regular[index_sent_right[i]];
 
-                    // Check if any of the the neighboring vertices are inside the buffer region
-                    bool outside = false;
-                    for (int idim = 1; idim <= CGAL_NDIM; idim++) {
-                        Point p1 = tit->at(idim).first;
-                        if (FML::ThisTask == 0) {
-                            if (p1[0] > FML::xmax_domain + dx_buffer and p1[0] < 1.0 - dx_buffer)
-                                outside = true;
-                        } else if (FML::ThisTask == FML::NTasks - 1) {
-                            if (p1[0] < FML::xmin_domain - dx_buffer and p1[0] > dx_buffer)
-                                outside = true;
-                        } else {
-                            if (p1[0] > FML::xmax_domain + dx_buffer or p1[0] < FML::xmin_domain - dx_buffer)
-                                outside = true;
-                        }
-                    }
-                    nbadcells += outside;
-                }
-                return nbadcells;
+                MPI_Status status;
+                MPI_Sendrecv(data_to_send_left.data(),
+                             sizeof(Q) * count_left,
+                             MPI_CHAR,
+                             LeftTask,
+                             0,
+                             data_boundary.data() + recv_left,
+                             sizeof(Q) * recv_right,
+                             MPI_CHAR,
+                             RightTask,
+                             0,
+                             MPI_COMM_WORLD,
+                             &status);
+                MPI_Sendrecv(data_to_send_right.data(),
+                             sizeof(Q) * count_right,
+                             MPI_CHAR,
+                             RightTask,
+                             0,
+                             data_boundary.data(),
+                             sizeof(Q) * recv_left,
+                             MPI_CHAR,
+                             LeftTask,
+                             0,
+                             MPI_COMM_WORLD,
+                             &status);
+#endif
+            }
+
+            // Check that the tesselation is OK: the number of cells with a regular vertex whose circumsphere
+            // extends outside the buffer
+            int num_bad_cells() {
+                std::vector<double> need_left;
+                std::vector<double> need_right;
+                return int(compute_required_buffer(need_left, need_right));
             }
         };
 
@@ -701,17 +1072,25 @@ namespace FML {
         typedef struct {
             void * part_ptr;
             QuantityType quantity{Infinity};
-            QuantityType min_quantity_nbor{Infinity};
+            long long int index{-1};
             IDType WatershedID{NoWatershedID};
             char point_type{GUARD_POINT};
         } VertexDataWatershed;
 
         //===============================================================================
-        /// In this method we perform a tesselation, then we assign [quantity] to vertices
-        /// and walk the tesselation assigning the particles to Watershed basins
-        /// Quantity is a vector of size NumPart. When quantity is the density or inverse
+        /// In this method we assign [quantity] to the vertices of a tesselation and find the
+        /// watershed zones. Every particle is linked to the neighbor with the lowest quantity
+        /// (steepest descent) and a zone is all the particles whose path ends in the same local minimum.
+        /// The paths are followed in parallel by pointer jumping and zones that continue across tasks
+        /// are resolved by exchanging the zone IDs of the boundary particles with the neighbor tasks
+        /// until nothing changes. Quantity is a vector of size NumPart. When quantity is the density or inverse
         /// density of the particle then we get a Void or Cluster finder
         ///
+        /// The zones can then be merged: for each pair of adjacent zones we compute the saddle, the lowest value of
+        /// max(quantity) over the Delaunay links between the two. All tasks gather the list of links and merge the
+        /// zones in order of increasing saddle with union-find (Kruskal) as long as the saddle is below
+        /// merge_threshold. A merged group gets the minimum of its deepest zone.
+        ///
         /// If the buffer is too small the results will not be perfect, we give warnings
         /// when this is the case (instead of just throwing) as some times this is fine.
         /// To be sure of the result its a good idea to try with a smaller number of CPUs
@@ -726,191 +1105,98 @@ namespace FML {
         /// @param[in] quantity Vector with the quantity to watershed on (e.g. the density of the particles).
         /// quantity[i] corresponds to the quantity for particle i.
         /// @param[out] watershed_groups The result of the watershed: a list of watershed groups.
+        /// @param[in] merge_threshold Optional. Merge zones linked by a saddle with quantity below this value. The
+        /// fiducial value is no merging.
         ///
         //===============================================================================
 
         template <class T, class U>
         void WatershedGeneral(MPIPeriodicDelaunay<T, VertexDataWatershed> & D,
-                              T * p,
+                              [[maybe_unused]] T * p,
                               size_t NumPart,
                               std::vector<double> & quantity,
-                              std::vector<U> & watershed_groups) {
+                              std::vector<U> & watershed_groups,
+                              double merge_threshold = -std::numeric_limits<double>::infinity()) {
 
             assert(quantity.size() == NumPart);
-            [[maybe_unused]] const double dx_buffer = D.get_dx_buffer();
 
             // Fetch tesselation
-            auto dt = D.get_delaunay_triangulation();
-            using Vertex_handle = typename decltype(dt)::Vertex_handle;
-
-            // For boundaries and communication
-            [[maybe_unused]] size_t count_left = 0;
-            [[maybe_unused]] size_t count_right = 0;
-            [[maybe_unused]] size_t recv_left = 0;
-            [[maybe_unused]] size_t recv_right = 0;
-            [[maybe_unused]] size_t nboundary = 0;
-
-            // Assign quantity to particles
-            // Here we fetch the vertex handles from the tesselation
-            auto vs = D.get_vertex_handles_regular();
+            auto & dt = D.get_delaunay_triangulation();
+            using Vertex_handle = typename std::remove_reference_t<decltype(dt)>::Vertex_handle;
+            auto & vs = D.get_vertex_handles_regular();
+            auto & vs_boundary = D.get_vertex_handles_boundary();
             assert(vs.size() == NumPart);
+            const size_t nboundary = vs_boundary.size();
+            const size_t nvertex = NumPart + nboundary;
+
+            // Assign quantity to the regular particles and fetch it for the boundary particles from the
+            // task that owns them. Vertices are labeled by i for regular particle i and NumPart + i for
+            // boundary particle i
+            std::vector<QuantityType> quantity_regular(NumPart);
+            for (size_t i = 0; i < NumPart; i++)
+                quantity_regular[i] = quantity[i];
+            std::vector<QuantityType> quantity_boundary;
+            D.communicate_boundary_data(quantity_regular, quantity_boundary);
             for (size_t i = 0; i < NumPart; i++) {
-                vs[i]->info().quantity = quantity[i];
+                vs[i]->info().quantity = quantity_regular[i];
                 vs[i]->info().point_type = REGULAR_POINT;
+                vs[i]->info().index = i;
             }
-
-            // Deal with the boundary
-#ifdef USE_MPI
-            int LeftTask = (FML::ThisTask - 1 + FML::NTasks) % FML::NTasks;
-            int RightTask = (FML::ThisTask + 1) % FML::NTasks;
-            if (FML::NTasks > 1) {
-
-                // Count how many particles we have on the left and right
-                // NB: this relies on we do exactly the same thing in MPIPeriodicDelaunay
-                // A more roboust way is to communicate index we want, gather, send etc.
-                count_left = 0;
-                count_right = 0;
-                for (size_t i = 0; i < NumPart; i++) {
-                    auto * pos = FML::PARTICLE::GetPos(p[i]);
-                    if (pos[0] < FML::xmin_domain + dx_buffer)
-                        count_left++;
-                    if (pos[0] > FML::xmax_domain - dx_buffer)
-                        count_right++;
-                }
-
-                // Comunicate how many to send
-                MPI_Status status;
-                MPI_Sendrecv(&count_left,
-                             sizeof(count_left),
-                             MPI_CHAR,
-                             LeftTask,
-                             0,
-                             &recv_right,
-                             sizeof(recv_right),
-                             MPI_CHAR,
-                             RightTask,
-                             0,
-                             MPI_COMM_WORLD,
-                             &status);
-                MPI_Sendrecv(&count_right,
-                             sizeof(count_right),
-                             MPI_CHAR,
-                             RightTask,
-                             0,
-                             &recv_left,
-                             sizeof(recv_left),
-                             MPI_CHAR,
-                             LeftTask,
-                             0,
-                             MPI_COMM_WORLD,
-                             &status);
-
-                // Gather quantity
-                std::vector<QuantityType> quantity_to_send_left(count_left);
-                std::vector<QuantityType> quantity_to_send_right(count_right);
-                std::vector<QuantityType> quantity_to_recv_left(recv_left);
-                std::vector<QuantityType> quantity_to_recv_right(recv_right);
-                count_left = 0;
-                count_right = 0;
-                for (size_t i = 0; i < NumPart; i++) {
-                    auto * pos = FML::PARTICLE::GetPos(p[i]);
-                    if (pos[0] < FML::xmin_domain + dx_buffer) {
-                        quantity_to_send_left[count_left] = quantity[i];
-                        count_left++;
-                    }
-                    if (pos[0] > FML::xmax_domain - dx_buffer) {
-                        quantity_to_send_right[count_right] = quantity[i];
-                        count_right++;
-                    }
-                }
-
-                // Send quantity
-                MPI_Sendrecv(quantity_to_send_left.data(),
-                             sizeof(QuantityType) * count_left,
-                             MPI_CHAR,
-                             LeftTask,
-                             0,
-                             quantity_to_recv_right.data(),
-                             sizeof(QuantityType) * recv_right,
-                             MPI_CHAR,
-                             RightTask,
-                             0,
-                             MPI_COMM_WORLD,
-                             &status);
-                MPI_Sendrecv(quantity_to_send_right.data(),
-                             sizeof(QuantityType) * count_right,
-                             MPI_CHAR,
-                             RightTask,
-                             0,
-                             quantity_to_recv_left.data(),
-                             sizeof(QuantityType) * recv_left,
-                             MPI_CHAR,
-                             LeftTask,
-                             0,
-                             MPI_COMM_WORLD,
-                             &status);
-
-                // Assign quantity to particles
-                // Here we fetch the vertex handles from the tesselation
-                auto vs_boundary = D.get_vertex_handles_boundary();
-                nboundary = recv_left + recv_right;
-                assert(vs_boundary.size() == nboundary);
-                for (size_t i = 0; i < recv_left; i++) {
-                    vs_boundary[i]->info().quantity = quantity_to_recv_left[i];
-                    vs_boundary[i]->info().point_type = BOUNDARY_POINT;
-                }
-                for (size_t i = 0; i < recv_right; i++) {
-                    vs_boundary[i + recv_left]->info().quantity = quantity_to_recv_right[i];
-                    vs_boundary[i + recv_left]->info().point_type = BOUNDARY_POINT;
-                }
-
-                // Assign minimum neighbor
-                for (size_t i = 0; i < nboundary; i++) {
-                    auto v = vs_boundary[i];
-                    std::vector<Vertex_handle> vertices;
-                    dt.adjacent_vertices(v, std::back_inserter(vertices));
-                    auto min_quantity = Infinity;
-                    for (auto & vnew : vertices) {
-                        if (vnew->info().point_type == GUARD_POINT)
-                            continue;
-                        if (vnew->info().quantity < min_quantity)
-                            min_quantity = vnew->info().quantity;
-                    }
-                    v->info().min_quantity_nbor = min_quantity;
-                    if (v->info().min_quantity_nbor == Infinity) {
-                        std::cout << "[WatershedGeneral] Warning boundary particle has no normal nbors " << v->point()
-                                  << " " << FML::ThisTask << "\n";
-                    }
-                }
+            for (size_t i = 0; i < nboundary; i++) {
+                vs_boundary[i]->info().quantity = quantity_boundary[i];
+                vs_boundary[i]->info().point_type = BOUNDARY_POINT;
+                vs_boundary[i]->info().index = NumPart + i;
             }
-#endif
+            auto get_quantity = [&](size_t index) {
+                return index < NumPart ? quantity_regular[index] : quantity_boundary[index - NumPart];
+            };
 
-            // Find quantity minima
-            std::vector<char> is_minimum(NumPart, 0);
+            // Gather the Delaunay links of the regular particles (excluding guard points). The neighbor queries
+            // in CGAL are not thread safe so we do this once and everything below in parallel
+            std::vector<size_t> nbor_start(NumPart + 1, 0);
+            std::vector<size_t> nbor_index;
+            nbor_index.reserve(16 * NumPart);
+            std::vector<Vertex_handle> vertices;
             for (size_t i = 0; i < NumPart; i++) {
-                std::vector<Vertex_handle> vertices;
+                vertices.clear();
                 dt.adjacent_vertices(vs[i], std::back_inserter(vertices));
-                auto quantity = vs[i]->info().quantity;
-                is_minimum[i] = 1;
                 for (auto & v : vertices) {
-                    if (v == vs[i])
+                    if (v == vs[i] or v->info().point_type == GUARD_POINT)
                         continue;
-                    if (v->info().quantity < quantity) {
-                        is_minimum[i] = 0;
-                        break;
-                    }
+                    nbor_index.push_back(size_t(v->info().index));
                 }
+                nbor_start[i + 1] = nbor_index.size();
             }
+            vertices.clear();
+            vertices.shrink_to_fit();
 
-            // Count number of minima
-            size_t nminima = 0;
+            // Steepest descent: link each regular particle to the neighbor with the lowest quantity
+            // (if lower than its own, otherwise it is a minimum). Boundary particles are linked to
+            // themselves as their links are known by the task that owns them
+            std::vector<size_t> parent(nvertex);
+#ifdef USE_OMP
+#pragma omp parallel for
+#endif
             for (size_t i = 0; i < NumPart; i++) {
-                if (is_minimum[i] == 1) {
-                    nminima++;
+                size_t lowest = i;
+                auto lowest_quantity = quantity_regular[i];
+                for (size_t k = nbor_start[i]; k < nbor_start[i + 1]; k++) {
+                    const auto q = get_quantity(nbor_index[k]);
+                    if (q < lowest_quantity) {
+                        lowest_quantity = q;
+                        lowest = nbor_index[k];
+                    }
                 }
+                parent[i] = lowest;
             }
+            for (size_t i = NumPart; i < nvertex; i++)
+                parent[i] = i;
 
-            // Ensure unique task id
+            // Count number of minima and ensure unique IDs across tasks
+            size_t nminima = 0;
+            for (size_t i = 0; i < NumPart; i++)
+                if (parent[i] == i)
+                    nminima++;
             std::vector<int> nminima_per_task(FML::NTasks, 0);
             nminima_per_task[FML::ThisTask] = nminima;
 #ifdef USE_MPI
@@ -928,180 +1214,77 @@ namespace FML {
 
             // Assign unique wathershed ID - this ID is unique across tasks
             // Gather vertex handles to all the minimas
-            decltype(vs) vminima(nminima);
+            std::vector<IDType> zone(nvertex, NoWatershedID);
+            std::vector<Vertex_handle> vminima(nminima);
             nminima = 0;
             for (size_t i = 0; i < NumPart; i++) {
-                if (is_minimum[i]) {
-                    auto v = vs[i];
-                    vminima[nminima] = v;
-                    v->info().WatershedID = id_start + nminima;
+                if (parent[i] == i) {
+                    vminima[nminima] = vs[i];
+                    zone[i] = id_start + nminima;
                     nminima++;
                 }
             }
-            is_minimum.clear();
-            is_minimum.shrink_to_fit();
 
-            // Find the smallest quantity in the nbors
-            for (size_t i = 0; i < NumPart; i++) {
-                auto v = vs[i];
-                std::vector<Vertex_handle> vertices;
-                dt.adjacent_vertices(v, std::back_inserter(vertices));
-                // auto quantity = v->info().quantity;
-                auto min_quantity = Infinity;
-                for (auto & vnew : vertices) {
-                    if (vnew->info().point_type == GUARD_POINT)
-                        continue;
-                    if (vnew->info().quantity < min_quantity)
-                        min_quantity = vnew->info().quantity;
-                }
-                assert(min_quantity < Infinity);
-                v->info().min_quantity_nbor = min_quantity;
-            }
-
-            // Recursive call to find the watershed basins we set all neighbors with higher values of quantity as
-            // part of the basin and then do a recursive call with each of these neighbors as the starting point
-            std::function<int(Vertex_handle, IDType)> recursive_through_vertices = [&](Vertex_handle v, IDType id) {
-                if (v->info().point_type == GUARD_POINT)
-                    return 0;
-
-                // Assign current vertex
-                int count = 0;
-                v->info().WatershedID = id;
-                if (v->info().point_type == REGULAR_POINT)
-                    count++;
-
-                // Loop over neighbors
-                std::vector<Vertex_handle> vertices;
-                dt.adjacent_vertices(v, std::back_inserter(vertices));
-                auto quantity = v->info().quantity;
-                for (auto & vnew : vertices) {
-                    if (vnew == v)
-                        continue;
-                    if (vnew->info().WatershedID == id)
-                        continue;
-                    if (vnew->info().point_type == GUARD_POINT)
-                        continue;
-                    if (quantity > vnew->info().min_quantity_nbor)
-                        continue;
-                    if (vnew->info().quantity > quantity) {
-                        if (vnew->info().point_type == REGULAR_POINT) {
-                            count++;
-                        }
-                        vnew->info().WatershedID = id;
-                        count += recursive_through_vertices(vnew, id);
-                    }
+            // Pointer jumping. In the end parent[i] is the end of the path from particle i within
+            // the local tesselation: a minimum or a boundary particle
+            std::vector<size_t> next(nvertex);
+            bool done = false;
+            while (not done) {
+                done = true;
+#ifdef USE_OMP
+#pragma omp parallel for reduction(&& : done)
+#endif
+                for (size_t i = 0; i < nvertex; i++) {
+                    next[i] = parent[parent[i]];
+                    done = done and next[i] == parent[i];
                 }
-                return count;
-            };
-
-            // We can now do this step with OpenMP if we want as no two basins should be able to overlap
-            size_t ntot = 0;
-            for (size_t i = 0; i < nminima; i++) {
-                auto v = vminima[i];
-                auto id = v->info().WatershedID;
-                ntot += recursive_through_vertices(v, id);
+                parent.swap(next);
             }
-#ifdef DEBUG_TESSELATION
-            std::cout << "We have " << nminima << " minima with " << ntot << " of " << NumPart
-                      << " particles tied up on task " << FML::ThisTask << "\n";
+            next.clear();
+            next.shrink_to_fit();
+#ifdef USE_OMP
+#pragma omp parallel for
 #endif
+            for (size_t i = 0; i < NumPart; i++)
+                zone[i] = zone[parent[i]];
 
-            // Now we need to merge across tasks
-            // We communicate boundary particles and their WatershedID to the left and right and do the merging
-            // If some of the particles have id > 0 then they will be merged
-            // We should really do this thing one by one (i,i+1) to ensure structures that span many tasks gets
-            // assigned correctly. This is rarely an issue unless we have extremely few particles and many tasks
-#ifdef USE_MPI
+            // Paths that leave the domain end at a boundary particle. Fetch the zone of the boundary particles from
+            // the task that owns them and repeat until nothing changes (zones spanning many tasks need more rounds)
             if (FML::NTasks > 1) {
-
-                std::vector<IDType> watershed_id_to_send_left(count_left);
-                std::vector<IDType> watershed_id_to_send_right(count_right);
-                std::vector<IDType> watershed_id_to_recv_left(recv_left);
-                std::vector<IDType> watershed_id_to_recv_right(recv_right);
-
-                // We merge back and forth until we are done
-                // or maximum 3 times
-                for (int s = 0; s < 3; s++) {
-                    auto vs = D.get_vertex_handles_regular();
-                    assert(vs.size() == NumPart);
-                    count_left = 0;
-                    count_right = 0;
+                const int max_rounds = FML::NTasks + 1;
+                for (int round = 0; round <= max_rounds; round++) {
+                    std::vector<IDType> zone_regular(zone.begin(), zone.begin() + NumPart);
+                    std::vector<IDType> zone_boundary;
+                    D.communicate_boundary_data(zone_regular, zone_boundary);
+                    for (size_t i = 0; i < nboundary; i++)
+                        zone[NumPart + i] = zone_boundary[i];
+
+                    long long int nchanged = 0;
+#ifdef USE_OMP
+#pragma omp parallel for reduction(+ : nchanged)
+#endif
                     for (size_t i = 0; i < NumPart; i++) {
-                        auto id = vs[i]->info().WatershedID;
-                        auto * pos = FML::PARTICLE::GetPos(p[i]);
-                        if (pos[0] < FML::xmin_domain + dx_buffer) {
-                            watershed_id_to_send_left[count_left] = id;
-                            count_left++;
-                        }
-                        if (pos[0] > FML::xmax_domain - dx_buffer) {
-                            watershed_id_to_send_right[count_right] = id;
-                            count_right++;
+                        if (parent[i] >= NumPart and zone[i] != zone[parent[i]]) {
+                            zone[i] = zone[parent[i]];
+                            nchanged++;
                         }
                     }
-                    assert(watershed_id_to_send_left.size() == count_left);
-                    assert(watershed_id_to_send_right.size() == count_right);
-
-                    MPI_Status status;
-                    MPI_Sendrecv(watershed_id_to_send_left.data(),
-                                 sizeof(IDType) * count_left,
-                                 MPI_CHAR,
-                                 LeftTask,
-                                 0,
-                                 watershed_id_to_recv_right.data(),
-                                 sizeof(IDType) * recv_right,
-                                 MPI_CHAR,
-                                 RightTask,
-                                 0,
-                                 MPI_COMM_WORLD,
-                                 &status);
-                    MPI_Sendrecv(watershed_id_to_send_right.data(),
-                                 sizeof(IDType) * count_right,
-                                 MPI_CHAR,
-                                 RightTask,
-                                 0,
-                                 watershed_id_to_recv_left.data(),
-                                 sizeof(IDType) * recv_left,
-                                 MPI_CHAR,
-                                 LeftTask,
-                                 0,
-                                 MPI_COMM_WORLD,
-                                 &status);
-
-                    // Update Watershed IDs
-                    auto vs_boundary = D.get_vertex_handles_boundary();
-                    for (size_t i = 0; i < recv_left; i++) {
-                        auto v = vs_boundary[i];
-                        auto id = watershed_id_to_recv_left[i];
-                        v->info().WatershedID = id;
-                    }
-                    for (size_t i = 0; i < recv_right; i++) {
-                        auto v = vs_boundary[i + recv_left];
-                        auto id = watershed_id_to_recv_right[i];
-                        v->info().WatershedID = id;
-                    }
-
-                    // Assign IDs to vertices recursively
-                    int ntot = 0;
-                    for (size_t i = 0; i < nboundary; i++) {
-                        auto v = vs_boundary[i];
-                        auto id = v->info().WatershedID;
-                        if (id == NoWatershedID)
-                            continue;
-                        ntot += recursive_through_vertices(v, id);
-                    }
 #ifdef DEBUG_TESSELATION
-                    std::cout << "In merging on " << FML::ThisTask << " we assigned " << ntot << "\n";
+                    std::cout << "In merging on " << FML::ThisTask << " we assigned " << nchanged << "\n";
 #endif
                     // If no more particles gets assigned we stop
-                    FML::SumOverTasks(&ntot);
-                    if (ntot == 0)
+                    FML::SumOverTasks(&nchanged);
+                    if (nchanged == 0)
                         break;
-                    if (s == 2 and FML::ThisTask == 0)
-                        std::cout << "[WatershedGeneral] Warning we merged 3 times and still not done, buffer should "
-                                     "be larger, cannot guarantee the results are perfect\n";
+                    if (round == max_rounds and FML::ThisTask == 0)
+                        std::cout << "[WatershedGeneral] Warning zones did not converge across tasks, cannot "
+                                     "guarantee the results are perfect\n";
                 }
             }
-#endif
+            for (size_t i = 0; i < NumPart; i++)
+                vs[i]->info().WatershedID = zone[i];
+            for (size_t i = 0; i < nboundary; i++)
+                vs_boundary[i]->info().WatershedID = zone[NumPart + i];
 
             // Count how many regular particles we have processed
             long long int assigned = 0;
@@ -1129,31 +1312,14 @@ namespace FML {
                 }
             }
 
-            // Compute how many particles there are per group and communicate this
-            std::vector<int> n_per_group(ntotal_minima, 0);
-            for (size_t i = 0; i < NumPart; i++) {
-                if (vs[i]->info().WatershedID != NoWatershedID) {
-                    n_per_group[vs[i]->info().WatershedID]++;
-                }
-            }
-#ifdef USE_MPI
-            MPI_Allreduce(MPI_IN_PLACE, n_per_group.data(), ntotal_minima, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-#endif
-
-            // Compute the minimum position and make sure all tasks have this
+            // Compute the minimum position and quantity and make sure all tasks have this
             std::vector<double> x_minima(ntotal_minima, 0.0);
             std::vector<double> y_minima(ntotal_minima, 0.0);
             std::vector<double> z_minima(ntotal_minima, 0.0);
+            std::vector<double> quantity_minima(ntotal_minima, 0.0);
             for (size_t i = 0; i < nminima; i++) {
                 auto v = vminima[i];
 
-                // Get points in dual polyhedra, i.e. voronoi cell
-                // std::vector< decltype(p) > pts;
-                // auto tetra = dt.dual(v, std::back_inserter(pts));
-                // std::cout << "Dual polyhedra: " << pts.size() << "\n";
-
-                // XXX Add compute circumcenter of core particle and 3 closest low density region
-
                 // Minimum density particle
                 auto pos = v->point();
                 x_minima[v->info().WatershedID] = pos[0];
@@ -1161,24 +1327,144 @@ namespace FML {
 #if CGAL_NDIM == 3
                 z_minima[v->info().WatershedID] = pos[2];
 #endif
+                quantity_minima[v->info().WatershedID] = v->info().quantity;
             }
 #ifdef USE_MPI
             MPI_Allreduce(MPI_IN_PLACE, x_minima.data(), ntotal_minima, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
             MPI_Allreduce(MPI_IN_PLACE, y_minima.data(), ntotal_minima, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
             MPI_Allreduce(MPI_IN_PLACE, z_minima.data(), ntotal_minima, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+            MPI_Allreduce(MPI_IN_PLACE, quantity_minima.data(), ntotal_minima, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 #endif
 
+            // The group each zone belongs to. Without merging every zone is a group
+            std::vector<IDType> group_of_zone(ntotal_minima);
+            std::iota(group_of_zone.begin(), group_of_zone.end(), 0);
+            if (merge_threshold > -std::numeric_limits<double>::infinity()) {
+
+                // Find the links between zones and the saddle (the lowest max(quantity) over the links)
+                struct ZoneLink {
+                    IDType zone1;
+                    IDType zone2;
+                    QuantityType saddle;
+                };
+                auto sort_and_reduce_links = [](std::vector<ZoneLink> & links) {
+                    std::sort(links.begin(), links.end(), [](const ZoneLink & a, const ZoneLink & b) {
+                        return a.zone1 < b.zone1 or (a.zone1 == b.zone1 and a.zone2 < b.zone2);
+                    });
+                    size_t n = 0;
+                    for (size_t i = 0; i < links.size(); i++) {
+                        if (n > 0 and links[n - 1].zone1 == links[i].zone1 and links[n - 1].zone2 == links[i].zone2)
+                            links[n - 1].saddle = std::min(links[n - 1].saddle, links[i].saddle);
+                        else
+                            links[n++] = links[i];
+                    }
+                    links.resize(n);
+                };
+
+                std::vector<ZoneLink> links;
+#ifdef USE_OMP
+#pragma omp parallel
+#endif
+                {
+                    std::vector<ZoneLink> links_thread;
+#ifdef USE_OMP
+#pragma omp for
+#endif
+                    for (size_t i = 0; i < NumPart; i++) {
+                        const auto zi = zone[i];
+                        if (zi == NoWatershedID)
+                            continue;
+                        for (size_t k = nbor_start[i]; k < nbor_start[i + 1]; k++) {
+                            const size_t j = nbor_index[k];
+                            const auto zj = zone[j];
+                            if (zj == NoWatershedID or zj == zi)
+                                continue;
+                            const auto saddle = std::max(quantity_regular[i], get_quantity(j));
+                            links_thread.push_back({std::min(zi, zj), std::max(zi, zj), saddle});
+                        }
+                    }
+                    sort_and_reduce_links(links_thread);
+#ifdef USE_OMP
+#pragma omp critical
+#endif
+                    links.insert(links.end(), links_thread.begin(), links_thread.end());
+                }
+                sort_and_reduce_links(links);
+
+                // Gather all the links on all tasks
+#ifdef USE_MPI
+                int bytes_links = int(sizeof(ZoneLink) * links.size());
+                std::vector<int> bytes_per_task = FML::GatherFromTasks(&bytes_links);
+                std::vector<int> offset_per_task(FML::NTasks, 0);
+                for (int i = 1; i < FML::NTasks; i++)
+                    offset_per_task[i] = offset_per_task[i - 1] + bytes_per_task[i - 1];
+                std::vector<ZoneLink> links_all((offset_per_task.back() + bytes_per_task.back()) / sizeof(ZoneLink));
+                MPI_Allgatherv(links.data(),
+                               bytes_links,
+                               MPI_BYTE,
+                               links_all.data(),
+                               bytes_per_task.data(),
+                               offset_per_task.data(),
+                               MPI_BYTE,
+                               MPI_COMM_WORLD);
+                links = std::move(links_all);
+                sort_and_reduce_links(links);
+#endif
+
+                // Kruskal: go through the links in order of increasing saddle and merge with union-find.
+                // The root of a group is always the zone with the lowest minimum. All tasks do the same
+                std::stable_sort(links.begin(), links.end(), [](const ZoneLink & a, const ZoneLink & b) {
+                    return a.saddle < b.saddle;
+                });
+                auto find_root = [&](IDType z) {
+                    while (group_of_zone[z] != z) {
+                        group_of_zone[z] = group_of_zone[group_of_zone[z]];
+                        z = group_of_zone[z];
+                    }
+                    return z;
+                };
+                size_t nmerged = 0;
+                for (auto & link : links) {
+                    if (link.saddle >= merge_threshold)
+                        break;
+                    auto root1 = find_root(link.zone1);
+                    auto root2 = find_root(link.zone2);
+                    if (root1 == root2)
+                        continue;
+                    if (quantity_minima[root2] < quantity_minima[root1] or
+                        (quantity_minima[root2] == quantity_minima[root1] and root2 < root1))
+                        std::swap(root1, root2);
+                    group_of_zone[root2] = root1;
+                    nmerged++;
+                }
+                for (size_t i = 0; i < ntotal_minima; i++)
+                    group_of_zone[i] = find_root(i);
+
+                if (FML::ThisTask == 0)
+                    std::cout << "[WatershedGeneral] Merged " << nmerged << " zones using " << links.size()
+                              << " zone links. We have " << ntotal_minima - nmerged << " groups\n";
+            }
+
+            // Number the groups by the zone they have as the root
+            std::vector<IDType> group_index(ntotal_minima, NoWatershedID);
+            size_t ngroups = 0;
+            for (size_t i = 0; i < ntotal_minima; i++)
+                if (group_of_zone[i] == IDType(i))
+                    group_index[i] = ngroups++;
+
             // Time to compile up the results. Make the result array
-            watershed_groups.resize(ntotal_minima);
+            watershed_groups.resize(ngroups);
 
             // Initialize groups on all tasks
             for (size_t i = 0; i < ntotal_minima; i++) {
+                if (group_index[i] == NoWatershedID)
+                    continue;
 #if CGAL_NDIM == 2
                 double pos[] = {x_minima[i], y_minima[i]};
 #elif CGAL_NDIM == 3
                 double pos[] = {x_minima[i], y_minima[i], z_minima[i]};
 #endif
-                watershed_groups[i].init(pos);
+                watershed_groups[group_index[i]].init(pos);
             }
 
             // Loop through all particles and assign data to groups
@@ -1186,7 +1472,8 @@ namespace FML {
                 auto v = vs[i];
                 auto id = v->info().WatershedID;
                 if (id != NoWatershedID) {
-                    watershed_groups[id].add_particle((T *)v->info().part_ptr, v->info().quantity);
+                    watershed_groups[group_index[group_of_zone[id]]].add_particle((T *)v->info().part_ptr,
+                                                                                   v->info().quantity);
                 }
             }
 
@@ -1195,14 +1482,14 @@ namespace FML {
             // objects in the class
 #ifdef USE_MPI
             for (int i = 1; i < FML::NTasks; i++) {
-                size_t bytes = sizeof(U) * ntotal_minima;
+                size_t bytes = sizeof(U) * ngroups;
                 if (FML::ThisTask == 0) {
-                    std::vector<U> watershed_groups_from_other_task(ntotal_minima);
+                    std::vector<U> watershed_groups_from_other_task(ngroups);
                     MPI_Status status;
                     MPI_Recv(watershed_groups_from_other_task.data(), bytes, MPI_BYTE, i, 0, MPI_COMM_WORLD, &status);
 
                     // Merge in the groups
-                    for (size_t j = 0; j < ntotal_minima; j++) {
+                    for (size_t j = 0; j < ngroups; j++) {
                         watershed_groups[j].merge(watershed_groups_from_other_task[j]);
                     }
                 } else if (FML::ThisTask == i) {
@@ -1214,7 +1501,7 @@ namespace FML {
 
             // Finalize the binning
             if (FML::ThisTask == 0) {
-                for (size_t i = 0; i < ntotal_minima; i++) {
+                for (size_t i = 0; i < ngroups; i++) {
                     watershed_groups[i].finalize();
                 }
             } else {
@@ -1222,61 +1509,6 @@ namespace FML {
                 watershed_groups.clear();
                 watershed_groups.shrink_to_fit();
             }
-
-            // XXX The stuff below should be in WatershedDensity or we should store quantity_min above!
-            // If we sort we need to keep the id
-            // Sort them by minimum density from large to small
-            // std::sort(watershed_groups.begin(), watershed_groups.end(), [](const auto i, const auto j){ return
-            // i.density_min > j.density_min; } );
-
-            /*
-            // NB: only task 0 has groups
-            // Second watershed merging. Compile up list of links between groups and send it all to task 0
-            std::vector< std::set<IDType> > set_of_group_links(ntotal_minima);
-            for(size_t i = 0; i < NumPart; i++){
-            auto v = vs[i];
-            auto id = v->info().WatershedID;
-            auto & curset = set_of_group_links[id];
-            std::vector<Vertex_handle> vertices;
-            dt.adjacent_vertices(v, std::back_inserter(vertices));
-            std::vector<IDType> links;
-            for(auto &vnew : vertices){
-            auto nborid = vnew->info().WatershedID;
-            if(nborid != id and nborid != NoWatershedID){
-            curset.insert(nborid); // Add to list
-            }
-            }
-            }
-
-            // We now have a list of sets containing all the links between groups. Compile this up
-            std::vector<int> num_links(ntotal_minima,0);
-            std::vector<std::vector<IDType>> links(ntotal_minima);
-            for(int i = 0; i < ntotal_minima; i++){
-            num_links[i] = set_of_group_links[i].size();
-            links[i].reserve(num_links[i]);
-            for(auto val : set_of_group_links[i]){
-            links[i].push_back(val);
-            }
-            std::cout << FML::ThisTask << " group " << i << " has " << num_links[i] << " neighbors\n";
-            set_of_group_links.clear();
-            set_of_group_links.shrink_to_fit();
-            }
-
-            // We now have all the links. We should really do a communication here
-            // to ensure we have all the same links. We typically have 10-50 links.
-            // Now we sort ntotal_minima group ids by density and merge them. We only
-            // keep the groups that are higher than the minimum density
-
-            for(int i = 0; i < ntotal_minima; i++){
-            for(auto nborid : links){
-            // Check if density is higher if so then merge
-            }
-            }
-
-             */
-
-            // Compile up struct with {id, quantity_min} for each group. Then sort by quantity_min
-            // Now loop over this struct. index tells us the location in watershed_groups
         }
 
         //==========================================================================================
@@ -1297,6 +1529,8 @@ namespace FML {
         /// @param[in] random_fraction Optional. How many (as fraction of the normal particles) random particles do we
         /// add (this is to help speed up the tesslation).
         /// @param[in] do_density_maximum Optional. Watershed based on the density (false) or 1/density (true).
+        /// @param[in] merge_threshold Optional. Merge zones that are linked by a saddle with a density below (voids)
+        /// or above (clusters) this value in units of the mean density. 0 means no merging.
         ///
         //==========================================================================================
 
@@ -1306,7 +1540,8 @@ namespace FML {
                               std::vector<U> & watershed_groups,
                               double buffer_fraction = 0.30,
                               double random_fraction = 0.5,
-                              bool do_density_maximum = false) {
+                              bool do_density_maximum = false,
+                              double merge_threshold = 0.0) {
 
             static_assert(FML::PARTICLE::has_set_volume<T>(),
                           "[WatershedDensity] We require the particle to have a set_volume / get_volume method");
@@ -1360,8 +1595,19 @@ namespace FML {
                     density[i] = mass / volumes[i];
             }
 
+            // The merge threshold in terms of the quantity (the volume of the box is 1)
+            double merge_threshold_quantity = -std::numeric_limits<double>::infinity();
+            if (merge_threshold > 0.0) {
+                double mass_total = 0.0;
+                for (size_t i = 0; i < NumPart; i++)
+                    mass_total += FML::PARTICLE::GetMass(p[i]);
+                FML::SumOverTasks(&mass_total);
+                merge_threshold_quantity =
+                    do_density_maximum ? 1.0 / (merge_threshold * mass_total) : merge_threshold * mass_total;
+            }
+
             // Run general algorithm
-            WatershedGeneral<T, U>(D, p, NumPart, density, watershed_groups);
+            WatershedGeneral<T, U>(D, p, NumPart, density, watershed_groups, merge_threshold_quantity);
         }
 
     } // namespace TRIANGULATION
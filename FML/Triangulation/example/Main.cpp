@@ -49,17 +49,25 @@ int main() {
     // This only works in 3D currently, the missing piece is to compute voronoi volumes (i.e. area)
     // from the tesselation in 2D
     //
-    // This is basically the ZOBOV void finder without the additional watershed merging of zones
-    // (and we use the Delaunay tesselation instead of the Voronoi tesselation to propagate
-    // the particles to their density minima)
+    // This is basically the ZOBOV void finder (but we use the Delaunay tesselation instead of the Voronoi
+    // tesselation to propagate the particles to their density minima). Zones that are linked by a saddle
+    // with density below merge_threshold (in units of the mean density) are merged into one void
+    // (set it to 0 to get the zones)
     //=======================================================================================
 
     const double random_fraction = 0.33;
     const double buffer_fraction = 0.33;
+    const double merge_threshold = 0.2;
+    const bool do_density_maximum = false;
     using WatershedBasin = FML::TRIANGULATION::WatershedBasin<Particle, NDIM>;
     std::vector<WatershedBasin> watershed_groups;
-    FML::TRIANGULATION::WatershedDensity(
-        part.get_particles_ptr(), part.get_npart(), watershed_groups, buffer_fraction, random_fraction);
+    FML::TRIANGULATION::WatershedDensity(part.get_particles_ptr(),
+                                         part.get_npart(),
+                                         watershed_groups,
+                                         buffer_fraction,
+                                         random_fraction,
+                                         do_density_maximum,
+                                         merge_threshold);
 
     // Output the resulting (what is here basically a zobov void) catalogue
     if (FML::ThisTask == 0) {